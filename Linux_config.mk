@@ -34,7 +34,11 @@
 #
 ICONV_LDFLAGS		 =
 GPSEE_C_DEFINES		+= HAVE_MEMRCHR
+GPSEE_C_DEFINES		+= HAVE_MEMMEM
 GPSEE_C_DEFINES		+= HAVE_IDENTITY_TRANSCODING_ICONV
+GPSEE_C_DEFINES		+= HAVE_SCHED_SETAFFINITY
+GPSEE_C_DEFINES		+= HAVE_PTHREAD_GETCPUCLOCKID
+THREAD_LDFLAGS		?= -lrt
 LEADING_CPPFLAGS	+= -D_GNU_SOURCE
 GFFI_CPPFLAGS		?= -D_GNU_SOURCE -DDB_DBM_HSEARCH=1
 
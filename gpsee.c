@@ -817,11 +817,23 @@ gpsee_runtime_t *gpsee_createRuntime(void)
   if (!(cx = JS_NewContext(rt, atoi(cfg_default_value(cfg, "gpsee_stack_chunk_size", "8192")))))
     panic(GPSEE_GLOBAL_NAMESPACE_NAME ": unable to create JavaScript context!");
 
+  /* Contention statistics must be chosen before the first monitor is created */
+  grt->monitorStats = (cfg_bool_value(cfg, "gpsee_monitor_stats") == cfg_true || getenv("GPSEE_MONITOR_STATS")) ? 1 : 0;
+
   if (gpsee_initializeMonitorSystem(cx, grt) == JS_FALSE)
     panic(__FILE__ ": Unable to intialize monitor subsystem");
 
+#ifdef JS_THREADSAFE
+  /* Created up front rather than on demand so that they are named in contention reports */
+  grt->monitors.realms  = gpsee_createMonitor(grt, "realms");
+  grt->monitors.user_io = gpsee_createMonitor(grt, "user_io");
+  grt->monitors.cx      = gpsee_createMonitor(grt, "cx");
+#endif
+
   grt->rt               = rt;
   grt->coreCx           = cx;
+  grt->stackChunkSize   = atoi(cfg_default_value(cfg, "gpsee_stack_chunk_size", "8192"));
+  grt->contextCacheSize = strtoul(cfg_default_value(cfg, "gpsee_context_cache_size", "8"), NULL, 0);
   grt->realms           = gpsee_ds_create(grt, 0, 1);
   grt->realmsByContext  = gpsee_ds_create(grt, 0, 1);
   grt->gcCallbackList   = gpsee_ds_create(grt, GPSEE_DS_OTM_KEYS, 1);
@@ -61,6 +61,7 @@ typedef struct gpsee_realm 	gpsee_realm_t;		/**< @ingroup realms */
 typedef struct dataStore *      gpsee_dataStore_t;      /**< Handle describing a GPSEE data store */
 typedef struct moduleHandle     moduleHandle_t; 	/**< Handle describing a loaded module */
 typedef struct moduleMemo       moduleMemo_t; 		/**< Handle to module system's realm-wide memo */
+typedef struct gpsee_requireProfile gpsee_requireProfile_t;	/**< Handle to a realm's require() profile */
 typedef struct modulePathEntry *modulePathEntry_t; 	/**< Pointer to a module path linked list element */
 typedef void *                  gpsee_monitor_t;        /**< Synchronization primitive */
 typedef void *                  gpsee_autoMonitor_t;    /**< Synchronization primitive */
@@ -69,6 +70,7 @@ typedef struct GPSEEAsyncCallback GPSEEAsyncCallback;   /**< @ingroup async */
 #include "gpsee_config.h" /* MUST BE INCLUDED FIRST */
 #include <prthread.h>
 #include <prlock.h>
+#include <prcvar.h>
 
 #if defined(GPSEE_SURELYNX_STREAM)
 # define GPSEE_MAX_LOG_MESSAGE_SIZE	ASL_MAX_LOG_MESSAGE_SIZE
@@ -243,23 +245,21 @@ typedef struct
   gpsee_dataStore_t	realmsByContext;	/**< Key-value index; key = context, value = realm */
   gpsee_dataStore_t     monitorList_unlocked;   /**< Key-value index; key = monitor, value = NULL. Must hold grt->monitors.monitor to use. */
   gpsee_dataStore_t     gcCallbackList;         /**< List of GC callback functions and their invocation realms */
-  size_t		stackChunkSize;		/**< For calls to JS_NewContext() */
+  size_t		stackChunkSize;		/**< For calls to JS_NewContext(); RC gpsee_stack_chunk_size */
+  size_t                contextCacheSize;       /**< Most contexts kept for reuse per realm; RC gpsee_context_cache_size */
   jsuint                threadStackLimit;       /**< Upper bound on C stack bounds per context */
   int 			exitCode;		/**< Exit Code from System.exit() etc */
   exitType_t		exitType;		/**< Why the script stopped running */
   errorReport_t		errorReport;		/**< What errors to report? 0=all unless RC file overrides */
   void			(*errorLogger)(JSContext *cx, const char *pfx, const char *msg); /**< Alternate logging function for error reporter */
 
-#if defined(JS_THREADSAFE)
-  PRThread	*requireLockThread;		/**< Matches NULL or PR_GetCurrentThread if we are allowed to require; change must be atomic */
-  size_t	requireLockDepth;
-#endif
 #ifndef GPSEE_NO_ASYNC_CALLBACKS
   GPSEEAsyncCallback    *asyncCallbacks;        /**< Pointer to linked list of OPCB entries */
   PRLock                *asyncCallbacks_lock;
   PRThread              *asyncCallbackTriggerThread;
 #endif
   unsigned int          useCompilerCache:1;     /**< Option: Do we use the compiler cache? */
+  unsigned int          monitorStats:1;         /**< Option: Do monitors record contention statistics? */
   const char            *pendingErrorMessage;   /**< This provides a way to provide an extra message for gpsee_reportErrorSourceCode() */
 
 #ifdef JS_THREADSAFE
@@ -286,15 +286,23 @@ typedef struct
     int    (*fgetc)       (FILE *, JSContext *);                              /**< Hookable I/O vtable entry for fgetc */
     int    (*puts)        (const char *, JSContext *);                        /**< Hookable I/O vtable entry for puts */
 
-    struct 
+    struct gpsee_ioHook
     { 
       gpsee_realm_t           *realm;                 /**< GPSEE Realm the I/O hooks belong to */
       jsval                   input;                  /**< JavaScript function to generate output */
       jsval                   output;                 /**< JavaScript function to collect input */
       JSContext               *hookCx;                /**< A JS Context which can be used by any thread holding the hookMonitor */
-      gpsee_autoMonitor_t     monitor;                /**< Monitor which must be held to use hookCx, or to call any vtable function */
+      gpsee_monitor_t         monitor;                /**< Monitor which must be held to use hookCx, or to read or change this hook; never held while JS runs */
+      int                     outMode;                /**< Output buffering policy: _IONBF, _IOLBF or _IOFBF, as for setvbuf() */
+      char                    *outBuf;                /**< Output not yet delivered to the output hook; malloc()ed */
+      size_t                  outLen;                 /**< Number of bytes in outBuf */
+      size_t                  outSize;                /**< Buffer size selected by the buffering policy; output is delivered when it fills */
+      size_t                  outAlloc;               /**< Number of bytes allocated for outBuf; may exceed outSize while output is deferred */
+      JSBool                  flushScheduled;         /**< An async callback will deliver outBuf (we could not call JS earlier) */
+      JSBool                  delivering;             /**< A thread is calling the output hook, and will deliver anything added to outBuf meanwhile */
     } *hooks;                                         /**< Javascript I/O hooks array; per-fd hooks; indexed by file descriptor  */
     size_t                    hooks_len;              /**< Number of entries in hooks array (maxfd+1) */
+    volatile jsword           hookedFds;              /**< Bitmap of file descriptors which have hooks; read without locking */
   } user_io;                                          /**< Hookable I/O vtable and JavaScript I/O hooks */
 } gpsee_runtime_t;
 
@@ -305,7 +313,11 @@ struct gpsee_realm
 {
   gpsee_runtime_t       *grt;                   /**< GPSEE Runtime which created this realm */
   JSObject		*globalObject;		/**< Global object ("super-global") */
-  JSContext             *cachedCx;              /**< A partially initialied context left over from realm creation, or NULL */
+  struct
+  {
+    JSContext           **list;                 /**< Contexts ready for reuse: no request, thread, global or exception */
+    size_t              count;                  /**< Number of contexts in list; at most grt->contextCacheSize */
+  } freeContexts;                               /**< Contexts released by gpsee_destroyContext(); guarded by grt->monitors.cx */
   moduleMemo_t 		*modules;		/**< List of loaded modules and their shutdown requirements etc */
   moduleHandle_t 	*unreachableModule_llist;/**< List of nearly-finalized modules waiting only for final free & dlclose */
   const char 		*moduleJail;		/**< Top-most UNIX directory allowed to contain modules, excluding libexec dir */
@@ -315,7 +327,7 @@ struct gpsee_realm
   JSObject		*userModulePath;	/**< Module path augumented by user, e.g. require.paths */
   JSObject		*requireDotMain;	/**< Pointer to the program module's "module free var" */
   gpsee_dataStore_t     moduleData;             /**< Scratch-pad for modules; keys are unique pointers */
-  gpsee_dataStore_t     user_io_pendingWrites;  /**< Pending data which will be written on the next async callback */
+  gpsee_requireProfile_t *requireProfile;       /**< require() profile, or NULL when not profiling */
 
   struct
   {
@@ -332,6 +344,13 @@ struct gpsee_realm
     gpsee_autoMonitor_t     programModuleDir;
     gpsee_autoMonitor_t     script_argv;
   } monitors;                                   /**< Monitors for monitored members */
+
+  struct
+  {
+    PRLock                      *lock;          /**< Guards modules, unreachableModule_llist, module load state and waiters */
+    PRCondVar                   *loaded;        /**< Broadcast whenever a module load finishes or fails */
+    struct moduleLoadWaiter     *waiters;       /**< Threads waiting for another thread to load a module */
+  } moduleLoad;                                 /**< Lets require() load different modules in different threads at once */
 #endif
 
 #ifdef GPSEE_DEBUG_BUILD
@@ -402,6 +421,8 @@ JS_EXTERN_API(const char *)	    gpsee_getModuleCName(moduleHandle_t *module);
 JS_EXTERN_API(JSBool)               gpsee_getModuleDataStore(JSContext *cx, gpsee_dataStore_t *dataStore_p);
 JS_EXTERN_API(JSBool)               gpsee_getModuleData(JSContext *cx, const void *key, void **data_p, const char *throwPrefix);
 JS_EXTERN_API(JSBool)               gpsee_setModuleData(JSContext *cx, const void *key, void *data);
+JS_EXTERN_API(JSBool)               gpsee_enableRequireProfiler(JSContext *cx, gpsee_realm_t *realm, const char *traceFilename);
+JS_EXTERN_API(void)                 gpsee_dumpRequireProfile(JSContext *cx, gpsee_realm_t *realm);
 /** @} */
 JS_EXTERN_API(JSBool)               gpsee_initGlobalObject(JSContext *cx, gpsee_realm_t *realm, JSObject *obj);
 JS_EXTERN_API(JSClass*)             gpsee_getGlobalClass(void) __attribute__((const));
@@ -412,6 +433,7 @@ gpsee_realm_t *      gpsee_createRealm(gpsee_runtime_t *grt, const char *name) _
 gpsee_realm_t *      gpsee_getRealm(JSContext *cx);
 JSBool               gpsee_destroyRealm(JSContext *cx, gpsee_realm_t *realm);
 JSContext *          gpsee_createContext(gpsee_realm_t *realm);
+JSContext *          gpsee_createContextWithStackChunkSize(gpsee_realm_t *realm, size_t stackChunkSize);
 void                 gpsee_destroyContext(JSContext *cx);
 /** @} */
 
@@ -447,14 +469,32 @@ JSBool 			gpsee_ds_hasData		(JSContext *cx, gpsee_dataStore_t store);
 /** @addtogroup monitors
  *  @{
  */
+#define GPSEE_MONITOR_HISTOGRAM_BUCKETS 24  /**< Wait histogram: bucket 0 is under 1us, bucket n under 2^n us, the last everything longer */
+
+/** Snapshot of one monitor's contention statistics; times are in microseconds. @see gpsee_getMonitorStats() */
+typedef struct
+{
+  const char            *name;                  /**< Name the monitor was created with */
+  PRUint32              entries;                /**< Outermost entries */
+  PRUint32              contended;              /**< Entries which found the monitor busy */
+  PRUint32              slept;                  /**< Contended entries which gave up spinning and slept */
+  PRUint64              waitTime;               /**< Total time spent waiting to enter */
+  PRUint32              maxWait;                /**< Longest wait to enter */
+  PRUint32              maxHold;                /**< Longest time the monitor was continuously held */
+  PRUint32              waitHistogram[GPSEE_MONITOR_HISTOGRAM_BUCKETS]; /**< Contended entries by wait time */
+} gpsee_monitorStats_t;
+
 void                    gpsee_enterAutoMonitorRT        (gpsee_runtime_t *grt, gpsee_autoMonitor_t *monitor_p);
 void                    gpsee_enterAutoMonitor          (JSContext *cx, gpsee_autoMonitor_t *monitor_p);
+void                    gpsee_enterAutoMonitorShared    (JSContext *cx, gpsee_autoMonitor_t *monitor_p);
 void                    gpsee_leaveAutoMonitor          (gpsee_autoMonitor_t monitor);
 gpsee_monitor_t         gpsee_getNilMonitor             (void) __attribute__((const));
-gpsee_monitor_t         gpsee_createMonitor             (gpsee_runtime_t *grt) __attribute__((malloc));
+gpsee_monitor_t         gpsee_createMonitor             (gpsee_runtime_t *grt, const char *name) __attribute__((malloc));
 void                    gpsee_enterMonitor              (gpsee_monitor_t monitor);
+void                    gpsee_enterMonitorShared        (gpsee_monitor_t monitor);
 void                    gpsee_leaveMonitor              (gpsee_monitor_t monitor);
 void                    gpsee_destroyMonitor            (gpsee_runtime_t *grt, gpsee_monitor_t monitor);
+JSBool                  gpsee_getMonitorStats           (gpsee_runtime_t *grt, gpsee_monitorStats_t **stats_p, size_t *count_p);
 
 /** @addtogroup debugger
  *  @{
@@ -489,12 +529,25 @@ JS_EXTERN_API(JSBool)               gpsee_createJSArray_fromVector(JSContext *cx
 JS_EXTERN_API(void)                 gpsee_resetIOHooks(JSContext *cx, gpsee_runtime_t *grt);
 JSBool gpsee_initIOHooks(JSContext *cx, gpsee_runtime_t *grt);
 void gpsee_uio_dumpPendingWrites(JSContext *cx, gpsee_realm_t *realm);
+void gpsee_uio_releaseRealm(JSContext *cx, gpsee_realm_t *realm);
+JSBool gpsee_hookFileDescriptor(JSContext *cx, int fd, jsval ihook, jsval ohook);
+JSBool gpsee_setIOHookBuffering(JSContext *cx, int fd, int mode, size_t size);
+void gpsee_flushIOHook(JSContext *cx, int fd);
 
 /* GPSEE JSAPI idiom extensions */
 JS_EXTERN_API(void*)                gpsee_getInstancePrivateNTN(JSContext *cx, JSObject *obj, ...); 
 #define                             gpsee_getInstancePrivate(cx, obj, ...) gpsee_getInstancePrivateNTN(cx, obj, __VA_ARGS__, NULL)
 JS_EXTERN_API(void)                 gpsee_byteThingTracer(JSTracer *trc, JSObject *obj); /**< @ingroup bytethings */
 JSObject *gpsee_newByteThing(JSContext *cx, void *buffer, size_t length, JSBool copy);
+JSObject *gpsee_newMappedByteThing(JSContext *cx, int fd, off_t offset, size_t length, JSBool writable, JSBool shared);
+JSBool gpsee_syncMappedByteThing(JSContext *cx, JSObject *obj, JSBool async);
+JSBool gpsee_adviseMappedByteThing(JSContext *cx, JSObject *obj, int advice);
+JSBool gpsee_unshareByteThing(JSContext *cx, JSObject *obj);
+typedef struct gpsee_byteStore gpsee_byteStore_t;	/**< @ingroup bytethings */
+gpsee_byteStore_t *gpsee_newByteStore(JSContext *cx, const void *bytes, size_t length);
+gpsee_byteStore_t *gpsee_getByteStore(JSContext *cx, JSObject *obj, size_t *offset_p);
+void gpsee_releaseByteStore(JSContext *cx, gpsee_byteStore_t *store);
+JSObject *gpsee_newByteThingFromStore(JSContext *cx, gpsee_byteStore_t *store, size_t offset, size_t length);
 
 /** Determine if JSClass instaciates bytethings or not.
  *  @ingroup    bytethings
@@ -655,7 +708,10 @@ static jsval_t  __attribute__((unused)) __jsval = jsval_void;
  */
 typedef enum 
 { 
-  bt_immutable	= 1 << 0 	/**< byteThing is immutable -- means we can count on hnd->buffer etc never changing */
+  bt_immutable	= 1 << 0, 	/**< byteThing is immutable -- means we can count on hnd->buffer etc never changing */
+  bt_mapped	= 1 << 1, 	/**< byteThing's backing store is a memory-mapped file region, released with munmap() */
+  bt_copyOnWrite = 1 << 2,	/**< byteThing shares hnd->memoryOwner's backing store; see gpsee_unshareByteThing() before writing */
+  bt_readOnly	= 1 << 3	/**< byteThing's backing store cannot be written, e.g. a read-only mapping; gpsee_unshareByteThing() throws */
 } byteThing_flags_e;
 
 /** Generic structure for representing pointer-like-things which we store in 
@@ -49,6 +49,8 @@
  */
 
 #include "gpsee.h"
+#include <sys/mman.h>
+#include <pratom.h>
 
 #ifdef GPSEE_DEBUG_BUILD
 # define dprintf(a...) do { if (gpsee_verbosity(0) > 2) gpsee_printf(cx, "> "), gpsee_printf(cx, a); } while(0)
@@ -181,3 +183,522 @@ JSObject *gpsee_newByteThing(JSContext *cx, void *buffer, size_t length, JSBool
 
   return NULL;
 }
+
+/**
+ *  Give a copy-on-write ByteThing a private copy of its backing store, so that it may be
+ *  written to without disturbing the other ByteThings sharing that store. The new buffer
+ *  comes from JS_malloc() and is owned by obj, so classes which use bt_copyOnWrite must
+ *  JS_free() hnd->buffer in their finalizers whenever hnd->memoryOwner == obj.
+ *
+ *  ByteThings without bt_copyOnWrite set are left alone. Every writer calls this routine first,
+ *  so it is also where writes to bt_readOnly ByteThings are refused.
+ *
+ *  @param      cx      The current JavaScript context.
+ *  @param      obj     The ByteThing about to be written to
+ *  @returns    JS_TRUE on success, JS_FALSE if an exception was thrown.
+ */
+JSBool gpsee_unshareByteThing(JSContext *cx, JSObject *obj)
+{
+  byteThing_handle_t	*hnd = JS_GetPrivate(cx, obj);
+  unsigned char		*buffer;
+
+  if (hnd && (hnd->btFlags & bt_readOnly))
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.readOnly: cannot write to a read-only %s", JS_GET_CLASS(cx, obj)->name);
+
+  if (!hnd || !(hnd->btFlags & bt_copyOnWrite))
+    return JS_TRUE;
+
+  buffer = JS_malloc(cx, hnd->length ? hnd->length : 1);
+  if (!buffer)
+    return JS_FALSE;
+
+  if (hnd->length)
+    memcpy(buffer, hnd->buffer, hnd->length);
+
+  hnd->buffer       = buffer;
+  hnd->memoryOwner  = obj;
+  hnd->btFlags     &= ~bt_copyOnWrite;
+
+  return JS_TRUE;
+}
+
+/** Private handle for memory-mapped ByteThings. Starts like all other byteThing handles, 
+ *  but also remembers the page-aligned region which was actually handed to us by mmap(),
+ *  as hnd->buffer may point partway into the first page.
+ */
+typedef struct
+{
+  size_t                length;                 /**< Number of bytes mapped, as requested by the caller */
+  unsigned char         *buffer;                /**< First requested byte in the mapping */
+  JSObject		*memoryOwner;		/**< Always the mapped ByteThing itself */
+  byteThing_flags_e	btFlags;		/**< bt_mapped, plus bt_readOnly for read-only maps; never bt_immutable, see gpsee_newMappedByteThing() */
+  void			*mapBase;		/**< Address returned by mmap() */
+  size_t		mapLength;		/**< Length passed to mmap() */
+} mappedByteThing_handle_t;
+
+/** 
+ *  Mapped ByteThing Finalizer. Unmaps the backing store; writable shared mappings
+ *  are left for the kernel to flush, exactly as if the process had exited.
+ */
+static void MappedByteThing_Finalize(JSContext *cx, JSObject *obj)
+{
+  mappedByteThing_handle_t	*hnd = JS_GetPrivate(cx, obj);
+
+  if (!hnd)
+    return;
+
+  if (hnd->mapBase && (hnd->btFlags & bt_mapped) && (hnd->memoryOwner == obj))
+    munmap(hnd->mapBase, hnd->mapLength);
+
+  JS_free(cx, hnd);
+
+  return;
+}
+
+static JSClass mappedByteThing_class =
+{
+  GPSEE_GLOBAL_NAMESPACE_NAME ".MappedByteThing",	/**< its name is MappedByteThing */
+  JSCLASS_HAS_PRIVATE,			/**< private slot in use */
+  JS_PropertyStub, 			/**< addProperty stub */
+  JS_PropertyStub, 			/**< deleteProperty stub */
+  JS_PropertyStub,			/**< custom getProperty */
+  JS_PropertyStub,			/**< setProperty stub */
+  JS_EnumerateStub,			/**< enumerateProperty stub */
+  JS_ResolveStub,  			/**< resolveProperty stub */
+  JS_ConvertStub,  			/**< convertProperty stub */
+  MappedByteThing_Finalize,		/**< it has a custom finalizer */
+    
+  JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+/**
+ *  Instanciate a GPSEE ByteThing whose backing store is a memory-mapped region of an open
+ *  file. The mapping is released by the finalizer; the file descriptor is not needed once 
+ *  this function returns, and may be closed by the caller.
+ *
+ *  Mapped ByteThings are never flagged bt_immutable, even when read-only: the file can be
+ *  written by another process underneath a MAP_SHARED map (or a MAP_PRIVATE map, for pages
+ *  we have not yet written), and truncating it turns accesses past the new end of file into
+ *  SIGBUS. Casts to ByteString therefore copy the bytes out of the mapping. Read-only maps
+ *  are flagged bt_readOnly, so that writers throw instead of faulting.
+ *
+ *  The requested region of a regular file must lie within the file as it is now; other 
+ *  files (devices) are mapped as asked. mmap() wants a page-aligned offset, so we map from 
+ *  the start of the page holding offset, and hnd->buffer points partway into that page.
+ *
+ *  @param      cx              The current JavaScript context.
+ *  @param      fd              An open file descriptor.
+ *  @param      offset          Offset into the file at which the mapping starts; need not be page-aligned.
+ *  @param      length          Number of bytes to map. 0 means "from offset to the end of the file".
+ *  @param      writable        Whether the mapping may be written to. Requires fd opened O_RDWR for shared maps.
+ *  @param      shared          Whether writes are carried through to the file (MAP_SHARED) or private (MAP_PRIVATE).
+ *  @returns    The object, or NULL if an exception was thrown.
+ */
+JSObject *gpsee_newMappedByteThing(JSContext *cx, int fd, off_t offset, size_t length, JSBool writable, JSBool shared)
+{
+  JSObject                      *robj;
+  mappedByteThing_handle_t      *hnd = NULL;
+  struct stat                   sb;
+  long                          pageSize;
+  off_t                         mapOffset;
+  size_t                        pageOffset;
+  void                          *base;
+
+  GPSEE_DECLARE_BYTETHING_CLASS(mappedByteThing);
+
+  if (offset < 0)
+  {
+    (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.offset: offset must not be negative");
+    return NULL;
+  }
+
+  if (fstat(fd, &sb))
+  {
+    (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.fstat: Cannot determine file size (%m)");
+    return NULL;
+  }
+
+  if (S_ISREG(sb.st_mode))
+  {
+    /* Pages wholly past the end of the file raise SIGBUS when touched, so refuse to map them */
+    if (offset > sb.st_size)
+    {
+      (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.offset: offset is past the end of the file");
+      return NULL;
+    }
+
+    if (length == 0)
+      length = sb.st_size - offset;
+    else if ((uint64)length > (uint64)(sb.st_size - offset))
+    {
+      (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.length: " GPSEE_SIZET_FMT " bytes at offset " GPSEE_INT64_FMT
+                        " run past the end of the " GPSEE_INT64_FMT "-byte file", length, (int64)offset, (int64)sb.st_size);
+      return NULL;
+    }
+
+    if (length == 0)	/* mmap() cannot map 0 bytes; an empty region yields an empty ByteThing */
+      return gpsee_newByteThing(cx, NULL, 0, JS_FALSE);
+  }
+  else if (length == 0)
+  {
+    (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.length: length is required when mapping non-regular files");
+    return NULL;
+  }
+
+  pageSize   = sysconf(_SC_PAGESIZE);
+  mapOffset  = offset - (offset % pageSize);
+  pageOffset = offset - mapOffset;
+
+  if (length > (size_t)-1 - pageOffset)
+  {
+    (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.length: " GPSEE_SIZET_FMT " bytes is too many to map", length);
+    return NULL;
+  }
+
+  base = mmap(NULL, length + pageOffset, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, 
+              shared ? MAP_SHARED : MAP_PRIVATE, fd, mapOffset);
+  if (base == MAP_FAILED)
+  {
+    (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.map.mmap: Unable to map " GPSEE_SIZET_FMT " bytes (%m)", length);
+    return NULL;
+  }
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    goto err_out;
+  memset(hnd, 0, sizeof(*hnd));
+
+  robj = JS_NewObject(cx, &mappedByteThing_class, NULL, NULL);
+  if (!robj)
+    goto err_out;
+
+  hnd->mapBase          = base;
+  hnd->mapLength        = length + pageOffset;
+  hnd->buffer           = (unsigned char *)base + pageOffset;
+  hnd->length           = length;
+  hnd->memoryOwner      = robj;
+  hnd->btFlags          = writable ? bt_mapped : (bt_mapped | bt_readOnly);
+
+  JS_SetPrivate(cx, robj, hnd);
+  return robj;
+
+  err_out:
+  munmap(base, length + pageOffset);
+  if (hnd)
+    JS_free(cx, hnd);
+
+  return NULL;
+}
+
+/** Retrieve the private handle for a mapped ByteThing, throwing if obj is something else */
+static mappedByteThing_handle_t *mappedByteThing_getHandle(JSContext *cx, JSObject *obj, const char *methodName)
+{
+  mappedByteThing_handle_t *hnd;
+
+  if (!obj || JS_GET_CLASS(cx, obj) != &mappedByteThing_class || !(hnd = JS_GetPrivate(cx, obj)))
+  {
+    (void)gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.%s.type: not a memory-mapped ByteThing", methodName);
+    return NULL;
+  }
+
+  return hnd;
+}
+
+/**
+ *  Flush changes made to a writable, memory-mapped ByteThing back to the underlying file.
+ *
+ *  @param      cx      The current JavaScript context.
+ *  @param      obj     A ByteThing returned by gpsee_newMappedByteThing()
+ *  @param      async   JS_TRUE to schedule the write (MS_ASYNC) rather than waiting for it (MS_SYNC)
+ *  @returns    JS_TRUE on success, or JS_FALSE if an exception was thrown.
+ */
+JSBool gpsee_syncMappedByteThing(JSContext *cx, JSObject *obj, JSBool async)
+{
+  mappedByteThing_handle_t	*hnd = mappedByteThing_getHandle(cx, obj, "sync");
+  jsrefcount                    depth;
+  int                           res;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  depth = JS_SuspendRequest(cx);
+  res = msync(hnd->mapBase, hnd->mapLength, async ? MS_ASYNC : MS_SYNC);
+  JS_ResumeRequest(cx, depth);
+
+  if (res)
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.sync.msync: %m");
+
+  return JS_TRUE;
+}
+
+/**
+ *  Advise the kernel how a memory-mapped ByteThing will be accessed.
+ *
+ *  @param      cx      The current JavaScript context.
+ *  @param      obj     A ByteThing returned by gpsee_newMappedByteThing()
+ *  @param      advice  One of the MADV_* constants, e.g. MADV_SEQUENTIAL
+ *  @returns    JS_TRUE on success, or JS_FALSE if an exception was thrown.
+ */
+JSBool gpsee_adviseMappedByteThing(JSContext *cx, JSObject *obj, int advice)
+{
+  mappedByteThing_handle_t	*hnd = mappedByteThing_getHandle(cx, obj, "advise");
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (madvise(hnd->mapBase, hnd->mapLength, advice))
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".byteThing.advise.madvise: %m");
+
+  return JS_TRUE;
+}
+
+/** A reference-counted backing store. ByteThings on any thread may share one; the bytes
+ *  are freed when the last reference is dropped, whichever thread drops it.
+ */
+struct gpsee_byteStore
+{
+  PRInt32               refCount;               /**< References held by store ByteThings and by C code */
+  unsigned char         *buffer;                /**< Bytes; malloc()ed, never written once shared */
+  size_t                length;                 /**< Size of buffer */
+};
+
+/** Private handle for store ByteThings: the JS objects which hold a reference to a 
+ *  gpsee_byteStore_t on behalf of the GC. Other ByteThings use the store's bytes by
+ *  naming a store ByteThing as their memoryOwner.
+ */
+typedef struct
+{
+  size_t                length;                 /**< Size of the store */
+  unsigned char         *buffer;                /**< store->buffer */
+  JSObject		*memoryOwner;		/**< Always NULL; the store, not the object, owns the memory */
+  byteThing_flags_e	btFlags;		/**< Always bt_immutable */
+  gpsee_byteStore_t     *store;                 /**< The reference this object holds */
+} storeByteThing_handle_t;
+
+/** Store ByteThing Finalizer. Drops the object's reference to its store. */
+static void StoreByteThing_Finalize(JSContext *cx, JSObject *obj)
+{
+  storeByteThing_handle_t	*hnd = JS_GetPrivate(cx, obj);
+
+  if (!hnd)
+    return;
+
+  if (hnd->store)
+    gpsee_releaseByteStore(cx, hnd->store);
+
+  JS_free(cx, hnd);
+}
+
+static JSClass storeByteThing_class =
+{
+  GPSEE_GLOBAL_NAMESPACE_NAME ".ByteStore",	/**< its name is ByteStore */
+  JSCLASS_HAS_PRIVATE,	                /**< private slot in use */
+  JS_PropertyStub, 			/**< addProperty stub */
+  JS_PropertyStub, 			/**< deleteProperty stub */
+  JS_PropertyStub,			/**< getProperty stub */
+  JS_PropertyStub,			/**< setProperty stub */
+  JS_EnumerateStub,			/**< enumerateProperty stub */
+  JS_ResolveStub,  			/**< resolveProperty stub */
+  JS_ConvertStub,  			/**< convertProperty stub */
+  StoreByteThing_Finalize,	        /**< it has a custom finalizer */
+  
+  JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
+/** Create a store ByteThing, taking over one reference to store. On failure the reference
+ *  is still the caller's.
+ */
+static JSObject *storeByteThing_new(JSContext *cx, gpsee_byteStore_t *store)
+{
+  JSObject                      *robj;
+  storeByteThing_handle_t       *hnd;
+
+  GPSEE_DECLARE_BYTETHING_CLASS(storeByteThing);
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return NULL;
+
+  robj = JS_NewObject(cx, &storeByteThing_class, NULL, NULL);
+  if (!robj)
+  {
+    JS_free(cx, hnd);
+    return NULL;
+  }
+
+  hnd->length      = store->length;
+  hnd->buffer      = store->buffer;
+  hnd->memoryOwner = NULL;
+  hnd->btFlags     = bt_immutable;
+  hnd->store       = store;
+
+  JS_SetPrivate(cx, robj, hnd);
+  return robj;
+}
+
+/**
+ *  Create a byte store holding a copy of some bytes.
+ *
+ *  @param      cx      The current JavaScript context.
+ *  @param      bytes   The bytes to copy
+ *  @param      length  How many bytes to copy
+ *  @returns    A store with one reference, owned by the caller, or NULL if an exception was thrown.
+ */
+gpsee_byteStore_t *gpsee_newByteStore(JSContext *cx, const void *bytes, size_t length)
+{
+  gpsee_byteStore_t     *store = JS_malloc(cx, sizeof(*store));
+
+  if (!store)
+    return NULL;
+
+  store->buffer = JS_malloc(cx, length ? length : 1);
+  if (!store->buffer)
+  {
+    JS_free(cx, store);
+    return NULL;
+  }
+
+  if (length)
+    memcpy(store->buffer, bytes, length);
+  store->length   = length;
+  store->refCount = 1;
+
+  return store;
+}
+
+/**
+ *  Drop a reference to a byte store. Safe to call from any thread, and from finalizers.
+ *
+ *  @param      cx      Any JavaScript context in the runtime
+ *  @param      store   The store
+ */
+void gpsee_releaseByteStore(JSContext *cx, gpsee_byteStore_t *store)
+{
+  if (PR_AtomicDecrement(&store->refCount) != 0)
+    return;
+
+  if (store->buffer)
+    JS_free(cx, store->buffer);
+  JS_free(cx, store);
+}
+
+/**
+ *  Find, or make, a reference-counted store holding an immutable ByteThing's bytes, so that
+ *  they can outlive the ByteThing or be handed to another thread without copying.
+ *
+ *  The first time an immutable ByteThing which owns its buffer is shared, the buffer is moved
+ *  into a store and the ByteThing is pointed at a store ByteThing as its memoryOwner. The bytes
+ *  do not move, so other threads reading them are not disturbed. Slices of such ByteThings 
+ *  share the same store.
+ *
+ *  @param      cx              The current JavaScript context.
+ *  @param      obj             The ByteThing
+ *  @param      offset_p        [out] Where obj's bytes start within the store
+ *  @returns    A new reference to the store, which the caller must release with
+ *              gpsee_releaseByteStore(); or NULL when obj's bytes cannot be shared (mutable,
+ *              memory-mapped, or owned by something other than a ByteThing), or an exception
+ *              was thrown.
+ */
+gpsee_byteStore_t *gpsee_getByteStore(JSContext *cx, JSObject *obj, size_t *offset_p)
+{
+  byteThing_handle_t            *hnd = JS_GetPrivate(cx, obj);
+  byteThing_handle_t            *ownerHnd;
+  JSObject                      *owner;
+  JSObject                      *storeObj;
+  gpsee_byteStore_t             *store;
+
+  if (!gpsee_isByteThing(cx, obj) || !hnd || !(hnd->btFlags & bt_immutable))
+    return NULL;
+
+  owner = hnd->memoryOwner;
+  if (!owner)
+    return NULL;        /* Buffer lifetime is managed elsewhere; we cannot extend it */
+
+  ownerHnd = JS_GetPrivate(cx, owner);
+
+  if (JS_GET_CLASS(cx, owner) != &storeByteThing_class)
+  {
+    if (ownerHnd->memoryOwner != owner)
+    {
+      /* Already moved into a store, or not a buffer we know how to free */
+      owner = ownerHnd->memoryOwner;
+      if (!owner || (JS_GET_CLASS(cx, owner) != &storeByteThing_class))
+        return NULL;
+    }
+    else
+    {
+      if (!(ownerHnd->btFlags & bt_immutable) || (ownerHnd->btFlags & bt_mapped) || !ownerHnd->buffer)
+        return NULL;
+
+      store = JS_malloc(cx, sizeof(*store));
+      if (!store)
+        return NULL;
+      store->buffer   = ownerHnd->buffer;
+      store->length   = ownerHnd->length;
+      store->refCount = 1;
+
+      storeObj = storeByteThing_new(cx, store);
+      if (!storeObj)
+      {
+        JS_free(cx, store);
+        return NULL;
+      }
+
+      /* Hand the buffer to the store. If another thread beat us to it, use theirs. */
+      if (jsval_CompareAndSwap((jsval *)&ownerHnd->memoryOwner, (jsval)owner, (jsval)storeObj) != JS_TRUE)
+      {
+        store->buffer = NULL;   /* Not ours; StoreByteThing_Finalize() must not free it */
+        storeObj = ownerHnd->memoryOwner;
+      }
+
+      owner = storeObj;
+    }
+  }
+
+  store = ((storeByteThing_handle_t *)JS_GetPrivate(cx, owner))->store;
+  PR_AtomicIncrement(&store->refCount);
+  *offset_p = hnd->buffer - store->buffer;
+
+  return store;
+}
+
+/**
+ *  Instanciate an immutable generic ByteThing over part of a byte store, without copying.
+ *  binary.ByteString() casts these without copying, too.
+ *
+ *  @param      cx      The current JavaScript context.
+ *  @param      store   The store; the caller keeps its own reference
+ *  @param      offset  First byte of the store to use
+ *  @param      length  Number of bytes to use
+ *  @returns    The object, or NULL if an exception was thrown.
+ */
+JSObject *gpsee_newByteThingFromStore(JSContext *cx, gpsee_byteStore_t *store, size_t offset, size_t length)
+{
+  JSObject              *robj;
+  JSObject              *storeObj;
+  byteThing_handle_t    *hnd;
+
+  GPSEE_ASSERT(offset + length <= store->length);
+
+  PR_AtomicIncrement(&store->refCount);
+  storeObj = storeByteThing_new(cx, store);
+  if (!storeObj)
+  {
+    gpsee_releaseByteStore(cx, store);
+    return NULL;
+  }
+
+  /* storeObj is only reachable from the stack until robj names it */
+  if (!JS_AddNamedObjectRoot(cx, &storeObj, "gpsee_newByteThingFromStore"))
+    return NULL;
+
+  robj = gpsee_newByteThing(cx, store->buffer + offset, length, JS_FALSE);
+  if (robj)
+  {
+    hnd = JS_GetPrivate(cx, robj);
+    hnd->memoryOwner = storeObj;
+  }
+
+  JS_RemoveObjectRoot(cx, &storeObj);
+  return robj;
+}
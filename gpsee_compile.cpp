@@ -118,6 +118,9 @@ JSBool gpsee_compileScript(JSContext *cx, const char *scriptFilename, FILE *scri
   struct stat 		cache_st;
   FILE 			*cache_file = NULL;
   JSBool                own_scriptFile = JS_FALSE;
+  PRTime                profileStart = gpsee_profileCompileStart(cx);
+  JSBool                cacheHit = JS_FALSE;
+  size_t                xdrBytes = 0;
 
   *script = NULL;
   *scriptObject = NULL;
@@ -278,6 +281,8 @@ JSBool gpsee_compileScript(JSContext *cx, const char *scriptFilename, FILE *scri
                     cache_filename, exception);
         } else {
           /* Success */
+          cacheHit = JS_TRUE;
+          xdrBytes = cache_st.st_size;
 	  if (gpsee_verbosity(0) >= GPSEE_XDR_DEBUG_VERBOSITY)
 	    gpsee_log(cx, GLOG_DEBUG, "JS_XDRScript() succeeded deserializing \"%s\" from cache file \"%s\"", scriptFilename,
 		      cache_filename);
@@ -442,5 +447,7 @@ JSBool gpsee_compileScript(JSContext *cx, const char *scriptFilename, FILE *scri
   finish:
   if (own_scriptFile)
     fclose(scriptFile);
+  if (profileStart)
+    gpsee_profileCompile(cx, profileStart, cacheHit, xdrBytes);
   return rval;
 }
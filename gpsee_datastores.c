@@ -79,7 +79,7 @@ void *gpsee_ds_get(gpsee_dataStore_t store, const void *key)
   GPSEE_ASSERT(store != NULL);
   GPSEE_ASSERT(store->monitor != NULL);
 
-  gpsee_enterMonitor(store->monitor);
+  gpsee_enterMonitorShared(store->monitor);
   for (i=0; i < store->size; i++)
   {
     if (store->data[i].key == key)
@@ -304,7 +304,7 @@ gpsee_dataStore_t gpsee_ds_create(gpsee_runtime_t *grt, uint32 flags, size_t ini
   if (flags & GPSEE_DS_UNLOCKED)
     store->monitor = gpsee_getNilMonitor();
   else
-    store->monitor = gpsee_createMonitor(grt);
+    store->monitor = gpsee_createMonitor(grt, "datastore");
   store->grt = grt;     /* Cached for delete */
   store->flags = flags;
 
@@ -391,7 +391,7 @@ JSBool gpsee_ds_hasData(JSContext *cx, gpsee_dataStore_t store)
   size_t        i;
   JSBool	b = JS_FALSE;
 
-  gpsee_enterMonitor(store->monitor);
+  gpsee_enterMonitorShared(store->monitor);
   for (i=0; i < store->size; i++)
   {
     if (!store->data[i].key)
@@ -400,6 +400,7 @@ JSBool gpsee_ds_hasData(JSContext *cx, gpsee_dataStore_t store)
     break;
   }
 
+  gpsee_leaveMonitor(store->monitor);
   return b;
 }
 
@@ -38,6 +38,13 @@
  *  @brief      Hookable I/O for GPSEE internals. All user-oriented I/O (such as stack dumps)
  *              should use these routines, so that JavaScript programs (like TUI development
  *              environments) can hook them to avoid screen corruption etc.
+ *
+ *              Locking: grt->monitors.user_io guards the vtable and the allocation of the hooks
+ *              array, which is never resized once allocated. Each hook's own monitor guards its
+ *              functions, realm and output buffer. grt->user_io.hookedFds is read without locks,
+ *              so that unhooked descriptors go straight to stdio. When both monitors are needed,
+ *              the hook's monitor is entered first. No monitor is held while a JS hook runs, nor
+ *              while beginning a request, so hooks may write to other hooked descriptors.
  *  @author     Wes Garland, wes@page.ca
  *  @date       April 2010
  *  @version    $Id: gpsee_hookable_io.c,v 1.4 2010/12/02 21:59:42 wes Exp $
@@ -45,6 +52,29 @@
 
 #include "gpsee.h"
 
+#define UIO_DEFAULT_BUFFER_SIZE 8192            /**< Output buffer size for hooked file descriptors, unless changed by gpsee_setIOHookBuffering() */
+#define UIO_MAX_HOOKED_FD       STDERR_FILENO   /**< Highest file descriptor which may be hooked; bounds grt->user_io.hookedFds */
+
+/** Test whether a file descriptor has JavaScript hooks, without locking. Once this is true, the hooks 
+ *  array is allocated and stable, and the hook's monitor must be entered to examine the hook itself.
+ */
+#define uio_isHooked(grt, fd)   ((fd) >= 0 && (fd) <= UIO_MAX_HOOKED_FD && ((grt)->user_io.hookedFds & (1 << (fd))))
+
+/** Set or clear a file descriptor's bit in the hooked-fd bitmap.  Callers hold the user_io monitor, so
+ *  the compare-and-swap never races with another writer; it is here for its memory barrier, which 
+ *  publishes the hooks array before any lock-free reader can see the bit.
+ */
+static void uio_setHooked(gpsee_runtime_t *grt, int fd, JSBool hooked)
+{
+  jsword        oldMap, newMap;
+
+  do
+  {
+    oldMap = grt->user_io.hookedFds;
+    newMap = hooked ? (oldMap | (1 << fd)) : (oldMap & ~(1 << fd));
+  } while (jsval_CompareAndSwap((jsval *)&grt->user_io.hookedFds, oldMap, newMap) != JS_TRUE);
+}
+
 /** GC Callback for hookable user I/O.  Insure the GC does not collect functions
  *  which are unreferenced in script, but used by the user io hooks.
  *
@@ -60,6 +90,9 @@ static JSBool uio_GCCallback(JSContext *cx, gpsee_realm_t *unused, JSGCStatus st
   if (status != JSGC_MARK_END)
     return JS_TRUE;
 
+  /* Hooks only change inside requests, so they are stable during GC; the per-hook monitors may be
+   * held by threads waiting to begin a request, and must not be entered here.
+   */
   gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
   for (i = 0; i < grt->user_io.hooks_len; i++)
   {
@@ -76,16 +109,13 @@ static JSBool uio_GCCallback(JSContext *cx, gpsee_realm_t *unused, JSGCStatus st
 /**
  *  Code to output data to JS instead of stdio functions.
  *
- *  @param      cx      Any context in the runtime
+ *  @param      cx      Any context in the runtime, in a request
  *  @param      realm   The invocation realm of the I/O hook
- *  @param      hookFn  The hook function for the relevant file descriptor
- *  @param      buf     The buffer to output
+ *  @param      hookFn  The hook function for the relevant file descriptor; rooted by the caller
+ *  @param      buf     The buffer to output. It is copied before the hook runs, so the hook may re-use it.
  *  @param      bufLen  The number of characters in the buffer.
- *
- *  @returns    Ideally, the number of bytes written -- we actually return bufLen if the return value of
- *              the JS hook function is not an integer; otherwise, we return that value.
  */
-static size_t uio_fwrite_js(JSContext *cx, gpsee_realm_t *realm, jsval hookFn, const char *buf, size_t bufLen)
+static void uio_fwrite_js(JSContext *cx, gpsee_realm_t *realm, jsval hookFn, const char *buf, size_t bufLen)
 {
   jsval       rval;
   JSString    *str;
@@ -103,57 +133,196 @@ static size_t uio_fwrite_js(JSContext *cx, gpsee_realm_t *realm, jsval hookFn, c
   {
     JS_ReportPendingException(cx);
     JS_ClearPendingException(cx);
-    rval = JSVAL_ZERO;
   }
 
   JS_LeaveLocalRootScope(cx);
+}
 
-  if (!JSVAL_IS_INT(rval))
-    return bufLen;
+static JSBool uio_fwrite_dump_cb(JSContext *cx, void *vdata, GPSEEAsyncCallback *cb);
 
-  if (JSVAL_TO_INT(rval) < 0)
-    return 0;
+/**
+ *  Append output to a hook's buffer, growing it if necessary.  Infallible; panics on OOM,
+ *  as we cannot report errors from here.  Caller must hold the hook's monitor.
+ */
+static void uio_append(struct gpsee_ioHook *hook, const char *buf, size_t len)
+{
+  if (hook->outLen + len > hook->outAlloc)
+  {
+    size_t      newSize = hook->outAlloc ? hook->outAlloc : hook->outSize;
+    char        *newBuf;
 
-  return JSVAL_TO_INT(rval);
+    while (newSize < hook->outLen + len)
+      newSize *= 2;
+
+    newBuf = realloc(hook->outBuf, newSize);   /* Can't JS_malloc: can't propagate OOM */
+    if (!newBuf)
+      panic(GPSEE_GLOBAL_NAMESPACE_NAME ".user_io.fwrite: out of memory buffering output");
+
+    hook->outBuf = newBuf;
+    hook->outAlloc = newSize;
+  }
+
+  memcpy(hook->outBuf + hook->outLen, buf, len);
+  hook->outLen += len;
 }
 
-/** 
- *  Fwrite Callback data - stored in a GPSEE Data Store, this data is used either by
- *  the realm destructor or an async callback to output pending data which could not
- *  be written earlier (normally because the context was throwing an exception at the
- *  time).
+/**
+ *  Deliver a hook's buffered output to its JS output function, along with anything written to
+ *  the buffer while we were delivering. The hook runs with its monitor released, so that it may
+ *  write to another hooked descriptor (whose hook may be writing to this one on another thread),
+ *  or change the hooks. Output for one descriptor stays in order because only one thread delivers
+ *  at a time: anybody else who wants the buffer delivered, including the hook itself, leaves it
+ *  for us instead of waiting. The request is begun before re-entering the monitor, as a thread 
+ *  waiting for a request must not hold a monitor which a thread in a request may want.
+ *
+ *  Caller must hold the hook's monitor; it is released and re-entered, so the hook may have 
+ *  changed by the time we return.
  */
-struct pendingWrite_data
+static void uio_deliver(JSContext *cx, struct gpsee_ioHook *hook)
 {
-  char          *buf;
-  size_t        len;
-  jsval         hookFn;
-};
+  gpsee_monitor_t       monitor = hook->monitor;
+  gpsee_realm_t         *realm;
+  jsval                 hookFn = JSVAL_VOID;
+  char                  *buf;
+  size_t                len, alloc;
 
-/** DataStore callback to dump, then destroy, a specific piece of pending fwrite data */
-static JSBool uio_dumpPendingWrites_cb(JSContext *cx, const void *key, void *value, void *private)
+  if (hook->delivering)
+    return;
+
+  hook->delivering = JS_TRUE;
+  gpsee_leaveMonitor(monitor);
+
+  JS_BeginRequest(cx);  /* callers such as print() suspend their requests around output */
+  JS_AddNamedRoot(cx, &hookFn, "output hook being called");
+  gpsee_enterMonitor(monitor);
+
+  while (hook->outLen && hook->output != JSVAL_VOID)
+  {
+    buf    = hook->outBuf;
+    len    = hook->outLen;
+    alloc  = hook->outAlloc;
+    hookFn = hook->output;
+    realm  = hook->realm;
+
+    hook->outBuf = NULL;
+    hook->outLen = hook->outAlloc = 0;
+    gpsee_leaveMonitor(monitor);
+
+    uio_fwrite_js(cx, realm, hookFn, buf, len);
+
+    gpsee_enterMonitor(monitor);
+    if (!hook->outBuf)          /* Nothing written meanwhile: re-use our buffer */
+    {
+      hook->outBuf = buf;
+      hook->outAlloc = alloc;
+    }
+    else
+      free(buf);
+  }
+
+  hook->delivering = JS_FALSE;
+  gpsee_leaveMonitor(monitor);
+
+  JS_RemoveRoot(cx, &hookFn);
+  JS_EndRequest(cx);
+
+  gpsee_enterMonitor(monitor);
+}
+
+/**
+ *  Deliver the output buffered for a file descriptor to its JS hook. If an exception is
+ *  pending on cx we might be in the error reporter, which cannot re-enter the JSAPI, so we 
+ *  instead ask the async callback facility (operation callback) to deliver it later.
+ *  Caller must hold the hook's monitor, which is released while the hook runs; see uio_deliver().
+ */
+static void uio_flush(JSContext *cx, struct gpsee_ioHook *hook)
 {
-  struct pendingWrite_data      *data = (void *)key;
-  gpsee_realm_t                 *realm = private;
+  if (!hook->outLen || hook->output == JSVAL_VOID)
+    return;     /* Left behind when the hook was removed mid-delivery; goes to the next output hook */
 
-  uio_fwrite_js(cx, realm, data->hookFn, data->buf, data->len);
+  if (JS_IsExceptionPending(cx) == JS_TRUE)
+  {
+    if (!hook->flushScheduled)
+    {
+      hook->flushScheduled = JS_TRUE;
+      gpsee_addAsyncCallback(cx, uio_fwrite_dump_cb, hook->realm);
+    }
+    return;
+  }
 
-  JS_free(cx, data->buf);
-  JS_free(cx, data);
+  uio_deliver(cx, hook);
+}
 
-  return JS_TRUE;
+/** Deliver the output buffered for every hooked file descriptor. Caller must not hold
+ *  any hook's monitor.
+ */
+static void uio_flushAll(JSContext *cx, gpsee_runtime_t *grt)
+{
+  int           fd;
+
+  for (fd = 0; fd <= UIO_MAX_HOOKED_FD; fd++)
+  {
+    if (!uio_isHooked(grt, fd))
+      continue;
+
+    gpsee_enterMonitor(grt->user_io.hooks[fd].monitor);
+    uio_flush(cx, &grt->user_io.hooks[fd]);
+    gpsee_leaveMonitor(grt->user_io.hooks[fd].monitor);
+  }
+}
+
+/**
+ *  Deliver any output buffered for a file descriptor to its JS hook, e.g. before
+ *  prompting for input or when a program needs its output to appear now.
+ *
+ *  @param      cx      Any context in the runtime
+ *  @param      fd      The file descriptor to flush, or -1 for all of them
+ */
+void gpsee_flushIOHook(JSContext *cx, int fd)
+{
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+
+  if (fd == -1)
+  {
+    uio_flushAll(cx, grt);
+    return;
+  }
+
+  if (!uio_isHooked(grt, fd))
+    return;
+
+  gpsee_enterMonitor(grt->user_io.hooks[fd].monitor);
+  uio_flush(cx, &grt->user_io.hooks[fd]);
+  gpsee_leaveMonitor(grt->user_io.hooks[fd].monitor);
 }
 
 /**
- *  Dump all pending fwrite data for a particular realm.
+ *  Deliver all buffered output for a particular realm's hooks, including output which could 
+ *  not be delivered earlier because the context was throwing an exception at the time.
  *
  *  @param      cx      The current context (any context in the runtime)
  *  @param      realm   The realm for which we wish to dump the pending outut
  */
 void gpsee_uio_dumpPendingWrites(JSContext *cx, gpsee_realm_t *realm)
 {
-  gpsee_ds_forEach(cx, realm->user_io_pendingWrites, uio_dumpPendingWrites_cb, realm);
-  gpsee_ds_empty(realm->user_io_pendingWrites);
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  struct gpsee_ioHook   *hook;
+  int                   fd;
+
+  for (fd = 0; fd <= UIO_MAX_HOOKED_FD; fd++)
+  {
+    if (!uio_isHooked(grt, fd))
+      continue;
+
+    hook = &grt->user_io.hooks[fd];
+    gpsee_enterMonitor(hook->monitor);
+    if (hook->realm == realm)
+    {
+      hook->flushScheduled = JS_FALSE;
+      uio_flush(cx, hook);
+    }
+    gpsee_leaveMonitor(hook->monitor);
+  }
 }
 
 static JSBool uio_fwrite_dump_cb(JSContext *cx, void *vdata, GPSEEAsyncCallback *cb)
@@ -164,65 +333,123 @@ static JSBool uio_fwrite_dump_cb(JSContext *cx, void *vdata, GPSEEAsyncCallback
   return JS_TRUE;
 }
 
+/**
+ *  Deliver pending output for, and remove, all I/O hooks belonging to a realm which is
+ *  being destroyed.
+ *
+ *  @param      cx      A context in the realm's runtime, in a request
+ *  @param      realm   The realm being destroyed
+ */
+void gpsee_uio_releaseRealm(JSContext *cx, gpsee_realm_t *realm)
+{
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  struct gpsee_ioHook   *hook;
+  gpsee_monitor_t       monitor;
+  JSBool                delivering;
+  int                   fd;
+
+  for (fd = 0; fd <= UIO_MAX_HOOKED_FD; fd++)
+  {
+    if (!uio_isHooked(grt, fd))
+      continue;
+
+    hook = &grt->user_io.hooks[fd];
+    monitor = hook->monitor;
+
+    gpsee_enterMonitor(monitor);
+    if (hook->realm == realm)
+      uio_flush(cx, hook);
+    if (hook->realm == realm)   /* Still: uio_flush() left the monitor while the hook ran */
+    {
+      gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
+      uio_setHooked(grt, fd, JS_FALSE);
+      gpsee_leaveAutoMonitor(grt->monitors.user_io);
+
+      delivering = hook->delivering;    /* The delivering thread stops once it sees no output hook */
+      if (hook->outBuf)
+        free(hook->outBuf);
+      memset(hook, 0, sizeof(*hook));
+      hook->input = hook->output = JSVAL_VOID;
+      hook->monitor = monitor;
+      hook->delivering = delivering;
+    }
+    gpsee_leaveMonitor(monitor);
+  }
+}
+
 #ifdef HAVE_CONST_CORRECT_FWRITE
 # define CONST const
 #else
 # define CONST  /* */
 #endif
 
+/** 
+ *  fwrite() replacement for hooked file descriptors.  Output is buffered according to the
+ *  hook's policy (see gpsee_setIOHookBuffering()), so that the JS hook sees a few large chunks
+ *  rather than a call per fputc() or printed line. Unbuffered output passes through the buffer 
+ *  too, so that it queues behind output another thread is delivering. Unhooked file descriptors
+ *  are written directly, without locking.
+ */
 static size_t uio_fwrite_hook(CONST void *ptr, size_t size, size_t nitems, FILE *file, JSContext *cx)
 {
   gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  gpsee_realm_t         *realm;
   int                   fd = fileno(file);
-  size_t                sz;
+  size_t                len = size * nitems;
+  struct gpsee_ioHook   *hook;
 
-  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
+  if (!uio_isHooked(grt, fd))
+    return fwrite(ptr, size, nitems, file);
+
+  hook = &grt->user_io.hooks[fd];
+  gpsee_enterMonitor(hook->monitor);
 
-  if (grt->user_io.hooks_len <= fd || grt->user_io.hooks[fd].output == JSVAL_VOID)
+  if (hook->output == JSVAL_VOID)
   {
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
+    gpsee_leaveMonitor(hook->monitor);
     return fwrite(ptr, size, nitems, file);
   }
 
-  realm = grt->user_io.hooks[fd].realm;
-
   if (JS_IsExceptionPending(cx) == JS_TRUE)
   {
-    /* We cannot re-enter the JSAPI from the error reporter, so we post the event
-     * to the async facility (operation callback) and then trigger it. Note that
-     * cx->throwing does not guarantee that we are in the reporter, but that's okay.
+    /* We cannot re-enter the JSAPI from the error reporter; buffer regardless of policy, and let uio_flush() 
+     * post the event to the async facility.  Note that cx->throwing does not guarantee that we are in the 
+     * reporter, but that's okay.
      */
-    struct pendingWrite_data *data = JS_malloc(cx, sizeof(*data));
+    uio_append(hook, ptr, len);
+    uio_flush(cx, hook);
+    gpsee_leaveMonitor(hook->monitor);
+    return nitems;
+  }
 
-    data->len = size * nitems;
-    data->buf = JS_malloc(cx, data->len);;
-    memcpy(data->buf, ptr, data->len);
- 
-    if (!data)
-      panic(GPSEE_GLOBAL_NAMESPACE_NAME ".user_io.fwrite: out of memory allocating callback data");
+  if ((hook->outMode != _IONBF) && (hook->outLen + len > hook->outSize))
+    uio_flush(cx, hook);
 
-    gpsee_addAsyncCallback(cx, uio_fwrite_dump_cb, realm);
+  uio_append(hook, ptr, len);
 
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-    return size * nitems;
-  }
+  if ((hook->outMode == _IONBF) || (hook->outLen >= hook->outSize) || (hook->outMode == _IOLBF && memchr(ptr, '\n', len)))
+    uio_flush(cx, hook);
 
-  sz = uio_fwrite_js(cx, realm, grt->user_io.hooks[fd].output, ptr, size * nitems);
-  gpsee_leaveAutoMonitor(grt->monitors.user_io);
-  return sz;
+  gpsee_leaveMonitor(hook->monitor);
+  return nitems;
 }
 
 static int uio_vfprintf_hook(JSContext *cx, FILE *file, const char *fmt, va_list ap)
 {
-  int buflen = vsnprintf(NULL, 0, fmt, ap);
-  char *buf;
-  int ret;
+  va_list       aq;
+  int           buflen;
+  char          *buf;
+  int           ret;
+
+  va_copy(aq, ap);      /* ap is consumed by each vsnprintf() */
+  buflen = vsnprintf(NULL, 0, fmt, aq);
+  va_end(aq);
 
   if (buflen <= 0)
     return buflen ? -1 : 0;
 
   buf = malloc(buflen + 1);     /* Can't JS_malloc: can't propagate OOM */
+  if (!buf)
+    return -1;
   vsnprintf(buf, buflen + 1, fmt, ap);
 
   ret = uio_fwrite_hook(buf, 1, buflen, file, cx);
@@ -238,12 +465,10 @@ static int uio_printf_hook(JSContext *cx, const char *fmt, ...)
 
   va_start(ap, fmt);
 
-  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
-  if (grt->user_io.hooks == NULL)
+  if (!uio_isHooked(grt, STDOUT_FILENO))
     ret = vprintf(fmt, ap);
   else
     ret = uio_vfprintf_hook(cx, stdout, fmt, ap);
-  gpsee_leaveAutoMonitor(grt->monitors.user_io);
 
   va_end(ap);
   return ret;
@@ -257,12 +482,10 @@ static int uio_fprintf_hook(JSContext *cx, FILE *file, const char *fmt, ...)
 
   va_start(ap, fmt);
 
-  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
-  if (grt->user_io.hooks == NULL)
+  if (!uio_isHooked(grt, fileno(file)))
     ret = vfprintf(file, fmt, ap);
   else
     ret = uio_vfprintf_hook(cx, file, fmt, ap);
-  gpsee_leaveAutoMonitor(grt->monitors.user_io);
 
   va_end(ap);
   return ret;
@@ -284,42 +507,96 @@ static int uio_fputc_hook(int c, FILE *file, JSContext *cx)
   return uio_fwrite_hook(&ch, 1, 1, file, cx);
 }
 
-static char *uio_fgets_hook(char *buf, int len, FILE *file, JSContext *cx)
+/** Outcome of uio_read_js() */
+typedef enum
 {
-  int                   fd = fileno(file);
-  jsval                 rval;
-  jsval                 argv[2];
-  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  gpsee_realm_t         *realm = gpsee_getRealm(cx);
+  uio_read_ok,                  /**< The input hook returned; its return value is in *rval */
+  uio_read_threw,               /**< The input hook threw; the exception has been reported */
+  uio_read_unhooked             /**< The file descriptor has no input hook; use stdio */
+} uio_read_e;
 
-  argv[0] = JSVAL_TRUE;         /* Read line */
-  argv[1] = INT_TO_JSVAL(len);  /* Do not exceed len characters */
+/**
+ *  Call the input hook for a file descriptor.  Pending output on every hooked file descriptor 
+ *  is delivered first, as stdio does, so that prompts appear before we block for input. The
+ *  same happens before an unhooked read from a terminal, which the caller does with stdio. 
+ *  The hook runs without its monitor held, like output hooks; see uio_deliver().
+ *
+ *  @param      cx      The current context, in a request
+ *  @param      fd      The file descriptor to read
+ *  @param      readLine Whether the hook should return at most one line
+ *  @param      len     The maximum number of characters the hook should return
+ *  @param      rval    [out] The hook's return value
+ */
+static uio_read_e uio_read_js(JSContext *cx, int fd, JSBool readLine, size_t len, jsval *rval)
+{
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  struct gpsee_ioHook   *hook;
+  gpsee_realm_t         *realm;
+  jsval                 hookFn;
+  jsval                 argv[2];
+  uio_read_e            res = uio_read_ok;
 
-  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
+  if (uio_isHooked(grt, fd))
+  {
+    hook = &grt->user_io.hooks[fd];
+    gpsee_enterMonitor(hook->monitor);
+    hookFn = hook->input;
+    realm  = hook->realm;
+    gpsee_leaveMonitor(hook->monitor);
+  }
+  else
+    hookFn = JSVAL_VOID;
 
-  if (grt->user_io.hooks_len <= fd || grt->user_io.hooks[fd].output == JSVAL_VOID)
+  if (hookFn == JSVAL_VOID)
   {
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-    return fgets(buf, len, file);
+    if (gpsee_isatty(fd))
+      uio_flushAll(cx, grt);
+    return uio_read_unhooked;
   }
 
-  realm = grt->user_io.hooks[fd].realm;
+  argv[0] = readLine ? JSVAL_TRUE : JSVAL_FALSE;        /* Read line, or read exactly */
+  argv[1] = INT_TO_JSVAL(len);                          /* Do not exceed len characters */
 
-  if (JS_CallFunctionValue(cx, realm->globalObject, grt->user_io.hooks[fd].input, 0, NULL, &rval) == JS_FALSE)
+  JS_AddNamedRoot(cx, &hookFn, "input hook being called");     /* The hook may be changed by output hooks, or other threads */
+  uio_flushAll(cx, grt);
+
+  if (JS_CallFunctionValue(cx, realm->globalObject, hookFn, 2, argv, rval) == JS_FALSE)
   {
     JS_ReportPendingException(cx);
     JS_ClearPendingException(cx);
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-    return NULL;
+    res = uio_read_threw;
   }
+  JS_RemoveRoot(cx, &hookFn);
 
-  gpsee_leaveAutoMonitor(grt->monitors.user_io);
+  return res;
+}
+
+static char *uio_fgets_hook(char *buf, int len, FILE *file, JSContext *cx)
+{
+  int                   fd = fileno(file);
+  jsval                 rval;
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  size_t                n;
+
+  if (len <= 0)
+    return uio_isHooked(grt, fd) ? NULL : fgets(buf, len, file);
+
+  switch(uio_read_js(cx, fd, JS_TRUE, len - 1, &rval))
+  {
+    case uio_read_unhooked:
+      return fgets(buf, len, file);
+    case uio_read_threw:
+      return NULL;
+    case uio_read_ok:
+      break;
+  }
 
   if (!JSVAL_IS_STRING(rval))
     return NULL;
 
-  memcpy(buf, JS_GetStringBytes(JSVAL_TO_STRING(rval)), min(len - 1, JS_GetStringLength(JSVAL_TO_STRING(rval))));
-  buf[len - 1] = (char)0;
+  n = min((size_t)len - 1, JS_GetStringLength(JSVAL_TO_STRING(rval)));
+  memcpy(buf, JS_GetStringBytes(JSVAL_TO_STRING(rval)), n);
+  buf[n] = (char)0;
 
   return buf;
 }
@@ -328,87 +605,63 @@ static int uio_fgetc_hook(FILE *file, JSContext *cx)
 {
   int                   fd = fileno(file);
   jsval                 rval;
-  jsval                 argv[2];
-  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  gpsee_realm_t         *realm;
-  char                  c;
-
-  argv[0] = JSVAL_FALSE;         /* Read exactly */
-  argv[1] = INT_TO_JSVAL(1);     /* 1 byte */
-
-  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
 
-  if (grt->user_io.hooks_len <= fd || grt->user_io.hooks[fd].output == JSVAL_VOID)
+  switch(uio_read_js(cx, fd, JS_FALSE, 1, &rval))
   {
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-    return fgetc(file);
+    case uio_read_unhooked:
+      return fgetc(file);
+    case uio_read_threw:
+      return -1;
+    case uio_read_ok:
+      break;
   }
 
-  realm = grt->user_io.hooks[fd].realm;
-
-  if (JS_CallFunctionValue(cx, realm->globalObject, grt->user_io.hooks[fd].input, 0, NULL, &rval) == JS_FALSE)
-  {
-    JS_ReportPendingException(cx);
-    JS_ClearPendingException(cx);
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
+  if (!JSVAL_IS_STRING(rval) || JS_GetStringLength(JSVAL_TO_STRING(rval)) == 0)
     return -1;
-  }
 
-  gpsee_leaveAutoMonitor(grt->monitors.user_io);
-
-  if (!JSVAL_IS_STRING(rval))
-    return -1;
-
-  memcpy(&c, JS_GetStringBytes(JSVAL_TO_STRING(rval)), 1);
-
-  return c;
+  return (unsigned char)JS_GetStringBytes(JSVAL_TO_STRING(rval))[0];
 }
 
 static size_t uio_fread_hook(void *buf, size_t size, size_t nitems, FILE *file, JSContext *cx)
 {
   int                   fd = fileno(file);
   jsval                 rval;
-  jsval                 argv[2];
   gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  gpsee_realm_t         *realm;
-
-  argv[0] = JSVAL_FALSE;                         /* Read exactly */
-  argv[1] = INT_TO_JSVAL(size * nitems);         /* size * nitems bytes */
+  size_t                n;
 
-  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
+  if (size == 0 || nitems == 0)
+    return uio_isHooked(grt, fd) ? 0 : fread(buf, size, nitems, file);
 
-  if (grt->user_io.hooks_len <= fd || grt->user_io.hooks[fd].output == JSVAL_VOID)
+  switch(uio_read_js(cx, fd, JS_FALSE, size * nitems, &rval))
   {
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-    return fread(buf, size, nitems, file);
+    case uio_read_unhooked:
+      return fread(buf, size, nitems, file);
+    case uio_read_threw:
+      return 0;
+    case uio_read_ok:
+      break;
   }
 
-  realm = grt->user_io.hooks[fd].realm;
-
-  if (JS_CallFunctionValue(cx, realm->globalObject, grt->user_io.hooks[fd].input, 0, NULL, &rval) == JS_FALSE)
-  {
-    JS_ReportPendingException(cx);
-    JS_ClearPendingException(cx);
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-    return 0;
-  }
-
-  gpsee_leaveAutoMonitor(grt->monitors.user_io);
-
   if (!JSVAL_IS_STRING(rval))
     return 0;
 
-  memcpy(buf, JS_GetStringBytes(JSVAL_TO_STRING(rval)), min(size * nitems, JS_GetStringLength(JSVAL_TO_STRING(rval))));
+  n = min(size * nitems, JS_GetStringLength(JSVAL_TO_STRING(rval)));
+  memcpy(buf, JS_GetStringBytes(JSVAL_TO_STRING(rval)), n);
 
-  return min(size * nitems, JS_GetStringLength(JSVAL_TO_STRING(rval)));
+  return n / size;
 }
 
 /** Initialize the user IO hooks to be as close to the bare
  *  metal as possible, freeing any previously-allocated 
- *  resources as we do so.
+ *  resources as we do so. No other thread may be using the
+ *  hookable I/O facility while this runs.
  */
 void gpsee_resetIOHooks(JSContext *cx, gpsee_runtime_t *grt)
 {
+  size_t        fd;
+
+  uio_flushAll(cx, grt);
+
   gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
 
   grt->user_io.printf   = uio_printf_hook;
@@ -425,9 +678,20 @@ void gpsee_resetIOHooks(JSContext *cx, gpsee_runtime_t *grt)
   grt->user_io.fgetc    = (void *)fgetc;
   grt->user_io.puts     = (void *)puts;
 
-  grt->user_io.hooks_len = 0;
+  for (fd = 0; fd <= UIO_MAX_HOOKED_FD; fd++)
+    uio_setHooked(grt, fd, JS_FALSE);
+
   if (grt->user_io.hooks)
+  {
+    for (fd = 0; fd < grt->user_io.hooks_len; fd++)
+    {
+      if (grt->user_io.hooks[fd].outBuf)
+        free(grt->user_io.hooks[fd].outBuf);
+      gpsee_destroyMonitor(grt, grt->user_io.hooks[fd].monitor);
+    }
     JS_free(cx, grt->user_io.hooks);
+  }
+  grt->user_io.hooks_len = 0;
   grt->user_io.hooks = NULL;
 
   gpsee_leaveAutoMonitor(grt->monitors.user_io);
@@ -445,38 +709,71 @@ JSBool gpsee_initIOHooks(JSContext *cx, gpsee_runtime_t *grt)
   return JS_TRUE;
 }
 
-static JSBool hookFileDescriptor(JSContext *cx, int fd, jsval ihook, jsval ohook)
+/** Install JavaScript I/O hooks for a file descriptor.  Output written to a hooked descriptor 
+ *  through the hookable I/O vtable is passed to ohook as a string; stdout is line buffered and
+ *  stderr is unbuffered, as for stdio, until changed with gpsee_setIOHookBuffering().
+ *
+ *  Each hooked descriptor has its own monitor, so that threads writing to different descriptors
+ *  do not contend. The monitor is not held while the hooks run, so a hook may write to another 
+ *  hooked descriptor, even while another thread's hook for that descriptor writes to this one.
+ *  Output buffered before this call is delivered to the old output hook, unless another thread 
+ *  is delivering it at the time.
+ *
+ *  @param      cx      The current context; hooks are called in its realm
+ *  @param      fd      stdin, stdout or stderr
+ *  @param      ihook   Function to collect input, or JSVAL_VOID
+ *  @param      ohook   Function to collect output, or JSVAL_VOID
+ *
+ *  @returns    JS_TRUE on success, or JS_FALSE with an exception pending
+ */
+JSBool gpsee_hookFileDescriptor(JSContext *cx, int fd, jsval ihook, jsval ohook)
 {
-  gpsee_runtime_t *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  struct gpsee_ioHook   *hook;
+
+  if (fd < 0 || fd > UIO_MAX_HOOKED_FD)
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".user_io.hookFileDescriptor.fd: only stdin, stdout and stderr may be hooked");
 
   gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
 
-  if (grt->user_io.hooks_len <= min(fd, STDERR_FILENO))
+  if (grt->user_io.hooks == NULL)    /* Allocated once, at full size, so that lock-free readers never see it move */
   {
-    void *old = grt->user_io.hooks;
-
-    grt->user_io.hooks_len = 1 + min(fd, STDERR_FILENO);
-    grt->user_io.hooks = JS_realloc(cx, grt->user_io.hooks, sizeof(grt->user_io.hooks[0]) * grt->user_io.hooks_len);
+    size_t      ifd;
 
+    grt->user_io.hooks = JS_malloc(cx, sizeof(grt->user_io.hooks[0]) * (UIO_MAX_HOOKED_FD + 1));
     if (grt->user_io.hooks == NULL)
     {
-      grt->user_io.hooks = old;
       gpsee_leaveAutoMonitor(grt->monitors.user_io);
       return JS_FALSE;
     }
 
-    if (old == NULL)    /* first-time allocation: init 3 fds before populating one */
+    memset(grt->user_io.hooks, 0, sizeof(grt->user_io.hooks[0]) * (UIO_MAX_HOOKED_FD + 1));
+    for (ifd = 0; ifd <= UIO_MAX_HOOKED_FD; ifd++)
     {
-      size_t ifd;
-
-      for (ifd = 0; ifd < grt->user_io.hooks_len; ifd++)
-        grt->user_io.hooks[ifd].input = grt->user_io.hooks[ifd].output = JSVAL_VOID;
+      grt->user_io.hooks[ifd].input = grt->user_io.hooks[ifd].output = JSVAL_VOID;
+      grt->user_io.hooks[ifd].monitor = gpsee_createMonitor(grt, "user_io hook");
     }
+    grt->user_io.hooks_len = UIO_MAX_HOOKED_FD + 1;
   }
 
-  grt->user_io.hooks[fd].input = ihook;
-  grt->user_io.hooks[fd].output = ohook;
-  grt->user_io.hooks[fd].realm = gpsee_getRealm(cx);
+  hook = &grt->user_io.hooks[fd];
+  gpsee_leaveAutoMonitor(grt->monitors.user_io);       /* Lock order: hook monitor, then user_io */
+
+  gpsee_enterMonitor(hook->monitor);
+
+  if (hook->outSize == 0)       /* new, or released by its realm */
+  {
+    hook->outMode = (fd == STDERR_FILENO) ? _IONBF : _IOLBF;
+    hook->outSize = UIO_DEFAULT_BUFFER_SIZE;
+  }
+
+  uio_flush(cx, hook);          /* Output written before now belongs to the old hook */
+
+  hook->input = ihook;
+  hook->output = ohook;
+  hook->realm = gpsee_getRealm(cx);
+
+  gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
 
   grt->user_io.printf   = uio_printf_hook;
   grt->user_io.fprintf  = uio_fprintf_hook;
@@ -489,9 +786,51 @@ static JSBool hookFileDescriptor(JSContext *cx, int fd, jsval ihook, jsval ohook
   grt->user_io.fgetc    = uio_fgetc_hook;
   grt->user_io.puts     = uio_puts_hook;
 
+  uio_setHooked(grt, fd, (ihook != JSVAL_VOID || ohook != JSVAL_VOID) ? JS_TRUE : JS_FALSE);
+
   gpsee_leaveAutoMonitor(grt->monitors.user_io);
+  gpsee_leaveMonitor(hook->monitor);
+
   return JS_TRUE;
 }
 
+/** Select the output buffering policy for a hooked file descriptor. Buffered output is
+ *  delivered when the buffer fills, when a newline is written (_IOLBF), before input is
+ *  read from any hooked descriptor or from a terminal, and on gpsee_flushIOHook().
+ *
+ *  @param      cx      The current context
+ *  @param      fd      A file descriptor previously passed to gpsee_hookFileDescriptor()
+ *  @param      mode    _IONBF, _IOLBF or _IOFBF, as for setvbuf()
+ *  @param      size    Buffer size in bytes, or 0 for the default
+ *
+ *  @returns    JS_TRUE on success, or JS_FALSE with an exception pending
+ */
+JSBool gpsee_setIOHookBuffering(JSContext *cx, int fd, int mode, size_t size)
+{
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  struct gpsee_ioHook   *hook;
+
+  if (mode != _IONBF && mode != _IOLBF && mode != _IOFBF)
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".user_io.setBuffering.mode: invalid buffering mode %i", mode);
+
+  if (!uio_isHooked(grt, fd))
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".user_io.setBuffering.fd: file descriptor %i is not hooked", fd);
 
+  hook = &grt->user_io.hooks[fd];
+  gpsee_enterMonitor(hook->monitor);
 
+  uio_flush(cx, hook);
+
+  if (hook->outLen == 0)        /* else delivery is deferred; keep the buffer */
+  {
+    if (hook->outBuf)
+      free(hook->outBuf);
+    hook->outBuf = NULL;
+    hook->outAlloc = 0;
+  }
+  hook->outMode = mode;
+  hook->outSize = size ? size : UIO_DEFAULT_BUFFER_SIZE;
+
+  gpsee_leaveMonitor(hook->monitor);
+  return JS_TRUE;
+}
@@ -291,6 +291,7 @@ struct moduleHandle
 
   moduleHandle_flags_t	flags;		/**< Special attributes of module; bit-field */
   int			released;
+  PRThread		*loader;	/**< Thread loading and initializing the module, or NULL once it is done */
   moduleHandle_t	*next;		/**< Used when treating as a linked list node, i.e. during DSO unload */
   SPLAY_ENTRY(moduleHandle)	entry;	/**< Tree data */
 };
@@ -306,70 +307,254 @@ SPLAY_PROTOTYPE(moduleMemo, moduleHandle, entry, moduleCName_strcmp)
 SPLAY_GENERATE(moduleMemo, moduleHandle, entry, moduleCName_strcmp)
 
 /**
- *  requireLock / requireUnlock form a simple re-entrant lockless "mutex", optimized for 
- *  the case where there are no collisions. These locks are per-runtime.
+ *  Module loading is latched per module rather than serialized across the runtime, so that
+ *  threads requiring different modules can compile and run them at the same time.
+ *
+ *  The first thread to claim a module (claimModule()) becomes its loader: it alone runs the
+ *  module's loaders and initializer, then calls finishModuleLoad(), or releaseModuleHandle()
+ *  if the load failed. Other threads which want the module wait for the loader, outside
+ *  their JS requests so that the loader can still GC. A thread which requires a module that
+ *  it is itself loading gets the partly-initialized exports, as CommonJS has it for circular
+ *  requires. When waiting would close a cycle across threads (the loader is waiting, perhaps
+ *  via other loaders, on a module this thread is loading), the require is treated the same 
+ *  way instead of deadlocking.
+ *
+ *  realm->moduleLoad.lock guards the module memo tree, which splays even on lookup, the 
+ *  unreachable module list, each module's loader and released members, and the waiters list.
+ *  It is only ever held around short stretches of C, never across a JSAPI call that could 
+ *  wait on the GC; the GC itself may take it, since no other thread can be inside a request
+ *  and holding it then.
+ */
+#if defined(JS_THREADSAFE)
+# define modulesLock(realm)	PR_Lock((realm)->moduleLoad.lock)
+# define modulesUnlock(realm)	PR_Unlock((realm)->moduleLoad.lock)
+#else
+# define modulesLock(realm)	do { ; } while(0)
+# define modulesUnlock(realm)	do { ; } while(0)
+#endif
+
+/** Outcome of claimModule() */
+typedef enum
+{
+  mc_load,		/**< This thread is now the module's loader */
+  mc_ready,		/**< Use the module's exports: it is loaded, or this require closes a cycle */
+  mc_retry		/**< The module failed to load in another thread and was released; look it up again */
+} moduleClaim_t;
+
+#if defined(JS_THREADSAFE)
+/** A thread waiting for another thread to load a module. Lives on the waiting thread's stack. 
+ *  Completes forward declaration in gpsee.h
+ */
+struct moduleLoadWaiter
+{
+  PRThread			*thread;	/**< Waiting thread */
+  moduleHandle_t		*module;	/**< Module it is waiting for */
+  struct moduleLoadWaiter	*next;		/**< Next waiter in realm->moduleLoad.waiters */
+};
+
+/** Decide whether waiting for module would deadlock: that is, whether its loader is waiting,
+ *  directly or through a chain of other loaders, for a module this thread is loading. Since
+ *  every waiter checks this before it waits, the chain cannot loop without reaching us.
+ *  Caller holds realm->moduleLoad.lock.
+ */
+static JSBool isModuleLoadCycle(gpsee_realm_t *realm, moduleHandle_t *module, PRThread *self)
+{
+  struct moduleLoadWaiter	*waiter;
+  PRThread			*loader;
+
+  for (loader = module->loader; loader; loader = waiter->module->loader)
+  {
+    if (loader == self)
+      return JS_TRUE;
+
+    for (waiter = realm->moduleLoad.waiters; waiter && waiter->thread != loader; waiter = waiter->next);
+    if (!waiter)
+      break;
+  }
+
+  return JS_FALSE;
+}
+
+/** Decide whether any thread is waiting on module, and so still holds a pointer to it. 
+ *  Caller holds realm->moduleLoad.lock.
+ */
+static JSBool isModuleAwaited(gpsee_realm_t *realm, moduleHandle_t *module)
+{
+  struct moduleLoadWaiter	*waiter;
+
+  for (waiter = realm->moduleLoad.waiters; waiter; waiter = waiter->next)
+    if (waiter->module == module)
+      return JS_TRUE;
+
+  return JS_FALSE;
+}
+#else
+# define isModuleAwaited(realm, module) JS_FALSE
+#endif
+
+/** Claim a module for loading, or wait until whichever thread is loading it has finished.
  *
- *  The requireLockThread holds the thread ID of the thread currrently holding this lock, or
- *  JSVAL_NULL (which is an invalid value for PRThread).  
+ *  @param	cx	Current JS context; its request is suspended while we wait
+ *  @param	realm	Realm the module belongs to
+ *  @param	module	Module handle from acquireModuleHandle()
  *
- *  requireLockThread is only read/written via CAS operations, forcing a full memory barrier 
- *  at the start of a locking operation. requireLockDepth may only be read or written by a 
- *  thread which holds the lock.  When the lock is released, the cas memory barrier insures 
- *  that the next lock-holder gets an initial depth of zero.
+ *  @returns	mc_load when the caller must load the module; mc_ready when the module's exports
+ *		may be returned as-is; mc_retry when the handle is dead and must be acquired again.
  */
-static void requireLock(JSContext *cx)
+static moduleClaim_t claimModule(JSContext *cx, gpsee_realm_t *realm, moduleHandle_t *module)
 {
-  dpDepth(+1);
+  PRThread			*self = PR_GetCurrentThread();
+  moduleClaim_t			claim;
 #if defined(JS_THREADSAFE)
-  gpsee_runtime_t 	*grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  PRThread		*thisThread = PR_GetCurrentThread();
-
-  if (jsval_CompareAndSwap((jsval *)&grt->requireLockThread, (jsval)thisThread, (jsval)thisThread) == JS_TRUE)  /* membar */
-    goto haveLock;
+  struct moduleLoadWaiter	waiter, **waiter_p;
+  jsrefcount			depth;
+#endif
 
-  do
+  modulesLock(realm);
+  while (1)
   {
-    jsrefcount depth;
+    if (module->released)
+    {
+      claim = mc_retry;
+      break;
+    }
 
-    if (jsval_CompareAndSwap((jsval *)&grt->requireLockThread, JSVAL_NULL, (jsval)thisThread) == JS_TRUE)
-      goto haveLock;
+    if (!module->loader)
+    {
+      if (module->flags & mhf_loaded)
+	claim = mc_ready;
+      else
+      {
+	module->loader = self;
+	claim = mc_load;
+      }
+      break;
+    }
+
+#if defined(JS_THREADSAFE)
+    if (module->loader == self || isModuleLoadCycle(realm, module, self))
+    {
+      claim = mc_ready;
+      break;
+    }
 
+    waiter.thread = self;
+    waiter.module = module;
+    waiter.next   = realm->moduleLoad.waiters;
+    realm->moduleLoad.waiters = &waiter;
+
+    /* Resuming the request can wait on a GC, which in turn waits on any thread blocked on the lock */
     depth = JS_SuspendRequest(cx);
-    PR_Sleep(PR_INTERVAL_NO_WAIT);
+    PR_WaitCondVar(realm->moduleLoad.loaded, PR_INTERVAL_NO_TIMEOUT);
+    modulesUnlock(realm);
     JS_ResumeRequest(cx, depth);
-  } while(1);
+    modulesLock(realm);
 
-  haveLock:
-  grt->requireLockDepth++;
+    for (waiter_p = &realm->moduleLoad.waiters; *waiter_p != &waiter; waiter_p = &(*waiter_p)->next);
+    *waiter_p = waiter.next;
+#else
+    GPSEE_ASSERT(module->loader == self);
+    claim = mc_ready;
+    break;
 #endif
-  return;
+  }
+  modulesUnlock(realm);
+
+  return claim;
 }
 
+/** Mark a module claimed with claimModule() as loaded, and wake any threads waiting for it. */
+static void finishModuleLoad(gpsee_realm_t *realm, moduleHandle_t *module)
+{
+  modulesLock(realm);
+  GPSEE_ASSERT(module->loader == PR_GetCurrentThread());
+  module->loader = NULL;
+#if defined(JS_THREADSAFE)
+  PR_NotifyAllCondVar(realm->moduleLoad.loaded);
+#endif
+  modulesUnlock(realm);
+}
+
+#if defined(JS_THREADSAFE)
 /**
- *  @see requireLock()
+ *  The per-realm latch above stops two threads initializing the same module in one realm, but
+ *  each realm initializes its own copy of a native module, and native initializers keep class
+ *  prototypes and the like in process-wide statics. nativeInit serializes the initializers of
+ *  each native module, by cname, across every realm and runtime in the process; initializers of
+ *  different modules still run at the same time.
  */
-static void requireUnlock(JSContext *cx)
+struct nativeInitLatch
 {
-#if defined(JS_THREADSAFE)
-  gpsee_runtime_t 	*grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  PRThread		*thisThread = PR_GetCurrentThread();
+  const char			*cname;		/**< Module being initialized */
+  PRThread			*thread;	/**< Thread running its initializer */
+  struct nativeInitLatch	*next;		/**< Next entry in nativeInit.running */
+};
 
-  GPSEE_ASSERT(grt->requireLockDepth);
-  GPSEE_ASSERT(grt->requireLockThread == thisThread);
+static struct
+{
+  PRCallOnceType		once;
+  PRLock			*lock;		/**< Guards running */
+  PRCondVar			*done;		/**< Broadcast whenever an initializer returns */
+  struct nativeInitLatch	*running;	/**< Native initializers running now; entries live on their threads' stacks */
+} nativeInit;
 
-  grt->requireLockDepth--;
-  if (grt->requireLockDepth == 0)
+static PRStatus nativeInit_create(void)
+{
+  nativeInit.lock = PR_NewLock();
+  if (nativeInit.lock)
+    nativeInit.done = PR_NewCondVar(nativeInit.lock);
+
+  return PR_SUCCESS;
+}
+
+/** Wait until no other thread is running the native initializer for cname, then record that
+ *  this thread is. Must be paired with nativeInitEnd(). A thread which is already running
+ *  cname's initializer, in another realm, proceeds at once.
+ */
+static void nativeInitBegin(JSContext *cx, struct nativeInitLatch *latch, const char *cname)
+{
+  PRThread		*self = PR_GetCurrentThread();
+  struct nativeInitLatch	*l;
+  jsrefcount		depth;
+
+  if (PR_CallOnce(&nativeInit.once, nativeInit_create) != PR_SUCCESS || !nativeInit.done)
+    panic(GPSEE_GLOBAL_NAMESPACE_NAME ".modules.nativeInit: Out of memory");
+
+  PR_Lock(nativeInit.lock);
+  for (;;)
   {
-    if (jsval_CompareAndSwap((jsval *)&grt->requireLockThread, (jsval)thisThread, JSVAL_NULL) != JS_TRUE) /* membar */
-    {
-      GPSEE_NOT_REACHED("bug in require-locking code");
-    }
- }
-#endif
-  dpDepth(-1);
-  return;
+    for (l = nativeInit.running; l && strcmp(l->cname, cname) != 0; l = l->next);
+    if (!l || l->thread == self)
+      break;
+
+    /* As in claimModule(), do not resume the request while holding the lock */
+    depth = JS_SuspendRequest(cx);
+    PR_WaitCondVar(nativeInit.done, PR_INTERVAL_NO_TIMEOUT);
+    PR_Unlock(nativeInit.lock);
+    JS_ResumeRequest(cx, depth);
+    PR_Lock(nativeInit.lock);
+  }
+
+  latch->cname	= cname;
+  latch->thread	= self;
+  latch->next	= nativeInit.running;
+  nativeInit.running = latch;
+  PR_Unlock(nativeInit.lock);
 }
 
+/** Note that a native initializer started with nativeInitBegin() has returned */
+static void nativeInitEnd(struct nativeInitLatch *latch)
+{
+  struct nativeInitLatch	**l_p;
+
+  PR_Lock(nativeInit.lock);
+  for (l_p = &nativeInit.running; *l_p != latch; l_p = &(*l_p)->next);
+  *l_p = latch->next;
+  PR_NotifyAllCondVar(nativeInit.done);
+  PR_Unlock(nativeInit.lock);
+}
+#endif
+
 /**
  *  Create a new module object (exports)
  *
@@ -594,6 +779,7 @@ static JSObject *newModuleScope(JSContext *cx, gpsee_realm_t *realm, moduleHandl
   return NULL;
 }
 
+/** Look up a module in the realm's memo. Caller holds realm->moduleLoad.lock. */
 static moduleHandle_t *findModuleHandle(gpsee_realm_t *realm, const char *cname)
 {
   moduleHandle_t tmp;
@@ -621,7 +807,7 @@ static moduleHandle_t *findModuleHandle(gpsee_realm_t *realm, const char *cname)
  */
 static moduleHandle_t *acquireModuleHandle(JSContext *cx, gpsee_realm_t *realm, const char *cname, JSObject *moduleScope)
 {
-  moduleHandle_t	*module = NULL;
+  moduleHandle_t	*module = NULL, *existing;
 
   GPSEE_ASSERT(cname != NULL);
 
@@ -631,7 +817,9 @@ static moduleHandle_t *acquireModuleHandle(JSContext *cx, gpsee_realm_t *realm,
   if (!realm)
     goto fail;
 
+  modulesLock(realm);
   module = findModuleHandle(realm, cname);
+  modulesUnlock(realm);
   if (module)
   {
     dprintf("Returning used module handle at %p with scope %p and exports %p\n", module, module->scope, module->exports);
@@ -667,7 +855,28 @@ static moduleHandle_t *acquireModuleHandle(JSContext *cx, gpsee_realm_t *realm,
     GPSEE_ASSERT(module->scope);
   }
   
-  SPLAY_INSERT(moduleMemo, realm->modules, module);	/* module->scope becomes a root here */
+  /* Another thread may have memoized the same module while we built this handle */
+  modulesLock(realm);
+  existing = findModuleHandle(realm, cname);
+  if (!existing)
+    SPLAY_INSERT(moduleMemo, realm->modules, module);	/* module->scope becomes a root here */
+  else if (moduleScope)
+  {
+    /* No scope of ours will ever finalize this handle, so drop it now */
+    module->released = 1;
+    module->next = realm->unreachableModule_llist;
+    realm->unreachableModule_llist = module;
+  }
+  modulesUnlock(realm);
+
+  if (existing)
+  {
+    dprintf("Lost race to memoize %s; using module handle at %p\n", cname, existing);
+    markModuleUnused(cx, realm, module);	/* Our new scope's finalizer releases our handle */
+    module = existing;
+    goto success;
+  }
+
   dprintf("Memoized module at %p with scope %p\n", module, module->scope);
 
   success:
@@ -776,12 +985,25 @@ static void releaseModuleHandle(JSContext *cx, gpsee_realm_t *realm, moduleHandl
 {
   dprintf("Releasing module at 0x%p\n", module);
 
+  modulesLock(realm);
   if (module->released)
+  {
+    modulesUnlock(realm);
     return;
-  else
-    module->released = 1;
+  }
+  module->released = 1;
+
+  /* A handle which lost a memoization race was never in the tree, but another with its cname is */
+  if (findModuleHandle(realm, module->cname) == module)
+    SPLAY_REMOVE(moduleMemo, realm->modules, module);
+
+  /* Threads waiting for a load which has failed will look the module up again */
+  module->loader = NULL;
+#if defined(JS_THREADSAFE)
+  PR_NotifyAllCondVar(realm->moduleLoad.loaded);
+#endif
+  modulesUnlock(realm);
 
-  SPLAY_REMOVE(moduleMemo, realm->modules, module);
   markModuleUnused(cx, realm, module);
 
   /* Actually release OS resources after everything on JS
@@ -789,8 +1011,10 @@ static void releaseModuleHandle(JSContext *cx, gpsee_realm_t *realm, moduleHandl
    * for DSO modules, as dlclosing() before JS object finalizer
    * has read clasp is disastrous 
    */
+  modulesLock(realm);
   module->next = realm->unreachableModule_llist;
   realm->unreachableModule_llist = module;
+  modulesUnlock(realm);
 }
 
 /**
@@ -1132,6 +1356,7 @@ static JSBool loadDiskModule_inDir(gpsee_realm_t *realm, JSContext *cx, const ch
       JSBool success;
       char   cnBuf[PATH_MAX];
       char   *s;
+      moduleClaim_t claim;
 
       if (!module)
       {
@@ -1150,10 +1375,15 @@ static JSBool loadDiskModule_inDir(gpsee_realm_t *realm, JSContext *cx, const ch
           if (strcmp(s + 1, *ext_p) == 0)
             *s = (char)0;
 
-        module = acquireModuleHandle(cx, realm, cnBuf, NULL);
-        if (!module)
-          return JS_FALSE;
-        if (module->flags & mhf_loaded)	/* Saw this module previously but cache missed: different relative name? */
+        do
+        {
+          module = acquireModuleHandle(cx, realm, cnBuf, NULL);
+          if (!module)
+            return JS_FALSE;
+          claim = claimModule(cx, realm, module);
+        } while (claim == mc_retry);
+
+        if (claim == mc_ready)	/* Loaded, being loaded in a cycle with us, or saw it previously under a different relative name */
           break;
       }
 
@@ -1239,7 +1469,7 @@ static JSBool loadDiskModule(JSContext *cx, moduleHandle_t *parentModule,  const
        * embedding can set the realm's programModuleDir: that can be used instead.
        * In the case of pre-load code loading relative modules, we simply use ".".
        */
-      gpsee_enterAutoMonitor(cx, &realm->monitors.programModuleDir);
+      gpsee_enterAutoMonitorShared(cx, &realm->monitors.programModuleDir);
       if (realm->monitored.programModuleDir)
       {
         gpsee_cpystrn(pmBuf, realm->monitored.programModuleDir, sizeof(pmBuf));
@@ -1322,6 +1552,7 @@ static JSBool loadInternalModule(JSContext *cx, const char *moduleName, moduleHa
   unsigned int 		i;
   moduleHandle_t	*module;
   gpsee_realm_t         *realm = gpsee_getRealm(cx);
+  moduleClaim_t		claim;
 
   *module_p = NULL;
 
@@ -1335,8 +1566,15 @@ static JSBool loadInternalModule(JSContext *cx, const char *moduleName, moduleHa
   if (i == (sizeof internalModules/sizeof internalModules[0]))
     return JS_TRUE;	/* internal module not found */
 
-  module = acquireModuleHandle(cx, realm, moduleName, NULL);
-  if (module->flags & mhf_loaded)
+  do
+  {
+    module = acquireModuleHandle(cx, realm, moduleName, NULL);
+    if (!module)
+      return JS_FALSE;
+    claim = claimModule(cx, realm, module);
+  } while (claim == mc_retry);
+
+  if (claim == mc_ready)
   {
     dprintf("no reload internal singleton %s\n", moduleShortName(moduleName));
     *module_p = module;
@@ -1374,8 +1612,15 @@ static JSBool initializeModule(JSContext *cx, moduleHandle_t *module)
   if (module->init)
   {
     const char *id;
+#if defined(JS_THREADSAFE)
+    struct nativeInitLatch latch;
 
+    nativeInitBegin(cx, &latch, module->cname);
+    id = module->init(cx, module->exports);
+    nativeInitEnd(&latch);
+#else
     id = module->init(cx, module->exports);
+#endif
 
     dprintf("Initialized native module with internal id = %s\n", id);
   }
@@ -1410,24 +1655,23 @@ static JSBool initializeModule(JSContext *cx, moduleHandle_t *module)
   return JS_TRUE;
 }
 
-/** Implements the CommonJS require() function, allowing JS inclusive-or native module types.
- *  First argument is the module name.
+/** Find, load and initialize a module on behalf of require().
+ *
+ *  @param      cx              Current JS context
+ *  @param      require_fn      The require() function which was called
+ *  @param      moduleName      Name of the module (argument to require)
+ *  @param      rval            [out] The module's exports object
+ *
+ *  @returns JS_TRUE on success, JS_FALSE if an exception was thrown
  */
-JSBool gpsee_loadModule(JSContext *cx, JSObject *thisObject, uintN argc, jsval *argv, jsval *rval)
+static JSBool requireModule(JSContext *cx, JSObject *require_fn, const char *moduleName, jsval *rval)
 {
-  const char		*moduleName;
   moduleHandle_t	*module;
   moduleHandle_t        *parentModule;
   jsval			v;
-  JSObject		*require_fn = JSVAL_TO_OBJECT(argv[-2]);
   gpsee_realm_t         *realm = gpsee_getRealm(cx);
-
-  if (argc != 1)
-    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".loadModule.argument.count");
-
-  moduleName = JS_GetStringBytes(JS_ValueToString(cx, argv[0]) ?: JS_InternString(cx, ""));
-  if (!moduleName || !moduleName[0])
-    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".loadModule.invalidName: Module name must be at least one character long");
+  JSBool                b;
+  JSBool                mustInitialize;
 
   dprintf("loading module %s\n", moduleShortName(moduleName));
 
@@ -1435,30 +1679,26 @@ JSBool gpsee_loadModule(JSContext *cx, JSObject *thisObject, uintN argc, jsval *
     return JS_FALSE;
   parentModule = JSVAL_TO_PRIVATE(v);
 
-  requireLock(cx);
-
   if (loadInternalModule(cx, moduleName, &module) == JS_FALSE)
-  {
-    requireUnlock(cx);
     return JS_FALSE;
-  }
 
   if (!module)
   {
     if (loadDiskModule(cx, parentModule, moduleName, &module) == JS_FALSE)
-    {
-      requireUnlock(cx);
       return JS_FALSE;
-    }
 
     GPSEE_ASSERT(module);
   }
 
-  if (module->flags & mhf_loaded)
+  /* We initialize the module if we claimed it; otherwise it is loaded, or we are in a require cycle */
+  mustInitialize = (module->loader == PR_GetCurrentThread() && !(module->flags & mhf_loaded)) ? JS_TRUE : JS_FALSE;
+
+  gpsee_profileRequireResolved(cx, module->cname, mustInitialize ? JS_FALSE : JS_TRUE);
+
+  if (!mustInitialize)
   {
     /* modules are singletons */
     dprintf("no reload singleton %s\n", moduleShortName(moduleName));
-    requireUnlock(cx);
     *rval = OBJECT_TO_JSVAL(module->exports);
     return JS_TRUE;
   }
@@ -1468,7 +1708,6 @@ JSBool gpsee_loadModule(JSContext *cx, JSObject *thisObject, uintN argc, jsval *
   if (!module->init && !module->script)
   {
     releaseModuleHandle(cx, realm, module);
-    requireUnlock(cx);
 
     if (module->DSOHnd)
       return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".loadModule.init.notFound: "
@@ -1481,21 +1720,47 @@ JSBool gpsee_loadModule(JSContext *cx, JSObject *thisObject, uintN argc, jsval *
   dprintf("Initializing module at 0x%p\n", module);
   dpDepth(+1);
 
-  if (initializeModule(cx, module) == JS_FALSE)
+  gpsee_profileRequireExec(cx, JS_TRUE);
+  b = initializeModule(cx, module);
+  gpsee_profileRequireExec(cx, JS_FALSE);
+
+  if (b == JS_FALSE)
   {
     releaseModuleHandle(cx, realm, module);
-    requireUnlock(cx);
     dpDepth(-1);
     return JS_FALSE;
   }
 
-  requireUnlock(cx);
+  finishModuleLoad(realm, module);
   *rval = OBJECT_TO_JSVAL(module->exports);
 
   dpDepth(-1);
   return JS_TRUE;
 }
 
+/** Implements the CommonJS require() function, allowing JS inclusive-or native module types.
+ *  First argument is the module name.
+ */
+JSBool gpsee_loadModule(JSContext *cx, JSObject *thisObject, uintN argc, jsval *argv, jsval *rval)
+{
+  const char		*moduleName;
+  JSObject		*require_fn = JSVAL_TO_OBJECT(argv[-2]);
+  JSBool                b;
+
+  if (argc != 1)
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".loadModule.argument.count");
+
+  moduleName = JS_GetStringBytes(JS_ValueToString(cx, argv[0]) ?: JS_InternString(cx, ""));
+  if (!moduleName || !moduleName[0])
+    return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".loadModule.invalidName: Module name must be at least one character long");
+
+  gpsee_profileRequireBegin(cx, moduleName);
+  b = requireModule(cx, require_fn, moduleName, rval);
+  gpsee_profileRequireEnd(cx, b);
+
+  return b;
+}
+
 #define RUNPROERR GPSEE_GLOBAL_NAMESPACE_NAME ".runProgramModule: error running %s: "
 /** Run a program as if it were a module. Interface differs from gpsee_loadModule()
  *  to reflect things like that the source of the program module may be stdin rather
@@ -1702,13 +1967,33 @@ JSBool gpsee_runProgramModule(JSContext *cx, const char *scriptFilename, const c
  */
 static JSBool moduleGCCallback(JSContext *cx, gpsee_realm_t *realm, JSGCStatus status)
 {
-  moduleHandle_t	*module;
+  moduleHandle_t	*module, **module_p, *doomed = NULL;
 
-  /* Finalize all modules on the unreachable list now that main GC has finished */
+  /* Finalize all modules on the unreachable list now that main GC has finished, except 
+   * those which a thread waiting in claimModule() will still look at. The handles are
+   * unlinked under the lock but destroyed after releasing it: dlclose() runs DSO
+   * destructors and takes the dynamic linker's lock, neither of which should nest
+   * inside ours.
+   */
   if (status == JSGC_FINALIZE_END)
   {
-    while (realm->unreachableModule_llist)
-      realm->unreachableModule_llist = destroyModuleHandle(cx, realm->unreachableModule_llist);
+    modulesLock(realm);
+    for (module_p = &realm->unreachableModule_llist; *module_p;)
+    {
+      module = *module_p;
+      if (isModuleAwaited(realm, module))
+	module_p = &module->next;
+      else
+      {
+	*module_p = module->next;
+	module->next = doomed;
+	doomed = module;
+      }
+    }
+    modulesUnlock(realm);
+
+    while (doomed)
+      doomed = destroyModuleHandle(cx, doomed);
   }
 
   if (status != JSGC_MARK_END)
@@ -1717,6 +2002,7 @@ static JSBool moduleGCCallback(JSContext *cx, gpsee_realm_t *realm, JSGCStatus s
   dprintf("Adding roots from GC Callback\n");
   dpDepth(+1);
 
+  modulesLock(realm);	/* Lookups splay the tree, and a thread outside its request may yet do one */
   SPLAY_FOREACH(module, moduleMemo, realm->modules)
   {
     dprintf("GC Callback considering module %s at %p\n", moduleShortName(module->cname), module);
@@ -1745,6 +2031,7 @@ static JSBool moduleGCCallback(JSContext *cx, gpsee_realm_t *realm, JSGCStatus s
       JS_MarkGCThing(cx, module->scrobj, module->cname, NULL);
     }
   }
+  modulesUnlock(realm);
 
   dpDepth(-1);
   return JS_TRUE;
@@ -1798,6 +2085,15 @@ JSBool gpsee_initializeModuleSystem(JSContext *cx, gpsee_realm_t *realm)
   realm->modules = malloc(sizeof *realm->modules);
   SPLAY_INIT(realm->modules);
 
+#if defined(JS_THREADSAFE)
+  realm->moduleLoad.lock = PR_NewLock();
+  if (!realm->moduleLoad.lock || !(realm->moduleLoad.loaded = PR_NewCondVar(realm->moduleLoad.lock)))
+  {
+    JS_ReportOutOfMemory(cx);
+    goto fail;
+  }
+#endif
+
   /* Populate the GPSEE module path */
   realm->modulePath->dir = JS_strdup(cx, libexecDir());
   if (envpath)
@@ -1833,6 +2129,15 @@ JSBool gpsee_initializeModuleSystem(JSContext *cx, gpsee_realm_t *realm)
   if (realm->moduleData)
     gpsee_ds_destroy(realm->moduleData);
 
+#if defined(JS_THREADSAFE)
+  if (realm->moduleLoad.loaded)
+    PR_DestroyCondVar(realm->moduleLoad.loaded);
+  if (realm->moduleLoad.lock)
+    PR_DestroyLock(realm->moduleLoad.lock);
+  realm->moduleLoad.loaded = NULL;
+  realm->moduleLoad.lock = NULL;
+#endif
+
   dpDepth(-1);
   return JS_FALSE;
 }
@@ -1854,6 +2159,8 @@ void gpsee_shutdownModuleSystem(JSContext *cx, gpsee_realm_t *realm)
   dprintf("Shutting down module system\n");
   dpDepth(+1);
 
+  gpsee_dumpRequireProfile(cx, realm);
+
   /* Clean up module paths */
   if (realm->userModulePath)
   {
@@ -2022,6 +2329,12 @@ void gpsee_moduleSystemCleanup(JSContext *cx, gpsee_realm_t *realm)
   memset(realm->modules, 0xbe, sizeof(*realm->modules));
 #endif
   free(realm->modules);
+
+#if defined(JS_THREADSAFE)
+  GPSEE_ASSERT(!realm->moduleLoad.waiters);
+  PR_DestroyCondVar(realm->moduleLoad.loaded);
+  PR_DestroyLock(realm->moduleLoad.lock);
+#endif
 }
 
 const char *gpsee_getModuleCName(moduleHandle_t *module)
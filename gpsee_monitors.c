@@ -39,17 +39,396 @@
  *                                      their containing pointer is NULL) and
  *                                      cleaned up automatically when the 
  *                                      monitor system is shut down.
+ *
+ *                                      Monitors are reader/writer locks. 
+ *                                      gpsee_enterMonitor() takes one exclusively
+ *                                      and may be nested, like a PRMonitor;
+ *                                      gpsee_enterMonitorShared() lets any number
+ *                                      of readers in at once, for read-mostly state.
+ *                                      A thread which holds a monitor exclusively
+ *                                      may also enter it shared; that counts as
+ *                                      another nested exclusive entry. Shared 
+ *                                      entries must not nest, and a shared entry
+ *                                      cannot be upgraded: once a writer is waiting,
+ *                                      new readers wait behind it.
+ *
+ *                                      Entering is a compare-and-swap on the state
+ *                                      word when the monitor is free. Otherwise we
+ *                                      spin for a while, then sleep on a condition
+ *                                      variable. Each monitor adapts how long it
+ *                                      spins to how long it has recently taken to
+ *                                      become free, as glibc's adaptive mutexes do.
+ *                                      Spinning is disabled on uniprocessors.
+ *
+ *                                      Setting the gpsee_monitor_stats RC variable
+ *                                      (or GPSEE_MONITOR_STATS in the environment)
+ *                                      records, per monitor, how often it was 
+ *                                      entered, how often that had to wait, a 
+ *                                      histogram of how long, and the longest time
+ *                                      it was held. Monitors are named when they are
+ *                                      created so that the figures can be told apart.
+ *                                      Each monitor's figures are written to stderr 
+ *                                      when it is destroyed, which for most is when 
+ *                                      the runtime is; gpsee_getMonitorStats() takes
+ *                                      a snapshot at any time.
  * @date        May 2010
  * @author      Wes Garland
- * @version     $Id: gpsee_monitors.c,v 1.2 2011/12/05 19:13:36 wes Exp $ 
+ * @version     $Id: gpsee_monitors.c,v 1.3 2012/01/31 20:10:44 wes Exp $ 
  *
  */
 
 #include "gpsee.h"
 #include <prmon.h>
+#include <prinit.h>
+#include <prtime.h>
 
 gpsee_monitor_t         nilMonitor = (gpsee_monitor_t)"NIL Monitor - using this monitor is like running unlocked";
 
+#ifdef JS_THREADSAFE
+#define MONITOR_WRITER          ((jsval)-1)     /**< monitor->state while a writer is inside */
+#define MONITOR_SPIN_INITIAL    100             /**< Starting spin limit for new monitors */
+#define MONITOR_SPIN_MAX        4000            /**< Upper bound on tries before sleeping */
+
+#if defined(__i386__) || defined(__x86_64__)
+# define MONITOR_CPU_RELAX()    __asm__ __volatile__("pause")
+#else
+# define MONITOR_CPU_RELAX()    do { ; } while(0)
+#endif
+
+/** Contention statistics for one monitor, kept when grt->monitorStats is set */
+typedef struct
+{
+  PRInt32               entries;        /**< Outermost entries */
+  PRInt32               contended;      /**< Entries which found the monitor busy */
+  PRInt32               slept;          /**< Contended entries which gave up spinning and slept */
+  PRUint64              waitTime;       /**< Total microseconds spent waiting; guarded by monitor->lock */
+  PRUint32              maxWait;        /**< Longest wait in microseconds; guarded by monitor->lock */
+  PRUint32              maxHold;        /**< Longest time held in microseconds; guarded by monitor->lock */
+  PRUint32              waitHistogram[GPSEE_MONITOR_HISTOGRAM_BUCKETS]; /**< Contended waits; guarded by monitor->lock */
+} monitorStats_t;
+
+/** What a gpsee_monitor_t points to, unless it is the nil monitor */
+typedef struct
+{
+  jsval                 state;          /**< 0 when free, number of readers inside, or MONITOR_WRITER */
+  PRThread * volatile   owner;          /**< Writer inside, or NULL */
+  PRUint32              depth;          /**< Writer's nesting depth; only touched by the owner */
+  PRInt32               writersWaiting; /**< Writers trying to get in; new readers hold back while non-zero */
+  PRInt32               sleepers;       /**< Threads asleep on wakeup */
+  PRInt32               spinLimit;      /**< Adaptive estimate of how many tries it takes to get in */
+  PRLock                *lock;          /**< Lock for wakeup */
+  PRCondVar             *wakeup;        /**< Broadcast on release when anyone is asleep */
+  const char            *name;          /**< Name given at creation, for reports */
+  monitorStats_t        *stats;         /**< Contention statistics, or NULL */
+  PRTime                heldSince;      /**< When the monitor last went from free to held; only kept with stats */
+} monitor_t;
+
+static JSBool           monitor_canSpin; /**< False on uniprocessors, where spinning only delays the holder */
+
+#if defined(GPSEE_DEBUG_BUILD)
+/* Debug builds remember which monitors each thread is inside shared, as the state word
+ * does not say who the readers are. Re-entering one of them would deadlock as soon as a
+ * writer queued between the two entries, so we assert instead of waiting for that.
+ */
+#define MONITOR_SHARED_TRACKED  32              /**< Shared entries remembered per thread; deeper ones go unchecked */
+
+typedef struct
+{
+  size_t                count;
+  monitor_t             *held[MONITOR_SHARED_TRACKED];
+} sharedHeld_t;
+
+static PRCallOnceType   sharedHeldOnce;
+static PRUintn          sharedHeldIndex;
+static PRStatus         sharedHeldStatus = PR_FAILURE;
+
+static PRStatus sharedHeld_init(void)
+{
+  sharedHeldStatus = PR_NewThreadPrivateIndex(&sharedHeldIndex, free);
+  return PR_SUCCESS;
+}
+
+/** Get the calling thread's list of shared entries, or NULL if it cannot be had */
+static sharedHeld_t *sharedHeld_get(void)
+{
+  sharedHeld_t  *sh;
+
+  if (PR_CallOnce(&sharedHeldOnce, sharedHeld_init) != PR_SUCCESS || sharedHeldStatus != PR_SUCCESS)
+    return NULL;
+
+  sh = PR_GetThreadPrivate(sharedHeldIndex);
+  if (!sh && (sh = calloc(1, sizeof(*sh))) && PR_SetThreadPrivate(sharedHeldIndex, sh) != PR_SUCCESS)
+  {
+    free(sh);
+    sh = NULL;
+  }
+
+  return sh;
+}
+
+/** True when the calling thread is inside monitor shared */
+static JSBool monitor_heldShared(monitor_t *monitor)
+{
+  sharedHeld_t  *sh = sharedHeld_get();
+  size_t        i;
+
+  for (i = 0; sh && i < sh->count; i++)
+  {
+    if (sh->held[i] == monitor)
+      return JS_TRUE;
+  }
+
+  return JS_FALSE;
+}
+
+/** Note that the calling thread has entered (entering == JS_TRUE) or left monitor shared */
+static void monitor_noteShared(monitor_t *monitor, JSBool entering)
+{
+  sharedHeld_t  *sh = sharedHeld_get();
+  size_t        i;
+
+  if (!sh)
+    return;
+
+  if (entering)
+  {
+    if (sh->count < MONITOR_SHARED_TRACKED)
+      sh->held[sh->count++] = monitor;
+    return;
+  }
+
+  for (i = sh->count; i > 0; i--)
+  {
+    if (sh->held[i - 1] == monitor)
+    {
+      sh->held[i - 1] = sh->held[--sh->count];
+      return;
+    }
+  }
+}
+#endif
+
+/** Try once to get into a monitor, without waiting.
+ *  @returns JS_TRUE if we are now inside
+ */
+static JSBool monitor_tryEnter(monitor_t *monitor, JSBool shared)
+{
+  jsval         state = monitor->state;
+
+  if (!shared)
+  {
+    if (state != 0 || jsval_CompareAndSwap(&monitor->state, 0, MONITOR_WRITER) != JS_TRUE)
+      return JS_FALSE;
+  }
+  else
+  {
+    if (state == MONITOR_WRITER || monitor->writersWaiting)
+      return JS_FALSE;
+    if (jsval_CompareAndSwap(&monitor->state, state, state + 1) != JS_TRUE)
+      return JS_FALSE;
+  }
+
+  /* Nobody else can leave the monitor free until we do, so heldSince is ours to write */
+  if (state == 0 && monitor->stats)
+    monitor->heldSince = PR_Now();
+
+  return JS_TRUE;
+}
+
+/** Microseconds elapsed since a PR_Now() reading. PR_IntervalNow() ticks are too coarse
+ *  on some platforms to time most waits, and wrap; PR_Now() is microseconds. It follows
+ *  the wall clock, so a clock stepped backwards reads as no time at all.
+ */
+static PRUint32 monitor_microsecondsSince(PRTime since)
+{
+  PRTime        elapsed = PR_Now() - since;
+
+  if (elapsed < 0)
+    return 0;
+  if (elapsed > (PRTime)PR_UINT32_MAX)
+    return PR_UINT32_MAX;
+
+  return (PRUint32)elapsed;
+}
+
+/** Histogram bucket for a wait: bucket 0 is under 1us, bucket n is under 2^n us, the last is everything longer */
+static int monitor_histogramBucket(PRUint32 microseconds)
+{
+  int   bucket;
+
+  for (bucket = 0; bucket < GPSEE_MONITOR_HISTOGRAM_BUCKETS - 1 && (microseconds >> bucket); bucket++);
+
+  return bucket;
+}
+
+/** Get into a monitor which was busy when we first looked: spin, then sleep. */
+static void monitor_enterContended(monitor_t *monitor, JSBool shared)
+{
+  PRTime                start = monitor->stats ? PR_Now() : 0;
+  PRInt32               limit, tries;
+  JSBool                slept = JS_FALSE;
+
+  if (!shared)
+    PR_AtomicIncrement(&monitor->writersWaiting);
+
+  limit = monitor_canSpin ? min(MONITOR_SPIN_MAX, monitor->spinLimit * 2 + 10) : 0;
+  for (tries = 0; tries < limit; tries++)
+  {
+    MONITOR_CPU_RELAX();
+    if (monitor_tryEnter(monitor, shared))
+      break;
+  }
+
+  /* The spin limit is only a heuristic, so unsynchronized updates are fine */
+  if (tries < limit)
+    monitor->spinLimit += (tries - monitor->spinLimit) / 8;
+  else
+  {
+    monitor->spinLimit /= 2;     /* Spinning did not help; try less next time */
+    slept = JS_TRUE;
+
+    PR_Lock(monitor->lock);
+    PR_AtomicIncrement(&monitor->sleepers);     /* Before trying, so that a releaser sees us or we see it */
+    while (!monitor_tryEnter(monitor, shared))
+      PR_WaitCondVar(monitor->wakeup, PR_INTERVAL_NO_TIMEOUT);
+    PR_AtomicDecrement(&monitor->sleepers);
+    PR_Unlock(monitor->lock);
+  }
+
+  if (!shared)
+    PR_AtomicDecrement(&monitor->writersWaiting);
+
+  if (monitor->stats)
+  {
+    PRUint32    waited = monitor_microsecondsSince(start);
+
+    PR_AtomicIncrement(&monitor->stats->contended);
+    if (slept)
+      PR_AtomicIncrement(&monitor->stats->slept);
+
+    PR_Lock(monitor->lock);
+    monitor->stats->waitTime += waited;
+    if (waited > monitor->stats->maxWait)
+      monitor->stats->maxWait = waited;
+    monitor->stats->waitHistogram[monitor_histogramBucket(waited)]++;
+    PR_Unlock(monitor->lock);
+  }
+}
+
+/** Enter a monitor, exclusively or shared. Re-entry by the exclusive holder only nests. */
+static void monitor_enter(monitor_t *monitor, JSBool shared)
+{
+  PRThread      *self = PR_GetCurrentThread();
+
+  if (monitor->owner == self)
+  {
+    monitor->depth++;
+    return;
+  }
+
+#if defined(GPSEE_DEBUG_BUILD)
+  if (monitor_heldShared(monitor))
+    GPSEE_NOT_REACHED(shared ? "nested shared entry into a GPSEE monitor" : "upgrade of a shared GPSEE monitor entry to exclusive");
+#endif
+
+  if (!monitor_tryEnter(monitor, shared))
+    monitor_enterContended(monitor, shared);
+
+  if (monitor->stats)
+    PR_AtomicIncrement(&monitor->stats->entries);
+
+  if (!shared)
+  {
+    monitor->owner = self;
+    monitor->depth = 1;
+  }
+#if defined(GPSEE_DEBUG_BUILD)
+  else
+    monitor_noteShared(monitor, JS_TRUE);
+#endif
+}
+
+/** Record how long a monitor was held, when the last holder leaves it free.
+ *  @param      since   The monitor's heldSince, read before it was left free
+ */
+static void monitor_recordHold(monitor_t *monitor, PRTime since)
+{
+  PRUint32      held = monitor_microsecondsSince(since);
+
+  PR_Lock(monitor->lock);
+  if (held > monitor->stats->maxHold)
+    monitor->stats->maxHold = held;
+  PR_Unlock(monitor->lock);
+}
+
+/** Copy a monitor's statistics into the public form */
+static void monitor_copyStats(monitor_t *monitor, gpsee_monitorStats_t *copy)
+{
+  monitorStats_t        *stats = monitor->stats;
+
+  memset(copy, 0, sizeof(*copy));
+  copy->name = monitor->name;
+  if (!stats)
+    return;
+
+  PR_Lock(monitor->lock);
+  copy->entries   = stats->entries;
+  copy->contended = stats->contended;
+  copy->slept     = stats->slept;
+  copy->waitTime  = stats->waitTime;
+  copy->maxWait   = stats->maxWait;
+  copy->maxHold   = stats->maxHold;
+  memcpy(copy->waitHistogram, stats->waitHistogram, sizeof(copy->waitHistogram));
+  PR_Unlock(monitor->lock);
+}
+
+/** Write a monitor's contention statistics to stderr, if it has any */
+static void monitor_report(monitor_t *monitor)
+{
+  gpsee_monitorStats_t  stats;
+  int                   bucket;
+
+  if (!monitor->stats)
+    return;
+
+  monitor_copyStats(monitor, &stats);
+  if (!stats.entries)
+    return;
+
+  fprintf(stderr, "gpsee monitor %s (" GPSEE_PTR_FMT "): %u entries, %u contended (%u slept), "
+          "%.3f ms waiting, longest wait %u us, longest hold %u us\n", stats.name, monitor, 
+          (unsigned int)stats.entries, (unsigned int)stats.contended, (unsigned int)stats.slept, 
+          (double)stats.waitTime / 1000.0, (unsigned int)stats.maxWait, (unsigned int)stats.maxHold);
+
+  if (!stats.contended)
+    return;
+
+  fprintf(stderr, "  waits:");
+  for (bucket = 0; bucket < GPSEE_MONITOR_HISTOGRAM_BUCKETS; bucket++)
+  {
+    if (!stats.waitHistogram[bucket])
+      continue;
+    if (bucket == GPSEE_MONITOR_HISTOGRAM_BUCKETS - 1)
+      fprintf(stderr, " >=%uus:%u", 1U << (bucket - 1), (unsigned int)stats.waitHistogram[bucket]);
+    else
+      fprintf(stderr, " <%uus:%u", 1U << bucket, (unsigned int)stats.waitHistogram[bucket]);
+  }
+  fprintf(stderr, "\n");
+}
+
+/** Free the resources of a monitor nobody is using */
+static void monitor_destroy(monitor_t *monitor)
+{
+  monitor_report(monitor);
+
+  PR_DestroyCondVar(monitor->wakeup);
+  PR_DestroyLock(monitor->lock);
+  if (monitor->stats)
+    free(monitor->stats);
+  free(monitor);
+}
+#endif
+
 /** Initialize the monitor subsystem associated with the passed grt.
  *  This routine runs unlocked: it is the job of the caller to 
  *  insure that no other threads are running.
@@ -68,6 +447,8 @@ JSBool gpsee_initializeMonitorSystem(JSContext *cx, gpsee_runtime_t *grt)
   if (!grt->monitors.monitor)
     return gpsee_throw(cx, GPSEE_GLOBAL_NAMESPACE_NAME ".monitors.initialize: Could not initialize monitor subsystem");
 
+  monitor_canSpin = PR_GetNumberOfProcessors() > 1 ? JS_TRUE : JS_FALSE;
+
   /* Access to monitorList_unlocked is guarded by grt->monitors.monitor henceforth */
   grt->monitorList_unlocked = gpsee_ds_create(NULL, GPSEE_DS_UNLOCKED, 5);
 #else
@@ -81,19 +462,28 @@ JSBool gpsee_initializeMonitorSystem(JSContext *cx, gpsee_runtime_t *grt)
  *  Create a monitor. Infallible.
  *
  *  @param      grt             The GPSEE runtime that owns the monitor
- *  @param      monitor_p       A pointer to the monitor. This address must stay valid for the lifetime of the runtime.
+ *  @param      name            A name for the monitor in contention reports. Must stay valid for 
+ *                              the life of the monitor; a string literal is best. Does not need to be unique.
  *
- *  @returns    The new monitor, or NULL if this was not a JS_THREADSAFE build.
+ *  @returns    The new monitor, or the nil monitor if this was not a JS_THREADSAFE build.
  */
-gpsee_monitor_t gpsee_createMonitor(gpsee_runtime_t *grt)
+gpsee_monitor_t gpsee_createMonitor(gpsee_runtime_t *grt, const char *name)
 {
 #ifdef JS_THREADSAFE
-  gpsee_monitor_t       monitor;
+  monitor_t             *monitor;
 
   GPSEE_ASSERT(grt->monitors.monitor);
 
+  monitor = calloc(1, sizeof(*monitor));
+  if (!monitor || !(monitor->lock = PR_NewLock()) || !(monitor->wakeup = PR_NewCondVar(monitor->lock)))
+    panic(GPSEE_GLOBAL_NAMESPACE_NAME ".monitors.create: Out of memory");
+
+  monitor->spinLimit = MONITOR_SPIN_INITIAL;
+  monitor->name = name;
+  if (grt->monitorStats && !(monitor->stats = calloc(1, sizeof(*monitor->stats))))
+    panic(GPSEE_GLOBAL_NAMESPACE_NAME ".monitors.create: Out of memory");
+
   PR_EnterMonitor(grt->monitors.monitor);
-  monitor = PR_NewMonitor();
   gpsee_ds_put(grt->monitorList_unlocked, monitor, NULL);
   PR_ExitMonitor(grt->monitors.monitor);
 
@@ -115,6 +505,22 @@ gpsee_monitor_t gpsee_getNilMonitor()
   return nilMonitor;
 }
 
+/** Create an auto-monitor if it does not exist yet. When two threads race to create 
+ *  the same one, the loser destroys its copy. Auto-monitors created here are all named
+ *  "auto"; ones which should be told apart in reports are created ahead of time.
+ */
+static void autoMonitor_create(gpsee_runtime_t *grt, gpsee_autoMonitor_t *monitor_p)
+{
+  gpsee_monitor_t       monitor;
+
+  if (*monitor_p)
+    return;
+
+  monitor = gpsee_createMonitor(grt, "auto");
+  if (jsval_CompareAndSwap((jsval *)monitor_p, (jsval)NULL, (jsval)monitor) != JS_TRUE)
+    gpsee_destroyMonitor(grt, monitor);
+}
+
 /**
  *  Enter an auto-monitor (RAII). Infallible. Creates the monitor as-needed. 
  *
@@ -143,45 +549,120 @@ void gpsee_enterAutoMonitorRT(gpsee_runtime_t *grt, gpsee_autoMonitor_t *monitor
 {
   GPSEE_ASSERT(grt->monitors.monitor);
 
-  if (!*monitor_p)
-    *monitor_p = gpsee_createMonitor(grt);
-
+  autoMonitor_create(grt, monitor_p);
   gpsee_enterMonitor(*monitor_p);
 }
 
 /**
- *  Enter a monitor. Infallible
+ *  Enter an auto-monitor for reading (shared with other readers). Infallible. Creates
+ *  the monitor as-needed. Leave it with gpsee_leaveAutoMonitor().
+ *
+ *  @param      cx              A context belonging to the current runtime.
+ *  @param      monitor_p       A pointer to the monitor. This address must stay valid for the lifetime of the runtime.
+ *
+ *  @see gpsee_enterMonitorShared()
+ */
+void gpsee_enterAutoMonitorShared(JSContext *cx, gpsee_autoMonitor_t *monitor_p)
+{
+  gpsee_runtime_t   *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+
+  GPSEE_ASSERT(grt->monitors.monitor);
+
+  autoMonitor_create(grt, monitor_p);
+  gpsee_enterMonitorShared(*monitor_p);
+}
+
+/**
+ *  Enter a monitor exclusively. Infallible. A thread already inside
+ *  exclusively may enter again; it must leave as many times.
  *
  *  @param      monitor         The monitor to enter.
  */
 void gpsee_enterMonitor(gpsee_monitor_t monitor)
 {
 #ifdef JS_THREADSAFE  
-if (monitor == nilMonitor)
+  if (monitor == nilMonitor)
     return;
 
-  PR_EnterMonitor(monitor);
+  monitor_enter(monitor, JS_FALSE);
 #endif
 }
 
 /**
- *  Leave a monitor. Infallible.
+ *  Enter a monitor for reading, alongside any other readers. Infallible. 
+ *  Leave it with gpsee_leaveMonitor().
+ *
+ *  @param      monitor         The monitor to enter.
+ *
+ *  @warning    Shared entries do not nest: a thread inside a monitor shared must not
+ *              enter it again, shared or exclusively, until it has left. Debug builds
+ *              assert when this happens.
+ */
+void gpsee_enterMonitorShared(gpsee_monitor_t monitor)
+{
+#ifdef JS_THREADSAFE  
+  if (monitor == nilMonitor)
+    return;
+
+  monitor_enter(monitor, JS_TRUE);
+#endif
+}
+
+/**
+ *  Leave a monitor, whether it was entered exclusively or shared. Infallible.
  *
  *  @param      monitor         The monitor to leave
  */
 void gpsee_leaveMonitor(gpsee_monitor_t monitor)
 {
+#ifdef JS_THREADSAFE
+  monitor_t     *m = monitor;
+  jsval         state;
+  PRTime        since;
+#endif
+
   GPSEE_ASSERT(monitor);
 
 #ifdef JS_THREADSAFE
-  PRStatus      status;
-
   if (monitor == nilMonitor)
     return;
 
-  status = PR_ExitMonitor(monitor);
-
-  GPSEE_ASSERT(status == PR_SUCCESS);   /* An assertion failure here means we were not in the monitor */
+  if (m->owner == PR_GetCurrentThread())
+  {
+    GPSEE_ASSERT(m->depth > 0 && m->state == MONITOR_WRITER);
+
+    if (--m->depth)
+      return;
+
+    since = m->heldSince;
+    m->owner = NULL;
+    if (jsval_CompareAndSwap(&m->state, MONITOR_WRITER, 0) != JS_TRUE)
+      GPSEE_NOT_REACHED("monitor state changed under writer");
+    if (m->stats)
+      monitor_recordHold(m, since);
+  }
+  else
+  {
+    do
+    {
+      since = m->heldSince;     /* Valid while we are still inside */
+      state = m->state;
+      GPSEE_ASSERT(state > 0);   /* An assertion failure here means we were not in the monitor */
+    } while (jsval_CompareAndSwap(&m->state, state, state - 1) != JS_TRUE);
+
+    if (state == 1 && m->stats)
+      monitor_recordHold(m, since);
+#if defined(GPSEE_DEBUG_BUILD)
+    monitor_noteShared(m, JS_FALSE);
+#endif
+  }
+
+  if (PR_AtomicAdd(&m->sleepers, 0))
+  {
+    PR_Lock(m->lock);
+    PR_NotifyAllCondVar(m->wakeup);
+    PR_Unlock(m->lock);
+  }
 #endif
 }
 
@@ -212,8 +693,76 @@ void gpsee_destroyMonitor(gpsee_runtime_t *grt, gpsee_monitor_t monitor)
   PR_EnterMonitor(grt->monitors.monitor);
   gpsee_ds_remove(grt->monitorList_unlocked, monitor);
   PR_ExitMonitor(grt->monitors.monitor);
-  PR_DestroyMonitor(monitor);
+  monitor_destroy(monitor);
+#endif
+}
+
+#ifdef JS_THREADSAFE
+typedef struct
+{
+  gpsee_monitorStats_t  *stats;
+  size_t                count;
+  size_t                size;
+} statsSnapshot_t;
+
+static JSBool snapshotMonitor_cb(JSContext *nullcx, const void *key, void *value, void *private)
+{
+  statsSnapshot_t       *snapshot = private;
+  gpsee_monitorStats_t  *stats;
+
+  if (snapshot->count == snapshot->size)
+  {
+    stats = realloc(snapshot->stats, sizeof(snapshot->stats[0]) * (snapshot->size * 2 + 8));
+    if (!stats)
+      return JS_FALSE;
+    snapshot->stats = stats;
+    snapshot->size = snapshot->size * 2 + 8;
+  }
+
+  monitor_copyStats((monitor_t *)key, &snapshot->stats[snapshot->count++]);
+  return JS_TRUE;
+}
+#endif
+
+/**
+ *  Take a snapshot of the contention statistics of every monitor in the runtime.
+ *  Monitors record statistics only when grt->monitorStats was set when they were
+ *  created; others report only their names.
+ *
+ *  @param      grt             The GPSEE runtime whose monitors to report
+ *  @param      stats_p         [out] A malloc()ed array of statistics, which the caller must free(). 
+ *                              NULL when there are no monitors.
+ *  @param      count_p         [out] Number of elements in *stats_p
+ *
+ *  @returns    JS_FALSE when out of memory (does not throw)
+ */
+JSBool gpsee_getMonitorStats(gpsee_runtime_t *grt, gpsee_monitorStats_t **stats_p, size_t *count_p)
+{
+#ifdef JS_THREADSAFE
+  statsSnapshot_t       snapshot;
+  JSBool                b;
+
+  memset(&snapshot, 0, sizeof(snapshot));
+
+  PR_EnterMonitor(grt->monitors.monitor);
+  b = gpsee_ds_forEach(NULL, grt->monitorList_unlocked, snapshotMonitor_cb, &snapshot);
+  PR_ExitMonitor(grt->monitors.monitor);
+
+  if (b == JS_FALSE)
+  {
+    if (snapshot.stats)
+      free(snapshot.stats);
+    return JS_FALSE;
+  }
+
+  *stats_p = snapshot.stats;
+  *count_p = snapshot.count;
+#else
+  *stats_p = NULL;
+  *count_p = 0;
 #endif
+
+  return JS_TRUE;
 }
 
 #ifdef JS_THREADSAFE
@@ -223,7 +772,7 @@ static JSBool destroyMonitor_cb(JSContext *nullcx, const void *key, void *value,
 
   GPSEE_ASSERT(monitor && monitor != nilMonitor);
 
-  PR_DestroyMonitor(monitor);
+  monitor_destroy((monitor_t *)monitor);
 
   return JS_TRUE;
 }
@@ -243,4 +792,3 @@ void gpsee_shutdownMonitorSystem(gpsee_runtime_t *grt)
 
   return;
 }
-
@@ -45,6 +45,12 @@
 #define GPSEE_PRIVATE_H
 
 #include "jsapi.h"
+#include <prtime.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 JSBool                  gpsee_initializeModuleSystem    (JSContext *cx, gpsee_realm_t *realm);
 void 			gpsee_shutdownModuleSystem      (JSContext *cx, gpsee_realm_t *realm);
 void			gpsee_moduleSystemCleanup       (JSContext *cx, gpsee_realm_t *realm);
@@ -53,6 +59,17 @@ void                    gpsee_shutdownMonitorSystem     (gpsee_runtime_t *grt);
 gpsee_realm_t *         gpsee_getModuleScopeRealm       (JSContext *cx, JSObject *moduleScope);
 JSBool                  gpsee_operationCallback         (JSContext *cx);
 JSBool                  gpsee_gcCallback                (JSContext *cx, JSGCStatus status);
+void                    gpsee_profileRequireBegin       (JSContext *cx, const char *moduleName);
+void                    gpsee_profileRequireResolved    (JSContext *cx, const char *cname, JSBool alreadyLoaded);
+PRTime                  gpsee_profileCompileStart       (JSContext *cx);
+void                    gpsee_profileCompile            (JSContext *cx, PRTime start, JSBool cacheHit, size_t xdrBytes);
+void                    gpsee_profileRequireExec        (JSContext *cx, JSBool begin);
+void                    gpsee_profileRequireEnd         (JSContext *cx, JSBool success);
+
+#ifdef __cplusplus
+}
+#endif
+
 #define AT_STRINGIFY_HELPER_1(s) #s
 #define AT_STRINGIFY_HELPER_2(s) AT_STRINGIFY_HELPER_1(s)
 #define AT __FILE__ ":" AT_STRINGIFY_HELPER_2(__LINE__) ": "
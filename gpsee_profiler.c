@@ -0,0 +1,398 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are 
+ * Copyright (c) 2007-2010, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s): 
+ * 
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** 
+ */
+
+/**
+ *  @file       gpsee_profiler.c
+ *  @brief      Opt-in profiler for require(). Records, for each module a realm loads, the time spent
+ *              resolving it, compiling it or thawing it from the compiler cache, and running its
+ *              module body, nested by the module which required it.  The report is written when
+ *              the realm's module system shuts down: a text table on stderr, and optionally a
+ *              Chrome trace (chrome://tracing) JSON file.
+ *
+ *              Only the thread which enabled the profiler is recorded, which keeps records in
+ *              require() call order without locking.
+ */
+
+#include "gpsee.h"
+#include "gpsee_private.h"
+
+/** Everything we know about one call to require() */
+typedef struct
+{
+  char          *name;          /**< Argument to require() */
+  char          *cname;         /**< Canonical name of the module, once resolved */
+  int           parent;         /**< Index of the record for the enclosing require(), or -1 */
+  int           depth;          /**< Nesting depth; 0 for modules required by the program */
+  PRTime        start;          /**< require() entered */
+  PRTime        resolved;       /**< Module found (and, for JS modules, compiled) */
+  PRTime        compileStart;   /**< gpsee_compileScript() entered, or 0 if not called */
+  PRTime        compileEnd;     /**< gpsee_compileScript() returned */
+  PRTime        execStart;      /**< Module initializer/body started, or 0 if not run */
+  PRTime        execEnd;        /**< Module initializer/body finished */
+  PRTime        end;            /**< require() returned */
+  JSBool        cacheHit;       /**< Script was thawed from the compiler cache */
+  size_t        xdrBytes;       /**< Size of the compiler cache file decoded */
+  JSBool        alreadyLoaded;  /**< Module was loaded by an earlier require() */
+  JSBool        failed;         /**< require() threw */
+} requireRecord_t;
+
+struct gpsee_requireProfile
+{
+  requireRecord_t       *records;       /**< One record per require(), in call order */
+  size_t                nRecords;       /**< Number of records in use */
+  size_t                allocRecords;   /**< Number of records allocated */
+  int                   current;        /**< Record for the innermost require() in progress, or -1 */
+  PRThread              *thread;        /**< Only require() calls on this thread are recorded */
+  PRTime                t0;             /**< When profiling began */
+  char                  *traceFilename; /**< Where to write the Chrome trace, or NULL */
+};
+
+/** Find the profile, if any, which should record activity on the current thread */
+static gpsee_requireProfile_t *getProfile(JSContext *cx)
+{
+  gpsee_realm_t *realm = gpsee_getRealm(cx);
+
+  if (!realm || !realm->requireProfile || realm->requireProfile->thread != PR_GetCurrentThread())
+    return NULL;
+
+  return realm->requireProfile;
+}
+
+/** Find the record for the innermost require() in progress on the profiled thread, if any */
+static requireRecord_t *currentRecord(JSContext *cx)
+{
+  gpsee_requireProfile_t *prof = getProfile(cx);
+
+  if (!prof || prof->current < 0)
+    return NULL;
+
+  return &prof->records[prof->current];
+}
+
+/** Start profiling require() in a realm.  Only calls made on the current thread are recorded.
+ *
+ *  @param      cx              A context in the realm
+ *  @param      realm           The realm to profile
+ *  @param      traceFilename   File to receive a Chrome trace when the realm shuts down, or NULL
+ *
+ *  @returns    JS_TRUE on success, JS_FALSE with an exception pending otherwise
+ */
+JSBool gpsee_enableRequireProfiler(JSContext *cx, gpsee_realm_t *realm, const char *traceFilename)
+{
+  gpsee_requireProfile_t        *prof;
+
+  if (realm->requireProfile)
+    return JS_TRUE;
+
+  prof = JS_malloc(cx, sizeof(*prof));
+  if (!prof)
+    return JS_FALSE;
+
+  memset(prof, 0, sizeof(*prof));
+  prof->current = -1;
+  prof->thread = PR_GetCurrentThread();
+  prof->t0 = PR_Now();
+
+  if (traceFilename && traceFilename[0])
+  {
+    prof->traceFilename = JS_strdup(cx, traceFilename);
+    if (!prof->traceFilename)
+    {
+      JS_free(cx, prof);
+      return JS_FALSE;
+    }
+  }
+
+  realm->requireProfile = prof;
+  return JS_TRUE;
+}
+
+/** Note that require() has been called. Must be paired with gpsee_profileRequireEnd().
+ *  Infallible; if we run out of memory, the module is simply not recorded.
+ */
+void gpsee_profileRequireBegin(JSContext *cx, const char *moduleName)
+{
+  gpsee_requireProfile_t        *prof = getProfile(cx);
+  requireRecord_t               *rec;
+
+  if (!prof)
+    return;
+
+  if (prof->nRecords == prof->allocRecords)
+  {
+    size_t              n = prof->allocRecords ? prof->allocRecords * 2 : 64;
+    requireRecord_t     *records = realloc(prof->records, n * sizeof(records[0]));
+
+    if (!records)
+    {
+      prof->thread = NULL;     /* Out of memory: stop recording, but still report what we have */
+      return;
+    }
+
+    prof->records = records;
+    prof->allocRecords = n;
+  }
+
+  rec = &prof->records[prof->nRecords];
+  memset(rec, 0, sizeof(*rec));
+  rec->name = strdup(moduleName);
+  rec->parent = prof->current;
+  rec->depth = prof->current < 0 ? 0 : prof->records[prof->current].depth + 1;
+  rec->start = PR_Now();
+
+  prof->current = prof->nRecords++;
+}
+
+/** Note that require() has found the module it is loading */
+void gpsee_profileRequireResolved(JSContext *cx, const char *cname, JSBool alreadyLoaded)
+{
+  requireRecord_t       *rec = currentRecord(cx);
+
+  if (!rec)
+    return;
+
+  rec->resolved = PR_Now();
+  rec->cname = cname ? strdup(cname) : NULL;
+  rec->alreadyLoaded = alreadyLoaded;
+}
+
+/** Note that gpsee_compileScript() is starting work.
+ *  @returns    The current time, or 0 when the profiler is not recording this compilation
+ */
+PRTime gpsee_profileCompileStart(JSContext *cx)
+{
+  requireRecord_t       *rec = currentRecord(cx);
+
+  if (!rec || rec->compileStart)
+    return 0;
+
+  return PR_Now();
+}
+
+/** Note that gpsee_compileScript() has finished compiling or thawing a script for the current module
+ *
+ *  @param      cx              The current context
+ *  @param      start           When gpsee_compileScript() started work, from gpsee_profileCompileStart()
+ *  @param      cacheHit        Whether the script came from the compiler cache
+ *  @param      xdrBytes        The size of the compiler cache file decoded, if any
+ */
+void gpsee_profileCompile(JSContext *cx, PRTime start, JSBool cacheHit, size_t xdrBytes)
+{
+  requireRecord_t       *rec = currentRecord(cx);
+
+  if (!start || !rec || rec->compileStart)       /* only the module's own script; not include()s run by its body */
+    return;
+
+  rec->compileStart = start;
+  rec->compileEnd = PR_Now();
+  rec->cacheHit = cacheHit;
+  rec->xdrBytes = xdrBytes;
+}
+
+/** Note that the current module's initializer or body has started (begin == JS_TRUE) or finished running */
+void gpsee_profileRequireExec(JSContext *cx, JSBool begin)
+{
+  requireRecord_t       *rec = currentRecord(cx);
+
+  if (!rec)
+    return;
+
+  if (begin)
+    rec->execStart = PR_Now();
+  else
+    rec->execEnd = PR_Now();
+}
+
+/** Note that require() is returning */
+void gpsee_profileRequireEnd(JSContext *cx, JSBool success)
+{
+  gpsee_requireProfile_t        *prof = getProfile(cx);
+  requireRecord_t               *rec;
+
+  if (!prof || prof->current < 0)
+    return;
+
+  rec = &prof->records[prof->current];
+  rec->end = PR_Now();
+  rec->failed = !success;
+  if (!rec->resolved)
+    rec->resolved = rec->end;
+
+  prof->current = rec->parent;
+}
+
+/** Microseconds, as milliseconds for the text report */
+#define MS(usec) ((double)(usec) / 1000.0)
+
+/** Time spent resolving a module, excluding its compilation */
+static PRTime resolveTime(const requireRecord_t *rec)
+{
+  return (rec->resolved - rec->start) - (rec->compileStart ? rec->compileEnd - rec->compileStart : 0);
+}
+
+static void dumpTextReport(JSContext *cx, gpsee_requireProfile_t *prof)
+{
+  size_t                i;
+  PRTime                total = 0;
+  requireRecord_t       *rec;
+
+  for (i = 0; i < prof->nRecords; i++)
+  {
+    if (prof->records[i].depth == 0)
+      total += prof->records[i].end - prof->records[i].start;
+  }
+
+  gpsee_fprintf(cx, stderr, "require() profile: " GPSEE_SIZET_FMT " calls, %.3f ms in top-level require()\n", prof->nRecords, MS(total));
+  gpsee_fprintf(cx, stderr, "%10s %10s %10s %10s %10s  %s\n", "total ms", "resolve", "compile", "exec", "xdr bytes", "module");
+
+  for (i = 0; i < prof->nRecords; i++)
+  {
+    char        xdr[32];
+
+    rec = &prof->records[i];
+    if (rec->cacheHit)
+      snprintf(xdr, sizeof(xdr), GPSEE_SIZET_FMT, rec->xdrBytes);
+    else
+      strcpy(xdr, "-");
+
+    gpsee_fprintf(cx, stderr, "%10.3f %10.3f %10.3f %10.3f %10s  %*s%s%s%s\n",
+                  MS(rec->end - rec->start), 
+                  MS(resolveTime(rec)),
+                  MS(rec->compileStart ? rec->compileEnd - rec->compileStart : 0),
+                  MS(rec->execStart ? rec->execEnd - rec->execStart : 0),
+                  xdr,
+                  rec->depth * 2, "", rec->name ?: "?",
+                  rec->alreadyLoaded ? " (already loaded)" : (rec->cacheHit ? " (cached)" : ""),
+                  rec->failed ? " (threw)" : "");
+  }
+}
+
+/** Write a string as a JSON string literal */
+static void fputJSONString(const char *s, FILE *file)
+{
+  fputc('"', file);
+  for (; s && *s; s++)
+  {
+    if (*s == '"' || *s == '\\')
+      fprintf(file, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(file, "\\u%04x", (unsigned char)*s);
+    else
+      fputc(*s, file);
+  }
+  fputc('"', file);
+}
+
+/** Write one Chrome trace "complete" event */
+static void traceEvent(FILE *file, int *first, const char *name, const requireRecord_t *rec, PRTime t0, PRTime start, PRTime end)
+{
+  fprintf(file, "%s\n{\"name\":", *first ? "" : ",");
+  fputJSONString(name, file);
+  fprintf(file, ",\"cat\":\"require\",\"ph\":\"X\",\"pid\":%i,\"tid\":1,\"ts\":%lld,\"dur\":%lld,\"args\":{\"module\":",
+          (int)getpid(), (long long)(start - t0), (long long)(end - start));
+  fputJSONString(rec->cname ?: rec->name, file);
+  fprintf(file, ",\"cacheHit\":%s,\"xdrBytes\":" GPSEE_SIZET_FMT "}}", rec->cacheHit ? "true" : "false", rec->xdrBytes);
+  *first = 0;
+}
+
+static void dumpChromeTrace(JSContext *cx, gpsee_requireProfile_t *prof)
+{
+  FILE                  *file;
+  size_t                i;
+  int                   first = 1;
+  requireRecord_t       *rec;
+
+  if (!(file = fopen(prof->traceFilename, "w")))
+  {
+    gpsee_log(cx, GLOG_NOTICE, "Could not write require() profile trace to '%s' (%m)", prof->traceFilename);
+    return;
+  }
+
+  fputs("{\"traceEvents\":[", file);
+  for (i = 0; i < prof->nRecords; i++)
+  {
+    rec = &prof->records[i];
+
+    traceEvent(file, &first, rec->name, rec, prof->t0, rec->start, rec->end);
+    if (rec->compileStart)
+      traceEvent(file, &first, rec->cacheHit ? "thaw" : "compile", rec, prof->t0, rec->compileStart, rec->compileEnd);
+    if (rec->execStart)
+      traceEvent(file, &first, "execute", rec, prof->t0, rec->execStart, rec->execEnd);
+  }
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+
+  if (fclose(file))
+    gpsee_log(cx, GLOG_NOTICE, "Error writing require() profile trace to '%s' (%m)", prof->traceFilename);
+}
+
+/** Write the require() profile report for a realm and stop profiling it.  Called when the
+ *  realm's module system shuts down; harmless when the profiler was never enabled.
+ *
+ *  @param      cx      A context in the runtime
+ *  @param      realm   The realm whose profile to report
+ */
+void gpsee_dumpRequireProfile(JSContext *cx, gpsee_realm_t *realm)
+{
+  gpsee_requireProfile_t        *prof = realm->requireProfile;
+  size_t                        i;
+
+  if (!prof)
+    return;
+
+  realm->requireProfile = NULL;
+
+  /* Unwind require() calls cut short by exit */
+  while (prof->current >= 0)
+  {
+    prof->records[prof->current].end = PR_Now();
+    if (!prof->records[prof->current].resolved)
+      prof->records[prof->current].resolved = prof->records[prof->current].end;
+    prof->current = prof->records[prof->current].parent;
+  }
+
+  dumpTextReport(cx, prof);
+  if (prof->traceFilename)
+    dumpChromeTrace(cx, prof);
+
+  for (i = 0; i < prof->nRecords; i++)
+  {
+    free(prof->records[i].name);
+    free(prof->records[i].cname);
+  }
+  free(prof->records);
+  if (prof->traceFilename)
+    JS_free(cx, prof->traceFilename);
+  JS_free(cx, prof);
+}
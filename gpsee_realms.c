@@ -59,6 +59,13 @@
  *     gpsee_createContext() knows about it.
  *   - Potentially elsewhere
  *
+ *  Each realm keeps a small free list of contexts, so that code which creates
+ *  and destroys a context per task (threads, async embeddings) does not pay for
+ *  JS_NewContext() and JS_DestroyContext() every time. gpsee_destroyContext()
+ *  resets a context and parks it there, up to grt->contextCacheSize of them;
+ *  gpsee_createContext() takes from it before making a new one. The context 
+ *  left over from realm creation starts the list.
+ *
  *  All pointers stored in the gpsee_realm_t are valid for the lifetime of
  *  the realm, and are safe to read unlocked. Facilities described by each
  *  pointer may be synchronized by facility-specific means.
@@ -90,7 +97,7 @@ static gpsee_realm_t *getRealm(JSContext *cx)
     return realm;
 
   grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
-  gpsee_enterAutoMonitor(cx, &grt->monitors.realms);
+  gpsee_enterAutoMonitorShared(cx, &grt->monitors.realms);
   if (grt && grt->realmsByContext)
     realm = gpsee_ds_get(grt->realmsByContext, cx);
   gpsee_leaveAutoMonitor(grt->monitors.realms);
@@ -131,6 +138,19 @@ static JSBool ModuleObject(JSContext *cx, JSObject *obj, uintN argc, jsval *argv
   return JS_TRUE;
 }
 
+/** Reset a context which is about to be parked on its realm's free list, so that it roots
+ *  nothing while it waits and the next user does not see what the last one left behind.
+ *  gpsee_createContext() restores the settings which JSAPI users commonly change.
+ *  Caller must be in a request on cx.
+ */
+static void resetContext(JSContext *cx)
+{
+  JS_ClearPendingException(cx);
+  JS_ClearRegExpStatics(cx);
+  JS_ClearNewbornRoots(cx);
+  JS_SetGlobalObject(cx, NULL);
+}
+
 /**
  *  Create a new GPSEE Realm. New realm will be initialized to have all members NULL, except
  *   - the context and name provided (name only present in debug build)
@@ -149,7 +169,7 @@ gpsee_realm_t *gpsee_createRealm(gpsee_runtime_t *grt, const char *name)
   gpsee_realm_t         *realm = NULL;
   JSContext             *cx;
 
-  cx = JS_NewContext(grt->rt, 8192);
+  cx = JS_NewContext(grt->rt, grt->stackChunkSize);
   if (!cx)
     return NULL;
 
@@ -163,6 +183,18 @@ gpsee_realm_t *gpsee_createRealm(gpsee_runtime_t *grt, const char *name)
 
   memset(realm, 0, sizeof(*realm));
   realm->grt = grt;
+#ifdef JS_THREADSAFE
+  realm->monitors.programModule    = gpsee_createMonitor(grt, "programModule");
+  realm->monitors.programModuleDir = gpsee_createMonitor(grt, "programModuleDir");
+  realm->monitors.script_argv      = gpsee_createMonitor(grt, "script_argv");
+#endif
+
+  if (grt->contextCacheSize)
+  {
+    realm->freeContexts.list = JS_malloc(cx, sizeof(realm->freeContexts.list[0]) * grt->contextCacheSize);
+    if (!realm->freeContexts.list)
+      goto err_out;
+  }
 
 #ifdef GPSEE_DEBUG_BUILD
   realm->name = JS_strdup(cx, name);
@@ -170,10 +202,6 @@ gpsee_realm_t *gpsee_createRealm(gpsee_runtime_t *grt, const char *name)
     goto err_out; 
 #endif
 
-  realm->user_io_pendingWrites = gpsee_ds_create(grt, GPSEE_DS_OTM_KEYS, 0);
-  if (!realm->user_io_pendingWrites)
-    return JS_FALSE;
-
 #if defined(JSRESERVED_GLOBAL_COMPARTMENT)
   realm->globalObject = JS_NewCompartmentAndGlobalObject(cx, gpsee_getGlobalClass(), NULL);
 #else
@@ -213,31 +241,42 @@ gpsee_realm_t *gpsee_createRealm(gpsee_runtime_t *grt, const char *name)
   if (gpsee_initGlobalObject(cx, realm, realm->globalObject) == JS_FALSE)
     goto err_out;
 
-  realm->cachedCx = cx;
+  gpsee_leaveAutoMonitor(grt->monitors.realms);
+
+  /* Our context is already set up for this realm; keep it for the first gpsee_createContext() */
+  if (realm->freeContexts.list && !JS_GetContextPrivate(cx))
+  {
+    resetContext(cx);
+    JS_EndRequest(cx);
+    JS_ClearContextThread(cx);
+    realm->freeContexts.list[realm->freeContexts.count++] = cx;
+  }
+  else
+  {
+    JS_EndRequest(cx);
+    JS_DestroyContext(cx);
+  }
 
-  goto out;
+  return realm;
 
   err_out:
   if (realm)
   {
-    JS_free(cx, realm);
 #ifdef GPSEE_DEBUG_BUILD
     if (realm->name)
       JS_free(cx, (char *)realm->name);
 #endif
+    if (realm->freeContexts.list)
+      JS_free(cx, realm->freeContexts.list);
+    JS_free(cx, realm);
     realm = NULL;
   }
 
-  if (cx) {
-    JS_DestroyContext(cx);
-    cx = NULL;
-  }
-
-  out:
   gpsee_leaveAutoMonitor(grt->monitors.realms);
-  if (cx)
-    JS_EndRequest(cx);
-  return realm;
+  JS_EndRequest(cx);
+  JS_DestroyContext(cx);
+
+  return NULL;
 }
 
 /** Callback which destroys context for a particular realm */
@@ -265,18 +304,10 @@ static JSBool destroyRealmContext_cb(JSContext *cx, const void *key, void *value
  */
 JSBool gpsee_destroyRealm(JSContext *cx, gpsee_realm_t *realm)
 {
-  size_t                fd;
   gpsee_runtime_t       *grt = realm->grt;
 
-  gpsee_uio_dumpPendingWrites(cx, realm);
-
-  /** Clean up any user I/O hooks belonging to the current realm */
-  for (fd = 0; fd < grt->user_io.hooks_len; fd++)
-  {
-    gpsee_enterAutoMonitor(cx, &grt->monitors.user_io);
-    memset(&grt->user_io.hooks[fd], 0, sizeof(grt->user_io.hooks[0]));
-    gpsee_leaveAutoMonitor(grt->monitors.user_io);
-  }
+  /** Deliver pending output from, and clean up, any user I/O hooks belonging to the current realm */
+  gpsee_uio_releaseRealm(cx, realm);
 
   JS_RemoveObjectRoot(cx, &realm->globalObject);
   JS_SetGlobalObject(cx, NULL);
@@ -297,11 +328,17 @@ JSBool gpsee_destroyRealm(JSContext *cx, gpsee_realm_t *realm)
 
   gpsee_moduleSystemCleanup(cx, realm);
 
-  if (realm->cachedCx)
-    JS_DestroyContext(realm->cachedCx);
-  
-  gpsee_ds_destroy(realm->user_io_pendingWrites);
+  /* Contexts parked by gpsee_destroyContext(), including those destroyed just above */
+  while (realm->freeContexts.count)
+  {
+    JSContext *freeCx = realm->freeContexts.list[--realm->freeContexts.count];
 
+    JS_SetContextThread(freeCx);
+    JS_DestroyContext(freeCx);
+  }
+  if (realm->freeContexts.list)
+    JS_free(cx, realm->freeContexts.list);
+  
 #ifdef GPSEE_DEBUG_BUILD
   memset(realm, 0xde, sizeof(*realm));
 #endif
@@ -320,6 +357,12 @@ JSBool gpsee_destroyRealm(JSContext *cx, gpsee_realm_t *realm)
  *  - Global variable will be set to realm's global
  *  - Error reporter will be set to gpsee_errorReporter
  *  - Operation callback will be initialized to use the muxed async facility
+ *  - Locale callbacks will be cleared
+ *
+ *  The context comes from the realm's free list when it has one, otherwise from 
+ *  JS_NewContext() with grt->stackChunkSize. A reused context was reset by gpsee_destroyContext()
+ *  and never carries context-private storage; the settings above undo whatever else its last 
+ *  user changed.
  *
  *  @param      realm           The realm to which the new context belongs.
  *  @returns    A pointer to a new JSContext, or NULL if we threw an exception or realm was NULL.
@@ -332,17 +375,50 @@ JSBool gpsee_destroyRealm(JSContext *cx, gpsee_realm_t *realm)
  *              nearly the exact same time on two threads.
  */
 JSContext *gpsee_createContext(gpsee_realm_t *realm)
+{
+  if (!realm)
+    return NULL;
+
+  return gpsee_createContextWithStackChunkSize(realm, realm->grt->stackChunkSize);
+}
+
+/** Key for the context-private storage which keeps odd-sized contexts off the free list */
+static const char unpooledContext_id[] = "unpooled context";
+
+/**
+ *  Create a new JS Context, as gpsee_createContext() does, whose stack pool grows in chunks of
+ *  the given size. Contexts of any size other than grt->stackChunkSize are always new, and 
+ *  gpsee_destroyContext() destroys rather than reuses them.
+ *
+ *  @param      realm           The realm to which the new context belongs.
+ *  @param      stackChunkSize  Stack chunk size for JS_NewContext()
+ *  @returns    A pointer to a new JSContext, or NULL if we threw an exception or realm was NULL.
+ */
+JSContext *gpsee_createContextWithStackChunkSize(gpsee_realm_t *realm, size_t stackChunkSize)
 {
   JSContext             *cx;
+  JSBool                pooled;
 
   if (!realm)
     return NULL;
-  
+
+  pooled = (stackChunkSize == realm->grt->stackChunkSize) ? JS_TRUE : JS_FALSE;
   gpsee_enterAutoMonitorRT(realm->grt, &realm->grt->monitors.cx);
 
-  cx = realm->cachedCx;
-  if ((cx == NULL) || (jsval_CompareAndSwap((jsval *)&realm->cachedCx, (jsval)cx, (jsval)NULL) == JS_FALSE))
-    cx = JS_NewContext(realm->grt->rt, 8192);
+  if (pooled && realm->freeContexts.count)
+  {
+    cx = realm->freeContexts.list[--realm->freeContexts.count];
+    JS_SetContextThread(cx);
+  }
+  else
+  {
+    cx = JS_NewContext(realm->grt->rt, stackChunkSize);
+    if (!cx)
+    {
+      gpsee_leaveAutoMonitor(realm->grt->monitors.cx);
+      return NULL;
+    }
+  }
 
   JS_SetThreadStackLimit(cx, realm->grt->threadStackLimit);
 
@@ -363,6 +439,13 @@ JSContext *gpsee_createContext(gpsee_realm_t *realm)
   JS_SetOperationCallback(cx, gpsee_operationCallback);
 #endif
   JS_SetVersion(cx, JS_GetVersion(realm->grt->coreCx));
+  JS_SetLocaleCallbacks(cx, NULL);
+
+  if (!pooled && !gpsee_getContextPrivate(cx, unpooledContext_id, 1, NULL))
+  {
+    gpsee_destroyContext(cx);
+    return NULL;
+  }
 
   return cx;
 }
@@ -370,6 +453,12 @@ JSContext *gpsee_createContext(gpsee_realm_t *realm)
 /** Destroy the passed JS context, closing the request opened during gpsee_createContext(), 
  *  and removing the context from the relevant runtime/realm book-keeping memos.
  *
+ *  While the realm's free list has room, the context is reset and kept for reuse 
+ *  instead: its exception, RegExp statics, newborn roots and global are cleared, so 
+ *  that it roots nothing, and it is detached from the current thread. Contexts with context-private storage 
+ *  (gpsee_getContextPrivate()) are always destroyed, so that the storage's owners
+ *  see JSCONTEXT_DESTROY and a reused context never carries stale state.
+ *
  *  @param      cx      The context to destroy
  *
  */
@@ -377,12 +466,24 @@ void gpsee_destroyContext(JSContext *cx)
 {       
   gpsee_runtime_t       *grt = gpsee_getRuntime(cx);
   gpsee_realm_t         *realm;
+  JSBool                reusable = JS_GetContextPrivate(cx) ? JS_FALSE : JS_TRUE;
+
+  if (reusable)
+    resetContext(cx);
 
   JS_EndRequest(cx);
   gpsee_enterAutoMonitor(cx, &grt->monitors.cx);
-  JS_DestroyContext(cx);
 
   realm = gpsee_ds_remove(grt->realmsByContext, cx);
   GPSEE_ASSERT(realm);
+
+  if (reusable && realm && realm->freeContexts.count < grt->contextCacheSize)
+  {
+    JS_ClearContextThread(cx);
+    realm->freeContexts.list[realm->freeContexts.count++] = cx;
+  }
+  else
+    JS_DestroyContext(cx);
+
   gpsee_leaveMonitor(grt->monitors.cx);
 }
@@ -43,6 +43,8 @@ static __attribute__((unused)) const char rcsid[]="$Id: gpsee_unix.c,v 1.6 2011/
  */
 
 #include "gpsee.h"
+#include <prcvar.h>
+#include <time.h>
 
 /** Format a log message, expanding %m as necessary,
  *  and returning a buffer suitable for processing
@@ -82,6 +84,273 @@ const char *gpsee_makeLogFormat(const char *fmt, char *fmtNew)
   return fmt;
 }
 
+/** One message waiting in the async log ring. seq implements a bounded MPSC queue (after
+ *  D. Vyukov): slot i is free for the producer claiming ticket t when seq == t, and holds
+ *  a message for the consumer at ticket t when seq == t + 1.
+ */
+typedef struct
+{
+  volatile jsword       seq;                                    /**< Ticket sequence; see above */
+  int                   pri;                                    /**< syslog priority */
+  char                  msg[GPSEE_MAX_LOG_MESSAGE_SIZE];        /**< Formatted message */
+} logSlot_t;
+
+/** State for the asynchronous syslog sink. Process-wide, like syslog itself. */
+static struct
+{
+  logSlot_t             *slots;         /**< Ring of nSlots messages */
+  size_t                nSlots;         /**< Power of two */
+  volatile jsword       head;           /**< Next ticket a producer will claim */
+  jsword                tail;           /**< Next ticket the drain thread will consume */
+  unsigned int          maxPerSecond;   /**< Rate limit, or 0 for none */
+  volatile jsword       rateWindow;     /**< time() of the current rate-limiting window */
+  volatile jsword       rateCount;      /**< Messages accepted during rateWindow */
+  volatile jsword       droppedFull;    /**< Messages dropped because the ring was full */
+  volatile jsword       droppedRate;    /**< Messages dropped by the rate limit */
+  volatile jsword       running;        /**< Non-zero while producers may use the ring */
+  PRThread              *thread;        /**< Drain thread */
+  PRLock                *lock;          /**< Guards wakeup */
+  PRCondVar             *wakeup;        /**< Signalled to stop the drain thread */
+} asyncLog;
+
+/** Add to a counter shared between threads, without locking */
+static void asyncLog_add(volatile jsword *counter, jsword amount)
+{
+  jsword        old;
+
+  do
+  {
+    old = *counter;
+  } while (jsval_CompareAndSwap((jsval *)counter, old, old + amount) != JS_TRUE);
+}
+
+/** Store to a ring slot's sequence number with a full memory barrier, so that the message
+ *  is visible to the other side before the new sequence number is.
+ */
+static void asyncLog_publish(volatile jsword *seq, jsword value)
+{
+  jsword        old;
+
+  do
+  {
+    old = *seq;
+  } while (jsval_CompareAndSwap((jsval *)seq, old, value) != JS_TRUE);
+}
+
+/** Decide whether the rate limit allows another message during this second */
+static int asyncLog_rateOK(void)
+{
+  jsword        now = (jsword)time(NULL);
+  jsword        window = asyncLog.rateWindow;
+
+  if (!asyncLog.maxPerSecond)
+    return 1;
+
+  if (window != now && jsval_CompareAndSwap((jsval *)&asyncLog.rateWindow, window, now) == JS_TRUE)
+    asyncLog_publish(&asyncLog.rateCount, 0);   /* Racing producers may slip a few extra in; fine for a rate limit */
+
+  if (asyncLog.rateCount >= (jsword)asyncLog.maxPerSecond)
+    return 0;
+
+  asyncLog_add(&asyncLog.rateCount, 1);
+  return 1;
+}
+
+/** Queue a message for the drain thread. Lock-free; never blocks the calling thread.
+ *  @returns    0 if the async sink is not running and the caller should log directly
+ */
+static int asyncLog_enqueue(int pri, const char *msg)
+{
+  jsword        ticket;
+  logSlot_t     *slot;
+
+  if (!asyncLog.running)
+    return 0;
+
+  if (!asyncLog_rateOK())
+  {
+    asyncLog_add(&asyncLog.droppedRate, 1);
+    return 1;
+  }
+
+  for (;;)
+  {
+    ticket = asyncLog.head;
+    slot = &asyncLog.slots[ticket & (asyncLog.nSlots - 1)];
+
+    if (slot->seq == ticket)
+    {
+      if (jsval_CompareAndSwap((jsval *)&asyncLog.head, ticket, ticket + 1) == JS_TRUE)
+        break;
+    }
+    else if (slot->seq < ticket)
+    {
+      asyncLog_add(&asyncLog.droppedFull, 1);    /* Ring full: drop, rather than make JS wait for syslog */
+      return 1;
+    }
+    /* else another producer claimed this ticket first; retry with the new head */
+  }
+
+  slot->pri = pri;
+  strcpy(slot->msg, msg);
+  asyncLog_publish(&slot->seq, ticket + 1);
+
+  return 1;
+}
+
+/** Write any queued messages to syslog, followed by a note about any messages dropped
+ *  since the last report. Only ever run by one thread at a time.
+ */
+static void asyncLog_drain(void)
+{
+  logSlot_t     *slot;
+  jsword        dropped;
+
+  for (;;)
+  {
+    slot = &asyncLog.slots[asyncLog.tail & (asyncLog.nSlots - 1)];
+    if (slot->seq != asyncLog.tail + 1)
+      break;
+
+    syslog(slot->pri, "%s", slot->msg);
+    asyncLog_publish(&slot->seq, asyncLog.tail + asyncLog.nSlots);
+    asyncLog.tail++;
+  }
+
+  if ((dropped = asyncLog.droppedFull))
+  {
+    asyncLog_add(&asyncLog.droppedFull, -dropped);
+    syslog(LOG_WARNING, "gpsee_log: dropped %ld messages (log buffer full)", (long)dropped);
+  }
+
+  if ((dropped = asyncLog.droppedRate))
+  {
+    asyncLog_add(&asyncLog.droppedRate, -dropped);
+    syslog(LOG_WARNING, "gpsee_log: dropped %ld messages (more than %u per second)", (long)dropped, asyncLog.maxPerSecond);
+  }
+}
+
+/** Drain thread for the async log sink */
+static void asyncLog_threadFunc(void *unused)
+{
+  PR_Lock(asyncLog.lock);
+  while (asyncLog.running)
+  {
+    PR_WaitCondVar(asyncLog.wakeup, PR_MillisecondsToInterval(50));
+    PR_Unlock(asyncLog.lock);
+    asyncLog_drain();
+    PR_Lock(asyncLog.lock);
+  }
+  PR_Unlock(asyncLog.lock);
+}
+
+/** Stop accepting messages, stop the drain thread, and write whatever is still queued.
+ *  Leaves the ring allocated, as a late producer may still be touching it.
+ */
+static void asyncLog_shutdown(void)
+{
+  PR_Lock(asyncLog.lock);
+  asyncLog.running = 0;
+  PR_NotifyCondVar(asyncLog.wakeup);
+  PR_Unlock(asyncLog.lock);
+
+  PR_JoinThread(asyncLog.thread);
+  asyncLog.thread = NULL;
+  asyncLog_drain();
+}
+
+/** atexit() handler: make sure messages queued just before exit(), such as those from
+ *  panic(), reach syslog even when the embedder never calls gpsee_stopAsyncLog().
+ */
+static void asyncLog_atexit(void)
+{
+  if (asyncLog.running)
+    asyncLog_shutdown();
+}
+
+/** Send syslog output from gpsee_log() through a ring buffer drained by a background thread, so 
+ *  that logging does not add syscall latency to the calling thread. When the ring is full, or
+ *  the rate limit is exceeded, messages are dropped and counted; the drain thread logs the counts.
+ *  Terminal (stderr) output is unaffected, and remains synchronous. Messages of priority LOG_ERR
+ *  and above bypass the ring and are never dropped; the ring is drained at exit().
+ *
+ *  @param      nSlots          Number of messages the ring can hold; rounded up to a power of two
+ *  @param      maxPerSecond    Maximum messages accepted per second, or 0 for no limit
+ *
+ *  @returns    0 on success, -1 if the sink could not be started (gpsee_log() stays synchronous)
+ */
+int gpsee_startAsyncLog(size_t nSlots, unsigned int maxPerSecond)
+{
+  size_t        i, n;
+  static int    atexitRegistered;
+
+  if (asyncLog.running)
+    return 0;
+
+  for (n = 2; n < nSlots; n <<= 1);
+
+  asyncLog.slots = malloc(n * sizeof(asyncLog.slots[0]));
+  asyncLog.lock = PR_NewLock();
+  asyncLog.wakeup = asyncLog.lock ? PR_NewCondVar(asyncLog.lock) : NULL;
+  if (!asyncLog.slots || !asyncLog.wakeup)
+    goto fail;
+
+  for (i = 0; i < n; i++)
+    asyncLog.slots[i].seq = i;
+  asyncLog.nSlots = n;
+  asyncLog.head = asyncLog.tail = 0;
+  asyncLog.maxPerSecond = maxPerSecond;
+  asyncLog.rateWindow = asyncLog.rateCount = 0;
+  asyncLog.droppedFull = asyncLog.droppedRate = 0;
+  asyncLog.running = 1;
+
+  asyncLog.thread = PR_CreateThread(PR_SYSTEM_THREAD, asyncLog_threadFunc, NULL, PR_PRIORITY_LOW, PR_GLOBAL_THREAD, PR_JOINABLE_THREAD, 0);
+  if (!asyncLog.thread)
+  {
+    asyncLog.running = 0;
+    goto fail;
+  }
+
+  if (!atexitRegistered)
+  {
+    if (atexit(asyncLog_atexit) != 0)
+    {
+      asyncLog_shutdown();
+      goto fail;
+    }
+    atexitRegistered = 1;
+  }
+
+  return 0;
+
+  fail:
+  if (asyncLog.wakeup)
+    PR_DestroyCondVar(asyncLog.wakeup);
+  if (asyncLog.lock)
+    PR_DestroyLock(asyncLog.lock);
+  if (asyncLog.slots)
+    free(asyncLog.slots);
+  memset(&asyncLog, 0, sizeof(asyncLog));
+  return -1;
+}
+
+/** Stop the async log sink, writing any queued messages to syslog first. Messages logged
+ *  after this returns are written synchronously. No other thread may be logging while this
+ *  runs, as it frees the ring.
+ */
+void gpsee_stopAsyncLog(void)
+{
+  if (!asyncLog.running)
+    return;
+
+  asyncLog_shutdown();
+
+  PR_DestroyCondVar(asyncLog.wakeup);
+  PR_DestroyLock(asyncLog.lock);
+  free(asyncLog.slots);
+  memset(&asyncLog, 0, sizeof(asyncLog));
+}
+
 void gpsee_log(JSContext *cx, unsigned int extra, signed int pri, const char *fmt, ...)
 {
   va_list	ap;
@@ -124,10 +393,10 @@ void gpsee_log(JSContext *cx, unsigned int extra, signed int pri, const char *fm
 
   if (n >= GPSEE_MAX_LOG_MESSAGE_SIZE)
   {
+    buf[GPSEE_MAX_LOG_MESSAGE_SIZE-4] = '.';
     buf[GPSEE_MAX_LOG_MESSAGE_SIZE-3] = '.';
     buf[GPSEE_MAX_LOG_MESSAGE_SIZE-2] = '.';
-    buf[GPSEE_MAX_LOG_MESSAGE_SIZE-1] = '.';
-    buf[GPSEE_MAX_LOG_MESSAGE_SIZE-0] = '\0';
+    buf[GPSEE_MAX_LOG_MESSAGE_SIZE-1] = '\0';
   }
 
   if (cx && printToStderr)
@@ -138,7 +407,8 @@ void gpsee_log(JSContext *cx, unsigned int extra, signed int pri, const char *fm
     gpsee_fputc(cx, '\n',    stderr);
   }
 
-  syslog(pri, buf, n);
+  if (pri <= LOG_ERR || !asyncLog_enqueue(pri, buf))	/* Errors are written now, in case we are about to die */
+    syslog(pri, "%s", buf);
 
   return;
 }
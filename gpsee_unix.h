@@ -88,6 +88,8 @@ static __attribute__((unused)) gpsee_runtime_t *_grt(JSContext *cx)
 #define gpsee_openlog(ident)		openlog(ident, LOG_ODELAY | LOG_PID, GPSEE_LOG_FACILITY)
 JS_EXTERN_API(void) gpsee_log(JSContext *cx, unsigned int extra, signed int pri, const char *fmt, ...)  __attribute__((format(printf,4,5)));
 #define gpsee_closelog()		closelog()
+int  gpsee_startAsyncLog(size_t nSlots, unsigned int maxPerSecond);
+void gpsee_stopAsyncLog(void);
 
 typedef void * cfgHnd;     					/**< opaque dictionary */
 typedef void * cfgFILE;					        /**< opaque dictionary I/O handle */
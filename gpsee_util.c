@@ -309,7 +309,7 @@ const char *gpsee_programRelativeFilename(JSContext *cx, const char *long_filena
   if (!realm || !long_filename)
     return long_filename;
 
-  gpsee_enterAutoMonitor(cx, &realm->monitors.programModule);
+  gpsee_enterAutoMonitorShared(cx, &realm->monitors.programModule);
   programModule = realm->monitored.programModule;
   if (!programModule)
     goto out;
@@ -495,7 +495,7 @@ JSBool gpsee_reportUncaughtException(JSContext *cx, jsval exval, int dumpStack)
     gpsee_realm_t       *realm = gpsee_getRealm(cx);
 
     /* Look for filenames which can be shortened */
-    gpsee_enterAutoMonitor(cx, &realm->monitors.programModuleDir);
+    gpsee_enterAutoMonitorShared(cx, &realm->monitors.programModuleDir);
     pm_dir = realm->monitored.programModuleDir;
     if (!pm_dir)
       panic("Out of memory reporting an uncaught exception in " __FILE__);
@@ -791,6 +791,12 @@ int gpsee_isatty(int fd)
 {
   const char *s;
 
+  if (fd == STDIN_FILENO)
+  {
+    if ((s = getenv("GPSEE_STDIN_ISATTY")))
+      return atoi(s) ? 1 : 0;
+  }
+
   if (fd == STDOUT_FILENO)
   {
     if ((s = getenv("GPSEE_STDOUT_ISATTY")))
@@ -183,6 +183,8 @@ static void __attribute__((noreturn)) usage(const char *argv_zero)
                   "    d - Increase verbosity\n"
                   "    e - Do not limit regexps to n^3 levels of backtracking\n"
                   "    J - Disable nanojit\n"
+                  "    P - Profile require(); report at exit on stderr, and as a Chrome\n"
+                  "        trace in $GPSEE_REQUIRE_TRACE if set\n"
                   "    S - Disable Strict mode\n"
                   "    R - Load RC file for interpreter (" PRODUCT_SHORTNAME ") based on\n"
                   "        script filename.\n"
@@ -258,6 +260,20 @@ static void __attribute__((noreturn)) moreHelp(const char *argv_zero)
   exit(1);
 };
 
+/** Turn on the require() profiler for the program's realm. The Chrome trace file is named by
+ *  the gpsee_require_profile_trace RC setting, or $GPSEE_REQUIRE_TRACE.
+ */
+static void enableRequireProfiler(JSContext *cx)
+{
+  const char *traceFilename = cfg_default_value(cfg, "gpsee_require_profile_trace", getenv("GPSEE_REQUIRE_TRACE"));
+
+  if (gpsee_enableRequireProfiler(cx, gpsee_getRealm(cx), traceFilename) == JS_FALSE)
+  {
+    JS_ClearPendingException(cx);
+    gpsee_log(cx, GLOG_WARNING, "Could not enable require() profiler");
+  }
+}
+
 /** Process the script interpreter flags.
  *
  *  @param	flags	An array of flags, in no particular order.
@@ -311,6 +327,10 @@ static void processFlags(JSContext *cx, const char *flags, signed int *verbosity
 	gcZeal++;
 	break;
 
+      case 'P':	/* Profile require() */
+	enableRequireProfiler(cx);
+	break;
+
       case 'd':	/* increase debug level */
 	(*verbosity_p)++;;
 	break;	
@@ -551,7 +571,7 @@ PRIntn prmain(PRIntn argc, char **argv)
     int 	c;
     char	*flag_p = flags;
 
-    while ((c = getopt(argc, argv, whenSureLynx("D:r:","") "v:c:hHnf:F:aCRxSUWdeJz")) != -1)
+    while ((c = getopt(argc, argv, whenSureLynx("D:r:","") "v:c:hHnf:F:aCRxSUWdeJPz")) != -1)
     {
       switch(c)
       {
@@ -590,6 +610,7 @@ PRIntn prmain(PRIntn argc, char **argv)
 	case 'd':
 	case 'e':
 	case 'J':
+	case 'P':
 	case 'S':
 	case 'R':
 	case 'U':
@@ -673,6 +694,15 @@ PRIntn prmain(PRIntn argc, char **argv)
     putenv((char *)"GPSEE_NO_UTF8_C_STRINGS=1");
   }
 
+#if !defined(__SURELYNX__)
+  if ((cfg_bool_value(cfg, "gpsee_async_log") == cfg_true) || getenv("GPSEE_ASYNC_LOG"))
+  {
+    if (gpsee_startAsyncLog(strtol(cfg_default_value(cfg, "gpsee_async_log_slots", "1024"), NULL, 0),
+			    strtol(cfg_default_value(cfg, "gpsee_async_log_max_per_second", "0"), NULL, 0)))
+      gpsee_log(NULL, GLOG_NOTICE, "Could not start asynchronous logging; logging synchronously");
+  }
+#endif
+
   jsi = gpsee_createInterpreter();
   realm = jsi->realm;
   cx = jsi->cx;
@@ -685,6 +715,9 @@ PRIntn prmain(PRIntn argc, char **argv)
   processFlags(cx, flags, &verbosity);
   free(flags);
 
+  if (cfg_bool_value(cfg, "gpsee_require_profile") == cfg_true)
+    enableRequireProfiler(cx);
+
 #if defined(__SURELYNX__)
   sl_set_debugLevel(gpsee_verbosity(0));
   /* enableTerminalLogs(permanent_pool, gpsee_verbosity(0) > 0, NULL); */
@@ -895,6 +928,9 @@ PRIntn prmain(PRIntn argc, char **argv)
 
   gpsee_destroyInterpreter(jsi);
   JS_ShutDown();
+#if !defined(__SURELYNX__)
+  gpsee_stopAsyncLog();
+#endif
 
   return exitCode;
 }
@@ -0,0 +1,360 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	Base64Stream.c	Classes for encoding and decoding base 64 a piece at a time, 
+ *				e.g. for MIME bodies which do not fit comfortably in memory.
+ *
+ *  binary.Base64Encoder::push() takes ByteStrings or ByteArrays and returns Strings;
+ *  binary.Base64Decoder::push() takes Strings and returns ByteThings. Input which does
+ *  not make up a whole base 64 group is carried to the next push(), and flush() ends 
+ *  the stream. Concatenating the results gives the same answer as binary.toBase64() or 
+ *  binary.fromBase64() on the whole stream.
+ */
+
+#include "gpsee.h"
+#include "binary.h"
+#include "base64.h"
+
+#define ENCODER_CLASS_ID MODULE_ID ".Base64Encoder"
+#define DECODER_CLASS_ID MODULE_ID ".Base64Decoder"
+
+static JSClass *base64Encoder_clasp;
+static JSClass *base64Decoder_clasp;
+
+/** Private handle for Base64Encoder instances */
+typedef struct
+{
+  unsigned char		pending[3];		/**< Bytes from the end of the last chunk which did not make a whole group */
+  size_t		pendingLength;		/**< Number of bytes in pending */
+  size_t		lineLength;		/**< Maximum output line length, or 0 for no line breaks */
+  size_t		column;			/**< Characters already written on the current output line */
+} base64Encoder_handle_t;
+
+/** Implements Base64Encoder::push(chunk). Returns the base 64 encoding of as much of the ByteString 
+ *  or ByteArray chunk, together with bytes left over from earlier chunks, as makes whole groups.
+ */
+static JSBool Base64Encoder_push(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval				*argv = JS_ARGV(cx, vp);
+  base64Encoder_handle_t	*hnd = JS_GetInstancePrivate(cx, JS_THIS_OBJECT(cx, vp), base64Encoder_clasp, NULL);
+  byteThing_handle_t		*chunkHnd;
+  const unsigned char		*in;
+  size_t			inLen, headLen = 0, tailLen;
+  JSString			*str;
+
+  if (!hnd)
+    return gpsee_throw(cx, ENCODER_CLASS_ID ".push.type: native member function applied to non-Base64Encoder object");
+
+  if (argc != 1)
+    return gpsee_throw(cx, ENCODER_CLASS_ID ".push.arguments.count");
+
+  if (!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) || !gpsee_isByteThing(cx, JSVAL_TO_OBJECT(argv[0])) || 
+      !(chunkHnd = JS_GetPrivate(cx, JSVAL_TO_OBJECT(argv[0]))))
+    return gpsee_throw(cx, ENCODER_CLASS_ID ".push.arguments.0.type: chunk must be a ByteString or ByteArray");
+
+  in    = chunkHnd->buffer;
+  inLen = chunkHnd->length;
+
+  if (hnd->pendingLength + inLen < 3)
+  {
+    memcpy(hnd->pending + hnd->pendingLength, in, inLen);
+    hnd->pendingLength += inLen;
+    JS_SET_RVAL(cx, vp, JS_GetEmptyStringValue(cx));
+    return JS_TRUE;
+  }
+
+  /* Complete the group left over from the last chunk */
+  if (hnd->pendingLength)
+  {
+    size_t take = 3 - hnd->pendingLength;
+
+    memcpy(hnd->pending + hnd->pendingLength, in, take);
+    in    += take;
+    inLen -= take;
+    headLen = 3;
+  }
+
+  tailLen = inLen % 3;
+  str = b64_encodeString(cx, hnd->pending, headLen, in, inLen - tailLen, hnd->lineLength, &hnd->column);
+  if (!str)
+    return JS_FALSE;
+
+  memcpy(hnd->pending, in + inLen - tailLen, tailLen);
+  hnd->pendingLength = tailLen;
+
+  JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(str));
+  return JS_TRUE;
+}
+
+/** Implements Base64Encoder::flush(). Ends the stream, returning the padded encoding of any 
+ *  bytes left over from the last chunk. The encoder may then be re-used for a new stream.
+ */
+static JSBool Base64Encoder_flush(JSContext *cx, uintN argc, jsval *vp)
+{
+  base64Encoder_handle_t	*hnd = JS_GetInstancePrivate(cx, JS_THIS_OBJECT(cx, vp), base64Encoder_clasp, NULL);
+  JSString			*str;
+
+  if (!hnd)
+    return gpsee_throw(cx, ENCODER_CLASS_ID ".flush.type: native member function applied to non-Base64Encoder object");
+
+  str = b64_encodeString(cx, NULL, 0, hnd->pending, hnd->pendingLength, hnd->lineLength, &hnd->column);
+  if (!str)
+    return JS_FALSE;
+
+  hnd->pendingLength = 0;
+  hnd->column = 0;
+
+  JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(str));
+  return JS_TRUE;
+}
+
+/** Implements Base64Decoder::push(string). Returns a ByteThing holding the decoding of as much of
+ *  the string, together with characters left over from earlier strings, as makes whole groups.
+ *  Whitespace is ignored; padding or other non-base 64 characters end the data.
+ */
+static JSBool Base64Decoder_push(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  b64_decoder_t		*hnd = JS_GetInstancePrivate(cx, JS_THIS_OBJECT(cx, vp), base64Decoder_clasp, NULL);
+  JSString		*str;
+  JSObject		*obj;
+
+  if (!hnd)
+    return gpsee_throw(cx, DECODER_CLASS_ID ".push.type: native member function applied to non-Base64Decoder object");
+
+  if (argc != 1)
+    return gpsee_throw(cx, DECODER_CLASS_ID ".push.arguments.count");
+
+  str = JS_ValueToString(cx, argv[0]);
+  if (!str)
+    return JS_FALSE;
+  argv[0] = STRING_TO_JSVAL(str);
+
+  obj = b64_decodeString(cx, str, hnd, JS_FALSE);
+  if (!obj)
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+  return JS_TRUE;
+}
+
+/** Implements Base64Decoder::flush(). Ends the stream, returning a ByteThing holding the bytes 
+ *  encoded by an unpadded final group. The decoder may then be re-used for a new stream.
+ */
+static JSBool Base64Decoder_flush(JSContext *cx, uintN argc, jsval *vp)
+{
+  b64_decoder_t		*hnd = JS_GetInstancePrivate(cx, JS_THIS_OBJECT(cx, vp), base64Decoder_clasp, NULL);
+  unsigned char		tmp[2];
+  size_t		n;
+  JSObject		*obj;
+
+  if (!hnd)
+    return gpsee_throw(cx, DECODER_CLASS_ID ".flush.type: native member function applied to non-Base64Decoder object");
+
+  n = b64_decodeFinish(hnd, tmp);
+  if (n)
+    obj = gpsee_newByteThing(cx, tmp, n, JS_TRUE);
+  else
+    obj = gpsee_newByteThing(cx, NULL, 0, JS_FALSE);
+  if (!obj)
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+  return JS_TRUE;
+}
+
+/** 
+ *  Implements the Base64Encoder constructor.
+ *  new binary.Base64Encoder([options]), where options.lineLength requests CRLF line breaks
+ *  (76 for MIME).
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	Pre-allocated Base64Encoder object
+ *  @param	argc	Number of arguments passed to constructor
+ *  @param	argv	Arguments passed to constructor
+ *  @param	rval	The new object returned to JavaScript
+ *
+ *  @returns 	JS_TRUE on success
+ */
+static JSBool Base64Encoder(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  base64Encoder_handle_t	*hnd;
+  int32				lineLength = 0;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, ENCODER_CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc > 1)
+    return gpsee_throw(cx, ENCODER_CLASS_ID ".constructor.arguments.count");
+
+  if (argc == 1 && !JSVAL_IS_VOID(argv[0]) && !JSVAL_IS_NULL(argv[0]))
+  {
+    jsval v;
+
+    if (!JSVAL_IS_OBJECT(argv[0]))
+      return gpsee_throw(cx, ENCODER_CLASS_ID ".constructor.arguments.0.type: options must be an object");
+
+    if (JS_GetProperty(cx, JSVAL_TO_OBJECT(argv[0]), "lineLength", &v) == JS_FALSE)
+      return JS_FALSE;
+
+    if (!JSVAL_IS_VOID(v) && JS_ValueToInt32(cx, v, &lineLength) == JS_FALSE)
+      return JS_FALSE;
+
+    if (lineLength < 0)
+      return gpsee_throw(cx, ENCODER_CLASS_ID ".constructor.lineLength.range: line length must not be negative");
+  }
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+  memset(hnd, 0, sizeof(*hnd));
+  hnd->lineLength = lineLength;
+
+  JS_SetPrivate(cx, obj, hnd);
+  return JS_TRUE;
+}
+
+/** 
+ *  Implements the Base64Decoder constructor.
+ *  new binary.Base64Decoder()
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	Pre-allocated Base64Decoder object
+ *  @param	argc	Number of arguments passed to constructor
+ *  @param	argv	Arguments passed to constructor
+ *  @param	rval	The new object returned to JavaScript
+ *
+ *  @returns 	JS_TRUE on success
+ */
+static JSBool Base64Decoder(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  b64_decoder_t	*hnd;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, DECODER_CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc != 0)
+    return gpsee_throw(cx, DECODER_CLASS_ID ".constructor.arguments.count");
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+  memset(hnd, 0, sizeof(*hnd));
+
+  JS_SetPrivate(cx, obj, hnd);
+  return JS_TRUE;
+}
+
+/**
+ *  Finalizer for Base64Encoder and Base64Decoder.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	The object to finalize
+ */
+static void Base64Stream_Finalize(JSContext *cx, JSObject *obj)
+{
+  void	*hnd = JS_GetPrivate(cx, obj);
+
+  if (hnd)
+    JS_free(cx, hnd);
+}
+
+/** Initializes binary.Base64Encoder and binary.Base64Decoder
+ *  @returns	The Base64Decoder prototype, or NULL on failure
+ */
+JSObject *Base64Stream_InitClasses(JSContext *cx, JSObject *obj)
+{
+  /** Description of the encoder class: */
+  static JSClass base64Encoder_class =
+  {
+    GPSEE_CLASS_NAME(Base64Encoder),	/**< its name is Base64Encoder */
+    JSCLASS_HAS_PRIVATE,		/**< private slot in use */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Base64Stream_Finalize,		/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  /** Description of the decoder class: */
+  static JSClass base64Decoder_class =
+  {
+    GPSEE_CLASS_NAME(Base64Decoder),	/**< its name is Base64Decoder */
+    JSCLASS_HAS_PRIVATE,		/**< private slot in use */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Base64Stream_Finalize,		/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSFunctionSpec encoder_methods[] =
+  {
+    JS_FN("push",		Base64Encoder_push,		1, 0),
+    JS_FN("flush",		Base64Encoder_flush,		0, 0),
+    JS_FS_END
+  };
+
+  static JSFunctionSpec decoder_methods[] =
+  {
+    JS_FN("push",		Base64Decoder_push,		1, 0),
+    JS_FN("flush",		Base64Decoder_flush,		0, 0),
+    JS_FS_END
+  };
+
+  JSObject *proto;
+
+  proto = JS_InitClass(cx, obj, NULL, &base64Encoder_class, Base64Encoder, 1, NULL, encoder_methods, NULL, NULL);
+  if (!proto)
+    return NULL;
+  base64Encoder_clasp = &base64Encoder_class;
+
+  proto = JS_InitClass(cx, obj, NULL, &base64Decoder_class, Base64Decoder, 0, NULL, decoder_methods, NULL, NULL);
+  if (!proto)
+    return NULL;
+  base64Decoder_clasp = &base64Decoder_class;
+
+  return proto;
+}
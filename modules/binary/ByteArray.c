@@ -48,13 +48,17 @@ static const char __attribute__((unused)) rcsid[]="$Id: ByteArray.c,v 1.8 2010/1
 static void	ByteArray_Finalize(JSContext *cx, JSObject *obj);
 static JSBool	ByteArray_getProperty(JSContext *cx, JSObject *obj, jsval idval, jsval *vp);
 static JSBool	ByteArray_setProperty(JSContext *cx, JSObject *obj, jsval idval, jsval *vp);
-static JSBool 	byteArray_requestSize(JSContext *cx, byteArray_handle_t *hnd, size_t newSize);
+static JSBool 	byteArray_requestFrontSize(JSContext *cx, JSObject *obj, byteArray_handle_t *hnd, size_t frontSize);
 static JSBool 	byteArray_append(JSContext *cx, uintN argc, jsval *vp, const char * methodName);
 static JSBool 	byteArray_prepend(JSContext *cx, uintN argc, jsval *vp, const char * methodName);
 
 JSObject *byteArray_proto;
 #define CLASS_ID  MODULE_ID ".ByteArray"
 
+/** Slices at least this long, covering at least half of their parent, share the parent's
+ *  backing store copy-on-write rather than copying it. */
+#define BYTEARRAY_COW_SLICE_MIN 1024
+
 /** Returns a pointer to a byteArray_handle_t, or NULL on error
  *  @param      cx          Your JSContext
  *  @param      obj         ByteArray instance
@@ -104,7 +108,7 @@ static JSBool ByteArray_setLength(JSContext *cx, JSObject *obj, jsval id, jsval
 
   /* Resize our byte vector */
   oldSize = hnd->length;
-  if (!byteArray_requestSize(cx, hnd, size))
+  if (!byteArray_requestSize(cx, obj, hnd, size))
     return JS_FALSE;
   hnd->length = size;
 
@@ -149,7 +153,9 @@ static JSBool ByteArray_setProperty(JSContext *cx, JSObject *obj, jsval id, jsva
   if ((errmsg=byteThing_val2byte(cx, *vp, &theByte)))
     return gpsee_throw(cx, CLASS_ID ".setter.byte.invalid: %s", errmsg);
 
-  /* Assign byte value and return! */
+  /* Unshare copy-on-write storage, assign byte value and return! */
+  if (!byteArray_requestSize(cx, obj, hnd, hnd->length))
+    return JS_FALSE;
   hnd->buffer[index] = theByte;
   return JS_TRUE;
 }
@@ -286,8 +292,13 @@ static void ByteArray_Finalize(JSContext *cx, JSObject *obj)
   if (!hnd)
     return;
 
-  if (hnd->buffer && (obj == hnd->memoryOwner))
-    JS_free(cx, hnd->buffer);
+  if (obj == hnd->memoryOwner)
+  {
+    if (hnd->realBuffer)
+      JS_free(cx, hnd->realBuffer);
+    else if (hnd->buffer)
+      JS_free(cx, hnd->buffer);
+  }
 
   JS_free(cx, hnd);
 
@@ -308,32 +319,172 @@ static JSBool ByteArray(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, j
     return ByteArray_Constructor(cx, obj, argc, argv, rval);
 }
 
-/** Resize a ByteArray
+/* ByteArrays which own their memory may keep spare capacity at both ends of hnd->buffer, so
+ * that they can be used as FIFOs: shift() and splice() from the front advance hnd->buffer,
+ * and unshift()/extendLeft() grow into the space in front of it. When hnd->realBuffer is
+ * not NULL it is the start of the allocation and hnd->capacity is measured from it;
+ * otherwise the allocation starts at hnd->buffer.
+ */
+
+/** Number of unused bytes in front of hnd->buffer */
+#define byteArray_headRoom(hnd) ((hnd)->realBuffer ? (size_t)((hnd)->buffer - (hnd)->realBuffer) : 0)
+
+/** Give a copy-on-write ByteArray a private buffer with room for at least newSize bytes.
+ *  @returns  JS_FALSE on OOM */
+static JSBool byteArray_unshare(JSContext *cx, JSObject *obj, byteArray_handle_t *hnd, size_t newSize)
+{
+  unsigned char	*buffer;
+  size_t	roundUp = 16;
+
+  if (newSize < hnd->length)
+    newSize = hnd->length;
+  while (roundUp < newSize)
+    roundUp <<= 1;
+
+  buffer = JS_malloc(cx, roundUp);
+  if (!buffer)
+    return JS_FALSE;
+  memcpy(buffer, hnd->buffer, hnd->length);
+
+  hnd->buffer       = buffer;
+  hnd->realBuffer   = buffer;
+  hnd->capacity     = roundUp;
+  hnd->memoryOwner  = obj;
+  hnd->btFlags     &= ~bt_copyOnWrite;
+
+  return JS_TRUE;
+}
+
+/** Resize a ByteArray. Copy-on-write ByteArrays are always given a private buffer, so
+ *  callers about to modify hnd->buffer in place request hnd->length bytes first.
+ *
+ *  hnd->buffer may move, either because the memory was reallocated or because the
+ *  contents were slid back over free space in front of them.
+ *
  *  @param    cx
+ *  @param    obj         The ByteArray which owns hnd
  *  @param    hnd         a byteArray_handle_t
  *  @param    newSize     A number that is greater than or equal to the number of bytes you wish
  *                        to make available in hnd->buffer.
  *  @returns  JS_FALSE on OOM */
-static JSBool byteArray_requestSize(JSContext *cx, byteArray_handle_t *hnd, size_t newSize)
+JSBool byteArray_requestSize(JSContext *cx, JSObject *obj, byteArray_handle_t *hnd, size_t newSize)
 {
-  if (hnd->capacity < newSize)
+  size_t		headRoom;
+  unsigned char		*base;
+
+  if (hnd->btFlags & bt_copyOnWrite)
+    return byteArray_unshare(cx, obj, hnd, newSize);
+
+  headRoom = byteArray_headRoom(hnd);
+  if (hnd->capacity >= headRoom + newSize)
+    return JS_TRUE;
+
+  base = hnd->realBuffer ? hnd->realBuffer : hnd->buffer;
+
+  /* Slide the contents back over the space in front of them. When that space is at least
+   * as large as the contents, the cost of the move is paid for by the shifts which created
+   * it and we are done; otherwise we are about to reallocate anyway. */
+  if (headRoom)
+  {
+    memmove(base, hnd->buffer, hnd->length);
+    hnd->buffer = base;
+
+    if (hnd->capacity >= newSize && headRoom >= hnd->length)
+      return JS_TRUE;
+  }
+
   {
     size_t roundUp = 16;
     while (roundUp < newSize)
       roundUp <<= 1;
+    if (roundUp <= hnd->capacity)
+      roundUp = hnd->capacity << 1;
 
-    hnd->buffer = JS_realloc(cx, hnd->buffer, roundUp);
-    if (!hnd->buffer)
+    base = JS_realloc(cx, base, roundUp);
+    if (!base)
     {
-      hnd->capacity = 0;
       JS_ReportOutOfMemory(cx);
       return JS_FALSE;
     }
-    hnd->capacity = roundUp;
+    hnd->buffer     = base;
+    hnd->realBuffer = base;
+    hnd->capacity   = roundUp;
   }
   return JS_TRUE;
 }
 
+/** Make at least frontSize bytes available in front of hnd->buffer, so that hnd->buffer may
+ *  be moved back by that much. The front space grows geometrically, so repeated prepends
+ *  cost amortized O(1) per byte. hnd->buffer may move.
+ *
+ *  @param    cx
+ *  @param    obj         The ByteArray which owns hnd
+ *  @param    hnd         a byteArray_handle_t
+ *  @param    frontSize   The number of bytes needed in front of hnd->buffer
+ *  @returns  JS_FALSE on OOM */
+static JSBool byteArray_requestFrontSize(JSContext *cx, JSObject *obj, byteArray_handle_t *hnd, size_t frontSize)
+{
+  unsigned char		*buffer;
+  size_t		roundUp = 16;
+  size_t		want;
+
+  if (hnd->btFlags & bt_copyOnWrite)
+  {
+    if (!byteArray_unshare(cx, obj, hnd, hnd->length))
+      return JS_FALSE;
+  }
+
+  if (byteArray_headRoom(hnd) >= frontSize)
+    return JS_TRUE;
+
+  /* Allocate room for twice what we need, and split the slack between the ends */
+  want = hnd->length + frontSize;
+  while (roundUp < want * 2)
+    roundUp <<= 1;
+
+  buffer = JS_malloc(cx, roundUp);
+  if (!buffer)
+    return JS_FALSE;
+
+  want = frontSize + (roundUp - want) / 2;
+  if (hnd->length)
+    memcpy(buffer + want, hnd->buffer, hnd->length);
+
+  if (hnd->realBuffer)
+    JS_free(cx, hnd->realBuffer);
+  else if (hnd->buffer)
+    JS_free(cx, hnd->buffer);
+
+  hnd->realBuffer = buffer;
+  hnd->buffer     = buffer + want;
+  hnd->capacity   = roundUp;
+
+  return JS_TRUE;
+}
+
+/** Remove count bytes from the front of a ByteArray without moving the rest. Copy-on-write
+ *  ByteArrays simply move their view of the shared memory forward.
+ *
+ *  @param    hnd         a byteArray_handle_t
+ *  @param    count       The number of bytes to remove; must not exceed hnd->length
+ */
+static void byteArray_consumeFront(byteArray_handle_t *hnd, size_t count)
+{
+  if (!hnd->realBuffer && !(hnd->btFlags & bt_copyOnWrite))
+  {
+    hnd->realBuffer = hnd->buffer;
+    if (hnd->capacity < hnd->length)
+      hnd->capacity = hnd->length;
+  }
+
+  hnd->buffer += count;
+  hnd->length -= count;
+
+  /* Empty: all of the memory is in front again */
+  if (!hnd->length && hnd->realBuffer)
+    hnd->buffer = hnd->realBuffer;
+}
+
 /** Implements ByteArray.toByteArray() */
 static JSBool ByteArray_toByteArray(JSContext *cx, uintN argc, jsval *vp)
 {
@@ -387,6 +538,8 @@ static JSBool ByteArray_reverse(JSContext *cx, uintN argc, jsval *vp)
   hnd = byteArray_getHandle(cx, JS_THIS_OBJECT(cx, vp), "reverse");
   if (!hnd)
     return JS_FALSE;
+  if (!byteArray_requestSize(cx, JS_THIS_OBJECT(cx, vp), hnd, hnd->length))
+    return JS_FALSE;
   buf = hnd->buffer;
   len = hnd->length;
   for(i=0, l=len/2; i<l; i++)
@@ -434,12 +587,15 @@ static JSBool byteArray_append(JSContext *cx, uintN argc, jsval *vp, const char
 
   /* Reallocate as necessary */
   oldBuffer = hnd->buffer;
-  if (!byteArray_requestSize(cx, hnd, hnd->length + len))
+  if (!byteArray_requestSize(cx, JS_THIS_OBJECT(cx, vp), hnd, hnd->length + len))
     return JS_FALSE;
 
-  /* Watch out for the case of myByteArray.concat(myByteArray) or other overlapping copies */
+  /* Watch out for the case of myByteArray.concat(myByteArray), where requestSize may have moved
+   * our contents, or other overlapping copies */
+  if (buffer == oldBuffer)
+    buffer = hnd->buffer;
   memmove(hnd->buffer + hnd->length, buffer, len);
-  if (stealBuffer && oldBuffer != buffer)
+  if (stealBuffer && buffer != hnd->buffer)
     JS_free(cx, buffer);
 
   hnd->length += len;
@@ -459,9 +615,7 @@ static JSBool ByteArray_pop(JSContext *cx, uintN argc, jsval *vp)
   /* Return a Number to the Javascript caller */
   retval = hnd->buffer[hnd->length-1];
 
-  /* Resize buffer to "pop" the return value off the top */;
-  if (!byteArray_requestSize(cx, hnd, hnd->length-1))
-    return JS_FALSE;
+  /* "Pop" the return value off the top; shrinking never needs memory, or a private copy */
   hnd->length--;
 
   /* Return Number */
@@ -480,7 +634,7 @@ static JSBool ByteArray_push(JSContext *cx, uintN argc, jsval *vp)
     return JS_FALSE;
 
   /* Resize our byte vector */
-  if (!byteArray_requestSize(cx, hnd, hnd->length + argc))
+  if (!byteArray_requestSize(cx, JS_THIS_OBJECT(cx, vp), hnd, hnd->length + argc))
     return JS_FALSE;
 
   /* Start appending things! */
@@ -525,27 +679,23 @@ static JSBool byteArray_prepend(JSContext *cx, uintN argc, jsval *vp, const char
   if (len == 0)
     return JS_TRUE;
 
-  /* Reallocate if necessary */
+  /* Make room in front of our contents, reallocating if necessary */
   /* Save a pointer to our internal buffer for pointer comparison later */
   oldBuffer = hnd->buffer;
-  if (!byteArray_requestSize(cx, hnd, hnd->length + len))
+  if (!byteArray_requestFrontSize(cx, JS_THIS_OBJECT(cx, vp), hnd, len))
     return JS_FALSE;
 
-  /* Watch out for the case of myByteArray.unshift(myByteArray) */
+  /* Watch out for the case of myByteArray.unshift(myByteArray); our contents may have moved */
   if (oldBuffer == buffer)
-    /* memcpy() any faster than memmove()? */
-    memcpy(hnd->buffer + len, hnd->buffer, hnd->length);
-  else
-  {
-    /* Slide original contents toward the end */
-    memmove(hnd->buffer + len, hnd->buffer, hnd->length);
-    /* Copy new contents into our ByteArray's buffer at the beginning */
-    memcpy(hnd->buffer, buffer, len);
-
-    /* Free memory if necessary */
-    if (stealBuffer)
-      JS_free(cx, buffer);
-  }
+    buffer = hnd->buffer;
+
+  /* Copy new contents into the space in front of our ByteArray's buffer */
+  hnd->buffer -= len;
+  memcpy(hnd->buffer, buffer, len);
+
+  /* Free memory if necessary */
+  if (stealBuffer && buffer != hnd->buffer + len)
+    JS_free(cx, buffer);
 
   /* Update our ByteArray's length */
   hnd->length += len;
@@ -579,12 +729,7 @@ static JSBool ByteArray_shift(JSContext *cx, uintN argc, jsval *vp)
   theByte = hnd->buffer[0];
 
   /* Shift one member off the low end */
-  memcpy(hnd->buffer, hnd->buffer+1, hnd->length-1);
-
-  /* Resize byte vector, reallocating if necessary */
-  if (!byteArray_requestSize(cx, hnd, hnd->length - 1))
-    return JS_FALSE;
-  hnd->length--;
+  byteArray_consumeFront(hnd, 1);
 
   /* Return byte */
   JS_SET_RVAL(cx, vp, INT_TO_JSVAL(theByte));
@@ -606,7 +751,9 @@ static JSBool ByteArray_sort(JSContext *cx, uintN argc, jsval *vp)
   if (!hnd)
     return JS_FALSE;
 
-  /* Quick-sort! */
+  /* Unshare copy-on-write storage, then quick-sort! */
+  if (!byteArray_requestSize(cx, JS_THIS_OBJECT(cx, vp), hnd, hnd->length))
+    return JS_FALSE;
   qsort(hnd->buffer, hnd->length, 1, compare_bytes);
 
   return JS_TRUE;
@@ -615,6 +762,60 @@ static int compare_bytes(const void *a, const void*b)
 {
   return *(const unsigned char*)a - *(const unsigned char*)b;
 }
+/** Create a ByteArray which shares a subsection of obj's buffer copy-on-write. If obj owns
+ *  its buffer, ownership moves to a hidden immutable ByteString first, so that both obj and
+ *  the slice reference a store which neither of them will free or modify; whichever writes
+ *  first gets a private copy via byteArray_requestSize().
+ *
+ *  @param      cx      JavaScript context
+ *  @param      obj     The ByteArray being sliced
+ *  @param      hnd     obj's private handle
+ *  @param      start   Offset of the slice in hnd->buffer
+ *  @param      length  Length of the slice
+ *  @returns    The new ByteArray, or NULL if an exception was thrown
+ */
+static JSObject *byteArray_cowSlice(JSContext *cx, JSObject *obj, byteArray_handle_t *hnd, size_t start, size_t length)
+{
+  JSObject		*owner;
+  byteArray_handle_t	*sliceHnd;
+  JSObject		*slice;
+
+  if (hnd->memoryOwner == obj)
+  {
+    byteString_handle_t	*ownerHnd;
+    unsigned char	*base = hnd->realBuffer ? hnd->realBuffer : hnd->buffer;
+
+    /* The owner spans the whole allocation, including any space in front of hnd->buffer */
+    owner = byteThing_fromCArray(cx, base, byteArray_headRoom(hnd) + hnd->length, NULL,
+                                 byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 1);
+    if (!owner)
+      return NULL;
+
+    ownerHnd = JS_GetPrivate(cx, owner);
+    ownerHnd->btFlags |= bt_immutable;
+
+    hnd->memoryOwner = owner;
+    hnd->realBuffer  = NULL;
+    hnd->capacity    = 0;
+    hnd->btFlags    |= bt_copyOnWrite;
+  }
+  else if (hnd->btFlags & bt_copyOnWrite)
+    owner = hnd->memoryOwner;	/* not obj: obj lets go of the store when it is first written */
+  else
+    return byteThing_fromCArray(cx, hnd->buffer + start, length, NULL,
+                                byteArray_clasp, byteArray_proto, sizeof(byteArray_handle_t), 0);
+
+  slice = byteThing_newSharedSlice(cx, owner, hnd->buffer + start, length,
+                                   byteArray_clasp, byteArray_proto, sizeof(byteArray_handle_t));
+  if (!slice)
+    return NULL;
+
+  sliceHnd = JS_GetPrivate(cx, slice);
+  sliceHnd->btFlags = bt_copyOnWrite;
+
+  return slice;
+}
+
 /** Implemented both ByteArray.slice() and ByteArray.splice() instance methods */
 static JSBool ByteArray_lice(JSContext *cx, uintN argc, jsval *vp, JSBool splice, const char *methodName)
 {
@@ -622,9 +823,10 @@ static JSBool ByteArray_lice(JSContext *cx, uintN argc, jsval *vp, JSBool splice
   byteArray_handle_t *  hnd;
   ssize_t               start, end, size;
   JSObject *            retval;
+  JSObject *            thisObj = JS_THIS_OBJECT(cx, vp);
   
   /* Acquire a pointer to our internal bytestring data */
-  hnd = byteArray_getHandle(cx, JS_THIS_OBJECT(cx, vp), methodName);
+  hnd = byteArray_getHandle(cx, thisObj, methodName);
   if (!hnd)
     return JS_FALSE;
   size = hnd->length;
@@ -664,6 +866,11 @@ static JSBool ByteArray_lice(JSContext *cx, uintN argc, jsval *vp, JSBool splice
     retval = byteThing_fromCArray(cx, NULL, 0, NULL,
                                   byteArray_clasp, byteArray_proto, sizeof(byteArray_handle_t), 0);
   }
+  /* Share large slices copy-on-write with the parent ByteArray */
+  else if (!splice && (end - start) >= BYTEARRAY_COW_SLICE_MIN && (size_t)(end - start) >= hnd->length / 2)
+  {
+    retval = byteArray_cowSlice(cx, thisObj, hnd, start, end - start);
+  }
   /* Instantiate a new ByteArray from a subsection of the buffer */
   else
   {
@@ -675,12 +882,16 @@ static JSBool ByteArray_lice(JSContext *cx, uintN argc, jsval *vp, JSBool splice
   if (!retval)
     return JS_FALSE;
 
-  /* Do we need to remove the chunk we're returning? */
-  if (splice && start != end)
+  /* Do we need to remove the chunk we're returning? Removing from the front is O(1). */
+  if (splice && start == 0 && end != 0)
+    byteArray_consumeFront(hnd, end);
+  else if (splice && start != end)
   {
     size_t newSize = hnd->length - (end - start);
-    memcpy(hnd->buffer + start, hnd->buffer + end, hnd->length - end);
-    byteArray_requestSize(cx, hnd, newSize);
+
+    if (!byteArray_requestSize(cx, thisObj, hnd, hnd->length))
+      return JS_FALSE;
+    memmove(hnd->buffer + start, hnd->buffer + end, hnd->length - end);
     hnd->length = newSize;
   }
 
@@ -706,12 +917,12 @@ static JSBool ByteArray_displace(JSContext *cx, uintN argc, jsval *vp)
 /** Implements ByteArray.indexOf() */
 static JSBool ByteArray_indexOf(JSContext *cx, uintN argc, jsval *vp)
 {
-  return byteThing_findChar(cx, argc, vp, memchr, "indexOf", byteArray_clasp);
+  return byteThing_findChar(cx, argc, vp, memchr, byteThing_memmem, "indexOf", byteArray_clasp);
 }
 /** Implements ByteArray.lastIndexOf() */
 static JSBool ByteArray_lastIndexOf(JSContext *cx, uintN argc, jsval *vp)
 {
-  return byteThing_findChar(cx, argc, vp, memrchr, "lastIndexOf", byteArray_clasp);
+  return byteThing_findChar(cx, argc, vp, memrchr, byteThing_memrmem, "lastIndexOf", byteArray_clasp);
 }
 /** ByteArray_xintAt() implements the ByteArray member method xintAt() */
 JSBool ByteArray_xintAt(JSContext *cx, uintN argc, jsval *vp)
@@ -51,6 +51,7 @@ static const char __attribute__((unused)) rcsid[]="$Id: ByteString.c,v 1.11 2011
 
 JSObject *byteString_proto;
 #define CLASS_ID MODULE_ID ".ByteString"
+#define BYTESTRING_SHARED_SLICE_MIN	32	/**< Shorter slices are copied; cheaper than pinning the parent's memory */
 
 /** Returns a pointer to a byteString_handle_t, or NULL on error
  *  @param      cx          Your JSContext
@@ -73,6 +74,37 @@ inline byteString_handle_t * byteString_getHandle(JSContext *cx, JSObject *obj,
 
 GPSEE_STATIC_ASSERT(sizeof(int64) == sizeof(long long int));
 
+/** Create a ByteString holding bytes [start, start + length) of another ByteString. Slices of at 
+ *  least BYTESTRING_SHARED_SLICE_MIN bytes share the parent's backing store rather than copying it.
+ *  ByteStrings are immutable, so the sharing is invisible to script, except that the parent's
+ *  memory stays alive for as long as any slice of it is reachable.
+ *
+ *  @param      cx          Your JSContext
+ *  @param      obj         The parent ByteString
+ *  @param      hnd         The parent's handle
+ *  @param      start       Offset of the first byte of the slice
+ *  @param      length      Number of bytes in the slice
+ *  @returns    The new ByteString, or NULL if an exception was thrown
+ */
+static JSObject *byteString_slice(JSContext *cx, JSObject *obj, byteString_handle_t *hnd, size_t start, size_t length)
+{
+  JSObject            *retval;
+  byteString_handle_t *rHnd;
+
+  /* No memoryOwner means the buffer lifetime is managed elsewhere; we cannot extend it */
+  if ((length >= BYTESTRING_SHARED_SLICE_MIN) && hnd->memoryOwner)
+    return byteThing_newSharedSlice(cx, obj, hnd->buffer + start, length, byteString_clasp, byteString_proto, sizeof(byteString_handle_t));
+
+  retval = byteThing_fromCArray(cx, hnd->buffer + start, length, NULL, byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
+  if (retval)
+  {
+    rHnd = JS_GetPrivate(cx, retval);
+    rHnd->btFlags |= bt_immutable;
+  }
+
+  return retval;
+}
+
 /** Tests an index to be sure it is within a byteString_handle_t's range, and throws
  *  @param      cx          Your JSContext
  *  @param      bs          Your byteString_handle_t
@@ -129,21 +161,21 @@ inline int byteString_retrieveAndCheckIndexArgument(JSContext *cx, byteString_ha
 }
 
 /** Implements ByteString::indexOf method. Method arguments are
- *  (byte, start, stop). Byte could be a number, or single element
- *  ByteArray or ByteString. -1 indicates not found.
+ *  (byte, start, stop). Byte could be a number, or a ByteArray or
+ *  ByteString, which is searched for as a byte sequence. -1 indicates not found.
  */
 JSBool ByteString_indexOf(JSContext *cx, uintN argc, jsval *vp)
 {
-  return byteThing_findChar(cx, argc, vp, memchr, "indexOf", byteString_clasp);
+  return byteThing_findChar(cx, argc, vp, memchr, byteThing_memmem, "indexOf", byteString_clasp);
 }
 
 /** Implements ByteString::lastIndexOf method. Method arguments are
- *  (byte, start, stop). Byte could be a number, or single element
- *  ByteArray or ByteString. -1 indicates not found.
+ *  (byte, start, stop). Byte could be a number, or a ByteArray or
+ *  ByteString, which is searched for as a byte sequence. -1 indicates not found.
  */
 static JSBool ByteString_lastIndexOf(JSContext *cx, uintN argc, jsval *vp)
 {
-  return byteThing_findChar(cx, argc, vp, memrchr, "lastIndexOf", byteString_clasp);
+  return byteThing_findChar(cx, argc, vp, memrchr, byteThing_memrmem, "lastIndexOf", byteString_clasp);
 }
 
 /** Implements ByteString::decodeToString method */
@@ -340,19 +372,26 @@ static void ByteString_Finalize(JSContext *cx, JSObject *obj)
   return;
 }
 
-/** ByteString_split() implements the ByteString member method split() */
+/** ByteString_split() implements the ByteString member method split(). The delimiter may be a byte
+ *  value, or a ByteString or ByteArray of any length; multi-byte delimiters are located with 
+ *  byteThing_memmem(), single bytes with memchr().
+ */
 JSBool ByteString_split(JSContext *cx, uintN argc, jsval *vp)
 {
   jsval 		*argv = JS_ARGV(cx, vp);
   byteString_handle_t	*hnd;
   JSObject              *retval;
-  int                   i, l, chunkstart, chunklen, chunknum;
-  unsigned char         *buf, delimiter;
+  size_t                chunkstart, chunkend;
+  int                   chunknum;
+  unsigned char         *buf, scalarDelimiter;
+  const unsigned char   *delimiter, *found;
+  size_t                delimiterLength;
   jsdouble              delimiter_temp;
-  /* TODO support more delimiter types than scalar int */
+  JSBool                success = JS_TRUE;
+  JSObject              *thisObj = JS_THIS_OBJECT(cx, vp);
 
   /* Acquire a pointer to our internal bytestring data */
-  hnd = byteString_getHandle(cx, JS_THIS_OBJECT(cx, vp), "split");
+  hnd = byteString_getHandle(cx, thisObj, "split");
   if (!hnd)
     return JS_FALSE;
   buf = hnd->buffer;
@@ -368,18 +407,34 @@ JSBool ByteString_split(JSContext *cx, uintN argc, jsval *vp)
     return gpsee_throw(cx, CLASS_ID ".split.arguments.count");
 
   /* Type coercion for long delimiters */
-  if (JSVAL_IS_OBJECT(argv[0]))
+  if (JSVAL_IS_OBJECT(argv[0]) && !JSVAL_IS_NULL(argv[0]))
   {
-    /* TODO support long delimiters */
-    return gpsee_throw(cx, CLASS_ID ".split.arguments.unimplemented");
-  }
+    JSObject            *o = JSVAL_TO_OBJECT(argv[0]);
+    JSClass             *c = JS_GET_CLASS(cx, o);
+    byteThing_handle_t  *dHnd;
+
+    /* TODO support arrays of delimiters */
+    if ((c != byteString_clasp && c != byteArray_clasp) || !(dHnd = JS_GetPrivate(cx, o)))
+      return gpsee_throw(cx, CLASS_ID ".split.arguments.unimplemented");
 
-  /* Type coercion for scalar delimiters */
-  if (!JS_ValueToNumber(cx, argv[0], &delimiter_temp))
-    return gpsee_throw(cx, CLASS_ID ".split.arguments.type.invalid");
-  delimiter = (unsigned char)delimiter_temp;
-  if (delimiter_temp != delimiter)
-    return gpsee_throw(cx, CLASS_ID ".split.arguments.type.invalid: %lf invalid byte value", delimiter_temp);
+    if (dHnd->length == 0)
+      return gpsee_throw(cx, CLASS_ID ".split.arguments.0.empty: delimiter must not be empty");
+
+    delimiter = dHnd->buffer;
+    delimiterLength = dHnd->length;
+  }
+  else
+  {
+    /* Type coercion for scalar delimiters */
+    if (!JS_ValueToNumber(cx, argv[0], &delimiter_temp))
+      return gpsee_throw(cx, CLASS_ID ".split.arguments.type.invalid");
+    scalarDelimiter = (unsigned char)delimiter_temp;
+    if (delimiter_temp != scalarDelimiter)
+      return gpsee_throw(cx, CLASS_ID ".split.arguments.type.invalid: %lf invalid byte value", delimiter_temp);
+
+    delimiter = &scalarDelimiter;
+    delimiterLength = 1;
+  }
 
   /* Instantiate an array to hold our results */
   retval = JS_NewArrayObject(cx, 0, NULL);
@@ -389,43 +444,41 @@ JSBool ByteString_split(JSContext *cx, uintN argc, jsval *vp)
   /* Protect our array from garbage collector */
   JS_AddObjectRoot(cx, &retval);
 
-  /* Iterate through ByteArray splitting it up by 'delimiter' */
-  chunkstart = 0;
-  chunklen = 0;
-  chunknum = 0;
-  for (i=0, l=hnd->length, chunkstart=0, chunklen=0; i<=l; i++)
+  /* Walk through ByteString splitting it up by 'delimiter'; a trailing empty chunk is not reported */
+  for (chunkstart = 0, chunknum = 0; success == JS_TRUE; chunkstart = chunkend + delimiterLength)
   {
-    /* Split! */
-    if (((i==l) && (chunklen>0)) || (buf[i] == delimiter))
+    JSObject    *o;
+    jsval       oval;
+
+    found = byteThing_memmem(buf + chunkstart, hnd->length - chunkstart, delimiter, delimiterLength);
+    chunkend = found ? (size_t)(found - buf) : hnd->length;
+
+    if (!found && (chunkend == chunkstart))
+      break;
+
+    /* Instantiate new ByteString */
+    o = byteString_slice(cx, thisObj, hnd, chunkstart, chunkend - chunkstart);
+    if (!o)
     {
-      JSBool success;
-      jsval oval;
-      /* Instantiate new ByteArray */
-      JSObject *o = byteThing_fromCArray(cx, buf + chunkstart, chunklen, NULL,
-                                         byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
-      if (!o)
-        return JS_FALSE;
-      /* Push the new ByteArray into our result array */
-      JS_AddObjectRoot(cx, &o);
-      oval = OBJECT_TO_JSVAL(o);
-      success = JS_SetElement(cx, retval, chunknum++, &oval);
-      JS_RemoveObjectRoot(cx, &o);
-      if (!success)
-        return JS_FALSE;
-      /* Start on new chunk! */
-      chunkstart = i+1;
-      chunklen = 0;
-    } else {
-      chunklen++;
+      success = JS_FALSE;
+      break;
     }
+
+    /* Push the new ByteString into our result array */
+    oval = OBJECT_TO_JSVAL(o);
+    success = JS_SetElement(cx, retval, chunknum++, &oval);
+
+    if (!found)
+      break;
   }
 
   /* Return the array object containing results */
-  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(retval));
+  if (success == JS_TRUE)
+    JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(retval));
   /* Un-GC-protect */
   JS_RemoveObjectRoot(cx, &retval);
-  /* Success! */
-  return JS_TRUE;
+
+  return success;
 }
 /** ByteString_slice() implements the ByteString member method slice() */
 JSBool ByteString_slice(JSContext *cx, uintN argc, jsval *vp)
@@ -482,8 +535,7 @@ JSBool ByteString_slice(JSContext *cx, uintN argc, jsval *vp)
     end = start;
 
   /* Instantiate a new ByteString from a subsection of the buffer */
-  retval = byteThing_fromCArray(cx, hnd->buffer + start, end - start, NULL,
-                                byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
+  retval = byteString_slice(cx, JS_THIS_OBJECT(cx, vp), hnd, start, end - start);
 
   /* Success! */
   if (retval)
@@ -565,8 +617,7 @@ JSBool ByteString_substr(JSContext *cx, uintN argc, jsval *vp)
   GPSEE_ASSERT(start + len < hnd->buffer + hnd->length);
 
   /* Instantiate a new ByteString from a subsection of the buffer */
-  retval = byteThing_fromCArray(cx, hnd->buffer + start, len, NULL,
-                                byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
+  retval = byteString_slice(cx, JS_THIS_OBJECT(cx, vp), hnd, start, len);
   if (!retval)
     return JS_FALSE;
 
@@ -629,8 +680,7 @@ JSBool ByteString_substring(JSContext *cx, uintN argc, jsval *vp)
   }
 
   /* Instantiate a new ByteString from a subsection of the buffer */
-  retval = byteThing_fromCArray(cx, hnd->buffer + start, end - start, NULL,
-                                byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
+  retval = byteString_slice(cx, JS_THIS_OBJECT(cx, vp), hnd, start, end - start);
 
   /* Success! */
   if (retval)
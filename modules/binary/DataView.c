@@ -0,0 +1,552 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	DataView.c	A class for reading and writing arrays of numbers stored in
+ *				the backing store of any GPSEE ByteThing.
+ *
+ *  A DataView has a fixed element type and byte order, chosen when it is constructed:
+ *  new binary.DataView(byteThing, "uint16", littleEndian). Offsets are in bytes and 
+ *  need not be aligned. readArray() and writeArray() move any number of elements per 
+ *  call, so parsers do not pay for a native call per value.
+ *
+ *  The view holds the ByteThing, not its buffer, and looks the buffer up on each call; 
+ *  ByteArrays may therefore change size underneath a view without harm.
+ */
+
+#include "gpsee.h"
+#include "binary.h"
+
+#define CLASS_ID MODULE_ID ".DataView"
+
+#if defined(_BIG_ENDIAN) || (defined(BYTE_ORDER) && defined(BIG_ENDIAN) && BYTE_ORDER == BIG_ENDIAN)
+# define HOST_IS_LITTLE_ENDIAN JS_FALSE
+#else
+# define HOST_IS_LITTLE_ENDIAN JS_TRUE
+#endif
+
+static JSClass *dataView_clasp;
+
+/** Element types a DataView can hold */
+typedef enum
+{
+  dv_int8, dv_uint8, dv_int16, dv_uint16, dv_int32, dv_uint32, dv_float32, dv_float64
+} dataView_type_e;
+
+static const struct
+{
+  const char		*name;
+  size_t		size;
+} dataView_types[] =
+{
+  { "int8",	1 },
+  { "uint8",	1 },
+  { "int16",	2 },
+  { "uint16",	2 },
+  { "int32",	4 },
+  { "uint32",	4 },
+  { "float32",	4 },
+  { "float64",	8 }
+};
+
+/** Private handle for DataView instances. The ByteThing being viewed lives in reserved slot 0. */
+typedef struct
+{
+  dataView_type_e	type;		/**< Type of each element */
+  size_t		size;		/**< Bytes per element */
+  JSBool		swap;		/**< Element byte order differs from the host's */
+} dataView_handle_t;
+
+/** Get the handles for a DataView and the ByteThing it views, or throw.
+ *  @param	target_p	[out] The ByteThing, or NULL if the caller does not need it
+ *  @returns	The ByteThing's handle, or NULL if an exception was thrown
+ */
+static byteThing_handle_t *dataView_getHandles(JSContext *cx, JSObject *obj, dataView_handle_t **hnd_p, JSObject **target_p,
+					       const char *methodName)
+{
+  jsval			v;
+  byteThing_handle_t	*btHnd;
+
+  *hnd_p = obj ? JS_GetInstancePrivate(cx, obj, dataView_clasp, NULL) : NULL;
+  if (!*hnd_p)
+  {
+    (void)gpsee_throw(cx, CLASS_ID ".%s.type: native member function applied to non-DataView object", methodName);
+    return NULL;
+  }
+
+  if (!JS_GetReservedSlot(cx, obj, 0, &v))
+    return NULL;
+
+  btHnd = JS_GetPrivate(cx, JSVAL_TO_OBJECT(v));
+  if (!btHnd)
+  {
+    (void)gpsee_throw(cx, CLASS_ID ".%s.invalid: ByteThing handle missing!", methodName);
+    return NULL;
+  }
+
+  if (target_p)
+    *target_p = JSVAL_TO_OBJECT(v);
+
+  return btHnd;
+}
+
+/** Parse a byte offset and element count, and check that they lie within the ByteThing.
+ *  @returns	JS_FALSE if an exception was thrown
+ */
+static JSBool dataView_range(JSContext *cx, dataView_handle_t *hnd, byteThing_handle_t *btHnd, jsval offsetVal, jsval countVal,
+			     size_t *offset_p, size_t *count_p, const char *methodName)
+{
+  const char	*err;
+
+  err = byteThing_val2size(cx, offsetVal, offset_p, methodName);
+  if (err)
+    return gpsee_throw(cx, CLASS_ID ".%s.arguments.0.invalid: %s", methodName, err);
+
+  err = byteThing_val2size(cx, countVal, count_p, methodName);
+  if (err)
+    return gpsee_throw(cx, CLASS_ID ".%s.arguments.1.invalid: %s", methodName, err);
+
+  if ((*offset_p > btHnd->length) || (*count_p > (btHnd->length - *offset_p) / hnd->size))
+    return gpsee_throw(cx, CLASS_ID ".%s.range: " GPSEE_SIZET_FMT " %s elements at byte " GPSEE_SIZET_FMT 
+		       " do not fit in " GPSEE_SIZET_FMT " bytes", methodName, *count_p, dataView_types[hnd->type].name, 
+		       *offset_p, btHnd->length);
+
+  return JS_TRUE;
+}
+
+/** Get the ByteThing's buffer ready for writing, or throw if it is read-only */
+static JSBool dataView_writable(JSContext *cx, JSObject *target, byteThing_handle_t *btHnd, const char *methodName)
+{
+  if ((btHnd->btFlags & bt_immutable) || (JS_GET_CLASS(cx, target) == byteString_clasp))
+    return gpsee_throw(cx, CLASS_ID ".%s.readOnly: cannot write to an immutable %s", methodName, JS_GET_CLASS(cx, target)->name);
+
+  return gpsee_unshareByteThing(cx, target);
+}
+
+/** Read one element as a jsval */
+static JSBool dataView_load(JSContext *cx, dataView_handle_t *hnd, const unsigned char *p, jsval *vp)
+{
+  unsigned char	b[8];
+  size_t	i;
+  jsdouble	d;
+
+  if (hnd->swap)
+  {
+    for (i = 0; i < hnd->size; i++)
+      b[i] = p[hnd->size - 1 - i];
+    p = b;
+  }
+
+  switch(hnd->type)
+  {
+    case dv_int8:	*vp = INT_TO_JSVAL(*(const signed char *)p);		return JS_TRUE;
+    case dv_uint8:	*vp = INT_TO_JSVAL(*p);					return JS_TRUE;
+    case dv_int16:	{ int16   x; memcpy(&x, p, 2); *vp = INT_TO_JSVAL(x); }	return JS_TRUE;
+    case dv_uint16:	{ uint16  x; memcpy(&x, p, 2); *vp = INT_TO_JSVAL(x); }	return JS_TRUE;
+    case dv_int32:	{ int32   x; memcpy(&x, p, 4); d = x; }			break;
+    case dv_uint32:	{ uint32  x; memcpy(&x, p, 4); d = x; }			break;
+    case dv_float32:	{ float   x; memcpy(&x, p, 4); d = x; }			break;
+    case dv_float64:	{ jsdouble x; memcpy(&x, p, 8); d = x; }		break;
+    default:		GPSEE_NOT_REACHED("invalid DataView type");		return JS_FALSE;
+  }
+
+  return JS_NewNumberValue(cx, d, vp);
+}
+
+/** Convert a jsval to one element's bytes, in the view's byte order, as for typed array assignment.
+ *  Conversion may run script (valueOf), which can resize, move or share the ByteThing's buffer, so
+ *  the caller must not compute where the element goes until this has returned.
+ */
+static JSBool dataView_encode(JSContext *cx, dataView_handle_t *hnd, jsval v, unsigned char *p)
+{
+  unsigned char	b[8];
+  size_t	i;
+  int32		i32;
+  uint32	u32;
+  jsdouble	d;
+
+  switch(hnd->type)
+  {
+    case dv_int8:
+    case dv_uint8:
+    case dv_int16:
+    case dv_uint16:
+    case dv_uint32:
+      if (JSVAL_IS_INT(v))
+	u32 = JSVAL_TO_INT(v);
+      else if (JS_ValueToECMAUint32(cx, v, &u32) == JS_FALSE)
+	return JS_FALSE;
+      if (hnd->size == 1)
+	b[0] = u32;
+      else if (hnd->size == 2)
+      {
+	uint16 x = u32;
+	memcpy(b, &x, 2);
+      }
+      else
+	memcpy(b, &u32, 4);
+      break;
+    case dv_int32:
+      if (JSVAL_IS_INT(v))
+	i32 = JSVAL_TO_INT(v);
+      else if (JS_ValueToECMAInt32(cx, v, &i32) == JS_FALSE)
+	return JS_FALSE;
+      memcpy(b, &i32, 4);
+      break;
+    case dv_float32:
+    case dv_float64:
+      if (JS_ValueToNumber(cx, v, &d) == JS_FALSE)
+	return JS_FALSE;
+      if (hnd->type == dv_float32)
+      {
+	float f = d;
+	memcpy(b, &f, 4);
+      }
+      else
+	memcpy(b, &d, 8);
+      break;
+    default:
+      GPSEE_NOT_REACHED("invalid DataView type");
+      return JS_FALSE;
+  }
+
+  if (hnd->swap)
+  {
+    for (i = 0; i < hnd->size; i++)
+      p[i] = b[hnd->size - 1 - i];
+  }
+  else
+    memcpy(p, b, hnd->size);
+
+  return JS_TRUE;
+}
+
+/** Implements DataView::get(byteOffset). Returns one element. */
+static JSBool DataView_get(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  dataView_handle_t	*hnd;
+  byteThing_handle_t	*btHnd = dataView_getHandles(cx, JS_THIS_OBJECT(cx, vp), &hnd, NULL, "get");
+  size_t		offset, count;
+
+  if (!btHnd)
+    return JS_FALSE;
+
+  if (argc != 1)
+    return gpsee_throw(cx, CLASS_ID ".get.arguments.count");
+
+  if (!dataView_range(cx, hnd, btHnd, argv[0], INT_TO_JSVAL(1), &offset, &count, "get"))
+    return JS_FALSE;
+
+  return dataView_load(cx, hnd, btHnd->buffer + offset, vp);
+}
+
+/** Store one encoded element at a byte offset. The value has already been converted, so no script can
+ *  run between checking the ByteThing and writing to it.
+ *  @returns	JS_FALSE if an exception was thrown
+ */
+static JSBool dataView_store(JSContext *cx, dataView_handle_t *hnd, JSObject *target, byteThing_handle_t *btHnd, 
+			     size_t offset, const unsigned char *element, const char *methodName)
+{
+  if ((offset > btHnd->length) || (hnd->size > btHnd->length - offset))
+    return gpsee_throw(cx, CLASS_ID ".%s.range: ByteThing shrank during write", methodName);
+
+  if (!dataView_writable(cx, target, btHnd, methodName))
+    return JS_FALSE;
+
+  memcpy(btHnd->buffer + offset, element, hnd->size);
+  return JS_TRUE;
+}
+
+/** Implements DataView::set(byteOffset, value). Stores one element. */
+static JSBool DataView_set(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  dataView_handle_t	*hnd;
+  JSObject		*target;
+  byteThing_handle_t	*btHnd = dataView_getHandles(cx, JS_THIS_OBJECT(cx, vp), &hnd, &target, "set");
+  size_t		offset, count;
+  unsigned char		element[8];
+
+  if (!btHnd)
+    return JS_FALSE;
+
+  if (argc != 2)
+    return gpsee_throw(cx, CLASS_ID ".set.arguments.count");
+
+  if (!dataView_range(cx, hnd, btHnd, argv[0], INT_TO_JSVAL(1), &offset, &count, "set"))
+    return JS_FALSE;
+
+  if (!dataView_writable(cx, target, btHnd, "set"))
+    return JS_FALSE;
+
+  if (!dataView_encode(cx, hnd, argv[1], element) || !dataView_store(cx, hnd, target, btHnd, offset, element, "set"))
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Implements DataView::readArray(byteOffset, count). Returns an Array of count elements
+ *  stored consecutively from byteOffset.
+ */
+static JSBool DataView_readArray(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  dataView_handle_t	*hnd;
+  byteThing_handle_t	*btHnd = dataView_getHandles(cx, JS_THIS_OBJECT(cx, vp), &hnd, NULL, "readArray");
+  size_t		offset, count, i;
+  JSObject		*array;
+  jsval			v;
+
+  if (!btHnd)
+    return JS_FALSE;
+
+  if (argc != 2)
+    return gpsee_throw(cx, CLASS_ID ".readArray.arguments.count");
+
+  if (!dataView_range(cx, hnd, btHnd, argv[0], argv[1], &offset, &count, "readArray"))
+    return JS_FALSE;
+
+  array = JS_NewArrayObject(cx, 0, NULL);
+  if (!array)
+    return JS_FALSE;
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(array));	/* root it */
+
+  for (i = 0; i < count; i++)
+  {
+    /* A setter on Array.prototype could run script which resizes a ByteArray; check again */
+    if (offset + (i + 1) * hnd->size > btHnd->length)
+      return gpsee_throw(cx, CLASS_ID ".readArray.range: ByteThing shrank during read");
+
+    if (!dataView_load(cx, hnd, btHnd->buffer + offset + i * hnd->size, &v) || !JS_SetElement(cx, array, i, &v))
+      return JS_FALSE;
+  }
+
+  return JS_TRUE;
+}
+
+/** Implements DataView::writeArray(byteOffset, array). Stores the elements of array (any 
+ *  array-like object) consecutively from byteOffset, and returns the number stored.
+ */
+static JSBool DataView_writeArray(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  dataView_handle_t	*hnd;
+  JSObject		*target, *array;
+  byteThing_handle_t	*btHnd = dataView_getHandles(cx, JS_THIS_OBJECT(cx, vp), &hnd, &target, "writeArray");
+  size_t		offset, count, i;
+  jsuint		arrayLength;
+  jsval			v;
+  unsigned char		element[8];
+
+  if (!btHnd)
+    return JS_FALSE;
+
+  if (argc != 2)
+    return gpsee_throw(cx, CLASS_ID ".writeArray.arguments.count");
+
+  if (!JSVAL_IS_OBJECT(argv[1]) || JSVAL_IS_NULL(argv[1]))
+    return gpsee_throw(cx, CLASS_ID ".writeArray.arguments.1.type: must be an Array");
+  array = JSVAL_TO_OBJECT(argv[1]);
+
+  if (!JS_GetArrayLength(cx, array, &arrayLength))
+    return JS_FALSE;
+
+  if (!dataView_range(cx, hnd, btHnd, argv[0], INT_TO_JSVAL(0), &offset, &count, "writeArray"))
+    return JS_FALSE;
+  count = arrayLength;
+  if (count > (btHnd->length - offset) / hnd->size)
+    return gpsee_throw(cx, CLASS_ID ".writeArray.range: " GPSEE_SIZET_FMT " %s elements at byte " GPSEE_SIZET_FMT 
+		       " do not fit in " GPSEE_SIZET_FMT " bytes", count, dataView_types[hnd->type].name, offset, btHnd->length);
+
+  if (!dataView_writable(cx, target, btHnd, "writeArray"))
+    return JS_FALSE;
+
+  for (i = 0; i < count; i++)
+  {
+    /* Getters and valueOf() may run script which resizes or slices a ByteArray; dataView_store() checks again */
+    if (!JS_GetElement(cx, array, i, &v) || !dataView_encode(cx, hnd, v, element))
+      return JS_FALSE;
+
+    if (!dataView_store(cx, hnd, target, btHnd, offset + i * hnd->size, element, "writeArray"))
+      return JS_FALSE;
+  }
+
+  return JS_NewNumberValue(cx, count, vp);
+}
+
+/** Getter for DataView::length, the number of whole elements in the ByteThing */
+static JSBool dataView_length_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  dataView_handle_t	*hnd;
+  byteThing_handle_t	*btHnd = dataView_getHandles(cx, obj, &hnd, NULL, "length");
+
+  if (!btHnd)
+    return JS_FALSE;
+
+  return JS_NewNumberValue(cx, btHnd->length / hnd->size, vp);
+}
+
+/** 
+ *  Implements the DataView constructor.
+ *  new binary.DataView(byteThing, type, [littleEndian])
+ *
+ *  type is one of int8, uint8, int16, uint16, int32, uint32, float32 or float64.
+ *  Elements are big-endian (network order) unless littleEndian is true.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	Pre-allocated DataView object
+ *  @param	argc	Number of arguments passed to constructor
+ *  @param	argv	Arguments passed to constructor
+ *  @param	rval	The new object returned to JavaScript
+ *
+ *  @returns 	JS_TRUE on success
+ */
+static JSBool DataView(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  dataView_handle_t	*hnd;
+  JSString		*str;
+  const char		*typeName;
+  JSBool		littleEndian = JS_FALSE;
+  size_t		i;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc < 2 || argc > 3)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.count");
+
+  if (!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) || !gpsee_isByteThing(cx, JSVAL_TO_OBJECT(argv[0])))
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.0.type: must be a ByteThing");
+
+  str = JS_ValueToString(cx, argv[1]);
+  if (!str)
+    return JS_FALSE;
+  argv[1] = STRING_TO_JSVAL(str);
+  typeName = JS_GetStringBytes(str);
+
+  for (i = 0; i < sizeof(dataView_types) / sizeof(dataView_types[0]); i++)
+  {
+    if (strcmp(typeName, dataView_types[i].name) == 0)
+      break;
+  }
+  if (i == sizeof(dataView_types) / sizeof(dataView_types[0]))
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.1.invalid: unknown element type '%s'", typeName);
+
+  if (argc == 3 && JS_ValueToBoolean(cx, argv[2], &littleEndian) == JS_FALSE)
+    return JS_FALSE;
+
+  if (!JS_SetReservedSlot(cx, obj, 0, argv[0]))
+    return JS_FALSE;
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+
+  hnd->type = i;
+  hnd->size = dataView_types[i].size;
+  hnd->swap = (hnd->size > 1) && (littleEndian != HOST_IS_LITTLE_ENDIAN);
+
+  JS_SetPrivate(cx, obj, hnd);
+  return JS_TRUE;
+}
+
+/**
+ *  DataView Finalizer.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	The object to finalize
+ */
+static void DataView_Finalize(JSContext *cx, JSObject *obj)
+{
+  dataView_handle_t	*hnd = JS_GetPrivate(cx, obj);
+
+  if (hnd)
+    JS_free(cx, hnd);
+}
+
+/** Initializes binary.DataView */
+JSObject *DataView_InitClass(JSContext *cx, JSObject *obj)
+{
+  /** Description of this class: */
+  static JSClass dataView_class =
+  {
+    GPSEE_CLASS_NAME(DataView),		/**< its name is DataView */
+    JSCLASS_HAS_PRIVATE |		/**< private slot in use */
+    JSCLASS_HAS_RESERVED_SLOTS(1),	/**< slot 0 roots the ByteThing being viewed */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    DataView_Finalize,			/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSPropertySpec instance_props[] =
+  {
+    { "length",	0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, dataView_length_getter, NULL },
+    { NULL, 0, 0, NULL, NULL }
+  };
+
+  static JSFunctionSpec instance_methods[] =
+  {
+    JS_FN("get",		DataView_get,			1, 0),
+    JS_FN("set",		DataView_set,			2, 0),
+    JS_FN("readArray",		DataView_readArray,		2, 0),
+    JS_FN("writeArray",		DataView_writeArray,		2, 0),
+    JS_FS_END
+  };
+
+  JSObject *proto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &dataView_class,	/* clasp - Class struct to init. Defs class for use by other API funs */
+		   DataView,		/* constructor function - Scope matches obj */
+		   2,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   instance_props,	/* ps - props struct for parent_proto */
+		   instance_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+
+  GPSEE_ASSERT(proto);
+  dataView_clasp = &dataView_class;
+
+  return proto;
+}
@@ -0,0 +1,425 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	LineReader.c	A class for splitting a file descriptor or a ByteThing into
+ *				delimited records ("lines") without per-line buffer churn.
+ *
+ *  File descriptors are read in large chunks. Each chunk is an immutable ByteString
+ *  which is never exposed to script; lines are ByteStrings which share the chunk's
+ *  backing store (see byteThing_newSharedSlice()), so producing a line costs one
+ *  memchr()/memmem() scan and one small allocation for the handle, regardless of line length.
+ *  A line which spans a chunk boundary is carried into the next chunk.
+ *
+ *  Immutable ByteThings (ByteStrings, memory-mapped files) are scanned in place and
+ *  lines share their memory; mutable ByteThings are copied line-by-line.
+ */
+
+#include "gpsee.h"
+#include "binary.h"
+
+#define CLASS_ID MODULE_ID ".LineReader"
+#define LINEREADER_DEFAULT_BUFFER_SIZE	65536	/**< Default chunk size for reading file descriptors */
+#define LINEREADER_MAX_DELIMITER	16	/**< Longest delimiter we will accept */
+
+static JSClass *lineReader_clasp;
+
+/** Private handle for LineReader instances. The current chunk (fd sources) or the
+ *  source ByteThing (in-memory sources) is kept GC-reachable by reserved slot 0.
+ */
+typedef struct
+{
+  int			fd;				/**< File descriptor being read, or -1 for in-memory sources */
+  JSObject		*chunk;				/**< Object owning buf; rooted in reserved slot 0 */
+  unsigned char		*buf;				/**< Bytes being scanned */
+  size_t		len;				/**< Number of valid bytes in buf */
+  size_t		capacity;			/**< Size of buf (fd sources only) */
+  size_t		pos;				/**< Start of the next line in buf */
+  size_t		bufferSize;			/**< Minimum chunk size for fd sources */
+  JSBool		eof;				/**< No more bytes will be appended to buf */
+  JSBool		copyLines;			/**< Source is mutable: lines must be copied */
+  JSBool		keepDelimiter;			/**< Include the delimiter at the end of each line */
+  size_t		delimiterLength;		/**< Number of bytes in delimiter */
+  unsigned char		delimiter[LINEREADER_MAX_DELIMITER];	/**< Record separator */
+} lineReader_handle_t;
+
+/** Append more bytes from the file descriptor to the current chunk. When the chunk is full,
+ *  a new chunk is allocated and the unconsumed tail of the old one is carried into it.
+ *
+ *  @returns	JS_TRUE on success, including EOF
+ */
+static JSBool lineReader_fill(JSContext *cx, JSObject *obj, lineReader_handle_t *hnd)
+{
+  ssize_t	bytesRead;
+  jsrefcount	depth;
+
+  if (hnd->len == hnd->capacity)
+  {
+    size_t		carry = hnd->len - hnd->pos;
+    size_t		capacity = hnd->bufferSize;
+    unsigned char	*buf;
+    JSObject		*chunk;
+    byteThing_handle_t	*chunkHnd;
+
+    while (capacity < carry * 2)
+      capacity *= 2;
+
+    buf = JS_malloc(cx, capacity);
+    if (!buf)
+      return JS_FALSE;
+
+    if (carry)
+      memcpy(buf, hnd->buf + hnd->pos, carry);
+
+    chunk = byteThing_fromCArray(cx, buf, capacity, NULL, byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 1);
+    if (!chunk)
+    {
+      JS_free(cx, buf);
+      return JS_FALSE;
+    }
+
+    /* Bytes in a chunk are never changed once a line could have been sliced from them */
+    chunkHnd = JS_GetPrivate(cx, chunk);
+    chunkHnd->btFlags |= bt_immutable;
+
+    if (!JS_SetReservedSlot(cx, obj, 0, OBJECT_TO_JSVAL(chunk)))
+      return JS_FALSE;
+
+    hnd->chunk    = chunk;
+    hnd->buf      = buf;
+    hnd->capacity = capacity;
+    hnd->len      = carry;
+    hnd->pos      = 0;
+  }
+
+  depth = JS_SuspendRequest(cx);
+  do
+  {
+    bytesRead = read(hnd->fd, hnd->buf + hnd->len, hnd->capacity - hnd->len);
+  } while ((bytesRead == -1) && (errno == EINTR));
+  JS_ResumeRequest(cx, depth);
+
+  if (bytesRead == -1)
+    return gpsee_throw(cx, CLASS_ID ".readLine.read: Error reading file descriptor %i (%m)", hnd->fd);
+
+  if (bytesRead == 0)
+    hnd->eof = JS_TRUE;
+  else
+    hnd->len += bytesRead;
+
+  return JS_TRUE;
+}
+
+/** Implements LineReader::readLine(). Returns the next line as a ByteString, or null at end of input. */
+static JSBool LineReader_readLine(JSContext *cx, uintN argc, jsval *vp)
+{
+  JSObject		*obj = JS_THIS_OBJECT(cx, vp);
+  lineReader_handle_t	*hnd = JS_GetInstancePrivate(cx, obj, lineReader_clasp, NULL);
+  const unsigned char	*found;
+  size_t		scanFrom;
+  size_t		lineLength;
+  const unsigned char	*line;
+  JSObject		*retval;
+
+  if (!hnd)
+    return gpsee_throw(cx, CLASS_ID ".readLine.type: native member function applied to non-LineReader object");
+
+  if (hnd->copyLines && hnd->chunk)	/* Mutable source -- buffer may have moved or shrunk since last call */
+  {
+    byteThing_handle_t *srcHnd = JS_GetPrivate(cx, hnd->chunk);
+
+    hnd->buf = srcHnd->buffer;
+    hnd->len = srcHnd->length;
+    if (hnd->pos > hnd->len)
+      hnd->pos = hnd->len;
+  }
+
+  scanFrom = hnd->pos;
+  for (;;)
+  {
+    found = byteThing_memmem(hnd->buf + scanFrom, hnd->len - scanFrom, hnd->delimiter, hnd->delimiterLength);
+    if (found)
+    {
+      line = hnd->buf + hnd->pos;
+      lineLength = (found - line) + (hnd->keepDelimiter ? hnd->delimiterLength : 0);
+      hnd->pos = (found - hnd->buf) + hnd->delimiterLength;
+      break;
+    }
+
+    if (hnd->eof)
+    {
+      if (hnd->pos == hnd->len)
+      {
+        JS_SET_RVAL(cx, vp, JSVAL_NULL);
+        return JS_TRUE;
+      }
+
+      line = hnd->buf + hnd->pos;
+      lineLength = hnd->len - hnd->pos;
+      hnd->pos = hnd->len;
+      break;
+    }
+
+    /* Resume scanning where a delimiter split across reads could begin */
+    scanFrom = hnd->len - hnd->pos >= hnd->delimiterLength ? hnd->len - (hnd->delimiterLength - 1) : hnd->pos;
+    scanFrom -= hnd->pos;
+    if (!lineReader_fill(cx, obj, hnd))
+      return JS_FALSE;
+    scanFrom += hnd->pos;
+  }
+
+  if (hnd->copyLines)
+    retval = byteThing_fromCArray(cx, line, lineLength, NULL, byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
+  else
+    retval = byteThing_newSharedSlice(cx, hnd->chunk, line, lineLength, byteString_clasp, byteString_proto, sizeof(byteString_handle_t));
+
+  if (!retval)
+    return JS_FALSE;
+
+  if (hnd->copyLines)
+    ((byteString_handle_t *)JS_GetPrivate(cx, retval))->btFlags |= bt_immutable;
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(retval));
+  return JS_TRUE;
+}
+
+/** Parse the delimiter option: a byte value, a String of byte-valued characters, or a ByteString/ByteArray. */
+static JSBool lineReader_setDelimiter(JSContext *cx, lineReader_handle_t *hnd, jsval v)
+{
+  unsigned char	*buf = NULL;
+  size_t	len;
+  JSBool	mustFree = JS_FALSE;
+
+  if (JSVAL_IS_NUMBER(v))
+  {
+    if (byteThing_val2byte(cx, v, hnd->delimiter))
+      return gpsee_throw(cx, CLASS_ID ".constructor.delimiter.invalid: delimiter is not a byte value");
+
+    hnd->delimiterLength = 1;
+    return JS_TRUE;
+  }
+
+  if (JSVAL_IS_OBJECT(v) && !JSVAL_IS_NULL(v) && gpsee_isByteThing(cx, JSVAL_TO_OBJECT(v)))
+  {
+    byteThing_handle_t *bt = JS_GetPrivate(cx, JSVAL_TO_OBJECT(v));
+
+    buf = bt->buffer;
+    len = bt->length;
+  }
+  else
+  {
+    JSString *str = JS_ValueToString(cx, v);
+
+    if (!str || !transcodeString_toBuf(cx, str, NULL, &buf, &len, CLASS_ID ".constructor.delimiter"))
+      return JS_FALSE;
+    mustFree = JS_TRUE;
+  }
+
+  if (len == 0 || len > LINEREADER_MAX_DELIMITER)
+  {
+    if (mustFree && buf)
+      JS_free(cx, buf);
+    return gpsee_throw(cx, CLASS_ID ".constructor.delimiter.length: delimiter must be between 1 and %i bytes long",
+                       LINEREADER_MAX_DELIMITER);
+  }
+
+  memcpy(hnd->delimiter, buf, len);
+  hnd->delimiterLength = len;
+
+  if (mustFree)
+    JS_free(cx, buf);
+
+  return JS_TRUE;
+}
+
+/**
+ *  LineReader constructor
+ *
+ *  new LineReader(source, options) where
+ *  - source is a file descriptor number or a ByteThing
+ *  - options is an optional object with the properties
+ *    - delimiter:     line delimiter (byte value, String or ByteString of up to 16 bytes). Default "\n".
+ *    - keepDelimiter: boolean; when true, lines include their delimiter. Default false.
+ *    - bufferSize:    size of the read buffer for file descriptors. Default 64KB.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	Pre-allocated LineReader object
+ *  @param	argc	Number of arguments passed to constructor
+ *  @param	argv	Arguments passed to constructor
+ *  @param	rval	The new object returned to JavaScript
+ *
+ *  @returns 	JS_TRUE on success
+ */
+static JSBool LineReader(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  lineReader_handle_t	*hnd;
+  jsval			v;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.count");
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+  memset(hnd, 0, sizeof(*hnd));
+  hnd->fd = -1;
+  hnd->bufferSize = LINEREADER_DEFAULT_BUFFER_SIZE;
+  hnd->delimiter[0] = '\n';
+  hnd->delimiterLength = 1;
+  JS_SetPrivate(cx, obj, hnd);
+
+  if (argc > 1 && !JSVAL_IS_VOID(argv[1]) && !JSVAL_IS_NULL(argv[1]))
+  {
+    JSObject *options;
+
+    if (!JSVAL_IS_OBJECT(argv[1]))
+      return gpsee_throw(cx, CLASS_ID ".constructor.arguments.1.type: options must be an object");
+    options = JSVAL_TO_OBJECT(argv[1]);
+
+    if (!JS_GetProperty(cx, options, "delimiter", &v))
+      return JS_FALSE;
+    if (!JSVAL_IS_VOID(v) && !lineReader_setDelimiter(cx, hnd, v))
+      return JS_FALSE;
+
+    if (!JS_GetProperty(cx, options, "keepDelimiter", &v))
+      return JS_FALSE;
+    hnd->keepDelimiter = gpsee_isFalsy(cx, v) ? JS_FALSE : JS_TRUE;
+
+    if (!JS_GetProperty(cx, options, "bufferSize", &v))
+      return JS_FALSE;
+    if (!JSVAL_IS_VOID(v))
+    {
+      const char *errmsg = byteThing_val2size(cx, v, &hnd->bufferSize, "constructor");
+
+      if (errmsg)
+	return gpsee_throw(cx, CLASS_ID ".constructor.bufferSize: %s", errmsg);
+      if (hnd->bufferSize < hnd->delimiterLength * 2)
+	return gpsee_throw(cx, CLASS_ID ".constructor.bufferSize.underflow: buffer too small");
+    }
+  }
+
+  if (JSVAL_IS_OBJECT(argv[0]) && !JSVAL_IS_NULL(argv[0]) && gpsee_isByteThing(cx, JSVAL_TO_OBJECT(argv[0])))
+  {
+    JSObject		*source = JSVAL_TO_OBJECT(argv[0]);
+    byteThing_handle_t	*srcHnd = JS_GetPrivate(cx, source);
+
+    if (!srcHnd)
+      return gpsee_throw(cx, CLASS_ID ".constructor.arguments.0.invalid: ByteThing handle missing!");
+
+    if (!JS_SetReservedSlot(cx, obj, 0, argv[0]))
+      return JS_FALSE;
+
+    hnd->chunk 	   = source;
+    hnd->buf 	   = srcHnd->buffer;
+    hnd->len 	   = srcHnd->length;
+    hnd->capacity  = srcHnd->length;
+    hnd->eof 	   = JS_TRUE;
+    hnd->copyLines = (srcHnd->btFlags & bt_immutable) ? JS_FALSE : JS_TRUE;
+  }
+  else
+  {
+    int32 fd;
+
+    if (!JSVAL_IS_NUMBER(argv[0]) || !JS_ValueToInt32(cx, argv[0], &fd) || fd < 0)
+      return gpsee_throw(cx, CLASS_ID ".constructor.arguments.0.type: source must be a file descriptor or a ByteThing");
+
+    hnd->fd = fd;
+  }
+
+  return JS_TRUE;
+}
+
+/**
+ *  LineReader Finalizer. The file descriptor belongs to the caller and is not closed.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	The object to finalize
+ */
+static void LineReader_Finalize(JSContext *cx, JSObject *obj)
+{
+  lineReader_handle_t	*hnd = JS_GetPrivate(cx, obj);
+
+  if (hnd)
+    JS_free(cx, hnd);
+
+  return;
+}
+
+/** Initializes binary.LineReader */
+JSObject *LineReader_InitClass(JSContext *cx, JSObject *obj)
+{
+  /** Description of this class: */
+  static JSClass lineReader_class =
+  {
+    GPSEE_CLASS_NAME(LineReader),	/**< its name is LineReader */
+    JSCLASS_HAS_PRIVATE |
+    JSCLASS_HAS_RESERVED_SLOTS(1),	/**< slot 0 roots the current chunk or source ByteThing */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    LineReader_Finalize,		/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSFunctionSpec instance_methods[] =
+  {
+    JS_FN("readLine",		LineReader_readLine,		0, 0),
+    JS_FS_END
+  };
+
+  JSObject *proto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &lineReader_class,	/* clasp - Class struct to init. Defs class for use by other API funs */
+		   LineReader,		/* constructor function - Scope matches obj */
+		   0,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   NULL,		/* ps - props struct for parent_proto */
+		   instance_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+
+  GPSEE_ASSERT(proto);
+  lineReader_clasp = &lineReader_class;
+
+  return proto;
+}
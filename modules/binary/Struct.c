@@ -0,0 +1,814 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	Struct.c	A class for packing and unpacking binary records described by
+ *				Python struct-style format strings.
+ *
+ *  new binary.Struct(">IHHq") parses the format once, into a list of operations with
+ *  precomputed offsets; pack() and unpack() then run that list directly against the
+ *  backing store of a ByteString or ByteArray.
+ *
+ *  The first character of the format may select the byte order, sizes and alignment:
+ *   - @ native order, native sizes and alignment (the default, like a C struct)
+ *   - = native order, standard sizes, no alignment
+ *   - < little-endian, > or ! big-endian; standard sizes, no alignment
+ *
+ *  Each code may be preceded by a repeat count: x (pad byte), ? (boolean), b/B (8-bit), 
+ *  h/H (16-bit), i/I and l/L (32-bit standard), q/Q (64-bit), f (float), d (double), and 
+ *  s (byte string; the count is its length, and it is one value). Upper-case integer 
+ *  codes are unsigned. 64-bit integers are exact only up to 2^53, like any JS Number.
+ */
+
+#include "gpsee.h"
+#include "binary.h"
+#include <ctype.h>
+#include <math.h>
+
+#define CLASS_ID MODULE_ID ".Struct"
+
+#if defined(_BIG_ENDIAN) || (defined(BYTE_ORDER) && defined(BIG_ENDIAN) && BYTE_ORDER == BIG_ENDIAN)
+# define HOST_IS_LITTLE_ENDIAN JS_FALSE
+#else
+# define HOST_IS_LITTLE_ENDIAN JS_TRUE
+#endif
+
+static JSClass *struct_clasp;
+
+/** One step of packing or unpacking: count consecutive items of the same code */
+typedef struct
+{
+  char			code;		/**< Format code */
+  size_t		size;		/**< Bytes per item */
+  size_t		count;		/**< Number of items; for 's', the string length */
+  size_t		offset;		/**< Offset of the first item from the start of the record */
+} struct_op_t;
+
+/** Private handle for Struct instances */
+typedef struct
+{
+  struct_op_t		*ops;		/**< Operations, in format order */
+  size_t		nOps;		/**< Number of operations */
+  size_t		size;		/**< Bytes per record */
+  size_t		nValues;	/**< Values per record */
+  JSBool		swap;		/**< Byte order differs from the host's */
+} struct_handle_t;
+
+/** Get the Struct handle for the this-object of a fast native, or throw */
+static struct_handle_t *struct_getHandle(JSContext *cx, JSObject *obj, const char *methodName)
+{
+  struct_handle_t *hnd = obj ? JS_GetInstancePrivate(cx, obj, struct_clasp, NULL) : NULL;
+
+  if (!hnd)
+    (void)gpsee_throw(cx, CLASS_ID ".%s.type: native member function applied to non-Struct object", methodName);
+
+  return hnd;
+}
+
+/** Work out the size of an item, for a given format code and size mode.
+ *  @returns	The size in bytes, or 0 if code is not a format code
+ */
+static size_t struct_itemSize(char code, JSBool nativeSizes)
+{
+  switch(code)
+  {
+    case 'x': case '?': case 'b': case 'B': case 's':
+      return 1;
+    case 'h': case 'H':
+      return nativeSizes ? sizeof(short) : 2;
+    case 'i': case 'I':
+      return nativeSizes ? sizeof(int) : 4;
+    case 'l': case 'L':
+      return nativeSizes ? sizeof(long) : 4;
+    case 'q': case 'Q':
+      return nativeSizes ? sizeof(long long) : 8;
+    case 'f':
+      return 4;
+    case 'd':
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+/** Copy an item between host order and record order */
+static void struct_copyItem(unsigned char *dst, const unsigned char *src, size_t size, JSBool swap)
+{
+  size_t i;
+
+  if (swap)
+  {
+    for (i = 0; i < size; i++)
+      dst[i] = src[size - 1 - i];
+  }
+  else
+    memcpy(dst, src, size);
+}
+
+/** Store one item, converting from a jsval */
+static JSBool struct_storeItem(JSContext *cx, struct_handle_t *hnd, const struct_op_t *op, unsigned char *p, jsval v, size_t argn)
+{
+  unsigned char	b[8];
+  jsdouble	d;
+
+  switch(op->code)
+  {
+    case '?':
+    {
+      JSBool bv;
+
+      if (JS_ValueToBoolean(cx, v, &bv) == JS_FALSE)
+	return JS_FALSE;
+      *p = bv ? 1 : 0;
+      return JS_TRUE;
+    }
+    case 'f':
+    case 'd':
+      if (JS_ValueToNumber(cx, v, &d) == JS_FALSE)
+	return JS_FALSE;
+      if (op->code == 'f')
+      {
+	float f = d;
+	memcpy(b, &f, 4);
+      }
+      else
+	memcpy(b, &d, 8);
+      break;
+    default:	/* integers */
+      if (JSVAL_IS_INT(v))
+	d = JSVAL_TO_INT(v);
+      else if (JS_ValueToNumber(cx, v, &d) == JS_FALSE)
+	return JS_FALSE;
+
+      if (!isfinite(d))
+	return gpsee_throw(cx, CLASS_ID ".pack.arguments.%i.range: cannot pack %g as an integer", (int)argn, d);
+
+      if (op->size == 8)
+      {
+	if ((d < -9223372036854775808.0) || (d >= 18446744073709551616.0) || (islower(op->code) && d >= 9223372036854775808.0))
+	  return gpsee_throw(cx, CLASS_ID ".pack.arguments.%i.range: %g does not fit in 64 bits", (int)argn, d);
+	if (isupper(op->code) && d < 0)
+	  return gpsee_throw(cx, CLASS_ID ".pack.arguments.%i.range: cannot pack %g as an unsigned 64-bit integer", (int)argn, d);
+
+	if (d < 0)
+	{
+	  int64 x = d;
+	  memcpy(b, &x, 8);
+	}
+	else
+	{
+	  uint64 x = d;
+	  memcpy(b, &x, 8);
+	}
+      }
+      else
+      {
+	/* Wrap modulo 2^(8*size), as for typed arrays */
+	uint32 x;
+	
+	if (JSVAL_IS_INT(v))
+	  x = JSVAL_TO_INT(v);
+	else if (JS_ValueToECMAUint32(cx, v, &x) == JS_FALSE)
+	  return JS_FALSE;
+
+	switch(op->size)
+	{
+	  case 1: b[0] = x; break;
+	  case 2: { uint16 y = x; memcpy(b, &y, 2); } break;
+	  default: memcpy(b, &x, 4); break;
+	}
+      }
+      break;
+  }
+
+  struct_copyItem(p, b, op->size, hnd->swap);
+  return JS_TRUE;
+}
+
+/** Load one item, converting to a jsval */
+static JSBool struct_loadItem(JSContext *cx, struct_handle_t *hnd, const struct_op_t *op, const unsigned char *p, jsval *vp)
+{
+  unsigned char	b[8];
+  jsdouble	d;
+
+  struct_copyItem(b, p, op->size, hnd->swap);
+
+  switch(op->code)
+  {
+    case '?':
+      *vp = b[0] ? JSVAL_TRUE : JSVAL_FALSE;
+      return JS_TRUE;
+    case 'f':
+      { float f; memcpy(&f, b, 4); d = f; }
+      break;
+    case 'd':
+      memcpy(&d, b, 8);
+      break;
+    default:	/* integers */
+      switch(op->size)
+      {
+	case 1:
+	  *vp = INT_TO_JSVAL(islower(op->code) ? (int)(signed char)b[0] : (int)b[0]);
+	  return JS_TRUE;
+	case 2:
+	  if (islower(op->code))
+	    { int16 x; memcpy(&x, b, 2); *vp = INT_TO_JSVAL(x); }
+	  else
+	    { uint16 x; memcpy(&x, b, 2); *vp = INT_TO_JSVAL(x); }
+	  return JS_TRUE;
+	case 4:
+	  if (islower(op->code))
+	    { int32 x; memcpy(&x, b, 4); d = x; }
+	  else
+	    { uint32 x; memcpy(&x, b, 4); d = x; }
+	  break;
+	default:
+	  if (islower(op->code))
+	    { int64 x; memcpy(&x, b, 8); d = x; }
+	  else
+	    { uint64 x; memcpy(&x, b, 8); d = x; }
+	  break;
+      }
+      break;
+  }
+
+  return JS_NewNumberValue(cx, d, vp);
+}
+
+/** Write one record at p from the values at argv */
+static JSBool struct_packRecord(JSContext *cx, struct_handle_t *hnd, unsigned char *p, jsval *argv, size_t argOffset)
+{
+  size_t	op, i, argn = 0;
+
+  memset(p, 0, hnd->size);	/* pad bytes and short strings */
+
+  for (op = 0; op < hnd->nOps; op++)
+  {
+    const struct_op_t *o = hnd->ops + op;
+
+    switch(o->code)
+    {
+      case 'x':
+	break;
+      case 's':
+      {
+	jsval	v = argv[argn++];
+
+	if (JSVAL_IS_OBJECT(v) && !JSVAL_IS_NULL(v) && gpsee_isByteThing(cx, JSVAL_TO_OBJECT(v)))
+	{
+	  byteThing_handle_t *btHnd = JS_GetPrivate(cx, JSVAL_TO_OBJECT(v));
+
+	  if (btHnd)
+	    memcpy(p + o->offset, btHnd->buffer, min(btHnd->length, o->count));
+	}
+	else
+	{
+	  /* Strings are taken a byte per character, like gffi.Memory.copyDataString() */
+	  JSString	*str = JS_ValueToString(cx, v);
+	  const jschar	*chars;
+	  size_t	j;
+
+	  if (!str)
+	    return JS_FALSE;
+	  argv[argn - 1] = STRING_TO_JSVAL(str);
+	  chars = JS_GetStringChars(str);
+	  for (j = 0; j < min(JS_GetStringLength(str), o->count); j++)
+	    p[o->offset + j] = chars[j];
+	}
+	break;
+      }
+      default:
+	for (i = 0; i < o->count; i++, argn++)
+	{
+	  if (!struct_storeItem(cx, hnd, o, p + o->offset + i * o->size, argv[argn], argOffset + argn))
+	    return JS_FALSE;
+	}
+	break;
+    }
+  }
+
+  return JS_TRUE;
+}
+
+/** Read the record at p into array, which is rooted by the caller */
+static JSBool struct_unpackRecord(JSContext *cx, struct_handle_t *hnd, JSObject *owner, byteThing_handle_t *btHnd, 
+				  size_t recordOffset, JSObject *array)
+{
+  size_t	op, i;
+  jsint		n = 0;
+  jsval		v;
+
+  for (op = 0; op < hnd->nOps; op++)
+  {
+    const struct_op_t	*o = hnd->ops + op;
+
+    /* Each item is re-addressed from btHnd, as storing into array could in principle run script */
+    if (recordOffset + hnd->size > btHnd->length)
+      return gpsee_throw(cx, CLASS_ID ".unpack.range: ByteThing shrank during unpack");
+
+    switch(o->code)
+    {
+      case 'x':
+	continue;
+      case 's':
+      {
+	JSObject *str;
+
+	if (btHnd->btFlags & bt_immutable)
+	  str = byteThing_newSharedSlice(cx, owner, btHnd->buffer + recordOffset + o->offset, o->count, 
+					 byteString_clasp, byteString_proto, sizeof(byteString_handle_t));
+	else
+	{
+	  str = byteThing_fromCArray(cx, btHnd->buffer + recordOffset + o->offset, o->count, NULL, 
+				     byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 0);
+	  if (str)
+	    ((byteString_handle_t *)JS_GetPrivate(cx, str))->btFlags |= bt_immutable;
+	}
+
+	if (!str)
+	  return JS_FALSE;
+	v = OBJECT_TO_JSVAL(str);
+	if (!JS_SetElement(cx, array, n++, &v))
+	  return JS_FALSE;
+	break;
+      }
+      default:
+	for (i = 0; i < o->count; i++)
+	{
+	  if (!struct_loadItem(cx, hnd, o, btHnd->buffer + recordOffset + o->offset + i * o->size, &v) ||
+	      !JS_SetElement(cx, array, n++, &v))
+	    return JS_FALSE;
+	}
+	break;
+    }
+  }
+
+  return JS_TRUE;
+}
+
+/** Fetch the ByteThing at argv[argn], or throw */
+static byteThing_handle_t *struct_byteThingArg(JSContext *cx, jsval *argv, uintN argn, const char *methodName)
+{
+  byteThing_handle_t *btHnd = NULL;
+
+  if (JSVAL_IS_OBJECT(argv[argn]) && !JSVAL_IS_NULL(argv[argn]) && gpsee_isByteThing(cx, JSVAL_TO_OBJECT(argv[argn])))
+    btHnd = JS_GetPrivate(cx, JSVAL_TO_OBJECT(argv[argn]));
+
+  if (!btHnd)
+    (void)gpsee_throw(cx, CLASS_ID ".%s.arguments.%i.type: must be a ByteString or ByteArray", methodName, argn);
+
+  return btHnd;
+}
+
+/** Implements Struct::pack(value, ...). Returns a new ByteString holding one record. */
+static JSBool Struct_pack(JSContext *cx, uintN argc, jsval *vp)
+{
+  struct_handle_t	*hnd = struct_getHandle(cx, JS_THIS_OBJECT(cx, vp), "pack");
+  unsigned char		*buf;
+  JSObject		*robj;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc != hnd->nValues)
+    return gpsee_throw(cx, CLASS_ID ".pack.arguments.count: expected " GPSEE_SIZET_FMT " values, got %i", hnd->nValues, argc);
+
+  buf = JS_malloc(cx, hnd->size ?: 1);
+  if (!buf)
+    return JS_FALSE;
+
+  if (!struct_packRecord(cx, hnd, buf, JS_ARGV(cx, vp), 0))
+  {
+    JS_free(cx, buf);
+    return JS_FALSE;
+  }
+
+  robj = byteThing_fromCArray(cx, buf, hnd->size, NULL, byteString_clasp, byteString_proto, sizeof(byteString_handle_t), 1);
+  if (!robj)
+  {
+    JS_free(cx, buf);
+    return JS_FALSE;
+  }
+  ((byteString_handle_t *)JS_GetPrivate(cx, robj))->btFlags |= bt_immutable;
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(robj));
+  return JS_TRUE;
+}
+
+/** Implements Struct::packInto(byteArray, offset, value, ...). Writes one record into byteArray
+ *  at offset, growing it if necessary, and returns the offset just past the record.
+ */
+static JSBool Struct_packInto(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  struct_handle_t	*hnd = struct_getHandle(cx, JS_THIS_OBJECT(cx, vp), "packInto");
+  JSObject		*target;
+  byteArray_handle_t	*baHnd;
+  size_t		offset;
+  const char		*err;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc != hnd->nValues + 2)
+    return gpsee_throw(cx, CLASS_ID ".packInto.arguments.count: expected " GPSEE_SIZET_FMT " values, got %i", hnd->nValues, argc - 2);
+
+  if (!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) || JS_GET_CLASS(cx, JSVAL_TO_OBJECT(argv[0])) != byteArray_clasp)
+    return gpsee_throw(cx, CLASS_ID ".packInto.arguments.0.type: must be a ByteArray");
+  target = JSVAL_TO_OBJECT(argv[0]);
+  baHnd = JS_GetPrivate(cx, target);
+  if (!baHnd)
+    return gpsee_throw(cx, CLASS_ID ".packInto.arguments.0.invalid: ByteArray handle missing!");
+
+  err = byteThing_val2size(cx, argv[1], &offset, "packInto");
+  if (err)
+    return gpsee_throw(cx, CLASS_ID ".packInto.arguments.1.invalid: %s", err);
+  if (offset > (size_t)-1 - hnd->size)
+    return gpsee_throw(cx, CLASS_ID ".packInto.arguments.1.range: offset " GPSEE_SIZET_FMT " is too large", offset);
+
+  /* Convert values which might run script (valueOf, toString) before addressing the buffer */
+  {
+    unsigned char	stackBuf[256];
+    unsigned char	*rec = (hnd->size <= sizeof(stackBuf)) ? stackBuf : JS_malloc(cx, hnd->size);
+
+    if (!rec)
+      return JS_FALSE;
+
+    if (!struct_packRecord(cx, hnd, rec, argv + 2, 2))
+    {
+      if (rec != stackBuf)
+	JS_free(cx, rec);
+      return JS_FALSE;
+    }
+
+    if (offset + hnd->size > baHnd->length)
+    {
+      if (!byteArray_requestSize(cx, target, baHnd, offset + hnd->size))
+      {
+	if (rec != stackBuf)
+	  JS_free(cx, rec);
+	return JS_FALSE;
+      }
+      if (offset > baHnd->length)
+	memset(baHnd->buffer + baHnd->length, 0, offset - baHnd->length);
+      baHnd->length = offset + hnd->size;
+    }
+    else if (!gpsee_unshareByteThing(cx, target))
+    {
+      if (rec != stackBuf)
+	JS_free(cx, rec);
+      return JS_FALSE;
+    }
+
+    memcpy(baHnd->buffer + offset, rec, hnd->size);
+    if (rec != stackBuf)
+      JS_free(cx, rec);
+  }
+
+  return JS_NewNumberValue(cx, offset + hnd->size, vp);
+}
+
+/** Implements Struct::unpack(byteThing, [offset]). Returns an Array holding the values of the
+ *  record at offset (default 0).
+ */
+static JSBool Struct_unpack(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  struct_handle_t	*hnd = struct_getHandle(cx, JS_THIS_OBJECT(cx, vp), "unpack");
+  byteThing_handle_t	*btHnd;
+  size_t		offset = 0;
+  JSObject		*array;
+  const char		*err;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, CLASS_ID ".unpack.arguments.count");
+
+  btHnd = struct_byteThingArg(cx, argv, 0, "unpack");
+  if (!btHnd)
+    return JS_FALSE;
+
+  if (argc == 2)
+  {
+    err = byteThing_val2size(cx, argv[1], &offset, "unpack");
+    if (err)
+      return gpsee_throw(cx, CLASS_ID ".unpack.arguments.1.invalid: %s", err);
+  }
+
+  if ((offset > btHnd->length) || (hnd->size > btHnd->length - offset))
+    return gpsee_throw(cx, CLASS_ID ".unpack.range: a " GPSEE_SIZET_FMT "-byte record at offset " GPSEE_SIZET_FMT 
+		       " does not fit in " GPSEE_SIZET_FMT " bytes", hnd->size, offset, btHnd->length);
+
+  array = JS_NewArrayObject(cx, 0, NULL);
+  if (!array)
+    return JS_FALSE;
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(array));	/* root it */
+
+  return struct_unpackRecord(cx, hnd, JSVAL_TO_OBJECT(argv[0]), btHnd, offset, array);
+}
+
+/** Implements Struct::unpackAll(byteThing, [offset], [count]). Returns an Array of Arrays, one per
+ *  consecutive record from offset (default 0). Without count, unpacks every whole record.
+ */
+static JSBool Struct_unpackAll(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  struct_handle_t	*hnd = struct_getHandle(cx, JS_THIS_OBJECT(cx, vp), "unpackAll");
+  byteThing_handle_t	*btHnd;
+  size_t		offset = 0, count, maxCount, i;
+  JSObject		*array, *record;
+  const char		*err;
+  jsval			v;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc < 1 || argc > 3)
+    return gpsee_throw(cx, CLASS_ID ".unpackAll.arguments.count");
+
+  if (!hnd->size)
+    return gpsee_throw(cx, CLASS_ID ".unpackAll.size: cannot unpack repeated 0-byte records");
+
+  btHnd = struct_byteThingArg(cx, argv, 0, "unpackAll");
+  if (!btHnd)
+    return JS_FALSE;
+
+  if (argc >= 2 && !JSVAL_IS_VOID(argv[1]))
+  {
+    err = byteThing_val2size(cx, argv[1], &offset, "unpackAll");
+    if (err)
+      return gpsee_throw(cx, CLASS_ID ".unpackAll.arguments.1.invalid: %s", err);
+  }
+
+  if (offset > btHnd->length)
+    return gpsee_throw(cx, CLASS_ID ".unpackAll.range: offset " GPSEE_SIZET_FMT " is past the end of " GPSEE_SIZET_FMT " bytes",
+		       offset, btHnd->length);
+
+  maxCount = (btHnd->length - offset) / hnd->size;
+  count = maxCount;
+  if (argc == 3 && !JSVAL_IS_VOID(argv[2]))
+  {
+    err = byteThing_val2size(cx, argv[2], &count, "unpackAll");
+    if (err)
+      return gpsee_throw(cx, CLASS_ID ".unpackAll.arguments.2.invalid: %s", err);
+    if (count > maxCount)
+      return gpsee_throw(cx, CLASS_ID ".unpackAll.range: " GPSEE_SIZET_FMT " records at offset " GPSEE_SIZET_FMT 
+			 " do not fit in " GPSEE_SIZET_FMT " bytes", count, offset, btHnd->length);
+  }
+
+  array = JS_NewArrayObject(cx, 0, NULL);
+  if (!array)
+    return JS_FALSE;
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(array));	/* root it */
+
+  for (i = 0; i < count; i++)
+  {
+    record = JS_NewArrayObject(cx, 0, NULL);
+    if (!record)
+      return JS_FALSE;
+
+    v = OBJECT_TO_JSVAL(record);
+    if (!JS_SetElement(cx, array, i, &v))	/* roots record */
+      return JS_FALSE;
+
+    if (!struct_unpackRecord(cx, hnd, JSVAL_TO_OBJECT(argv[0]), btHnd, offset + i * hnd->size, record))
+      return JS_FALSE;
+  }
+
+  return JS_TRUE;
+}
+
+/** Parse a format string into hnd.
+ *  @returns JS_FALSE if an exception was thrown
+ */
+static JSBool struct_parseFormat(JSContext *cx, struct_handle_t *hnd, const char *format)
+{
+  const char	*s = format;
+  JSBool	nativeSizes = JS_TRUE;
+  JSBool	align = JS_TRUE;
+  JSBool	littleEndian = HOST_IS_LITTLE_ENDIAN;
+  size_t	allocated = 0;
+
+  switch(*s)
+  {
+    case '@':						s++; break;
+    case '=': nativeSizes = align = JS_FALSE;		s++; break;
+    case '<': nativeSizes = align = JS_FALSE; littleEndian = JS_TRUE;  s++; break;
+    case '>':
+    case '!': nativeSizes = align = JS_FALSE; littleEndian = JS_FALSE; s++; break;
+  }
+  hnd->swap = (littleEndian != HOST_IS_LITTLE_ENDIAN);
+
+  while (*s)
+  {
+    struct_op_t	*op;
+    size_t	count = 1;
+
+    if (isspace((unsigned char)*s))
+    {
+      s++;
+      continue;
+    }
+
+    if (isdigit((unsigned char)*s))
+    {
+      char		*end;
+      unsigned long	ul;
+
+      errno = 0;
+      ul = strtoul(s, &end, 10);
+      count = ul;
+      if ((errno == ERANGE) || (count != ul))
+	return gpsee_throw(cx, CLASS_ID ".format.count.range: repeat count too large at position %i in \"%s\"", 
+			   (int)(s - format), format);
+      s = end;
+    }
+
+    if (!struct_itemSize(*s, nativeSizes))
+      return gpsee_throw(cx, CLASS_ID ".format.invalid: bad format character '%c' at position %i in \"%s\"", 
+			 *s ? *s : '?', (int)(s - format), format);
+
+    if (hnd->nOps == allocated)
+    {
+      struct_op_t *ops;
+
+      allocated = allocated ? allocated * 2 : 8;
+      ops = JS_realloc(cx, hnd->ops, allocated * sizeof(*ops));
+      if (!ops)
+	return JS_FALSE;
+      hnd->ops = ops;
+    }
+
+    op = hnd->ops + hnd->nOps++;
+    op->code  = *s++;
+    op->size  = struct_itemSize(op->code, nativeSizes);
+    op->count = count;
+
+    /* Record size, including alignment padding, must fit in a size_t */
+    if (hnd->size > (size_t)-1 - (op->size - 1))
+      goto tooBig;
+    if (align && (op->size > 1) && (op->code != 's'))
+      hnd->size = (hnd->size + op->size - 1) / op->size * op->size;
+    op->offset = hnd->size;
+
+    if (op->count > ((size_t)-1 - hnd->size) / op->size)
+      goto tooBig;
+    hnd->size += op->size * op->count;
+    if (op->code == 's')
+      hnd->nValues++;
+    else if (op->code != 'x')
+      hnd->nValues += op->count;
+  }
+
+  return JS_TRUE;
+
+  tooBig:
+  return gpsee_throw(cx, CLASS_ID ".format.size.range: record size overflows at position %i in \"%s\"", 
+		     (int)(s - 1 - format), format);
+}
+
+/** 
+ *  Implements the Struct constructor.
+ *  new binary.Struct(format)
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	Pre-allocated Struct object
+ *  @param	argc	Number of arguments passed to constructor
+ *  @param	argv	Arguments passed to constructor
+ *  @param	rval	The new object returned to JavaScript
+ *
+ *  @returns 	JS_TRUE on success
+ */
+static JSBool Struct(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  struct_handle_t	*hnd;
+  JSString		*str;
+  jsval			v;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc != 1)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.count");
+
+  str = JS_ValueToString(cx, argv[0]);
+  if (!str)
+    return JS_FALSE;
+  argv[0] = STRING_TO_JSVAL(str);
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+  memset(hnd, 0, sizeof(*hnd));
+  JS_SetPrivate(cx, obj, hnd);	/* cleanup now solely the job of the finalizer */
+
+  if (!struct_parseFormat(cx, hnd, JS_GetStringBytes(str)))
+    return JS_FALSE;
+
+  if (!JS_DefineProperty(cx, obj, "format", argv[0], NULL, NULL, JSPROP_ENUMERATE | JSPROP_READONLY | JSPROP_PERMANENT))
+    return JS_FALSE;
+
+  if (!JS_NewNumberValue(cx, hnd->size, &v) || 
+      !JS_DefineProperty(cx, obj, "size", v, NULL, NULL, JSPROP_ENUMERATE | JSPROP_READONLY | JSPROP_PERMANENT))
+    return JS_FALSE;
+
+  return JS_TRUE;
+}
+
+/**
+ *  Struct Finalizer.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	The object to finalize
+ */
+static void Struct_Finalize(JSContext *cx, JSObject *obj)
+{
+  struct_handle_t	*hnd = JS_GetPrivate(cx, obj);
+
+  if (!hnd)
+    return;
+
+  if (hnd->ops)
+    JS_free(cx, hnd->ops);
+  JS_free(cx, hnd);
+}
+
+/** Initializes binary.Struct */
+JSObject *Struct_InitClass(JSContext *cx, JSObject *obj)
+{
+  /** Description of this class: */
+  static JSClass struct_class =
+  {
+    GPSEE_CLASS_NAME(Struct),		/**< its name is Struct */
+    JSCLASS_HAS_PRIVATE,		/**< private slot in use */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Struct_Finalize,			/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSFunctionSpec instance_methods[] =
+  {
+    JS_FN("pack",		Struct_pack,			0, 0),
+    JS_FN("packInto",		Struct_packInto,		2, 0),
+    JS_FN("unpack",		Struct_unpack,			2, 0),
+    JS_FN("unpackAll",		Struct_unpackAll,		3, 0),
+    JS_FS_END
+  };
+
+  JSObject *proto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &struct_class,	/* clasp - Class struct to init. Defs class for use by other API funs */
+		   Struct,		/* constructor function - Scope matches obj */
+		   1,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   NULL,		/* ps - props struct for parent_proto */
+		   instance_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+
+  GPSEE_ASSERT(proto);
+  struct_clasp = &struct_class;
+
+  return proto;
+}
@@ -0,0 +1,439 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	Transcoder.c	A class for incrementally transcoding a stream of bytes from one
+ *				character set to another, with bounded memory.
+ *
+ *  Each Transcoder owns one iconv descriptor for its lifetime, so shift states and
+ *  multibyte sequences which are split across chunk boundaries are carried from one
+ *  push() to the next. Output is appended directly to a ByteArray, which may be
+ *  supplied by the caller and re-used (e.g. after splice()ing out what was consumed).
+ *  Transcoders without a target charset produce JS String characters.
+ */
+
+#include "gpsee.h"
+#include "binary.h"
+
+#define CLASS_ID MODULE_ID ".Transcoder"
+#define TRANSCODER_MAX_PENDING	16	/**< Longest partial multibyte sequence we carry between chunks */
+
+static JSClass *transcoder_clasp;
+
+#if defined(HAVE_ICONV)
+/** Private handle for Transcoder instances */
+typedef struct
+{
+  iconv_t		cd;					/**< Conversion descriptor, carries shift state */
+  size_t		pendingStart;				/**< Offset of the first pending byte in pending */
+  size_t		pendingLength;				/**< Number of bytes in pending */
+  unsigned char		pending[TRANSCODER_MAX_PENDING];	/**< Incomplete sequence from the end of the last chunk */
+  char			sourceCharset[64];			/**< For error messages */
+  char			targetCharset[64];			/**< For error messages */
+} transcoder_handle_t;
+
+/** Get the Transcoder handle for the this-object of a fast native, or throw */
+static transcoder_handle_t *transcoder_getHandle(JSContext *cx, JSObject *obj, const char *methodName)
+{
+  transcoder_handle_t *hnd = JS_GetInstancePrivate(cx, obj, transcoder_clasp, NULL);
+
+  if (!hnd)
+    (void)gpsee_throw(cx, CLASS_ID ".%s.type: native member function applied to non-Transcoder object", methodName);
+
+  return hnd;
+}
+
+/** Work out which ByteArray output will be appended to: argv[argn] if supplied, otherwise a new one.
+ *  @returns NULL if an exception was thrown
+ */
+static JSObject *transcoder_output(JSContext *cx, uintN argc, jsval *argv, uintN argn, const char *methodName)
+{
+  JSObject *out;
+
+  if (argc > argn && !JSVAL_IS_VOID(argv[argn]))
+  {
+    if (!JSVAL_IS_OBJECT(argv[argn]) || JSVAL_IS_NULL(argv[argn]) || 
+	JS_GET_CLASS(cx, JSVAL_TO_OBJECT(argv[argn])) != byteArray_clasp)
+    {
+      (void)gpsee_throw(cx, CLASS_ID ".%s.arguments.%i.type: output must be a ByteArray", methodName, argn);
+      return NULL;
+    }
+
+    return JSVAL_TO_OBJECT(argv[argn]);
+  }
+
+  out = byteThing_fromCArray(cx, NULL, 0, NULL, byteArray_clasp, byteArray_proto, sizeof(byteArray_handle_t), 0);
+  if (out)
+    argv[argn] = OBJECT_TO_JSVAL(out);	/* root it; argv[argn] is at least JSVAL_VOID within nargs */
+
+  return out;
+}
+
+/**
+ *  Run iconv over some input, appending the result to a ByteArray. Passing NULL for inbuf
+ *  writes the sequence which returns the descriptor to its initial shift state.
+ *
+ *  @param	inbuf		[in/out] Input cursor, advanced past what was converted
+ *  @param	inbytesleft	[in/out] Number of bytes at *inbuf, reduced by what was converted. When this is
+ *				non-zero on successful return, the input ends with an incomplete sequence.
+ *  @returns	JS_TRUE on success, JS_FALSE if an exception was thrown
+ */
+static JSBool transcoder_convert(JSContext *cx, transcoder_handle_t *hnd, JSObject *out, 
+				 const char **inbuf, size_t *inbytesleft, const char *methodName)
+{
+  byteArray_handle_t	*outHnd = JS_GetPrivate(cx, out);
+  size_t		want = (inbuf ? *inbytesleft + *inbytesleft / 2 : 0) + 32;	/* WAG, grows on E2BIG */
+  const char		*inStart = inbuf ? *inbuf : NULL;
+  jsrefcount		depth;
+
+  for (;;)
+  {
+    char	*outbuf;
+    size_t	outbytesleft;
+    size_t	result;
+    int		error;
+
+    if (!byteArray_requestSize(cx, out, outHnd, outHnd->length + want))
+      return JS_FALSE;
+
+    outbuf = (char *)outHnd->buffer + outHnd->length;
+    outbytesleft = want;
+
+    depth = JS_SuspendRequest(cx);
+    result = iconv(hnd->cd, inbuf, inbytesleft, &outbuf, &outbytesleft);
+    error = errno;
+    JS_ResumeRequest(cx, depth);
+
+    outHnd->length += want - outbytesleft;
+
+    if (result != (size_t)-1)
+      return JS_TRUE;
+
+    switch(error)
+    {
+      case E2BIG:
+	want *= 2;
+	break;
+      case EINVAL:	/* Incomplete multibyte sequence at end of input */
+	return JS_TRUE;
+      default:
+	return gpsee_throw(cx, CLASS_ID ".%s.transcode: Error transcoding %s to %s at chunk byte " GPSEE_PTRDIFF_FMT " (%s)",
+			   methodName, hnd->sourceCharset, hnd->targetCharset, inStart ? *inbuf - inStart : 0, strerror(error));
+    }
+  }
+}
+
+/** Implements Transcoder::push(chunk, [output]). Transcodes the ByteString or ByteArray chunk, 
+ *  appending the result to output (a new ByteArray if not supplied), which is returned. 
+ *  Any incomplete multibyte sequence at the end of chunk is remembered, and completed by the next push().
+ */
+static JSBool Transcoder_push(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  transcoder_handle_t	*hnd = transcoder_getHandle(cx, JS_THIS_OBJECT(cx, vp), "push");
+  byteThing_handle_t	*chunkHnd;
+  JSObject		*out;
+  const char		*inbuf;
+  size_t		inbytesleft;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, CLASS_ID ".push.arguments.count");
+
+  if (!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) || !gpsee_isByteThing(cx, JSVAL_TO_OBJECT(argv[0])) || 
+      !(chunkHnd = JS_GetPrivate(cx, JSVAL_TO_OBJECT(argv[0]))))
+    return gpsee_throw(cx, CLASS_ID ".push.arguments.0.type: chunk must be a ByteString or ByteArray");
+
+  out = transcoder_output(cx, argc, argv, 1, "push");
+  if (!out)
+    return JS_FALSE;
+
+  /* The output may be the chunk itself; keep what we are reading stable */
+  if (out == JSVAL_TO_OBJECT(argv[0]))
+    return gpsee_throw(cx, CLASS_ID ".push.arguments.1.invalid: output cannot be the chunk being transcoded");
+
+  inbuf       = (const char *)chunkHnd->buffer;
+  inbytesleft = chunkHnd->length;
+
+  /* Complete the sequence left over from the last chunk, by running it together with the start of this one.
+   * Bytes which are still pending afterwards stay where they are; they are moved back to the front of
+   * hnd->pending only when there is no room left after them.
+   */
+  while (hnd->pendingLength)
+  {
+    size_t	take, total, pleft, consumed;
+    const char	*pbuf;
+
+    if (hnd->pendingStart && (hnd->pendingStart + hnd->pendingLength == TRANSCODER_MAX_PENDING))
+    {
+      memmove(hnd->pending, hnd->pending + hnd->pendingStart, hnd->pendingLength);
+      hnd->pendingStart = 0;
+    }
+
+    take = TRANSCODER_MAX_PENDING - (hnd->pendingStart + hnd->pendingLength);
+    if (take > inbytesleft)
+      take = inbytesleft;
+    memcpy(hnd->pending + hnd->pendingStart + hnd->pendingLength, inbuf, take);
+    pbuf = (const char *)hnd->pending + hnd->pendingStart;
+    total = pleft = hnd->pendingLength + take;
+
+    if (!transcoder_convert(cx, hnd, out, &pbuf, &pleft, "push"))
+    {
+      hnd->pendingStart = hnd->pendingLength = 0;
+      return JS_FALSE;
+    }
+    consumed = total - pleft;
+
+    if (consumed >= hnd->pendingLength)
+    {
+      /* Complete; carry on from the first byte of this chunk which was not converted */
+      inbuf       += consumed - hnd->pendingLength;
+      inbytesleft -= consumed - hnd->pendingLength;
+      hnd->pendingStart = hnd->pendingLength = 0;
+      break;
+    }
+
+    /* Still incomplete; what we took from this chunk is now pending too */
+    hnd->pendingStart += consumed;
+    hnd->pendingLength = pleft;
+    inbuf       += take;
+    inbytesleft -= take;
+
+    if (!inbytesleft)
+    {
+      JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(out));
+      return JS_TRUE;
+    }
+
+    if (pleft == TRANSCODER_MAX_PENDING)
+    {
+      hnd->pendingStart = hnd->pendingLength = 0;
+      return gpsee_throw(cx, CLASS_ID ".push.transcode: Invalid %s multibyte sequence", hnd->sourceCharset);
+    }
+  }
+
+  if (!transcoder_convert(cx, hnd, out, &inbuf, &inbytesleft, "push"))
+    return JS_FALSE;
+
+  if (inbytesleft)
+  {
+    if (inbytesleft > TRANSCODER_MAX_PENDING)
+      return gpsee_throw(cx, CLASS_ID ".push.transcode: Invalid %s multibyte sequence", hnd->sourceCharset);
+
+    memcpy(hnd->pending, inbuf, inbytesleft);
+    hnd->pendingStart  = 0;
+    hnd->pendingLength = inbytesleft;
+  }
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(out));
+  return JS_TRUE;
+}
+
+/** Implements Transcoder::flush([output]). Ends the stream: writes any sequence needed to return
+ *  the target charset to its initial shift state, appending it to output (a new ByteArray if not 
+ *  supplied), which is returned. Throws if the input ended part-way through a multibyte sequence. 
+ *  The Transcoder may then be re-used for a new stream.
+ */
+static JSBool Transcoder_flush(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  transcoder_handle_t	*hnd = transcoder_getHandle(cx, JS_THIS_OBJECT(cx, vp), "flush");
+  JSObject		*out;
+  size_t		pendingLength;
+
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc > 1)
+    return gpsee_throw(cx, CLASS_ID ".flush.arguments.count");
+
+  out = transcoder_output(cx, argc, argv, 0, "flush");
+  if (!out)
+    return JS_FALSE;
+
+  pendingLength = hnd->pendingLength;
+  hnd->pendingStart = hnd->pendingLength = 0;
+
+  if (!transcoder_convert(cx, hnd, out, NULL, NULL, "flush"))
+    return JS_FALSE;
+
+  if (pendingLength)
+    return gpsee_throw(cx, CLASS_ID ".flush.incomplete: Input ended with " GPSEE_SIZET_FMT " bytes of an incomplete %s sequence",
+		       pendingLength, hnd->sourceCharset);
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(out));
+  return JS_TRUE;
+}
+#endif /* HAVE_ICONV */
+
+/** 
+ *  Implements the Transcoder constructor.
+ *  new binary.Transcoder(sourceCharset, [targetCharset])
+ *
+ *  A null or missing targetCharset means JS String characters (UTF-16 in machine order, without
+ *  a BOM), so that the output of push() and flush() can be turned into a String by 
+ *  decodeToString() with no arguments, without transcoding it a second time.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	Pre-allocated Transcoder object
+ *  @param	argc	Number of arguments passed to constructor
+ *  @param	argv	Arguments passed to constructor
+ *  @param	rval	The new object returned to JavaScript
+ *
+ *  @returns 	JS_TRUE on success
+ */
+static JSBool Transcoder(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+#if !defined(HAVE_ICONV)
+  return gpsee_throw(cx, CLASS_ID ".constructor.iconv.missing: GPSEE was compiled without iconv support");
+#else
+  transcoder_handle_t	*hnd;
+  const char		*charset[2];
+  int			i;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.count");
+
+  for (i = 0; i < 2; i++)
+  {
+    JSString *str;
+
+    if (i == 1 && (argc < 2 || JSVAL_IS_VOID(argv[i]) || JSVAL_IS_NULL(argv[i])))
+    {
+      charset[i] = DEFAULT_UTF_16_FLAVOUR;
+      continue;
+    }
+
+    str = JS_ValueToString(cx, argv[i]);
+
+    if (!str)
+      return JS_FALSE;
+    argv[i] = STRING_TO_JSVAL(str);
+    charset[i] = JS_GetStringBytes(str);
+
+    if (strlen(charset[i]) >= sizeof(hnd->sourceCharset))
+      return gpsee_throw(cx, CLASS_ID ".constructor.arguments.%i.length: charset name too long", i);
+  }
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+  memset(hnd, 0, sizeof(*hnd));
+  strcpy(hnd->sourceCharset, charset[0]);
+  strcpy(hnd->targetCharset, charset[1]);
+
+  hnd->cd = iconv_open(hnd->targetCharset, hnd->sourceCharset);
+  if (hnd->cd == (iconv_t)-1)
+  {
+    JS_free(cx, hnd);
+    return gpsee_throw(cx, CLASS_ID ".constructor.charset: Cannot transcode from %s to %s", charset[0], charset[1]);
+  }
+
+  JS_SetPrivate(cx, obj, hnd);
+  return JS_TRUE;
+#endif
+}
+
+/**
+ *  Transcoder Finalizer.
+ *
+ *  @param	cx	JavaScript context
+ *  @param	obj	The object to finalize
+ */
+static void Transcoder_Finalize(JSContext *cx, JSObject *obj)
+{
+#if defined(HAVE_ICONV)
+  transcoder_handle_t	*hnd = JS_GetPrivate(cx, obj);
+
+  if (!hnd)
+    return;
+
+  iconv_close(hnd->cd);
+  JS_free(cx, hnd);
+#endif
+
+  return;
+}
+
+/** Initializes binary.Transcoder */
+JSObject *Transcoder_InitClass(JSContext *cx, JSObject *obj)
+{
+  /** Description of this class: */
+  static JSClass transcoder_class =
+  {
+    GPSEE_CLASS_NAME(Transcoder),	/**< its name is Transcoder */
+    JSCLASS_HAS_PRIVATE,		/**< private slot in use */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Transcoder_Finalize,		/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSFunctionSpec instance_methods[] =
+  {
+#if defined(HAVE_ICONV)
+    JS_FN("push",		Transcoder_push,		2, 0),
+    JS_FN("flush",		Transcoder_flush,		1, 0),
+#endif
+    JS_FS_END
+  };
+
+  JSObject *proto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &transcoder_class,	/* clasp - Class struct to init. Defs class for use by other API funs */
+		   Transcoder,		/* constructor function - Scope matches obj */
+		   2,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   NULL,		/* ps - props struct for parent_proto */
+		   instance_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+
+  GPSEE_ASSERT(proto);
+  transcoder_clasp = &transcoder_class;
+
+  return proto;
+}
@@ -224,7 +224,7 @@ char *binary_to_qp_alloc(JSContext *cx, unsigned char *in_buf, size_t n_els, con
     return JS_strdup(cx, "");
 
   buf_alloc = n_els + (n_els / 10);	/* Guess: alloc amount as 10% more than input */
-  buf       = malloc(buf_alloc);
+  buf       = JS_malloc(cx, buf_alloc);
 
   if (buf == NULL)
     return NULL;
@@ -236,7 +236,7 @@ char *binary_to_qp_alloc(JSContext *cx, unsigned char *in_buf, size_t n_els, con
     if (buf_used + 8 >= buf_alloc)
     {
       buf_alloc += 256;			/* Guess: we're shy by about 256 bytes.. */
-      btmp = realloc(buf, buf_alloc);
+      btmp = JS_realloc(cx, buf, buf_alloc);
 
       if (btmp == NULL)
       {
@@ -247,7 +247,7 @@ char *binary_to_qp_alloc(JSContext *cx, unsigned char *in_buf, size_t n_els, con
 	buf=btmp;
     }
 
-    if (x == n_els)
+    if (x == n_els - 1)			/* don't let qp_encode_byte peek past the end */
     {
       unsigned char tmp_buf[2]={in_buf[x], (char)0};
       tmp = qp_encode_byte(tmp_buf, force);
@@ -288,7 +288,7 @@ unsigned char *qp_to_binary(JSContext *cx, const char *qp, unsigned char *outBuf
 
   if (!outBuf)
   {
-    outBuf = JS_malloc(cx, strlen(qp));
+    outBuf = JS_malloc(cx, strlen(qp) + 1);
     if (!outBuf)
       return NULL;
   }
@@ -306,99 +306,253 @@ unsigned char *qp_to_binary(JSContext *cx, const char *qp, unsigned char *outBuf
   return outBuf;
 }
 
-/** Decode a base64-encoded buffer. Output buffer must be at least
- * ((strlen(b64) / 4) * 3) + 2 bytes long to avoid overflow. 
- *
- *  @param      b64             buffer to decode (ASCIIZ)
- *  @param      buf             output buffer, or NULL to allocate it ourselves
- *  @param      outChars_p      pointer to number of characters placed into the output buffer
- *  @returns    buf          
+/* Base 64 encoding and decoding. The scalar code handles a whole 24-bit group per step; when
+ * GPSEE is compiled for a CPU with SSSE3 (e.g. -mssse3 or -march=native, which also covers 
+ * AVX2 machines), 12 bytes are encoded or 16 characters decoded per step with pshufb-based 
+ * table lookups. Either way, callers supply the output buffer, so results can be written 
+ * straight into the memory which will back the final JSString or ByteThing.
  */
-unsigned char *b64_to_binary(JSContext *cx, const char *b64, unsigned char *buf, size_t *outChars_p)
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+
+#define B64_WHITESPACE	-2	/**< B64_DECODE value for characters skipped while decoding (MIME line breaks) */
+#define B64_PAD		-3	/**< B64_DECODE value for '=' */
+
+/** Map from character to sextet value, B64_WHITESPACE, B64_PAD, or -1 for invalid */
+static const signed char B64_DECODE[256] =
 {
-  unsigned char *buf_p;
-  const char	*b64_p, *alpha_p;
-  unsigned char	leftover=0, emit=0, value;
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -2,  -2,  -1,  -1,  -2,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -2,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  62,  -1,  -1,  -1,  63,
+   52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  -1,  -1,  -1,  -3,  -1,  -1,
+   -1,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+   15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  -1,  -1,  -1,  -1,  -1,
+   -1,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+   41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+};
+
+#if defined(__SSSE3__)
+/** Encode 12 bytes into 16 base 64 characters. Reads 16 bytes from in. */
+static inline void b64_encode_ssse3(const unsigned char *in, char *out)
+{
+  __m128i	v, t0, t1, t2, t3, indices, result, less;
+
+  v = _mm_loadu_si128((const __m128i *)in);
+  v = _mm_shuffle_epi8(v, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+  /* Spread each 24-bit group into four bytes holding one sextet each */
+  t0 = _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00));
+  t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  t2 = _mm_and_si128(v, _mm_set1_epi32(0x003f03f0));
+  t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  indices = _mm_or_si128(t1, t3);
+
+  /* Map sextets to ASCII by adding an offset chosen by range: A-Z, a-z, 0-9, +, / */
+  result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  less   = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+  result = _mm_shuffle_epi8(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+					  '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0), result);
+
+  _mm_storeu_si128((__m128i *)out, _mm_add_epi8(result, indices));
+}
 
-  if (!buf)
+/** Decode 16 base 64 characters into 12 bytes.
+ *  @returns 0 without writing anything if any of the characters is not in the base 64 alphabet
+ */
+static inline int b64_decode_ssse3(const char *in, unsigned char *out)
+{
+  const __m128i	mask_2F = _mm_set1_epi8(0x2f);
+  __m128i	v, hi_nibbles, lo_nibbles, lo, hi, roll, merged;
+
+  v = _mm_loadu_si128((const __m128i *)in);
+
+  /* Classify each character by its nibbles; a valid character never has a bit in common */
+  hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), mask_2F);
+  lo_nibbles = _mm_and_si128(v, mask_2F);
+  lo = _mm_shuffle_epi8(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 
+				      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a), lo_nibbles);
+  hi = _mm_shuffle_epi8(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 
+				      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10), hi_nibbles);
+  if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+    return 0;
+
+  /* Map ASCII to sextets, then pack four sextets into three bytes */
+  roll = _mm_shuffle_epi8(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0), 
+			  _mm_add_epi8(_mm_cmpeq_epi8(v, mask_2F), hi_nibbles));
+  v = _mm_add_epi8(v, roll);
+  merged = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+  merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+  merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+  _mm_storel_epi64((__m128i *)out, merged);
   {
-    buf = JS_malloc(cx, ((strlen(b64) * 6) / 8) + 1);
-    if (!buf)
-      return NULL;
+    int tail = _mm_cvtsi128_si32(_mm_srli_si128(merged, 8));
+    memcpy(out + 8, &tail, 4);
   }
-    
-  *buf = (char)0;
-  for (buf_p=buf, b64_p = b64; 
-       *b64_p && (alpha_p = strchr(B64_ALPHABET, *b64_p));
-       b64_p++)
+
+  return 1;
+}
+#endif
+
+/** Encode a buffer into base 64, with padding. 
+ *  @param      in      The buffer to convert
+ *  @param      inLen   The number of bytes in the input buffer
+ *  @param      out     Where to write the output; must hold B64_ENCODED_LENGTH(inLen) characters
+ *  @returns    The number of characters written, which is always B64_ENCODED_LENGTH(inLen)
+ */
+size_t b64_encode(const unsigned char *in, size_t inLen, char *out)
+{
+  char		*start = out;
+  uint32	w;
+
+#if defined(__SSSE3__)
+  for (; inLen >= 16; in += 12, inLen -= 12, out += 16)
+    b64_encode_ssse3(in, out);
+#endif
+
+  for (; inLen >= 3; in += 3, inLen -= 3, out += 4)
   {
-    value = (alpha_p - B64_ALPHABET);
+    w = (in[0] << 16) | (in[1] << 8) | in[2];
+    out[0] = B64_ALPHABET[w >> 18];
+    out[1] = B64_ALPHABET[(w >> 12) & 0x3f];
+    out[2] = B64_ALPHABET[(w >> 6) & 0x3f];
+    out[3] = B64_ALPHABET[w & 0x3f];
+  }
 
-    if (*b64_p == '=')       		/* Time to finish up? */
+  if (inLen)
+  {
+    w = (in[0] << 16) | ((inLen == 2) ? (in[1] << 8) : 0);
+    out[0] = B64_ALPHABET[w >> 18];
+    out[1] = B64_ALPHABET[(w >> 12) & 0x3f];
+    out[2] = (inLen == 2) ? B64_ALPHABET[(w >> 6) & 0x3f] : '=';
+    out[3] = '=';
+    out += 4;
+  }
+
+  return out - start;
+}
+
+/** Decode base 64 characters, possibly part of a longer stream. Whitespace is skipped; decoding
+ *  stops for good at padding or at any other character which is not in the base 64 alphabet. 
+ *  A partial group of characters at the end of in is remembered in st, to be completed by the 
+ *  next call or by b64_decodeFinish().
+ *
+ *  @param      st      Decoder state, initially all zero
+ *  @param      in      Characters to decode
+ *  @param      inLen   Number of characters at in
+ *  @param      out     Where to write the output; must hold B64_DECODED_MAX(inLen) bytes
+ *  @returns    The number of bytes written
+ */
+size_t b64_decode(b64_decoder_t *st, const char *in, size_t inLen, unsigned char *out)
+{
+  const char		*end = in + inLen;
+  unsigned char		*start = out;
+  int			v;
+
+  while (!st->done && (in < end))
+  {
+#if defined(__SSSE3__)
+    if (st->sextets == 0)
     {
-      if (((b64_p - b64) % 4) == 1)	/* A=== case */
-	*buf_p++ = leftover;
+      while ((end - in >= 16) && b64_decode_ssse3(in, out))
+      {
+	in  += 16;
+	out += 12;
+      }
 
-      break;
+      if (in == end)
+	break;
     }
+#endif
 
-    switch((b64_p - b64) % 4)
+    v = B64_DECODE[(unsigned char)*in++];
+    if (v >= 0)
     {
-      case 0:				/* Start of a quartet; no character emitted */
-	leftover = value << 2;
-	continue;
-      case 1:				/* Emit first character, result of 1st & 2nd encoded chars.. */
-	emit	 = (value >> 4) | leftover;
-	leftover = (value << 4);
-	break;
-      case 2:				/* Emit second character, result of 2nd & 3rd encoded chars.. */
-	emit	 = (value >> 2) | leftover;
-	leftover = (value << 6);
-	break;
-      case 3:				/* Emit last character, result of 3rd & 4th encoded chars.. */
-	emit	 = value | leftover;
-	leftover = 0;
-	break;
+      st->bits = (st->bits << 6) | v;
+      if (++st->sextets == 4)
+      {
+	out[0] = st->bits >> 16;
+	out[1] = st->bits >> 8;
+	out[2] = st->bits;
+	out += 3;
+	st->bits = 0;
+	st->sextets = 0;
+      }
+    }
+    else if (v != B64_WHITESPACE)
+    {
+      /* Padding or garbage: end of data. "A===" has always decoded to the first character's bits */
+      if (v == B64_PAD && st->sextets == 1)
+      {
+	*out++ = st->bits << 2;
+	st->bits = 0;
+	st->sextets = 0;
+      }
+      st->done = 1;
     }
-    
-    *buf_p++ = emit;
   }
 
-  *outChars_p = (size_t)(buf_p - buf);
-  return buf;
+  return out - start;
 }
 
-/** Encode up to three bytes into base 64.
+/** Finish decoding a stream, emitting the bytes held in a final partial group and resetting st.
+ *  @param      out     Where to write the output; must hold 2 bytes
+ *  @returns    The number of bytes written
  */
-static char *b64_encode_3bytes(int c_arr[3])
+size_t b64_decodeFinish(b64_decoder_t *st, unsigned char *out)
 {
-  static char enc_c[4];
+  size_t	n = 0;
 
-  /* Encode left six bits of c_arr[0] into first character */
-  enc_c[0] = B64_ALPHABET[c_arr[0] >> 2];
-  
-  if (c_arr[1] == EOF)
+  switch(st->sextets)
   {
-    enc_c[1] = B64_ALPHABET[(c_arr[0] & 0x03) << 0x04];
-    enc_c[2] = '=';
-    enc_c[3] = '=';
-    return enc_c;
+    case 2:
+      out[n++] = st->bits >> 4;
+      break;
+    case 3:
+      out[n++] = st->bits >> 10;
+      out[n++] = st->bits >> 2;
+      break;
   }
 
-  /* Encode right two bits of c_arr[0] + left four bits of c_arr[1] into next character */
-  enc_c[1] = B64_ALPHABET[(c_arr[0] & 0x03) << 0x04 | (c_arr[1] >> 0x04)];
+  memset(st, 0, sizeof(*st));
+  return n;
+}
 
-  if (c_arr[2] == EOF)
+/** Decode a base64-encoded buffer. Output buffer must be at least
+ * ((strlen(b64) / 4) * 3) + 2 bytes long to avoid overflow. 
+ *
+ *  @param      b64             buffer to decode (ASCIIZ)
+ *  @param      buf             output buffer, or NULL to allocate it ourselves
+ *  @param      outChars_p      pointer to number of characters placed into the output buffer
+ *  @returns    buf          
+ */
+unsigned char *b64_to_binary(JSContext *cx, const char *b64, unsigned char *buf, size_t *outChars_p)
+{
+  b64_decoder_t	st;
+  size_t	len = strlen(b64);
+
+  if (!buf)
   {
-    enc_c[2] = B64_ALPHABET[(c_arr[1] & 0x0F) << 0x02];
-    enc_c[3] = '=';
-    return enc_c;
+    buf = JS_malloc(cx, B64_DECODED_MAX(len));
+    if (!buf)
+      return NULL;
   }
 
-  enc_c[2] = B64_ALPHABET[(c_arr[1] & 0x0F) << 0x02 | (c_arr[2] >> 0x06)];
-  enc_c[3] = B64_ALPHABET[(c_arr[2] & 0x3F)];
+  memset(&st, 0, sizeof(st));
+  *outChars_p  = b64_decode(&st, b64, len, buf);
+  *outChars_p += b64_decodeFinish(&st, buf + *outChars_p);
 
-  return enc_c;
+  return buf;
 }
 
 /** Copy a buffer into a new buffer, converting to base-64 as we go.
@@ -415,46 +569,159 @@ static char *b64_encode_3bytes(int c_arr[3])
  */
 size_t binary_to_b64(const unsigned char *in, size_t inLen, char *out)
 { 
-  int           c[3];
-  int           i;
-  size_t        outLen = 0;
+  size_t	outLen;
+
+  if (!out)
+    return B64_ENCODED_LENGTH(inLen);
+
+  outLen = b64_encode(in, inLen, out);
+  out[outLen] = (char)0;
 
-  for (i=0; i < inLen; i++)
+  return outLen;
+}
+
+#define B64_CHUNK	3072	/**< Bytes encoded per step by b64_encodeString(); must be a multiple of 3 */
+
+/** Widen base 64 characters into a jschar buffer, breaking lines with CRLF.
+ *  @param	column_p	[in/out] Characters already on the current line
+ *  @returns	The next position in p
+ */
+static jschar *b64_emit(jschar *p, const char *enc, size_t n, size_t lineLength, size_t *column_p)
+{
+  size_t	column = *column_p;
+  size_t	run, i;
+
+  while (n)
   {
-    if (i && i % 3 == 0)
+    if (lineLength)
     {
-      if (out)
-        memcpy(out + outLen, b64_encode_3bytes(c), 4);
-      outLen += 4;
+      if (column == lineLength)
+      {
+	*p++ = '\r';
+	*p++ = '\n';
+	column = 0;
+      }
+      run = lineLength - column;
+      if (run > n)
+	run = n;
     }
-    c[i % 3] = in[i];
+    else
+      run = n;
+
+    for (i = 0; i < run; i++)
+      p[i] = (unsigned char)enc[i];
+
+    p      += run;
+    enc    += run;
+    n      -= run;
+    column += run;
+  }
+
+  *column_p = column;
+  return p;
+}
+
+/** Encode bytes as a base 64 JavaScript String. The string's characters are written in place,
+ *  in cache-sized steps, rather than building a C string and copying it.
+ *
+ *  @param	cx		JavaScript context
+ *  @param	head		Bytes to encode before in, or NULL. When in is not empty, headLen must be 0 or 3.
+ *  @param	headLen		Number of bytes at head
+ *  @param	in		Bytes to encode
+ *  @param	inLen		Number of bytes at in; unless this is the end of the data, a multiple of 3
+ *  @param	lineLength	Insert CRLF line breaks to keep lines this long (76 for MIME), or 0 for none
+ *  @param	column_p	[in/out] Characters already on the current line, or NULL when starting fresh. A line 
+ *				break is written before a character which would make the line too long, never 
+ *				at the end, so streams can be encoded piecewise.
+ *  @returns	The new string, or NULL if an exception was thrown
+ */
+JSString *b64_encodeString(JSContext *cx, const unsigned char *head, size_t headLen, const unsigned char *in, size_t inLen,
+			   size_t lineLength, size_t *column_p)
+{
+  char		tmp[B64_ENCODED_LENGTH(B64_CHUNK)];
+  size_t	encodedLength = B64_ENCODED_LENGTH(headLen) + B64_ENCODED_LENGTH(inLen);
+  size_t	column = column_p ? *column_p : 0;
+  size_t	total, step;
+  jschar	*chars, *p;
+  JSString	*str;
+
+  if (!encodedLength)
+    return JS_NewStringCopyN(cx, "", 0);
+
+  total = encodedLength;
+  if (lineLength)
+    total += 2 * ((column + encodedLength - 1) / lineLength);
+
+  chars = JS_malloc(cx, (total + 1) * sizeof(jschar));
+  if (!chars)
+    return NULL;
+
+  p = chars;
+  if (headLen)
+    p = b64_emit(p, tmp, b64_encode(head, headLen, tmp), lineLength, &column);
+
+  for (; inLen; in += step, inLen -= step)
+  {
+    step = inLen < B64_CHUNK ? inLen : B64_CHUNK;
+    p = b64_emit(p, tmp, b64_encode(in, step, tmp), lineLength, &column);
   }
 
-  switch(i % 3)
+  GPSEE_ASSERT((size_t)(p - chars) == total);
+  *p = 0;
+
+  str = JS_NewUCString(cx, chars, total);
+  if (!str)
   {
-    case 1:
-      c[1] = 0;
-    case 2:
-      c[2] = 0;
-    case 0:     
-      if (out)
-        memcpy(out + outLen, b64_encode_3bytes(c), 4);
-      break;
+    JS_free(cx, chars);
+    return NULL;
   }
 
-  switch(i % 3)
+  if (column_p)
+    *column_p = column;
+
+  return str;
+}
+
+/** Decode a base 64 JavaScript String, possibly one piece of a stream, into a new GPSEE ByteThing.
+ *  Whitespace (e.g. MIME line breaks) is skipped.
+ *
+ *  @param	cx		JavaScript context
+ *  @param	str		The string to decode
+ *  @param	st		Decoder state, all zero at the start of a stream
+ *  @param	finish		Whether this is the end of the stream
+ *  @returns	The new ByteThing, or NULL if an exception was thrown. Its contents are followed by a NUL
+ *		which is not included in its length.
+ */
+JSObject *b64_decodeString(JSContext *cx, JSString *str, b64_decoder_t *st, JSBool finish)
+{
+  const jschar		*chars = JS_GetStringChars(str);
+  size_t		len = JS_GetStringLength(str);
+  char			tmp[4096];
+  JSObject		*obj;
+  byteThing_handle_t	*hnd;
+  size_t		pos, step, i, n = 0;
+
+  if (!chars)
+    return NULL;
+
+  obj = gpsee_newByteThing(cx, NULL, B64_DECODED_MAX(len) + 1, JS_TRUE);
+  if (!obj)
+    return NULL;
+  hnd = JS_GetPrivate(cx, obj);
+
+  for (pos = 0; pos < len; pos += step)
   {
-    case 0:
-      out[outLen + 4] = (char)0;
-      break;
-    case 1:
-      out[outLen + 2] = '=';
-    case 2:
-      out[outLen + 3] = '=';
-      out[outLen + 4] = (char)0;
-      outLen += (i % 3) + 1;      
-      break;
+    step = (len - pos) < sizeof(tmp) ? (len - pos) : sizeof(tmp);
+    for (i = 0; i < step; i++)
+      tmp[i] = chars[pos + i] > 0xff ? '!' : chars[pos + i];	/* '!' is not base 64; ends decoding */
+    n += b64_decode(st, tmp, step, hnd->buffer + n);
   }
 
-  return outLen;
+  if (finish)
+    n += b64_decodeFinish(st, hnd->buffer + n);
+
+  hnd->buffer[n] = (char)0;
+  hnd->length = n;
+
+  return obj;
 }
@@ -39,6 +39,26 @@
  *  @date	Aug 2014
  */
 
+/** Number of characters in the base 64 encoding of n bytes */
+#define B64_ENCODED_LENGTH(n)	((((n) + 2) / 3) * 4)
+/** Largest number of bytes that n base 64 characters can decode to */
+#define B64_DECODED_MAX(n)	((((n) + 3) / 4) * 3 + 3)
+
+/** State of a base 64 decoder, carried between chunks of a stream. Initialize to all zero. */
+typedef struct
+{
+  uint32	bits;		/**< Sextets of the current, incomplete group */
+  int		sextets;	/**< Number of sextets in bits */
+  int		done;		/**< Padding or garbage seen; ignore the rest of the stream */
+} b64_decoder_t;
+
+size_t b64_encode(const unsigned char *in, size_t inLen, char *out);
+size_t b64_decode(b64_decoder_t *st, const char *in, size_t inLen, unsigned char *out);
+size_t b64_decodeFinish(b64_decoder_t *st, unsigned char *out);
+JSString *b64_encodeString(JSContext *cx, const unsigned char *head, size_t headLen, const unsigned char *in, size_t inLen,
+			   size_t lineLength, size_t *column_p);
+JSObject *b64_decodeString(JSContext *cx, JSString *str, b64_decoder_t *st, JSBool finish);
+
 size_t binary_to_b64(const unsigned char *in, size_t inLen, char *out);
 unsigned char *b64_to_binary(JSContext *cx, const char *b64, unsigned char *buf, size_t *outChars_p);
 unsigned char *qp_to_binary(JSContext *cx, const char *qp, unsigned char *outBuf, size_t *outLen_p);
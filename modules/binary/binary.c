@@ -53,43 +53,61 @@ static const char __attribute__((unused)) rcsid[]="$Id: binary.c,v 1.4 2011/12/0
 JSClass *byteString_clasp;
 JSClass *byteArray_clasp;
 
+/** Fetch the ByteThing handle for argv[0] of a binary module static method, or throw */
+static byteThing_handle_t *binary_byteThingArg(JSContext *cx, jsval *argv, const char *throwPrefix)
+{
+  JSObject              *obj;
+  byteThing_handle_t    *hnd;
+
+  if (!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]))
+  {
+    (void)gpsee_throw(cx, "%s.arguments.0: not an object", throwPrefix);
+    return NULL;
+  }
+  obj = JSVAL_TO_OBJECT(argv[0]);
+  if (!gpsee_isByteThing(cx, obj))
+  {
+    (void)gpsee_throw(cx, "%s.arguments.0: not a ByteThing", throwPrefix);
+    return NULL;
+  }
+  hnd = JS_GetPrivate(cx, obj);
+  if (!hnd)
+  {
+    (void)gpsee_throw(cx, "%s.arguments.0: ByteThing handle missing!", throwPrefix);
+    return NULL;
+  }
+
+  return hnd;
+}
+
 /** Static method of binary module which can convert a bytething into
- *  a JS String, encoding in base 64 along the way.
+ *  a JS String, encoding in base 64 along the way. The optional second
+ *  argument is a line length (76 for MIME bodies); lines are separated
+ *  with CRLF.
  */
 static JSBool binary_toBase64(JSContext *cx, int argc, jsval *vp)
 {
   jsval                 *argv = JS_ARGV(cx, vp);
-  JSObject              *obj;
   byteThing_handle_t    *hnd;
-  char                  *s;
   JSString              *str;
+  int32                 lineLength = 0;
   
-  if (argc != 1)
+  if (argc < 1 || argc > 2)
     return gpsee_throw(cx, MODULE_ID ".toBase64.arguments.count");
-  if (!JSVAL_IS_OBJECT(argv[0]))
-    return gpsee_throw(cx, MODULE_ID ".toBase64.arguments.0: not an object");
-  obj = JSVAL_TO_OBJECT(argv[0]);
-  if (!gpsee_isByteThing(cx, obj))
-    return gpsee_throw(cx, MODULE_ID ".toBase64.arguments.0: not a ByteThing");
-  hnd = JS_GetPrivate(cx, obj);
+
+  hnd = binary_byteThingArg(cx, argv, MODULE_ID ".toBase64");
   if (!hnd)
-    return gpsee_throw(cx, MODULE_ID ".toBase64.arguments.0: ByteThing handle missing!");
+    return JS_FALSE;
 
-  if (hnd->length)
+  if (argc == 2 && !JSVAL_IS_VOID(argv[1]))
   {
-    s = JS_malloc(cx, ((((hnd->length) + 2) / 3) * 4) + 1);
-    if (!s)
+    if (JS_ValueToInt32(cx, argv[1], &lineLength) == JS_FALSE)
       return JS_FALSE;
-    (void)binary_to_b64(hnd->buffer, hnd->length, s);
-
-    str = JS_NewStringCopyZ(cx, s);
-    JS_free(cx, s);
-  }
-  else
-  {
-    str = JS_NewStringCopyN(cx, "", 0);
+    if (lineLength < 0)
+      return gpsee_throw(cx, MODULE_ID ".toBase64.arguments.1.range: line length must not be negative");
   }
 
+  str = b64_encodeString(cx, NULL, 0, hnd->buffer, hnd->length, lineLength, NULL);
   if (!str)
     return JS_FALSE;
 
@@ -104,10 +122,8 @@ static JSBool binary_fromBase64(JSContext *cx, int argc, jsval *vp)
 {
   jsval                 *argv = JS_ARGV(cx, vp);
   JSString              *str;
-  const char            *s;
-  unsigned char         *buf;
   JSObject              *obj;
-  byteThing_handle_t    *hnd;
+  b64_decoder_t         st;
 
   if (argc != 1)
     return gpsee_throw(cx, MODULE_ID ".fromBase64.arguments.count");
@@ -119,23 +135,100 @@ static JSBool binary_fromBase64(JSContext *cx, int argc, jsval *vp)
     str = JS_ValueToString(cx, argv[0]);
     if (!str)
       return JS_FALSE;
+    argv[0] = STRING_TO_JSVAL(str);
+  }
+
+  memset(&st, 0, sizeof(st));
+  obj = b64_decodeString(cx, str, &st, JS_TRUE);
+  if (!obj)
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+  return JS_TRUE;
+}  
+
+/** Static method of binary module which can convert a bytething into
+ *  a JS String, encoding as quoted-printable along the way. The optional
+ *  second argument is a string of characters which must be encoded even
+ *  though they could be sent plain.
+ */
+static JSBool binary_toQuotedPrintable(JSContext *cx, int argc, jsval *vp)
+{
+  jsval                 *argv = JS_ARGV(cx, vp);
+  byteThing_handle_t    *hnd;
+  const char            *force = "";
+  char                  *s;
+  JSString              *str;
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, MODULE_ID ".toQuotedPrintable.arguments.count");
+
+  hnd = binary_byteThingArg(cx, argv, MODULE_ID ".toQuotedPrintable");
+  if (!hnd)
+    return JS_FALSE;
+
+  if (argc == 2 && !JSVAL_IS_VOID(argv[1]))
+  {
+    str = JS_ValueToString(cx, argv[1]);
+    if (!str)
+      return JS_FALSE;
+    argv[1] = STRING_TO_JSVAL(str);
+    force = JS_GetStringBytesZ(cx, str);
+    if (!force)
+      return JS_FALSE;
+  }
+
+  s = binary_to_qp_alloc(cx, hnd->buffer, hnd->length, force);
+  if (!s)
+    return JS_FALSE;
+
+  str = JS_NewString(cx, s, strlen(s));
+  if (!str)
+  {
+    JS_free(cx, s);
+    return JS_FALSE;
   }
 
+  JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(str));
+  return JS_TRUE;
+}
+
+/** Static method of binary module which can convert a JS string
+ *  into a bytething, decoding quoted-printable along the way
+ */
+static JSBool binary_fromQuotedPrintable(JSContext *cx, int argc, jsval *vp)
+{
+  jsval                 *argv = JS_ARGV(cx, vp);
+  JSString              *str;
+  const char            *s;
+  JSObject              *obj;
+  byteThing_handle_t    *hnd;
+  size_t                outLen = 0;
+
+  if (argc != 1)
+    return gpsee_throw(cx, MODULE_ID ".fromQuotedPrintable.arguments.count");
+
+  str = JS_ValueToString(cx, argv[0]);
+  if (!str)
+    return JS_FALSE;
+  argv[0] = STRING_TO_JSVAL(str);
+
   s = JS_GetStringBytesZ(cx, str);
   if (!s)
     return JS_FALSE;
-  
-  obj = gpsee_newByteThing(cx, NULL, ((strlen(s) / 4) * 3) + 2, JS_TRUE);
+
+  obj = gpsee_newByteThing(cx, NULL, strlen(s) + 1, JS_TRUE);
+  if (!obj)
+    return JS_FALSE;
   hnd = JS_GetPrivate(cx, obj);
-  buf = b64_to_binary(cx, s, hnd->buffer, &hnd->length);
-  if (!buf)
+  if (!qp_to_binary(cx, s, hnd->buffer, &outLen))
     return JS_FALSE;
+  hnd->length = outLen;
 
   JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
   return JS_TRUE;
-}  
+}
   
-
 /** Initialize the module */
 const char *binary_InitModule(JSContext *cx, JSObject *moduleObject)
 {
@@ -145,10 +238,8 @@ const char *binary_InitModule(JSContext *cx, JSObject *moduleObject)
   {
     JS_FN("toBase64",               binary_toBase64,                0, 0),
     JS_FN("fromBase64",             binary_fromBase64,              0, 0),
-/** @todo
     JS_FN("toQuotedPrintable",      binary_toQuotedPrintable,       0, 0),
-    JS_FN("fromQuotedPrintable",    binary_fromQuotePrintable,      0, 0),
-*/
+    JS_FN("fromQuotedPrintable",    binary_fromQuotedPrintable,     0, 0),
     { NULL, NULL, 0, 0, 0 },
   };
 
@@ -165,6 +256,21 @@ const char *binary_InitModule(JSContext *cx, JSObject *moduleObject)
   if (ByteArray_InitClass(cx, moduleObject, proto) == NULL)
     return NULL;
 
+  if (LineReader_InitClass(cx, moduleObject) == NULL)
+    return NULL;
+
+  if (Transcoder_InitClass(cx, moduleObject) == NULL)
+    return NULL;
+
+  if (Base64Stream_InitClasses(cx, moduleObject) == NULL)
+    return NULL;
+
+  if (DataView_InitClass(cx, moduleObject) == NULL)
+    return NULL;
+
+  if (Struct_InitClass(cx, moduleObject) == NULL)
+    return NULL;
+
   
   return MODULE_ID;
 }
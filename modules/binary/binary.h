@@ -50,6 +50,11 @@
 JSObject *ByteString_InitClass(JSContext *cx, JSObject *obj, JSObject *parentProto);
 JSObject *ByteArray_InitClass(JSContext *cx, JSObject *obj, JSObject *parentProto);
 JSObject *Binary_InitClass(JSContext *cx, JSObject *obj);
+JSObject *LineReader_InitClass(JSContext *cx, JSObject *obj);
+JSObject *Transcoder_InitClass(JSContext *cx, JSObject *obj);
+JSObject *Base64Stream_InitClasses(JSContext *cx, JSObject *obj);
+JSObject *DataView_InitClass(JSContext *cx, JSObject *obj);
+JSObject *Struct_InitClass(JSContext *cx, JSObject *obj);
 
 #ifndef HAVE_MEMRCHR
 #define memrchr gpsee_memrchr
@@ -152,6 +152,19 @@ exports.ByteArray.prototype.reduceRight = function(f) {
   return rval;
 }
 
+/** LineReader.__iterator__()
+ *  @name           LineReader.__iterator__
+ *  @function
+ *  @public
+ *
+ *  Yields each line from the LineReader as a ByteString, i.e. for (line in new LineReader(fd)) ...
+ */
+exports.LineReader.prototype.__iterator__ = function() {
+  var line;
+  while ((line = this.readLine()) !== null)
+    yield line;
+}
+
 /** Converts a string to a ByteArray encoded in charset. */
 function binary$$String$toByteArray(charset)
 {
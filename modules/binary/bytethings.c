@@ -45,13 +45,7 @@ static const char __attribute__((unused)) rcsid[]="$Id: bytethings.c,v 1.14 2010
 
 #include "gpsee.h"
 #include "binary.h"
-
-/** BE and LE flavours of UTF-16 do not emit the BOM. JS Strings are BOM-less and in machine order. */
-#if defined(_BIG_ENDIAN) || (defined(BYTE_ORDER) && defined(BIG_ENDIAN) && BYTE_ORDER == BIG_ENDAN)
-# define DEFAULT_UTF_16_FLAVOUR "utf-16BE"
-#else
-# define DEFAULT_UTF_16_FLAVOUR "utf-16LE"
-#endif
+#include <prinit.h>
 
 /** A neutral character set that anything can be transcoded to/from */
 #define NEUTRAL_CHARSET	"utf-8"
@@ -298,6 +292,386 @@ JSBool copyJSArray_toBuf(JSContext *cx, JSObject *arr, size_t start, unsigned ch
   return JS_FALSE;
 }
 
+#if defined(HAVE_ICONV)
+/* iconv_open() is expensive -- it typically loads and parses conversion tables -- so each
+ * thread keeps a few recently-used descriptors, most recently used first. A descriptor
+ * is removed from the cache while in use, so nested transcodes never share one.
+ */
+#define ICONV_CACHE_SIZE	8
+
+typedef struct
+{
+  char		target[32];	/**< Target charset name, as passed to iconv_open() */
+  char		source[32];	/**< Source charset name, as passed to iconv_open() */
+  iconv_t	cd;		/**< Conversion descriptor, in its initial shift state */
+} iconvCacheEntry_t;
+
+typedef struct
+{
+  size_t		used;				/**< Number of valid entries */
+  iconvCacheEntry_t	entries[ICONV_CACHE_SIZE];	/**< Most recently used first */
+} iconvCache_t;
+
+static PRUintn		iconvCacheIndex;
+static PRCallOnceType	iconvCacheOnce;
+static PRStatus		iconvCacheStatus = PR_FAILURE;
+
+/** Thread-private data destructor; closes a thread's cached descriptors when it exits */
+static void iconvCache_destroy(void *priv)
+{
+  iconvCache_t	*cache = priv;
+  size_t	i;
+
+  for (i = 0; i < cache->used; i++)
+    iconv_close(cache->entries[i].cd);
+
+  free(cache);
+}
+
+static PRStatus iconvCache_init(void)
+{
+  iconvCacheStatus = PR_NewThreadPrivateIndex(&iconvCacheIndex, iconvCache_destroy);
+  return PR_SUCCESS;
+}
+
+/** Get the calling thread's descriptor cache, or NULL if it cannot be had */
+static iconvCache_t *iconvCache_get(JSBool create)
+{
+  iconvCache_t	*cache;
+
+  if (PR_CallOnce(&iconvCacheOnce, iconvCache_init) != PR_SUCCESS || iconvCacheStatus != PR_SUCCESS)
+    return NULL;
+
+  cache = PR_GetThreadPrivate(iconvCacheIndex);
+  if (cache || !create)
+    return cache;
+
+  cache = calloc(1, sizeof(*cache));
+  if (cache && PR_SetThreadPrivate(iconvCacheIndex, cache) != PR_SUCCESS)
+  {
+    free(cache);
+    cache = NULL;
+  }
+
+  return cache;
+}
+
+/** Drop-in replacement for iconv_open() which takes descriptors from the thread's cache when it can */
+static iconv_t iconvCache_open(const char *targetCharset, const char *sourceCharset)
+{
+  iconvCache_t	*cache = iconvCache_get(JS_FALSE);
+  size_t	i;
+
+  if (cache)
+  {
+    for (i = 0; i < cache->used; i++)
+    {
+      iconvCacheEntry_t *entry = &cache->entries[i];
+
+      if ((strcasecmp(entry->target, targetCharset) == 0) && (strcasecmp(entry->source, sourceCharset) == 0))
+      {
+	iconv_t cd = entry->cd;
+
+	cache->used--;
+	memmove(entry, entry + 1, (cache->used - i) * sizeof(*entry));
+	return cd;
+      }
+    }
+  }
+
+  return iconv_open(targetCharset, sourceCharset);
+}
+
+/** Drop-in replacement for iconv_close() which returns descriptors to the thread's cache */
+static void iconvCache_close(iconv_t cd, const char *targetCharset, const char *sourceCharset)
+{
+  iconvCache_t	*cache;
+
+  if ((strlen(targetCharset) >= sizeof(cache->entries[0].target)) || 
+      (strlen(sourceCharset) >= sizeof(cache->entries[0].source)) ||
+      !(cache = iconvCache_get(JS_TRUE)))
+  {
+    iconv_close(cd);
+    return;
+  }
+
+  /* Return the descriptor to its initial shift state */
+  iconv(cd, NULL, NULL, NULL, NULL);
+
+  if (cache->used == ICONV_CACHE_SIZE)
+    iconv_close(cache->entries[--cache->used].cd);
+
+  memmove(&cache->entries[1], &cache->entries[0], cache->used * sizeof(cache->entries[0]));
+  strcpy(cache->entries[0].target, targetCharset);
+  strcpy(cache->entries[0].source, sourceCharset);
+  cache->entries[0].cd = cd;
+  cache->used++;
+}
+#endif /* HAVE_ICONV */
+
+/* Hand-written transcoders for the conversions between JavaScript Strings and the charsets
+ * we see most. They process a machine word of ASCII at a time, and leave the hard cases --
+ * invalid input, which needs a proper error message -- to iconv.
+ */
+typedef enum
+{
+  fcs_other,
+  fcs_utf16,	/**< DEFAULT_UTF_16_FLAVOUR, i.e. JS String characters */
+  fcs_utf8,
+  fcs_latin1
+} fastCharset_e;
+
+static fastCharset_e fastCharset(const char *charset)
+{
+  if (strcasecmp(charset, DEFAULT_UTF_16_FLAVOUR) == 0)
+    return fcs_utf16;
+  if ((strcasecmp(charset, "utf-8") == 0) || (strcasecmp(charset, "utf8") == 0))
+    return fcs_utf8;
+  if ((strcasecmp(charset, "iso-8859-1") == 0) || (strcasecmp(charset, "iso8859-1") == 0) || 
+      (strcasecmp(charset, "latin1") == 0) || (strcasecmp(charset, "l1") == 0))
+    return fcs_latin1;
+
+  return fcs_other;
+}
+
+#define ASCII_MASK_8	0x8080808080808080ULL	/**< High bit of eight bytes */
+#define ASCII_MASK_16	0xff80ff80ff80ff80ULL	/**< Non-ASCII bits of four jschars */
+
+/** Decode UTF-8 into jschars. @returns number of jschars written, or -1 on invalid input */
+static ssize_t utf8_toUTF16(jschar *out, const unsigned char *in, size_t len)
+{
+  const unsigned char	*end = in + len;
+  jschar		*start = out;
+
+  while (in < end)
+  {
+    uint64	word;
+    uint32	c;
+    size_t	extra;
+
+    /* Widen runs of ASCII a word at a time */
+    while ((end - in >= sizeof(word)) && (memcpy(&word, in, sizeof(word)), !(word & ASCII_MASK_8)))
+    {
+      out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = in[3];
+      out[4] = in[4]; out[5] = in[5]; out[6] = in[6]; out[7] = in[7];
+      in += 8;
+      out += 8;
+    }
+
+    if (in == end)
+      break;
+
+    c = *in++;
+    if (c < 0x80)
+    {
+      *out++ = c;
+      continue;
+    }
+
+    if (c < 0xc2)			/* continuation byte or overlong 2-byte form */
+      return -1;
+    else if (c < 0xe0)
+      extra = 1, c &= 0x1f;
+    else if (c < 0xf0)
+      extra = 2, c &= 0x0f;
+    else if (c < 0xf5)
+      extra = 3, c &= 0x07;
+    else
+      return -1;
+
+    if (end - in < extra)
+      return -1;
+
+    switch(extra)
+    {
+      case 3:
+	if ((*in & 0xc0) != 0x80) return -1;
+	c = (c << 6) | (*in++ & 0x3f);
+	/* fall through */
+      case 2:
+	if ((*in & 0xc0) != 0x80) return -1;
+	c = (c << 6) | (*in++ & 0x3f);
+	/* fall through */
+      case 1:
+	if ((*in & 0xc0) != 0x80) return -1;
+	c = (c << 6) | (*in++ & 0x3f);
+    }
+
+    if ((extra == 2 && c < 0x800) || (extra == 3 && (c < 0x10000 || c > 0x10ffff)) || (c >= 0xd800 && c < 0xe000))
+      return -1;			/* overlong, out of range, or a surrogate */
+
+    if (c < 0x10000)
+      *out++ = c;
+    else
+    {
+      c -= 0x10000;
+      *out++ = 0xd800 | (c >> 10);
+      *out++ = 0xdc00 | (c & 0x3ff);
+    }
+  }
+
+  return out - start;
+}
+
+/** Encode jschars as UTF-8. @returns number of bytes written, or -1 on an unpaired surrogate */
+static ssize_t utf16_toUTF8(unsigned char *out, const jschar *in, size_t nChars)
+{
+  const jschar		*end = in + nChars;
+  unsigned char		*start = out;
+
+  while (in < end)
+  {
+    uint64	word;
+    uint32	c;
+
+    /* Narrow runs of ASCII four characters at a time */
+    while ((end - in >= 4) && (memcpy(&word, in, sizeof(word)), !(word & ASCII_MASK_16)))
+    {
+      out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = in[3];
+      in += 4;
+      out += 4;
+    }
+
+    if (in == end)
+      break;
+
+    c = *in++;
+    if (c < 0x80)
+      *out++ = c;
+    else if (c < 0x800)
+    {
+      *out++ = 0xc0 | (c >> 6);
+      *out++ = 0x80 | (c & 0x3f);
+    }
+    else if (c < 0xd800 || c >= 0xe000)
+    {
+      *out++ = 0xe0 | (c >> 12);
+      *out++ = 0x80 | ((c >> 6) & 0x3f);
+      *out++ = 0x80 | (c & 0x3f);
+    }
+    else
+    {
+      if (c >= 0xdc00 || in == end || *in < 0xdc00 || *in >= 0xe000)
+	return -1;
+
+      c = 0x10000 + (((c - 0xd800) << 10) | (*in++ - 0xdc00));
+      *out++ = 0xf0 | (c >> 18);
+      *out++ = 0x80 | ((c >> 12) & 0x3f);
+      *out++ = 0x80 | ((c >> 6) & 0x3f);
+      *out++ = 0x80 | (c & 0x3f);
+    }
+  }
+
+  return out - start;
+}
+
+/**
+ *  Transcode without iconv, when we know how. Arguments are as for transcodeBuf_toBuf(), except
+ *  that the charsets must not be NULL.
+ *
+ *  @param	handled_p	[out] Set to JS_TRUE if the conversion was done; JS_FALSE if the caller should 
+ *				      use iconv, either because the charsets are not ones we know or because the 
+ *				      input is not valid in sourceCharset.
+ *  @returns	JS_TRUE on success, JS_FALSE on throw
+ */
+static JSBool transcodeBuf_fastPath(JSContext *cx, const char *targetCharset, const char *sourceCharset, 
+				    unsigned char **outputBuffer_p, size_t *outputBufferLength_p, 
+				    const unsigned char *inputBuffer, size_t inputBufferLength, JSBool *handled_p)
+{
+  fastCharset_e		target = fastCharset(targetCharset);
+  fastCharset_e		source = fastCharset(sourceCharset);
+  unsigned char		*out;
+  size_t		allocBytes;
+  ssize_t		outLength;
+  size_t		i;
+
+  *handled_p = JS_FALSE;
+
+  if ((target == fcs_other) || (source == fcs_other))
+    return JS_TRUE;
+
+  if ((source == fcs_utf16) && (inputBufferLength % sizeof(jschar)))
+    return JS_TRUE;
+
+  /* Different spellings of the same charset, e.g. NULL and DEFAULT_UTF_16_FLAVOUR: copy, as for equal names */
+  if (target == source)
+  {
+    out = JS_malloc(cx, inputBufferLength);
+    if (!out)
+      return JS_FALSE;
+
+    memcpy(out, inputBuffer, inputBufferLength);
+    *outputBuffer_p = out;
+    *outputBufferLength_p = inputBufferLength;
+    *handled_p = JS_TRUE;
+
+    return JS_TRUE;
+  }
+
+  if ((target != fcs_utf16) && (source != fcs_utf16))
+    return JS_TRUE;
+
+  /* Worst cases: one jschar per input byte; three UTF-8 bytes per jschar */
+  if (source != fcs_utf16)
+    allocBytes = inputBufferLength * sizeof(jschar);
+  else if (target == fcs_utf8)
+    allocBytes = (inputBufferLength / 2) * 3;
+  else
+    allocBytes = inputBufferLength / 2;
+
+  out = JS_malloc(cx, allocBytes);
+  if (!out)
+    return JS_FALSE;
+
+  if (source == fcs_latin1)
+  {
+    jschar *chars = (jschar *)out;
+
+    for (i = 0; i < inputBufferLength; i++)
+      chars[i] = inputBuffer[i];
+    outLength = inputBufferLength * sizeof(jschar);
+  }
+  else if (source == fcs_utf8)
+  {
+    outLength = utf8_toUTF16((jschar *)out, inputBuffer, inputBufferLength);
+    if (outLength != -1)
+      outLength *= sizeof(jschar);
+  }
+  else if (target == fcs_latin1)
+  {
+    const jschar	*chars = (const jschar *)inputBuffer;
+    jschar		seen = 0;
+
+    for (i = 0; i < inputBufferLength / 2; i++)
+    {
+      seen |= chars[i];
+      out[i] = (unsigned char)chars[i];
+    }
+    outLength = (seen & 0xff00) ? -1 : inputBufferLength / 2;
+  }
+  else
+    outLength = utf16_toUTF8(out, (const jschar *)inputBuffer, inputBufferLength / 2);
+
+  if (outLength == -1)
+  {
+    JS_free(cx, out);
+    return JS_TRUE;
+  }
+
+  if (outLength != allocBytes)
+  {
+    unsigned char *newBuf = JS_realloc(cx, out, outLength ?: 1);
+    if (newBuf)
+      out = newBuf;
+  }
+
+  *outputBuffer_p = out;
+  *outputBufferLength_p = outLength;
+  *handled_p = JS_TRUE;
+
+  return JS_TRUE;
+}
+
 /**
  *  Transcode from one character encoding to another. This routine works on "buffers", i.e.
  *  C arrays of unsigned char. 
@@ -329,6 +703,7 @@ JSBool transcodeBuf_toBuf(JSContext *cx, const char *targetCharset, const char *
   jsrefcount	depth;
 #endif
   size_t	approxChars;
+  JSBool	handled;
 
   /* Empty string? */
   if (inputBufferLength == 0) {
@@ -362,12 +737,18 @@ JSBool transcodeBuf_toBuf(JSContext *cx, const char *targetCharset, const char *
   if (!targetCharset)
     targetCharset =  DEFAULT_UTF_16_FLAVOUR;
 
+  if (transcodeBuf_fastPath(cx, targetCharset, sourceCharset, outputBuffer_p, outputBufferLength_p, 
+			    inputBuffer, inputBufferLength, &handled) == JS_FALSE)
+    return JS_FALSE;
+  if (handled)
+    return JS_TRUE;
+
 #if !defined(HAVE_ICONV)
   return gpsee_throw(cx, "%s.transcode.iconv.missing: Could not transcode charset %s to %s charset; GPSEE was compiled without iconv "
 		     "support.", throwPrefix, sourceCharset, targetCharset);
 #else
   depth = JS_SuspendRequest(cx);
-  cd = iconv_open(targetCharset, sourceCharset);
+  cd = iconvCache_open(targetCharset, sourceCharset);
   JS_ResumeRequest(cx, depth);
   
 #if !defined(HAVE_IDENTITY_TRANSCODING_ICONV)
@@ -382,13 +763,14 @@ JSBool transcodeBuf_toBuf(JSContext *cx, const char *targetCharset, const char *
     iconv_t	cd1;
     iconv_t	cd2; 
 
-    /* Here we'll iconv_open() just as a feature test */
+    /* Here we'll iconv_open() just as a feature test; the cache hands the descriptors
+     * straight back to the recursive calls below */
     depth = JS_SuspendRequest(cx);
-    if ((cd1 = iconv_open(targetCharset, NEUTRAL_CHARSET)) != (iconv_t)-1)
-      iconv_close(cd1);
+    if ((cd1 = iconvCache_open(targetCharset, NEUTRAL_CHARSET)) != (iconv_t)-1)
+      iconvCache_close(cd1, targetCharset, NEUTRAL_CHARSET);
 
-    if ((cd2 = iconv_open(NEUTRAL_CHARSET, sourceCharset)) != (iconv_t)-1)
-      iconv_close(cd2);
+    if ((cd2 = iconvCache_open(NEUTRAL_CHARSET, sourceCharset)) != (iconv_t)-1)
+      iconvCache_close(cd2, NEUTRAL_CHARSET, sourceCharset);
     JS_ResumeRequest(cx, depth);
 
     if (cd1 != (iconv_t)-1 && cd2 != (iconv_t)-1)
@@ -405,7 +787,7 @@ JSBool transcodeBuf_toBuf(JSContext *cx, const char *targetCharset, const char *
 	  return JS_TRUE;
       }      
 
-      return JS_TRUE;
+      return JS_FALSE;
     }
   }
 #endif
@@ -473,7 +855,7 @@ JSBool transcodeBuf_toBuf(JSContext *cx, const char *targetCharset, const char *
     }
   } while (result == -1);
 
-  iconv_close(cd);
+  iconvCache_close(cd, targetCharset, sourceCharset);
   *outputBufferLength_p = outbuf - outbufStart;
   if (*outputBufferLength_p != allocBytes)
   {
@@ -537,15 +919,12 @@ JSBool transcodeString_toBuf(JSContext *cx, JSString *string, const char *charse
   }
 
 #if !defined(HAVE_ICONV)
-# warning Iconv support not detected: Binary module will throw rather than convert
-  return gpsee_throw(cx, "%s.transcode.iconv.missing: Could not transcode UTF-16 String to %s charset; GPSEE was compiled without iconv "
-		     "support.", throwPrefix, charset ?: "(null)");
-#else
+# warning Iconv support not detected: Binary module will throw rather than convert charsets other than UTF-8 and ISO-8859-1
+#endif
    if (string_length >=  1L << ((sizeof(size_t) * 8) - 1))   /* JSAPI limit is currently lower than this; may 2009 wg from shaver */
      return gpsee_throw(cx, "%s.transcode.length: String length exceeds maximum characters, cannot convert", throwPrefix);
   else
     return transcodeBuf_toBuf(cx, charset, DEFAULT_UTF_16_FLAVOUR, bufp, lenp, (const unsigned char *)string_chars, string_length * 2, throwPrefix);
-#endif
 }
 
 /** Implements Binary::length getter.
@@ -1047,6 +1426,56 @@ JSObject *byteThing_fromCArray(JSContext *cx, const unsigned char *buffer, size_
   return obj;
 }
 
+/**
+ *  Create a new, immutable ByteString instance which shares memory with an existing ByteThing
+ *  rather than copying it. The new instance's memoryOwner is the owner of the shared memory,
+ *  which keeps that memory alive (via gpsee_byteThingTracer) for as long as the new instance
+ *  is reachable.
+ *
+ *  @param	cx          JavaScript context
+ *  @param	owner       The ByteThing whose backing store contains buffer. Its memoryOwner (or
+ *                          owner itself, when it has none) becomes the new instance's memoryOwner.
+ *  @param	buffer      The first byte of the new instance; must lie within owner's backing store
+ *  @param	length      The number of bytes in the new instance
+ *  @param      clasp       The class to instanciate, normally byteString_clasp
+ *  @param      proto       The prototype for the new instance, normally byteString_proto
+ *  @param      btallocSize Size of the private handle for clasp
+ *
+ *  @returns	NULL on OOM, otherwise a new ByteThing.
+ *  @note       The caller is responsible for insuring that the shared memory will never be
+ *              modified, e.g. by only sharing the backing stores of bt_immutable ByteThings.
+ */
+JSObject *byteThing_newSharedSlice(JSContext *cx, JSObject *owner, const unsigned char *buffer, size_t length,
+                                   JSClass *clasp, JSObject *proto, size_t btallocSize)
+{
+  byteThing_handle_t	*ownerHnd = JS_GetPrivate(cx, owner);
+  byteThing_handle_t	*hnd;
+  JSObject		*obj;
+
+  GPSEE_ASSERT(ownerHnd);
+  GPSEE_ASSERT(gpsee_isByteThingClass(cx, clasp));
+
+  hnd = JS_malloc(cx, btallocSize);
+  if (!hnd)
+    return NULL;
+  memset(hnd, 0, btallocSize);
+
+  obj = JS_NewObject(cx, clasp, proto, NULL);
+  if (!obj)
+  {
+    JS_free(cx, hnd);
+    return NULL;
+  }
+
+  hnd->buffer 	   = (unsigned char *)buffer;
+  hnd->length 	   = length;
+  hnd->memoryOwner = ownerHnd->memoryOwner ? ownerHnd->memoryOwner : owner;
+  hnd->btFlags 	   = bt_immutable;
+  JS_SetPrivate(cx, obj, hnd);
+
+  return obj;
+}
+
 /** Allocate and initialize a new byteThing_handle_t. Returned handle is allocated
  *  with JS_malloc().  Caller is responsible for releasing memory; if it winds up
  *  as the private data in a ByteString or ByteArray instance, the finalizer will
@@ -1217,7 +1646,17 @@ JSBool byteThing_decodeToString(JSContext *cx, uintN argc, jsval *vp, JSClass *c
       return gpsee_throw(cx, MODULE_ID ".%s.decodeToString.arguments.count", clasp->name);
   }
 
-  /* TODO not always necessary to do this! */
+  /* Bytes which are already JS String characters are copied straight into the string */
+  if (!sourceCharset && !((size_t)hnd->buffer % sizeof(jschar)))
+  {
+    s = JS_NewUCStringCopyN(cx, (jschar *)hnd->buffer, hnd->length / 2);
+    if (!s)
+      return JS_FALSE;
+
+    JS_SET_RVAL(cx, vp, STRING_TO_JSVAL(s));
+    return JS_TRUE;
+  }
+
   /* Transcode from one character encoding to another */
   if (!transcodeBuf_toBuf(cx, NULL, sourceCharset, (unsigned char **)&buf, &length, hnd->buffer, hnd->length,
                           clasp == byteString_clasp ? "ByteString.decodeToString" : "ByteArray.decodeToString"))
@@ -1378,10 +1817,12 @@ JSBool byteThing_byarAt(JSContext *cx, uintN argc, jsval *vp, JSClass *clasp, JS
  *  @param	argc		Number of arguments
  *  @param	vp		JSFastNative value pointer
  *  @param	memchr_fn	Function to use to find bytes in memory
+ *  @param	memmem_fn	Function to use to find multi-byte ByteString/ByteArray needles in memory
  *  @param	methodName	What this method is called (for display purposes only)
  *  @param	clasp		Class that method was called as, regardless of call() object type
  */
-JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(const void *, int, size_t), const char const *methodName, JSClass *clasp)
+JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(const void *, int, size_t), 
+                          void *memmem_fn(const void *, size_t, const void *, size_t), const char const *methodName, JSClass *clasp)
 {
   byteThing_handle_t    *hnd;
   jsval			*argv = JS_ARGV(cx, vp);
@@ -1392,6 +1833,7 @@ JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(
   const char            *errmsg;
   JSObject		*obj = JS_THIS_OBJECT(cx, vp);
   JSClass		*objClasp = JS_GET_CLASS(cx, obj);
+  byteThing_handle_t	*needle = NULL;
 
   if (!obj)
     return JS_FALSE;
@@ -1407,8 +1849,19 @@ JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(
   if (argc < 1 || argc > 3)
     return gpsee_throw(cx, "%s.arguments.count", methodName);
 
-  /* Process 'needle' argument */
-  if ((errmsg = byteThing_val2byte(cx, argv[0], &theByte)))
+  /* Process 'needle' argument: multi-byte ByteStrings and ByteArrays are searched for as sequences.
+   * Empty ones are handed to byteThing_val2byte() with the single bytes, which rejects them.
+   */
+  if (JSVAL_IS_OBJECT(argv[0]) && !JSVAL_IS_NULL(argv[0]))
+  {
+    JSClass *needleClasp = JS_GET_CLASS(cx, JSVAL_TO_OBJECT(argv[0]));
+
+    if ((needleClasp == byteString_clasp || needleClasp == byteArray_clasp) 
+	&& (needle = JS_GetPrivate(cx, JSVAL_TO_OBJECT(argv[0]))) && (needle->length <= 1))
+      needle = NULL;
+  }
+
+  if (!needle && (errmsg = byteThing_val2byte(cx, argv[0], &theByte)))
     return gpsee_throw(cx, "%s.%s.arguments.0.byte.invalid: %s", clasp->name, methodName, errmsg);
 
   /* Convert JS args to C args */
@@ -1418,7 +1871,12 @@ JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(
     return JS_FALSE;
 
   /* Search for needle */
-  if ((found = memchr_fn(hnd->buffer + start, theByte, len)))
+  if (needle)
+    found = memmem_fn(hnd->buffer + start, len, needle->buffer, needle->length);
+  else
+    found = memchr_fn(hnd->buffer + start, theByte, len);
+
+  if (found)
   {
     if (INT_FITS_IN_JSVAL(found - hnd->buffer))
       JS_SET_RVAL(cx, vp, INT_TO_JSVAL(found - hnd->buffer));
@@ -1454,6 +1912,209 @@ void *gpsee_memrchr(const void *s, int c, size_t n)
 }
 #endif
 
+#if !defined(HAVE_MEMMEM)
+#define BITOP(a,b,op) ((a)[(size_t)(b)/(8*sizeof *(a))] op (size_t)1<<((size_t)(b)%(8*sizeof *(a))))
+/** Crochemore-Perrin "Two-Way" substring search. Linear time, constant space, and no
+ *  pathological inputs; used when the C library does not supply memmem().
+ *  Requires nlen > 1 and hlen >= nlen.
+ */
+static const unsigned char *twoWay_memmem(const unsigned char *h, size_t hlen, const unsigned char *n, size_t nlen)
+{
+  const unsigned char	*z = h + hlen;
+  size_t		i, ip, jp, k, p, ms, p0, mem, mem0;
+  size_t		byteset[32 / sizeof(size_t)] = { 0 };
+  size_t		shift[256];
+
+  /* Fill the byte set and the bad-character shift table */
+  for (i = 0; i < nlen; i++)
+  {
+    BITOP(byteset, n[i], |=);
+    shift[n[i]] = i + 1;
+  }
+
+  /* Compute maximal suffix */
+  ip = -1; jp = 0; k = p = 1;
+  while (jp + k < nlen)
+  {
+    if (n[ip + k] == n[jp + k])
+    {
+      if (k == p)
+      {
+	jp += p;
+	k = 1;
+      }
+      else
+	k++;
+    }
+    else if (n[ip + k] > n[jp + k])
+    {
+      jp += k;
+      k = 1;
+      p = jp - ip;
+    }
+    else
+    {
+      ip = jp++;
+      k = p = 1;
+    }
+  }
+  ms = ip;
+  p0 = p;
+
+  /* And with the opposite comparison */
+  ip = -1; jp = 0; k = p = 1;
+  while (jp + k < nlen)
+  {
+    if (n[ip + k] == n[jp + k])
+    {
+      if (k == p)
+      {
+	jp += p;
+	k = 1;
+      }
+      else
+	k++;
+    }
+    else if (n[ip + k] < n[jp + k])
+    {
+      jp += k;
+      k = 1;
+      p = jp - ip;
+    }
+    else
+    {
+      ip = jp++;
+      k = p = 1;
+    }
+  }
+  if (ip + 1 > ms + 1)
+    ms = ip;
+  else
+    p = p0;
+
+  /* Periodic needle? */
+  if (memcmp(n, n + p, ms + 1))
+  {
+    mem0 = 0;
+    p = ((ms > nlen - ms - 1) ? ms : nlen - ms - 1) + 1;
+  }
+  else
+    mem0 = nlen - p;
+  mem = 0;
+
+  for (;;)
+  {
+    if ((size_t)(z - h) < nlen)
+      return NULL;
+
+    /* Check last byte first; advance by shift on mismatch */
+    if (BITOP(byteset, h[nlen - 1], &))
+    {
+      k = nlen - shift[h[nlen - 1]];
+      if (k)
+      {
+	if (k < mem)
+	  k = mem;
+	h += k;
+	mem = 0;
+	continue;
+      }
+    }
+    else
+    {
+      h += nlen;
+      mem = 0;
+      continue;
+    }
+
+    /* Compare right half */
+    for (k = (ms + 1 > mem ? ms + 1 : mem); k < nlen && n[k] == h[k]; k++);
+    if (k < nlen)
+    {
+      h += k - ms;
+      mem = 0;
+      continue;
+    }
+
+    /* Compare left half */
+    for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--);
+    if (k <= mem)
+      return h;
+    h += p;
+    mem = mem0;
+  }
+}
+#undef BITOP
+#endif
+
+/** Find the first occurrence of a byte sequence in a buffer.
+ *
+ *  @param	haystack	Buffer to search
+ *  @param	hlen		Length of haystack
+ *  @param	needle		Byte sequence to search for
+ *  @param	nlen		Length of needle
+ *  @returns	Pointer to the first match in haystack, or NULL. An empty needle matches at haystack.
+ */
+void *byteThing_memmem(const void *haystack, size_t hlen, const void *needle, size_t nlen)
+{
+  if (nlen == 0)
+    return (void *)haystack;
+
+  if (nlen > hlen)
+    return NULL;
+
+  if (nlen == 1)
+    return memchr(haystack, *(const unsigned char *)needle, hlen);
+
+#if defined(HAVE_MEMMEM)
+  return memmem(haystack, hlen, needle, nlen);
+#else
+  return (void *)twoWay_memmem(haystack, hlen, needle, nlen);
+#endif
+}
+
+/** Find the last occurrence of a byte sequence in a buffer. Uses a reversed
+ *  Boyer-Moore-Horspool search, which skips up to nlen bytes per probe.
+ *
+ *  @param	haystack	Buffer to search
+ *  @param	hlen		Length of haystack
+ *  @param	needle		Byte sequence to search for
+ *  @param	nlen		Length of needle
+ *  @returns	Pointer to the last match in haystack, or NULL. An empty needle matches at haystack + hlen.
+ */
+void *byteThing_memrmem(const void *haystack, size_t hlen, const void *needle, size_t nlen)
+{
+  const unsigned char	*h = haystack;
+  const unsigned char	*n = needle;
+  const unsigned char	*p;
+  size_t		skip[256];
+  size_t		i;
+
+  if (nlen == 0)
+    return (void *)(h + hlen);
+
+  if (nlen > hlen)
+    return NULL;
+
+  if (nlen == 1)
+    return memrchr(haystack, n[0], hlen);
+
+  /* Shift table keyed on the byte aligned with the *first* needle byte */
+  for (i = 0; i < 256; i++)
+    skip[i] = nlen;
+  for (i = nlen - 1; i > 0; i--)
+    skip[n[i]] = i;
+
+  for (p = h + hlen - nlen; ; p -= skip[*p])
+  {
+    if (*p == n[0] && memcmp(p + 1, n + 1, nlen - 1) == 0)
+      return (void *)p;
+
+    if ((size_t)(p - h) < skip[*p])
+      return NULL;
+  }
+}
+
 /** Returns a Javascript Array object containing 'len' Numbers taken from 'bytes' */
 JSObject *byteThing_toArray(JSContext *cx, const unsigned char *bytes, size_t len)
 {
@@ -1606,12 +2267,23 @@ JSBool byteThing_Cast(JSContext *cx, uintN argc, jsval *argv, jsval *rval,
   {
     /* casting from immutable to immutable: can avoid copy */
     byteThing_handle_t	*newHnd = JS_malloc(cx, sizeof(*newHnd));
+    JSObject		*src = obj;
     
     if (!newHnd)
       return JS_FALSE;
 
-    *newHnd = *hnd;
     obj = JS_NewObject(cx, clasp, proto, NULL);
+    if (!obj)
+    {
+      JS_free(cx, newHnd);
+      return JS_FALSE;
+    }
+
+    *newHnd = *hnd;
+    if (!newHnd->memoryOwner)
+      newHnd->memoryOwner = src;	/* Keep the source, and whatever keeps its bytes alive, reachable */
+    if ((length >= 0) && ((size_t)length < hnd->length))
+      newHnd->length = length;
     JS_SetPrivate(cx, obj, newHnd);
   }
   else
@@ -44,6 +44,13 @@
 #ifndef _BYTETHINGS_H
 #define _BYTETHINGS_H
 
+/** BE and LE flavours of UTF-16 do not emit the BOM. JS Strings are BOM-less and in machine order. */
+#if defined(_BIG_ENDIAN) || (defined(BYTE_ORDER) && defined(BIG_ENDIAN) && BYTE_ORDER == BIG_ENDIAN)
+# define DEFAULT_UTF_16_FLAVOUR "utf-16BE"
+#else
+# define DEFAULT_UTF_16_FLAVOUR "utf-16LE"
+#endif
+
 typedef struct
 {
   size_t                length;         /**< Number of characters in buffer */
@@ -63,10 +70,13 @@ typedef struct
 } byteArray_handle_t;
 
 byteThing_handle_t *byteThing_newHandle(JSContext *cx);
+JSBool              byteArray_requestSize(JSContext *cx, JSObject *obj, byteArray_handle_t *hnd, size_t newSize);
 JSObject           *byteThing_fromCArray(JSContext *cx,
                                          const unsigned char *buffer, size_t length,
                                          JSObject *obj, JSClass *clasp,
                                         JSObject *proto, size_t btallocSize, int stealBuffer);
+JSObject           *byteThing_newSharedSlice(JSContext *cx, JSObject *owner, const unsigned char *buffer, size_t length,
+                                             JSClass *clasp, JSObject *proto, size_t btallocSize);
 JSBool copyJSArray_toBuf(JSContext *cx, JSObject *arr, size_t start, unsigned char **bufp, size_t *lenp, JSBool *more, const char *throwPrefix);
 JSBool          transcodeString_toBuf   (JSContext *cx, JSString *string, const char *codec, unsigned char **bufp, size_t *lenp,
                                          const char *throwPrefix);
@@ -94,7 +104,10 @@ JSBool byteThing_toString(JSContext *cx, uintN argc, jsval *vp);
 JSObject *byteThing_toArray(JSContext *cx, const unsigned char *bytes, size_t len);
 byteThing_handle_t * byteThing_getHandle(JSContext *cx, JSObject *obj, JSClass **claspp, const char const * methodName);
 JSBool byteThing_toSource(JSContext *cx, uintN argc, jsval *vp, JSClass *class);
-JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(const void *, int, size_t), const char const *methodName, JSClass *clasp);
+JSBool byteThing_findChar(JSContext *cx, uintN argc, jsval *vp, void *memchr_fn(const void *, int, size_t),
+                          void *memmem_fn(const void *, size_t, const void *, size_t), const char const *methodName, JSClass *clasp);
+void *byteThing_memmem(const void *haystack, size_t hlen, const void *needle, size_t nlen);
+void *byteThing_memrmem(const void *haystack, size_t hlen, const void *needle, size_t nlen);
 JSBool byteThing_getProperty(JSContext *cx, JSObject *obj, jsval id, jsval *vp, JSClass *clasp);
 JSBool byteThing_Cast(JSContext *cx, uintN argc, jsval *argv, jsval *rval,
 		      JSClass *clasp, JSObject *proto, size_t hndSize, const const char *throwPrefix);
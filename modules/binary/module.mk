@@ -32,6 +32,6 @@
 #
 # ***** END LICENSE BLOCK ***** 
 #
-EXTRA_MODULE_OBJS	= bytethings.o ByteString.o ByteArray.o BinaryStub.o base64.o
+EXTRA_MODULE_OBJS	= bytethings.o ByteString.o ByteArray.o BinaryStub.o base64.o LineReader.o Transcoder.o Base64Stream.o DataView.o Struct.o
 
 include $(GPSEE_SRC_DIR)/iconv.mk
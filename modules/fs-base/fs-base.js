@@ -42,6 +42,7 @@ const binary = require("binary");
 const ffi = require("gffi");
 const dl = ffi;		/**< Dynamic lib handle for pulling symbols */
 const dh = ffi.gpsee	/**< Header collection for #define'd constants */
+const gpsee = require("gpsee");
 
 const __umask		= new dl.CFunction(ffi.mode_t,  "umask",		ffi.mode_t);
 function _umask(old)
@@ -82,6 +83,7 @@ const _opendir 		= new dl.CFunction(ffi.pointer, "opendir", 		ffi.pointer);
 const _fwrite		= new dl.CFunction(ffi.size_t,	"fwrite",		ffi.pointer, ffi.size_t, ffi.size_t, ffi.pointer);
 const _fread		= new dl.CFunction(ffi.size_t,	"fread",		ffi.pointer, ffi.size_t, ffi.size_t, ffi.pointer);
 const _ftello		= new dl.CFunction(ffi.off_t,	"ftello", 		ffi.pointer);
+const _lseek		= new dl.CFunction(ffi.off_t,	"lseek", 		ffi.int, ffi.off_t, ffi.int);
 
 /**
  *  Return a string documenting the most recent OS-level error, if there was one.
@@ -223,6 +225,62 @@ exports.openRaw = function(path, mode, permissions)
   return exports.openDescriptor(fd, mode);
 };
 
+/**
+ *  Map a file, or part of a file, into memory.
+ *
+ *  @param	path	Path to the file to map
+ *  @param	mode	Mode to map the file in; either an fs-base mode object or a string containing 
+ *			"r" and/or "w". Additionally, mode objects may have the following properties:
+ *			- private:	writes are not carried through to the file (MAP_PRIVATE)
+ *			- advice:	access pattern hint for the kernel: "normal", "sequential", "random",
+ *					"willneed" or "dontneed"
+ *  @param	offset	Offset into the file at which to start mapping. Default 0.
+ *  @param	length	Number of bytes to map. Default is to the end of the file.
+ *  @returns	A ByteThing backed by the mapping, usable anywhere ByteThings are accepted, e.g. the
+ *		ByteString constructor. Every mapping has an advise() method, and writable shared
+ *		mappings also have a sync() method; the mapping is released when the ByteThing is
+ *		garbage collected.
+ */
+exports.mmap = function mmap(path, mode, offset, length)
+{
+  var m;
+  var fd;
+  var map;
+
+  if (typeof mode === "string" || !mode)
+    mode = { read: true, write: mode ? mode.indexOf("w") != -1 : false };
+
+  if (mode.append || mode.truncate || mode.exclusive)
+    throw new Error("Cannot map '" + path + "' - append, truncate and exclusive are not supported");
+
+  m = (mode.write && !mode.private) ? dh.O_RDWR : dh.O_RDONLY;
+  if (mode.create)
+    m |= dh.O_CREAT;
+
+  fd = _open(path, m, new Permissions().toUnix());
+  if (fd == -1)
+    throw new Error("Unable to open file '" + path + "'" + syserr());
+
+  try
+  {
+    map = gpsee.mmap(fd, offset || 0, length || 0, !!mode.write, !mode.private);
+  }
+  finally
+  {
+    _close(fd);
+  }
+
+  if (mode.advice)
+    gpsee.madvise(map, mode.advice);
+
+  if (mode.write && !mode.private)
+    map.sync = function sync(async) { gpsee.msync(this, async); };
+
+  map.advise = function advise(advice) { gpsee.madvise(this, advice); };
+
+  return map;
+}
+
 /** Move a file at one path to another. If necessary, copies then removes the original. 
  *  All moves (renames) are performed atomically. Directory Moves across filesystems are 
  *  not supported, but files are copy/unlinked.
@@ -837,6 +895,60 @@ Stream.prototype.readlines = function Stream_readlines(encoding)
   }
 }
 
+/** Generator method which yields lines from a Stream as ByteStrings. The underlying file
+ *  descriptor is read in large blocks by a binary.LineReader, and each line shares memory 
+ *  with the block it was read from, so this is much faster than readlines() on large files.
+ *
+ *  @param	options		Options for binary.LineReader (delimiter, keepDelimiter, bufferSize).
+ *				Unlike readlines(), delimiters are stripped unless keepDelimiter is set.
+ *  @param	encoding	Character encoding of file; when specified, yields Strings instead
+ *  @note	Reads the file descriptor directly, bypassing stdio. Do not mix with other 
+ *		reads on the same Stream.
+ */
+Stream.prototype.lines = function Stream_lines(options, encoding)
+{
+  var pos = _ftello(this.stream);
+  var reader;
+  var line;
+
+  if (pos != -1)	/* Start where stdio thinks we are, not where its read-ahead left the fd */
+    _lseek(this.fd, pos, dh.SEEK_SET);
+
+  reader = new binary.LineReader(this.fd, options);
+  while ((line = reader.readLine()) !== null)
+    yield encoding ? line.decodeToString(encoding) : line;
+}
+
+/** Generator method which yields the contents of a Stream as Strings, decoded incrementally
+ *  by a binary.Transcoder, so that memory use is bounded by chunkSize regardless of the size 
+ *  of the file. Multibyte sequences which are split across chunks are decoded correctly.
+ *
+ *  @param	encoding	Character encoding of file
+ *  @param	chunkSize	Number of bytes to read at a time; default 64KB
+ */
+Stream.prototype.decode = function Stream_decode(encoding, chunkSize)
+{
+  var transcoder = new binary.Transcoder(encoding);	/* decodes straight to String characters */
+  var buf = new ffi.Memory(chunkSize || 65536);
+  var out = new binary.ByteArray();
+  var bytesRead;
+
+  while ((bytesRead = +_fread(buf, 1, buf.size, this.stream)) > 0)
+  {
+    buf.length = bytesRead;
+    transcoder.push(buf, out);
+    if (out.length)
+    {
+      yield out.decodeToString();
+      out.length = 0;
+    }
+  }
+
+  transcoder.flush(out);
+  if (out.length)
+    yield out.decodeToString();
+}
+
 Stream.prototype.readln = function Stream_readln()
 {
   var buf = new ffi.Memory(1024);
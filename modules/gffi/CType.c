@@ -161,6 +161,9 @@ JSBool CType_Cast(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *
     return gpsee_throw(cx, CLASS_ID ".cast.type: %s objects are not castable to CType", className);
   }
 
+  if (gpsee_unshareByteThing(cx, obj) == JS_FALSE)
+    return JS_FALSE;
+
   obj = JS_NewObject(cx, ctype_clasp, ctype_proto, NULL);
   if (!obj)
     return JS_FALSE;
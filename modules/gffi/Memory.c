@@ -231,12 +231,130 @@ static JSBool memory_asDataString(JSContext *cx, uintN argc, jsval *vp)
 
   str = JS_NewUCString(cx, buf, length);
   if (!str)
+  {
+    JS_free(cx, buf);
     return JS_FALSE;
+  }
 
   *vp = STRING_TO_JSVAL(str);
   return JS_TRUE;
 }
 
+/**
+ *  Implements Memory.prototype.asByteThing -- a method to move the contents of a
+ *  Memory object into a new GPSEE ByteThing, flagged bt_immutable, without copying them.
+ *
+ *  When this object owns its memory, ownership of the buffer is handed to the new
+ *  ByteThing and this object is left pointing at NULL; otherwise the bytes are copied.
+ *  The ByteThing becomes this object's memoryOwner, so that casts made from this object
+ *  before the hand-off, which name it as their memoryOwner, keep the buffer alive too.
+ *  asByteThing can take one argument: a length, as for asString().
+ *
+ *  bt_immutable is not enforced here: nothing stops those casts, or C code holding the
+ *  pointer, from writing to the buffer. The flag records the caller's promise that they
+ *  will not, which is what lets binary.ByteString() share the buffer instead of copying it.
+ */
+/* @jazzdoc gffi.Memory.asByteThing()
+ * Turns a C buffer into a GPSEE ByteThing which is marked immutable, suitable for casting to 
+ * binary.ByteString (which does not copy immutable ByteThings) or for passing to any function 
+ * which accepts ByteThings.
+ *
+ * If the Memory instance owns its memory, that memory is handed to the ByteThing rather than
+ * copied, and the Memory instance becomes a NULL pointer of size zero. Memory which is not owned 
+ * by the instance is copied, since its lifetime and mutability are unknown.
+ *
+ * The immutable mark is a promise made by the caller, not something GPSEE enforces. Casts of the 
+ * Memory instance (e.g. MutableStructs) made before the hand-off still point at the buffer and keep
+ * it alive, and C functions which were given the pointer still hold it; any of them can still write
+ * to the bytes. Such writes show up in every ByteString made from the ByteThing, so they must not 
+ * be made. Copy the bytes instead, e.g. with duplicate(), if the buffer may still change.
+ *
+ * @form (instance of Memory).asByteThing()
+ * Consume the whole buffer, inferring its size as for asString().
+ *
+ * @form (instance of Memory).asByteThing(length >= 0)
+ * Consume the first length bytes of the buffer. The rest of the buffer is not released
+ * until the ByteThing is finalized.
+ */
+static JSBool memory_asByteThing(JSContext *cx, uintN argc, jsval *vp)
+{
+  memory_handle_t	*hnd;
+  byteThing_handle_t	*newHnd;
+  JSObject		*obj = JS_THIS_OBJECT(cx, vp);
+  JSObject		*robj;
+  size_t		length;
+  jsval			*argv = JS_ARGV(cx, vp);
+
+  if (!obj)
+    return JS_FALSE;
+
+  hnd = JS_GetInstancePrivate(cx, obj, memory_clasp, NULL);
+  if (!hnd)
+    return JS_FALSE;
+
+  if (!hnd->buffer)
+  {
+    *vp = JSVAL_NULL;
+    return JS_TRUE;
+  }
+
+  switch(argc)
+  {
+    case 0:
+      if (hnd->length || (hnd->memoryOwner == obj))
+	length = hnd->length;
+      else
+	length = strlen((char *)hnd->buffer);
+      break;
+    case 1:
+      if (memory_parseLengthArgument(cx, argv[0], hnd->buffer, &length, CLASS_ID ".asByteThing.argument.1") != JS_TRUE)
+	return JS_FALSE;
+      break;
+    default:
+      return gpsee_throw(cx, CLASS_ID ".asByteThing.arguments.count");
+  }
+
+  if (hnd->memoryOwner != obj)
+  {
+    if (!length)
+      robj = gpsee_newByteThing(cx, NULL, 0, JS_FALSE);
+    else
+    {
+      robj = gpsee_newByteThing(cx, hnd->buffer, length, JS_TRUE);
+      if (robj)
+	((byteThing_handle_t *)JS_GetPrivate(cx, robj))->btFlags |= bt_immutable;
+    }
+
+    if (!robj)
+      return JS_FALSE;
+
+    *vp = OBJECT_TO_JSVAL(robj);
+    return JS_TRUE;
+  }
+
+  if (hnd->length && length > hnd->length)
+    return gpsee_throw(cx, CLASS_ID ".asByteThing.length.range: cannot hand off " GPSEE_SIZET_FMT " bytes of a " 
+		       GPSEE_SIZET_FMT "-byte buffer", length, hnd->length);
+
+  robj = gpsee_newByteThing(cx, NULL, 0, JS_FALSE);	/* Create before handing off, so OOM leaves us intact */
+  if (!robj)
+    return JS_FALSE;
+  *vp = OBJECT_TO_JSVAL(robj);
+
+  /* The buffer is not shrunk: casts made before the hand-off still point into it */
+  newHnd = JS_GetPrivate(cx, robj);
+  newHnd->buffer      = (unsigned char *)hnd->buffer;
+  newHnd->length      = length;
+  newHnd->memoryOwner = robj;
+
+  /* Casts of this object trace it, and it traces the new owner */
+  hnd->buffer      = NULL;
+  hnd->length      = 0;
+  hnd->memoryOwner = robj;
+
+  return JS_TRUE;
+}
+
 /**
  *  Implements Memory.prototype.copyDataString -- a method to take a String and
  *  and copy it into a Memory object's backing store a simple uint16->uchar cast.
@@ -609,6 +727,9 @@ JSBool Memory_Cast(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval
     if (!other_hnd)
       return gpsee_throw(cx, MODULE_ID ".cast.arguments.0.invalid: invalid bytething (missing private handle)");
 
+    if (gpsee_unshareByteThing(cx, JSVAL_TO_OBJECT(argv[0])) == JS_FALSE)
+      return JS_FALSE;
+
     hnd->buffer         = (void *)other_hnd->buffer;
     hnd->length         = other_hnd->length;
     hnd->memoryOwner    = JSVAL_TO_OBJECT(argv[0]);
@@ -812,6 +933,7 @@ JSObject *Memory_InitClass(JSContext *cx, JSObject *obj, JSObject *parentProto)
     JS_FN("toString",		memory_toString, 	0, JSPROP_ENUMERATE),
     JS_FN("asString",		memory_asString, 	0, JSPROP_ENUMERATE),
     JS_FN("asDataString",	memory_asDataString, 	0, JSPROP_ENUMERATE),
+    JS_FN("asByteThing",	memory_asByteThing, 	0, JSPROP_ENUMERATE),
     JS_FN("copyDataString",	memory_copyDataString, 	0, JSPROP_ENUMERATE),
     JS_FN("realloc",		memory_realloc, 	0, JSPROP_ENUMERATE),
     JS_FN("duplicate",		memory_duplicate,	0, JSPROP_ENUMERATE),
@@ -234,6 +234,9 @@ JSBool MutableStruct_Cast(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
   if (gpsee_getModuleData(cx, mutableStruct_clasp, (void **)&mutableStruct_proto, CLASS_ID ".cast") == JS_FALSE)
     return JS_FALSE;
 
+  if (gpsee_unshareByteThing(cx, obj) == JS_FALSE)
+    return JS_FALSE;
+
   obj = JS_NewObject(cx, mutableStruct_clasp, mutableStruct_proto, srcHnd->memoryOwner);
   if (!obj)
     return JS_FALSE;
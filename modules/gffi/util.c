@@ -375,6 +375,9 @@ static JSBool valueTo_pointer(JSContext *cx, jsval v, void **avaluep, void **sto
     {
       memory_handle_t *hnd = JS_GetPrivate(cx, obj);
       if (hnd) {
+        /* C code may write through this pointer */
+        if (gpsee_unshareByteThing(cx, obj) == JS_FALSE)
+          return JS_FALSE;
         *avaluep = &hnd->buffer;
         return JS_TRUE;
       }
@@ -54,6 +54,7 @@ static __attribute__((unused)) const char rcsid[]="$Id: gpsee.c,v 1.13 2011/12/0
 #endif
 
 #include <math.h>
+#include <sys/mman.h>
 
 #define MODULE_ID GPSEE_GLOBAL_NAMESPACE_NAME	".module.ca.page.gpsee"
 
@@ -420,6 +421,212 @@ static JSBool gpseemod_sizeofByteThing(JSContext *cx, uintN argc, jsval *vp)
   return JS_TRUE;
 }
 
+/** Map part of an open file into memory, returning a ByteThing.
+ *  Arguments: fd, offset, length, writable, shared. length 0 maps to end of file.
+ */
+static JSBool gpseemod_mmap(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval         *argv = JS_ARGV(cx, vp);
+  int32         fd;
+  jsdouble      offset = 0, length = 0;
+  JSObject      *obj;
+
+  if (argc < 1 || argc > 5)
+    return gpsee_throw(cx, MODULE_ID ".mmap.arguments.count");
+
+  if (!JS_ValueToInt32(cx, argv[0], &fd))
+    return JS_FALSE;
+
+  if (argc > 1 && !JS_ValueToNumber(cx, argv[1], &offset))
+    return JS_FALSE;
+
+  if (argc > 2 && !JS_ValueToNumber(cx, argv[2], &length))
+    return JS_FALSE;
+
+  if (isnan(offset) || offset < 0 || offset != floor(offset))
+    return gpsee_throw(cx, MODULE_ID ".mmap.arguments.1.range: offset must be a non-negative integer");
+
+  if (isnan(length) || length < 0 || length != floor(length) || length > (jsdouble)((size_t)-1))
+    return gpsee_throw(cx, MODULE_ID ".mmap.arguments.2.range: length must be a non-negative integer");
+
+  obj = gpsee_newMappedByteThing(cx, fd, (off_t)offset, (size_t)length, 
+                                 argc > 3 ? !gpsee_isFalsy(cx, argv[3]) : JS_FALSE,
+                                 argc > 4 ? !gpsee_isFalsy(cx, argv[4]) : JS_TRUE);
+  if (!obj)
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(obj));
+  return JS_TRUE;
+}
+
+/** Flush a writable memory-mapped ByteThing to disk. Arguments: byteThing, async */
+static JSBool gpseemod_msync(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval         *argv = JS_ARGV(cx, vp);
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, MODULE_ID ".msync.arguments.count");
+
+  if (JSVAL_IS_PRIMITIVE(argv[0]))
+    return gpsee_throw(cx, MODULE_ID ".msync.arguments.0.type: must be a memory-mapped ByteThing");
+
+  if (!gpsee_syncMappedByteThing(cx, JSVAL_TO_OBJECT(argv[0]), argc > 1 ? !gpsee_isFalsy(cx, argv[1]) : JS_FALSE))
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Tell the kernel how a memory-mapped ByteThing will be accessed. Arguments: byteThing, advice 
+ *  where advice is one of "normal", "sequential", "random", "willneed", "dontneed".
+ */
+static JSBool gpseemod_madvise(JSContext *cx, uintN argc, jsval *vp)
+{
+  static const struct { const char *name; int advice; } adviceList[] = 
+  {
+    { "normal",		MADV_NORMAL },
+    { "sequential",	MADV_SEQUENTIAL },
+    { "random",		MADV_RANDOM },
+    { "willneed",	MADV_WILLNEED },
+    { "dontneed",	MADV_DONTNEED },
+  };
+
+  jsval         *argv = JS_ARGV(cx, vp);
+  JSString      *str;
+  const char    *name;
+  size_t        i;
+
+  if (argc != 2)
+    return gpsee_throw(cx, MODULE_ID ".madvise.arguments.count");
+
+  if (JSVAL_IS_PRIMITIVE(argv[0]))
+    return gpsee_throw(cx, MODULE_ID ".madvise.arguments.0.type: must be a memory-mapped ByteThing");
+
+  str = JS_ValueToString(cx, argv[1]);
+  if (!str)
+    return JS_FALSE;
+  argv[1] = STRING_TO_JSVAL(str);
+  name = JS_GetStringBytes(str);
+
+  for (i = 0; i < sizeof(adviceList) / sizeof(adviceList[0]); i++)
+  {
+    if (strcmp(adviceList[i].name, name) == 0)
+      break;
+  }
+
+  if (i == sizeof(adviceList) / sizeof(adviceList[0]))
+    return gpsee_throw(cx, MODULE_ID ".madvise.arguments.1.invalid: unknown advice '%s'", name);
+
+  if (!gpsee_adviseMappedByteThing(cx, JSVAL_TO_OBJECT(argv[0]), adviceList[i].advice))
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Route output written to stdin, stdout or stderr by GPSEE internals (print(), stack dumps, etc)
+ *  through JavaScript functions. Arguments: fd, inputFunction, outputFunction; either function 
+ *  may be null or undefined.
+ */
+static JSBool gpseemod_hookFileDescriptor(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval         *argv = JS_ARGV(cx, vp);
+  int32         fd;
+  jsval         hooks[2];
+  size_t        i;
+
+  if (argc != 3)
+    return gpsee_throw(cx, MODULE_ID ".hookFileDescriptor.arguments.count");
+
+  if (!JS_ValueToInt32(cx, argv[0], &fd))
+    return JS_FALSE;
+
+  for (i = 0; i < 2; i++)
+  {
+    if (JSVAL_IS_NULL(argv[i + 1]) || JSVAL_IS_VOID(argv[i + 1]))
+      hooks[i] = JSVAL_VOID;
+    else if (JSVAL_IS_PRIMITIVE(argv[i + 1]) || !JS_ObjectIsFunction(cx, JSVAL_TO_OBJECT(argv[i + 1])))
+      return gpsee_throw(cx, MODULE_ID ".hookFileDescriptor.arguments.%i.type: must be a function", (int)i + 1);
+    else
+      hooks[i] = argv[i + 1];
+  }
+
+  if (!gpsee_hookFileDescriptor(cx, fd, hooks[0], hooks[1]))
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Select when output to a hooked file descriptor is delivered to its output function. Arguments:
+ *  fd, mode, [size] where mode is one of "none", "line" or "full", and size is the buffer size in bytes.
+ */
+static JSBool gpseemod_setHookBuffering(JSContext *cx, uintN argc, jsval *vp)
+{
+  static const struct { const char *name; int mode; } modeList[] = 
+  {
+    { "none",		_IONBF },
+    { "line",		_IOLBF },
+    { "full",		_IOFBF },
+  };
+
+  jsval         *argv = JS_ARGV(cx, vp);
+  int32         fd;
+  int32         size = 0;
+  JSString      *str;
+  const char    *name;
+  size_t        i;
+
+  if (argc < 2 || argc > 3)
+    return gpsee_throw(cx, MODULE_ID ".setHookBuffering.arguments.count");
+
+  if (!JS_ValueToInt32(cx, argv[0], &fd))
+    return JS_FALSE;
+
+  str = JS_ValueToString(cx, argv[1]);
+  if (!str)
+    return JS_FALSE;
+  argv[1] = STRING_TO_JSVAL(str);
+  name = JS_GetStringBytes(str);
+
+  for (i = 0; i < sizeof(modeList) / sizeof(modeList[0]); i++)
+  {
+    if (strcmp(modeList[i].name, name) == 0)
+      break;
+  }
+
+  if (i == sizeof(modeList) / sizeof(modeList[0]))
+    return gpsee_throw(cx, MODULE_ID ".setHookBuffering.arguments.1.invalid: unknown mode '%s'", name);
+
+  if (argc > 2 && !JSVAL_IS_VOID(argv[2]))
+  {
+    if (!JS_ValueToInt32(cx, argv[2], &size))
+      return JS_FALSE;
+    if (size < 0)
+      return gpsee_throw(cx, MODULE_ID ".setHookBuffering.arguments.2.range: size must not be negative");
+  }
+
+  if (!gpsee_setIOHookBuffering(cx, fd, modeList[i].mode, size))
+    return JS_FALSE;
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Deliver buffered output for a hooked file descriptor now. Arguments: [fd]; all descriptors if omitted. */
+static JSBool gpseemod_flushHook(JSContext *cx, uintN argc, jsval *vp)
+{
+  int32         fd = -1;
+
+  if (argc > 0 && !JS_ValueToInt32(cx, JS_ARGV(cx, vp)[0], &fd))
+    return JS_FALSE;
+
+  gpsee_flushIOHook(cx, fd);
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
 /* Convenience method for use with the debugger */
 static JSBool gpseemod_breakpoint(JSContext *cx, uintN argc, jsval *vp)
 {
@@ -433,6 +640,12 @@ const char *gpsee_InitModule(JSContext *cx, JSObject *moduleObject)
     JS_FN("isByteThing",        gpseemod_isByteThing,           1, 0),
     JS_FN("sizeofByteThing",    gpseemod_sizeofByteThing,       1, 0),
     JS_FN("breakpoint",         gpseemod_breakpoint,            1, 0),
+    JS_FN("mmap",               gpseemod_mmap,                  5, 0),
+    JS_FN("msync",              gpseemod_msync,                 2, 0),
+    JS_FN("madvise",            gpseemod_madvise,               2, 0),
+    JS_FN("hookFileDescriptor", gpseemod_hookFileDescriptor,    3, 0),
+    JS_FN("setHookBuffering",   gpseemod_setHookBuffering,      3, 0),
+    JS_FN("flushHook",          gpseemod_flushHook,             1, 0),
     { "include",		gpsee_include,			0, 0, 0 },	/* char: filename */
     { "system",			gpsee_system,			0, 0, 0 },	/* char: cmd str returns int exit code */
     { "exit",			gpsee_exit,			0, 0, 0 },	/* int: exit code */
@@ -84,6 +84,7 @@ const FD_SETSIZE = ffi.std.FD_SETSIZE;
 exports.config = 
 {
   readBufferSize:		65536,
+  byteStringReads:		false,	/**< Emit "data" as ByteStrings, which avoids copying, instead of Strings */
   defaultBacklog:		32,
   pollAllSocketsTimeout:	100
 };
@@ -692,7 +693,14 @@ function socketReadThenEmit(socket)
       socket.emit("error");
       break;
     default: 
-      socket.emit("data", socket.readBuffer.asDataString(bytesRead));
+      if (exports.config.byteStringReads)
+      {
+	/* Hand the read buffer to the ByteString rather than copying it; next read allocates another */
+	socket.emit("data", binary.ByteString(socket.readBuffer.asByteThing(bytesRead)));
+	delete socket.readBuffer;
+      }
+      else
+	socket.emit("data", socket.readBuffer.asDataString(bytesRead));
       break;
   }
 }
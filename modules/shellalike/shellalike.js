@@ -46,7 +46,7 @@
 
 /* Module requirements */
 const ffi = require('gffi');
-const {ByteString,ByteArray} = require('binary');
+const {ByteString,ByteArray,LineReader} = require('binary');
 const system = require('system');
 
 /* GFFI decls */
@@ -61,14 +61,9 @@ const _read = new ffi.CFunction(ffi.ssize_t, 'read', ffi.int, ffi.pointer, ffi.s
 const _write = new ffi.CFunction(ffi.ssize_t, 'write', ffi.int, ffi.pointer, ffi.size_t);
 const _fsync = new ffi.CFunction(ffi.int, 'fsync', ffi.int);
 const _memset = new ffi.CFunction(ffi.pointer, 'memset', ffi.pointer, ffi.int, ffi.size_t);
-const _fdopen = new ffi.CFunction(ffi.pointer, 'fdopen', ffi.int, ffi.pointer);
-const _fgets = new ffi.CFunction(ffi.pointer, 'fgets', ffi.pointer, ffi.int, ffi.pointer);
 const _fwrite = new ffi.CFunction(ffi.size_t, 'fwrite', ffi.pointer, ffi.size_t, ffi.size_t, ffi.pointer);
 const _fflush = new ffi.CFunction(ffi.int, 'fflush', ffi.pointer);
 const _fclose = new ffi.CFunction(ffi.int, 'fclose', ffi.pointer);
-const _feof = new ffi.CFunction(ffi.int, 'feof', ffi.pointer);
-const _ferror = new ffi.CFunction(ffi.int, 'ferror', ffi.pointer);
-const _strlen = new ffi.CFunction(ffi.size_t, 'strlen', ffi.pointer);
 
 /* TODO add this sort of thing to GFFI proper */
 const sizeofInt = 4;
@@ -110,26 +105,16 @@ function $CS(s){var f=s.pop();return s.length?f(arguments.callee(s)):f()}
 
 /* @jazzdoc shellalike.flines
  * @form for (line in flines(source)) {...}
- * Allows line-by-line iteration over a readable stdio FILE* source.
+ * Allows line-by-line iteration over a readable file descriptor.
  */
 const flines = (function(){
-  var buflen = 4096, buf = new ffi.Memory(buflen);
+  var options = { keepDelimiter: true };
   function flines(fdsrc) {
-    /* fdopen(3) just for fgets(3) */
-    var src = _fdopen.call(fdsrc, "r");
+    /* LineReader reads fdsrc in large blocks; throws on read(2) errors */
+    var reader = new LineReader(fdsrc, options);
     var line;
-    //print('flines buf', buf);
-    //print('flines src', src);
-    while ((line = _fgets.call(buf, buflen, src))) {
-      yield ByteString(line, _strlen.call(line)).decodeToString('ascii');
-    }
-    /* Check ferror(3) */
-    var err = _ferror.call(src);
-    if (err|0)
-      print('throw new Error("fgets() threw error "+err);');
-    /* Check feof(3) */
-    if (_feof.call(src)|0)
-      return;
+    while ((line = reader.readLine()) !== null)
+      yield line.decodeToString('ascii');
   }
   return flines;
 })();
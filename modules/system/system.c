@@ -174,7 +174,7 @@ const char *system_InitModule(JSContext *cx, JSObject *module)
   if (!system_InitEnv(cx, module))
     return NULL;
 
-  gpsee_enterAutoMonitor(cx, &realm->monitors.script_argv);
+  gpsee_enterAutoMonitorShared(cx, &realm->monitors.script_argv);
   if (!gpsee_createJSArray_fromVector(cx, module, "args", realm->monitored.script_argv))
   {
     gpsee_leaveAutoMonitor(realm->monitors.script_argv);
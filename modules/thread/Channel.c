@@ -0,0 +1,856 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	Channel.c	Message-passing channels between threads, carrying copies of values.
+ *
+ *  Objects are not safe to share between threads (see thread.jsdoc), so a Channel
+ *  never hands the receiver an object the sender can still touch. send() serializes
+ *  its argument into a flat message, and receive() builds fresh values from it on the
+ *  receiving context. The following can be sent:
+ *
+ *  - undefined, null, booleans, numbers and strings
+ *  - arrays and plain objects (own enumerable properties) made of sendable values
+ *  - immutable ByteThings, such as binary.ByteString
+ *
+ *  ByteThing contents are not copied. The message carries a reference to the sent
+ *  ByteThing's reference-counted byte store (gpsee_getByteStore()), and the receiver
+ *  wraps the same bytes in a new object. Neither side roots anything of the other's.
+ *  ByteThings whose bytes cannot be shared this way, such as read-only memory maps,
+ *  are copied into a new store. Received ByteStrings are ByteStrings; other immutable
+ *  ByteThings arrive as generic ByteThings.
+ *
+ *  Messages are kept in an intrusive multi-producer, single-consumer queue (Dmitry
+ *  Vyukov's design): each sender swaps itself in as the head with a CAS, then links its
+ *  predecessor to it. Receivers take receiveLock, which makes them a single consumer,
+ *  and sleep on messageReady when the queue is empty. Senders serialize their value
+ *  without the lock, then hold it only to check closed and link the message, so that
+ *  nothing can be sent once close() has returned.
+ */
+
+#include "thread.h"
+
+#define CLASS_ID MODULE_ID ".Channel"
+#define CHANNEL_MAX_DEPTH	256	/**< Nesting limit for sent values; also how we notice cycles */
+#define BYTESTRING_CLASS_NAME	GPSEE_GLOBAL_NAMESPACE_NAME ".module.ca.page.binary.ByteString"
+
+/** Tags which introduce each value in a serialized message */
+typedef enum
+{
+  ct_undefined,
+  ct_null,
+  ct_false,
+  ct_true,
+  ct_int,			/**< int32 follows */
+  ct_double,			/**< jsdouble follows */
+  ct_string,			/**< size_t length, then that many jschars */
+  ct_array,			/**< jsuint length, then that many values */
+  ct_object,			/**< jsuint count, then count (string, value) pairs */
+  ct_byteThing,			/**< jsuint index into msg->stores, size_t offset, size_t length */
+  ct_byteString			/**< As ct_byteThing, received as a binary.ByteString */
+} channel_tag_t;
+
+typedef struct channel_message channel_message_t;
+
+/** A serialized value, in the queue or on its way there */
+struct channel_message
+{
+  channel_message_t * volatile	next;			/**< Next (newer) message in the queue */
+  gpsee_byteStore_t		**stores;		/**< Byte stores referenced by the message; we hold a reference to each */
+  jsuint			nStores;		/**< Number of stores */
+  unsigned char			*data;			/**< Serialized value */
+  size_t			length;			/**< Bytes used in data */
+  size_t			size;			/**< Bytes allocated for data */
+};
+
+/** Private data of a Channel */
+typedef struct
+{
+  channel_message_t * volatile	head;			/**< Newest message; senders swap themselves in here */
+  channel_message_t		*tail;			/**< Oldest message; guarded by receiveLock */
+  channel_message_t		stub;			/**< Placeholder which keeps the queue non-empty */
+  PRLock			*receiveLock;		/**< Serializes receivers; guards messageReady and closed */
+  PRCondVar			*messageReady;		/**< Notified when a message is sent or the channel closes */
+  PRInt32			nWaiting;		/**< Receivers which may be about to wait on messageReady */
+  PRInt32			length;			/**< Messages sent but not yet received */
+  jsval				closed;			/**< JSVAL_TRUE once close() has been called */
+} channel_handle_t;
+
+/** Cursor for reading a message back */
+typedef struct
+{
+  const unsigned char		*p;			/**< Next byte to read */
+  const unsigned char		*end;			/**< One past the last byte of the message */
+  channel_message_t		*msg;			/**< Message being read */
+  JSObject			*channel;		/**< Channel it came from */
+} channel_reader_t;
+
+static JSClass *channel_clasp;
+static JSClass *byteString_clasp;	/**< Learned from the first ByteString sent */
+
+/** Free a message and release its stores */
+static void channel_freeMessage(JSContext *cx, channel_message_t *msg)
+{
+  jsuint i;
+
+  for (i = 0; i < msg->nStores; i++)
+    gpsee_releaseByteStore(cx, msg->stores[i]);
+  if (msg->stores)
+    JS_free(cx, msg->stores);
+  if (msg->data)
+    JS_free(cx, msg->data);
+  JS_free(cx, msg);
+}
+
+/** Append bytes to a message being serialized */
+static JSBool channel_write(JSContext *cx, channel_message_t *msg, const void *bytes, size_t length)
+{
+  if (msg->length + length > msg->size)
+  {
+    size_t		size = msg->size ? msg->size : 64;
+    unsigned char	*data;
+
+    while (size < msg->length + length)
+      size *= 2;
+
+    data = JS_realloc(cx, msg->data, size);
+    if (!data)
+      return JS_FALSE;
+
+    msg->data = data;
+    msg->size = size;
+  }
+
+  memcpy(msg->data + msg->length, bytes, length);
+  msg->length += length;
+
+  return JS_TRUE;
+}
+
+static JSBool channel_writeTag(JSContext *cx, channel_message_t *msg, channel_tag_t tag)
+{
+  unsigned char	c = tag;
+
+  return channel_write(cx, msg, &c, 1);
+}
+
+static JSBool channel_writeString(JSContext *cx, channel_message_t *msg, JSString *str)
+{
+  size_t	length = JS_GetStringLength(str);
+
+  return channel_write(cx, msg, &length, sizeof(length)) && channel_write(cx, msg, JS_GetStringChars(str), length * sizeof(jschar));
+}
+
+/** Attach an immutable ByteThing's byte store to the message, and write a reference to it.
+ *  ByteStrings also leave their prototype in the channel's reserved slot for the receiver.
+ */
+static JSBool channel_writeByteThing(JSContext *cx, JSObject *channel, channel_message_t *msg, JSObject *obj, 
+				     byteThing_handle_t *hnd)
+{
+  gpsee_byteStore_t	*store, **stores;
+  size_t		offset = 0;
+  jsuint		index = msg->nStores;
+  JSClass		*clasp = JS_GET_CLASS(cx, obj);
+  channel_tag_t		tag = ct_byteThing;
+
+  if (clasp == byteString_clasp || (!byteString_clasp && strcmp(clasp->name, BYTESTRING_CLASS_NAME) == 0))
+  {
+    jsval	v;
+
+    if (!JS_GetReservedSlot(cx, channel, 0, &v))
+      return JS_FALSE;
+    if (JSVAL_IS_VOID(v) && !JS_SetReservedSlot(cx, channel, 0, OBJECT_TO_JSVAL(JS_GetPrototype(cx, obj))))
+      return JS_FALSE;
+
+    byteString_clasp = clasp;
+    tag = ct_byteString;
+  }
+
+  store = gpsee_getByteStore(cx, obj, &offset);
+  if (!store)
+  {
+    if (JS_IsExceptionPending(cx))
+      return JS_FALSE;
+
+    store = gpsee_newByteStore(cx, hnd->buffer, hnd->length);	/* Not shareable; copy */
+    if (!store)
+      return JS_FALSE;
+  }
+
+  stores = JS_realloc(cx, msg->stores, sizeof(stores[0]) * (index + 1));
+  if (!stores)
+  {
+    gpsee_releaseByteStore(cx, store);
+    return JS_FALSE;
+  }
+  stores[index] = store;
+  msg->stores = stores;
+  msg->nStores++;
+
+  return channel_writeTag(cx, msg, tag) && channel_write(cx, msg, &index, sizeof(index)) && 
+    channel_write(cx, msg, &offset, sizeof(offset)) && channel_write(cx, msg, &hnd->length, sizeof(hnd->length));
+}
+
+/** Serialize v onto the end of msg, or throw if it cannot be sent */
+static JSBool channel_serialize(JSContext *cx, JSObject *channel, channel_message_t *msg, jsval v, int depth)
+{
+  JSObject	*obj;
+  JSClass	*clasp;
+
+  if (JSVAL_IS_VOID(v))
+    return channel_writeTag(cx, msg, ct_undefined);
+
+  if (JSVAL_IS_NULL(v))
+    return channel_writeTag(cx, msg, ct_null);
+
+  if (JSVAL_IS_BOOLEAN(v))
+    return channel_writeTag(cx, msg, JSVAL_TO_BOOLEAN(v) ? ct_true : ct_false);
+
+  if (JSVAL_IS_INT(v))
+  {
+    int32 i = JSVAL_TO_INT(v);
+    return channel_writeTag(cx, msg, ct_int) && channel_write(cx, msg, &i, sizeof(i));
+  }
+
+  if (JSVAL_IS_DOUBLE(v))
+    return channel_writeTag(cx, msg, ct_double) && channel_write(cx, msg, JSVAL_TO_DOUBLE(v), sizeof(jsdouble));
+
+  if (JSVAL_IS_STRING(v))
+    return channel_writeTag(cx, msg, ct_string) && channel_writeString(cx, msg, JSVAL_TO_STRING(v));
+
+  if (++depth > CHANNEL_MAX_DEPTH)
+    return gpsee_throw(cx, CLASS_ID ".send.depth: value is nested more than %i deep, or is cyclic", CHANNEL_MAX_DEPTH);
+
+  obj = JSVAL_TO_OBJECT(v);
+  clasp = JS_GET_CLASS(cx, obj);
+
+  if (gpsee_isByteThingClass(cx, clasp))
+  {
+    byteThing_handle_t *hnd = JS_GetPrivate(cx, obj);
+
+    if (!hnd || !(hnd->btFlags & bt_immutable))
+      return gpsee_throw(cx, CLASS_ID ".send.byteThing.mutable: only immutable ByteThings, such as ByteStrings, can be sent");
+
+    return channel_writeByteThing(cx, channel, msg, obj, hnd);
+  }
+
+  if (JS_IsArrayObject(cx, obj))
+  {
+    jsuint	length, i;
+
+    if (!JS_GetArrayLength(cx, obj, &length))
+      return JS_FALSE;
+    if (!channel_writeTag(cx, msg, ct_array) || !channel_write(cx, msg, &length, sizeof(length)))
+      return JS_FALSE;
+
+    for (i = 0; i < length; i++)
+    {
+      if (!JS_GetElement(cx, obj, i, &v) || !channel_serialize(cx, channel, msg, v, depth))
+	return JS_FALSE;
+    }
+
+    return JS_TRUE;
+  }
+
+  if ((strcmp(clasp->name, "Object") == 0) && !JS_ObjectIsFunction(cx, obj))
+  {
+    JSIdArray	*ida = JS_Enumerate(cx, obj);
+    jsuint	count, i;
+    JSBool	ok = JS_TRUE;
+
+    if (!ida)
+      return JS_FALSE;
+
+    count = ida->length;
+    if (!channel_writeTag(cx, msg, ct_object) || !channel_write(cx, msg, &count, sizeof(count)))
+      ok = JS_FALSE;
+
+    for (i = 0; ok && i < count; i++)
+    {
+      jsval	key;
+      JSString	*str;
+
+      if (!JS_IdToValue(cx, ida->vector[i], &key) || !(str = JS_ValueToString(cx, key)))
+	ok = JS_FALSE;
+      else if (!channel_writeString(cx, msg, str))
+	ok = JS_FALSE;
+      else if (!JS_GetPropertyById(cx, obj, ida->vector[i], &v) || !channel_serialize(cx, channel, msg, v, depth))
+	ok = JS_FALSE;
+    }
+
+    JS_DestroyIdArray(cx, ida);
+    return ok;
+  }
+
+  return gpsee_throw(cx, CLASS_ID ".send.type: %s objects cannot be sent", clasp->name);
+}
+
+/** Read bytes from a message. Messages are produced by channel_serialize(), so running off the end is a bug. */
+static const void *channel_read(channel_reader_t *r, size_t length)
+{
+  const void *p = r->p;
+
+  GPSEE_ASSERT(r->p + length <= r->end);
+  r->p += length;
+
+  return p;
+}
+
+/** Wrap a new ByteThing around one of the message's byte stores */
+static JSBool channel_deserializeByteThing(JSContext *cx, channel_reader_t *r, channel_tag_t tag, jsval *vp)
+{
+  jsuint		index;
+  size_t		offset, length;
+  JSObject		*obj, *bs;
+  byteThing_handle_t	*hnd;
+  jsval			v;
+
+  memcpy(&index, channel_read(r, sizeof(index)), sizeof(index));
+  memcpy(&offset, channel_read(r, sizeof(offset)), sizeof(offset));
+  memcpy(&length, channel_read(r, sizeof(length)), sizeof(length));
+  GPSEE_ASSERT(index < r->msg->nStores);
+
+  obj = gpsee_newByteThingFromStore(cx, r->msg->stores[index], offset, length);
+  if (!obj)
+    return JS_FALSE;
+  *vp = OBJECT_TO_JSVAL(obj);
+
+  if (tag != ct_byteString)
+    return JS_TRUE;
+
+  /* Same cast binary.ByteString() makes for immutable ByteThings: copy the handle, not the bytes */
+  if (!JS_GetReservedSlot(cx, r->channel, 0, &v))
+    return JS_FALSE;
+  bs = JS_NewObject(cx, byteString_clasp, JSVAL_TO_OBJECT(v), NULL);
+  if (!bs)
+    return JS_FALSE;
+
+  hnd = JS_malloc(cx, sizeof(*hnd));
+  if (!hnd)
+    return JS_FALSE;
+
+  *hnd = *(byteThing_handle_t *)JS_GetPrivate(cx, obj);
+  JS_SetPrivate(cx, bs, hnd);
+  *vp = OBJECT_TO_JSVAL(bs);
+
+  return JS_TRUE;
+}
+
+/** Build a value from a message. Caller provides a local root scope. */
+static JSBool channel_deserialize(JSContext *cx, channel_reader_t *r, jsval *vp)
+{
+  unsigned char	tag = *(const unsigned char *)channel_read(r, 1);
+  JSObject	*obj;
+  jsuint	length, i;
+  size_t	slen;
+  jsval		v;
+
+  switch((channel_tag_t)tag)
+  {
+    case ct_undefined:
+      *vp = JSVAL_VOID;
+      return JS_TRUE;
+    case ct_null:
+      *vp = JSVAL_NULL;
+      return JS_TRUE;
+    case ct_false:
+      *vp = JSVAL_FALSE;
+      return JS_TRUE;
+    case ct_true:
+      *vp = JSVAL_TRUE;
+      return JS_TRUE;
+    case ct_int:
+    {
+      int32 n;
+      memcpy(&n, channel_read(r, sizeof(n)), sizeof(n));
+      *vp = INT_TO_JSVAL(n);
+      return JS_TRUE;
+    }
+    case ct_double:
+    {
+      jsdouble d;
+      memcpy(&d, channel_read(r, sizeof(d)), sizeof(d));
+      return JS_NewNumberValue(cx, d, vp);
+    }
+    case ct_string:
+    {
+      JSString *str;
+
+      memcpy(&slen, channel_read(r, sizeof(slen)), sizeof(slen));
+      str = JS_NewUCStringCopyN(cx, channel_read(r, slen * sizeof(jschar)), slen);
+      if (!str)
+	return JS_FALSE;
+      *vp = STRING_TO_JSVAL(str);
+      return JS_TRUE;
+    }
+    case ct_array:
+      memcpy(&length, channel_read(r, sizeof(length)), sizeof(length));
+      obj = JS_NewArrayObject(cx, 0, NULL);
+      if (!obj)
+	return JS_FALSE;
+      *vp = OBJECT_TO_JSVAL(obj);
+
+      for (i = 0; i < length; i++)
+      {
+	if (!channel_deserialize(cx, r, &v) || !JS_SetElement(cx, obj, i, &v))
+	  return JS_FALSE;
+      }
+      return JS_TRUE;
+    case ct_object:
+      memcpy(&length, channel_read(r, sizeof(length)), sizeof(length));
+      obj = JS_NewObject(cx, NULL, NULL, NULL);
+      if (!obj)
+	return JS_FALSE;
+      *vp = OBJECT_TO_JSVAL(obj);
+
+      for (i = 0; i < length; i++)
+      {
+	const jschar *name;
+
+	memcpy(&slen, channel_read(r, sizeof(slen)), sizeof(slen));
+	name = channel_read(r, slen * sizeof(jschar));
+	if (!channel_deserialize(cx, r, &v) || !JS_DefineUCProperty(cx, obj, name, slen, v, NULL, NULL, JSPROP_ENUMERATE))
+	  return JS_FALSE;
+      }
+      return JS_TRUE;
+    case ct_byteThing:
+    case ct_byteString:
+      return channel_deserializeByteThing(cx, r, (channel_tag_t)tag, vp);
+  }
+
+  GPSEE_NOT_REACHED("corrupt channel message");
+  return gpsee_throw(cx, CLASS_ID ".receive.corrupt: bad tag %i in message", (int)tag);
+}
+
+/** Add a message to the queue. Lock-free; safe to call from any number of threads. */
+static void channel_push(channel_handle_t *ch, channel_message_t *msg)
+{
+  channel_message_t	*prev;
+
+  msg->next = NULL;
+  do
+  {
+    prev = ch->head;
+  } while (jsval_CompareAndSwap((jsval *)&ch->head, (jsval)prev, (jsval)msg) != JS_TRUE);
+
+  prev->next = msg;	/* Until this lands, the receiver sees the queue as busy */
+}
+
+/** Take the oldest message off the queue. Caller holds ch->receiveLock.
+ *
+ *  @param	busy_p	[out] JS_TRUE when the queue is not empty, but a sender has not finished linking 
+ *			its message yet; try again shortly.
+ *  @returns	The message, or NULL
+ */
+static channel_message_t *channel_pop(channel_handle_t *ch, JSBool *busy_p)
+{
+  channel_message_t	*tail = ch->tail;
+  channel_message_t	*next = tail->next;
+
+  *busy_p = JS_FALSE;
+
+  if (tail == &ch->stub)
+  {
+    if (!next)
+      return NULL;
+    ch->tail = tail = next;
+    next = next->next;
+  }
+
+  if (next)
+  {
+    ch->tail = next;
+    return tail;
+  }
+
+  if (tail != ch->head)
+  {
+    *busy_p = JS_TRUE;
+    return NULL;
+  }
+
+  /* tail is the last message; put the stub behind it so that we can take it */
+  channel_push(ch, &ch->stub);
+  next = tail->next;
+  if (next)
+  {
+    ch->tail = next;
+    return tail;
+  }
+
+  *busy_p = JS_TRUE;
+  return NULL;
+}
+
+/** Find the channel behind a Channel object, or throw */
+static channel_handle_t *channel_getHandle(JSContext *cx, JSObject *obj, const char *methodName)
+{
+  channel_handle_t *ch = obj ? JS_GetInstancePrivate(cx, obj, channel_clasp, NULL) : NULL;
+
+  if (!ch)
+    gpsee_throw(cx, CLASS_ID ".%s.invalidObject: Invalid Channel object!", methodName);
+
+  return ch;
+}
+
+/** 
+ *  Implements Channel.prototype.send(value). Copies value into the channel; never waits for a receiver.
+ */
+static JSBool Channel_send(JSContext *cx, uintN argc, jsval *vp)
+{
+  JSObject		*obj = JS_THIS_OBJECT(cx, vp);
+  channel_handle_t	*ch = channel_getHandle(cx, obj, "send");
+  channel_message_t	*msg;
+
+  if (!ch)
+    return JS_FALSE;
+
+  if (argc != 1)
+    return gpsee_throw(cx, CLASS_ID ".send.arguments.count");
+
+  if (ch->closed == JSVAL_TRUE)	/* Early out; checked again under the lock below */
+    return gpsee_throw(cx, CLASS_ID ".send.closed: Channel is closed");
+
+  msg = JS_malloc(cx, sizeof(*msg));
+  if (!msg)
+    return JS_FALSE;
+  memset(msg, 0, sizeof(*msg));
+
+  if (!channel_serialize(cx, obj, msg, JS_ARGV(cx, vp)[0], 0))
+  {
+    channel_freeMessage(cx, msg);
+    return JS_FALSE;
+  }
+
+  /* Holding receiveLock across the test and the push means that once close() returns, no
+   * message can arrive after a receiver has seen the channel closed and empty.
+   */
+  PR_Lock(ch->receiveLock);
+  if (ch->closed == JSVAL_TRUE)
+  {
+    PR_Unlock(ch->receiveLock);
+    channel_freeMessage(cx, msg);
+    return gpsee_throw(cx, CLASS_ID ".send.closed: Channel is closed");
+  }
+
+  channel_push(ch, msg);
+  PR_AtomicIncrement(&ch->length);
+  if (ch->nWaiting)
+    PR_NotifyCondVar(ch->messageReady);
+  PR_Unlock(ch->receiveLock);
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Take a message off the channel, waiting for one if block is true.
+ *
+ *  @returns	JS_TRUE and a message, JS_TRUE and NULL when !block and the channel is empty,
+ *		or JS_FALSE when an exception was thrown.
+ */
+static JSBool channel_receive(JSContext *cx, channel_handle_t *ch, JSBool block, channel_message_t **msg_p)
+{
+  channel_message_t	*msg;
+  JSBool		busy;
+  jsrefcount		depth;
+
+  depth = JS_SuspendRequest(cx);
+  PR_Lock(ch->receiveLock);
+
+  for (;;)
+  {
+    msg = channel_pop(ch, &busy);
+    if (msg)
+      break;
+
+    if (busy)
+    {
+      /* A sender is mid-push; it will finish without needing anything from us */
+      PR_Unlock(ch->receiveLock);
+      PR_Sleep(PR_INTERVAL_NO_WAIT);
+      PR_Lock(ch->receiveLock);
+      continue;
+    }
+
+    if (!block || ch->closed == JSVAL_TRUE)
+      break;
+
+    /* Announce ourselves before looking again, so a sender which links after our look sees us */
+    PR_AtomicIncrement(&ch->nWaiting);
+    msg = channel_pop(ch, &busy);
+    if (!msg && !busy && ch->closed != JSVAL_TRUE)
+      PR_WaitCondVar(ch->messageReady, PR_INTERVAL_NO_TIMEOUT);
+    PR_AtomicDecrement(&ch->nWaiting);
+
+    if (msg)
+      break;
+  }
+
+  PR_Unlock(ch->receiveLock);
+  JS_ResumeRequest(cx, depth);
+
+  if (msg)
+    PR_AtomicDecrement(&ch->length);
+  else if (block)
+    return gpsee_throw(cx, CLASS_ID ".receive.closed: Channel is closed and empty");
+
+  *msg_p = msg;
+  return JS_TRUE;
+}
+
+/** Turn a received message into a value, and free the message */
+static JSBool channel_unpack(JSContext *cx, JSObject *channel, channel_message_t *msg, jsval *vp)
+{
+  channel_reader_t	reader;
+  JSBool		ok;
+
+  reader.p	= msg->data;
+  reader.end	= msg->data + msg->length;
+  reader.msg	= msg;
+  reader.channel	= channel;
+
+  if (!JS_EnterLocalRootScope(cx))
+  {
+    channel_freeMessage(cx, msg);
+    return JS_FALSE;
+  }
+
+  ok = channel_deserialize(cx, &reader, vp);
+  JS_LeaveLocalRootScope(cx);
+
+  channel_freeMessage(cx, msg);
+  return ok;
+}
+
+/** 
+ *  Implements Channel.prototype.receive(). Blocks until a message arrives, then returns a 
+ *  copy of the value which was sent. Throws if the channel is closed and empty.
+ */
+static JSBool Channel_receive(JSContext *cx, uintN argc, jsval *vp)
+{
+  JSObject		*obj = JS_THIS_OBJECT(cx, vp);
+  channel_handle_t	*ch = channel_getHandle(cx, obj, "receive");
+  channel_message_t	*msg;
+
+  if (!ch)
+    return JS_FALSE;
+
+  if (!channel_receive(cx, ch, JS_TRUE, &msg))
+    return JS_FALSE;
+
+  return channel_unpack(cx, obj, msg, vp);
+}
+
+/** 
+ *  Implements Channel.prototype.tryReceive([dflt]). Returns a copy of the next value
+ *  if one has been sent, otherwise returns dflt without blocking.
+ */
+static JSBool Channel_tryReceive(JSContext *cx, uintN argc, jsval *vp)
+{
+  JSObject		*obj = JS_THIS_OBJECT(cx, vp);
+  channel_handle_t	*ch = channel_getHandle(cx, obj, "tryReceive");
+  channel_message_t	*msg;
+
+  if (!ch)
+    return JS_FALSE;
+
+  if (argc > 1)
+    return gpsee_throw(cx, CLASS_ID ".tryReceive.arguments.count");
+
+  if (ch->length == 0)	/* Cheap test for the common empty case */
+    msg = NULL;
+  else if (!channel_receive(cx, ch, JS_FALSE, &msg))
+    return JS_FALSE;
+
+  if (!msg)
+  {
+    JS_SET_RVAL(cx, vp, argc ? JS_ARGV(cx, vp)[0] : JSVAL_VOID);
+    return JS_TRUE;
+  }
+
+  return channel_unpack(cx, obj, msg, vp);
+}
+
+/** 
+ *  Implements Channel.prototype.close(). Further sends throw; receivers drain what is 
+ *  left, then receive() throws instead of blocking.
+ */
+static JSBool Channel_close(JSContext *cx, uintN argc, jsval *vp)
+{
+  channel_handle_t	*ch = channel_getHandle(cx, JS_THIS_OBJECT(cx, vp), "close");
+
+  if (!ch)
+    return JS_FALSE;
+
+  PR_Lock(ch->receiveLock);
+  if (ch->closed != JSVAL_TRUE)
+  {
+    ch->closed = JSVAL_TRUE;
+    PR_NotifyAllCondVar(ch->messageReady);
+  }
+  PR_Unlock(ch->receiveLock);
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Implements Channel.prototype.length getter: messages sent but not yet received */
+static JSBool channel_length_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  channel_handle_t	*ch = channel_getHandle(cx, obj, "length");
+
+  if (!ch)
+    return JS_FALSE;
+
+  *vp = INT_TO_JSVAL(ch->length);
+  return JS_TRUE;
+}
+
+/** Implements Channel.prototype.closed getter */
+static JSBool channel_closed_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  channel_handle_t	*ch = channel_getHandle(cx, obj, "closed");
+
+  if (!ch)
+    return JS_FALSE;
+
+  *vp = ch->closed;
+  return JS_TRUE;
+}
+
+/** Implements the Channel constructor */
+static JSBool Channel(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  channel_handle_t	*ch;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc != 0)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.count");
+
+  ch = JS_malloc(cx, sizeof(*ch));
+  if (!ch)
+    return JS_FALSE;
+
+  memset(ch, 0, sizeof(*ch));
+  ch->head	= &ch->stub;
+  ch->tail	= &ch->stub;
+  ch->closed	= JSVAL_FALSE;
+
+  if (!(ch->receiveLock = PR_NewLock()) || !(ch->messageReady = PR_NewCondVar(ch->receiveLock)))
+  {
+    if (ch->receiveLock)
+      PR_DestroyLock(ch->receiveLock);
+    JS_free(cx, ch);
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+  }
+
+  JS_SetPrivate(cx, obj, ch);
+  return JS_TRUE;
+}
+
+/** Channel Finalizer. Discards messages which were never received. */
+static void Channel_Finalize(JSContext *cx, JSObject *obj)
+{
+  channel_handle_t	*ch = JS_GetPrivate(cx, obj);
+  channel_message_t	*msg;
+  JSBool		busy;
+
+  if (!ch)
+    return;
+
+  while ((msg = channel_pop(ch, &busy)))
+    channel_freeMessage(cx, msg);
+
+  PR_DestroyCondVar(ch->messageReady);
+  PR_DestroyLock(ch->receiveLock);
+  JS_free(cx, ch);
+}
+
+/** Initializes thread.Channel */
+JSObject *Channel_InitClass(JSContext *cx, JSObject *obj)
+{
+  /** Description of this class: */
+  static JSClass channel_class =
+  {
+    GPSEE_CLASS_NAME(Channel),		/**< its name is Channel */
+    JSCLASS_HAS_PRIVATE |		/**< private slot in use */
+    JSCLASS_HAS_RESERVED_SLOTS(1),	/**< slot 0 holds ByteString.prototype once a ByteString is sent */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Channel_Finalize,			/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSPropertySpec instance_props[] =
+  {
+    { "length",	0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, channel_length_getter, NULL },
+    { "closed",	0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, channel_closed_getter, NULL },
+    { NULL, 0, 0, NULL, NULL }
+  };
+
+  static JSFunctionSpec instance_methods[] =
+  {
+    JS_FN("send",		Channel_send,			1, 0),
+    JS_FN("receive",		Channel_receive,		0, 0),
+    JS_FN("tryReceive",		Channel_tryReceive,		1, 0),
+    JS_FN("close",		Channel_close,			0, 0),
+    JS_FS_END
+  };
+
+  JSObject *proto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &channel_class,	/* clasp - Class struct to init. Defs class for use by other API funs */
+		   Channel,		/* constructor function - Scope matches obj */
+		   0,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   instance_props,	/* ps - props struct for parent_proto */
+		   instance_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+
+  GPSEE_ASSERT(proto);
+  channel_clasp = &channel_class;
+
+  return proto;
+}
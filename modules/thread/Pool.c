@@ -0,0 +1,924 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	Pool.c		A pool of persistent worker threads, and the futures
+ *				which carry results back from them.
+ *
+ *  A Thread pays for an NSPR thread and a JSContext every time it is started. A Pool
+ *  pays for them once: new thread.Pool(n) starts n workers, each of which keeps the
+ *  context it was given by gpsee_createContext() until the pool is shut down. 
+ *  pool.submit(fn, args) queues fn.apply(null, args) and returns a Future; 
+ *  future.wait() blocks until a worker has run it, then returns its value or throws
+ *  its exception.
+ *
+ *  A Future keeps the function, its arguments and, later, its result in reserved slots.
+ *  The task holds a root on the Future from submit() until a worker is finished with it,
+ *  so work which is submitted and forgotten still runs. Workers suspend their requests
+ *  while they wait for work; an idle pool never holds up the garbage collector.
+ *
+ *  Pools are rooted until shutdown() is called. Work queued before shutdown() is run 
+ *  before the workers exit. thread_FiniModule() shuts down any pools left running.
+ *
+ *  Naming Convention: 	pool_ prefix:	mechanics, does not throw exceptions.
+ *			Pool_ prefix:	methods, getters and setters of Pool objects.
+ *			Future_ prefix:	methods, getters and setters of Future objects.
+ *
+ *  @warning	A task which waits on a future from its own pool can deadlock the pool
+ *		if every worker is doing the same.
+ */
+
+#include "thread.h"
+#include <errno.h>
+
+#define CLASS_ID MODULE_ID ".Pool"
+#define POOL_MAX_THREADS	1024	/**< Sanity limit on workers per pool */
+
+/** Reserved slots in Future objects */
+enum
+{
+  future_slot_fn,			/**< Function to run */
+  future_slot_args,			/**< Array of arguments, or undefined */
+  future_slot_result,			/**< Return value or exception, once run */
+  future_slots
+};
+
+typedef enum
+{
+  task_queued = 1,			/**< Waiting for a worker */
+  task_running,				/**< A worker is running it */
+  task_done,				/**< Returned normally; result is in future_slot_result */
+  task_failed				/**< Threw; exception (if any) is in future_slot_result */
+} pool_taskState_t;
+
+typedef struct pool_task	pool_task_t;
+typedef struct thread_pool	thread_pool_t;
+
+/** Private data of a Future */
+struct pool_task
+{
+  pool_task_t			*next;			/**< Next task in the pool's queue */
+  thread_pool_t			*pool;			/**< Pool which runs the task; we hold a reference */
+  JSObject			*future;		/**< The Future; rooted while queued or running */
+  pool_taskState_t		state;			/**< Guarded by pool->lock */
+};
+
+/** A worker thread and the context it owns */
+typedef struct
+{
+  thread_pool_t			*pool;			/**< Pool this worker serves */
+  JSContext			*cx;			/**< Worker's context, created by gpsee_createContext() */
+  PRThread			*thread;		/**< NSPR thread handle; NULL once joined */
+  thread_placement_t		placement;		/**< CPUs / NUMA node the worker binds itself to */
+  thread_cpuClock_t		cpuClock;		/**< CPU time used by the worker */
+} pool_worker_t;
+
+/** Private data of a Pool */
+struct thread_pool
+{
+  thread_pool_t			*next;			/**< Next pool in livePools */
+  gpsee_realm_t			*realm;			/**< Realm the workers run in */
+  JSObject			*obj;			/**< The Pool; rooted until shutdown */
+  JSObject			*futureProto;		/**< Future.prototype, rooted by Pool.prototype */
+  PRInt32			refCount;		/**< One for the Pool, one per live Future */
+
+  PRLock			*lock;			/**< Guards the queue, task states and shuttingDown */
+  PRCondVar			*workReady;		/**< Signalled when work is queued, broadcast on shutdown */
+  PRCondVar			*taskDone;		/**< Broadcast when any task finishes */
+  pool_task_t			*head;			/**< Next task to run */
+  pool_task_t			*tail;			/**< Last task queued */
+  size_t			nQueued;		/**< Tasks waiting for a worker */
+  JSBool			shuttingDown;		/**< No more submissions; workers exit when queue is empty */
+
+  size_t			nThreads;		/**< Number of workers started */
+  pool_worker_t			*workers;		/**< Array of nThreads workers */
+};
+
+static JSClass *pool_clasp;
+static JSClass *future_clasp;
+
+/** Pools which have not been shut down, so that thread_FiniModule() can find them */
+static thread_pool_t	*livePools;
+static PRLock		*livePools_lock;
+
+/** NSPR thread-private index holding the pool_worker_t which a worker thread is */
+static PRUintn		workerIndex;
+static PRCallOnceType	workerIndexOnce;
+
+static PRStatus pool_newWorkerIndex(void)
+{
+  return PR_NewThreadPrivateIndex(&workerIndex, NULL);
+}
+
+/** Drop a reference to a pool, freeing it when the last one is gone. */
+static void pool_release(JSContext *cx, thread_pool_t *pool)
+{
+  if (PR_AtomicDecrement(&pool->refCount) != 0)
+    return;
+
+  if (pool->taskDone)
+    PR_DestroyCondVar(pool->taskDone);
+  if (pool->workReady)
+    PR_DestroyCondVar(pool->workReady);
+  if (pool->lock)
+    PR_DestroyLock(pool->lock);
+  if (pool->workers)
+    JS_free(cx, pool->workers);
+  JS_free(cx, pool);
+}
+
+/** Remove a pool from livePools, if it is there. */
+static void pool_unlink(thread_pool_t *pool)
+{
+  thread_pool_t **pp;
+
+  PR_Lock(livePools_lock);
+  for (pp = &livePools; *pp; pp = &(*pp)->next)
+  {
+    if (*pp == pool)
+    {
+      *pp = pool->next;
+      break;
+    }
+  }
+  PR_Unlock(livePools_lock);
+}
+
+/** Stop accepting work, and wait for the workers to drain the queue and exit.
+ *
+ *  @returns	JS_TRUE if this call shut the pool down, JS_FALSE if another call already had
+ */
+static JSBool pool_shutdown(JSContext *cx, thread_pool_t *pool)
+{
+  jsrefcount	depth;
+  size_t	i;
+
+  PR_Lock(pool->lock);
+  if (pool->shuttingDown)
+  {
+    PR_Unlock(pool->lock);
+    return JS_FALSE;
+  }
+  pool->shuttingDown = JS_TRUE;
+  PR_NotifyAllCondVar(pool->workReady);
+  PR_Unlock(pool->lock);
+
+  depth = JS_SuspendRequest(cx);
+  for (i = 0; i < pool->nThreads; i++)
+  {
+    if (!pool->workers[i].thread)
+      continue;
+
+    while ((PR_JoinThread(pool->workers[i].thread) != PR_SUCCESS) && (PR_GetError() == PR_PENDING_INTERRUPT_ERROR))
+      ;
+    pool->workers[i].thread = NULL;
+  }
+  JS_ResumeRequest(cx, depth);
+
+  return JS_TRUE;
+}
+
+/** Run one task on a worker's context, leaving its outcome in the Future's result slot.
+ *
+ *  @returns	task_done or task_failed
+ */
+static pool_taskState_t pool_runTask(JSContext *cx, JSObject *future)
+{
+  jsval		fn, args, v;
+  jsval		*argv = NULL;
+  jsuint	argc = 0, i;
+  JSBool	ok;
+
+  if (!JS_GetReservedSlot(cx, future, future_slot_fn, &fn) || !JS_GetReservedSlot(cx, future, future_slot_args, &args))
+    goto fail;
+
+  if (JSVAL_IS_OBJECT(args) && !JSVAL_IS_NULL(args))
+  {
+    if (!JS_GetArrayLength(cx, JSVAL_TO_OBJECT(args), &argc))
+      goto fail;
+
+    if (argc)
+    {
+      argv = JS_malloc(cx, sizeof(argv[0]) * argc);
+      if (!argv)
+	goto fail;
+
+      for (i = 0; i < argc; i++)
+      {
+	if (!JS_GetElement(cx, JSVAL_TO_OBJECT(args), i, argv + i))
+	  goto fail;
+      }
+    }
+  }
+
+  ok = JS_CallFunctionValue(cx, JS_GetGlobalObject(cx), fn, argc, argv, &v);
+  if (argv)
+    JS_free(cx, argv);
+  argv = NULL;
+
+  if (ok && JS_SetReservedSlot(cx, future, future_slot_result, v))
+    return task_done;
+
+  fail:
+  if (argv)
+    JS_free(cx, argv);
+
+  if (JS_GetPendingException(cx, &v))
+  {
+    JS_ClearPendingException(cx);
+    JS_SetReservedSlot(cx, future, future_slot_result, v);
+  }
+
+  return task_failed;
+}
+
+/** Body of a worker thread. Takes tasks from the queue until the pool is shut down 
+ *  and the queue is empty, then destroys its context.
+ */
+static void pool_worker(void *vworker)
+{
+  pool_worker_t		*worker = vworker;
+  thread_pool_t		*pool = worker->pool;
+  JSContext		*cx = worker->cx;
+  pool_task_t		*task;
+  pool_taskState_t	state;
+  jsrefcount		depth;
+  const char		*e;
+
+  PR_SetThreadPrivate(workerIndex, worker);
+  JS_SetContextThread(cx);
+  JS_BeginRequest(cx);
+
+  /* Leave exceptions pending, so that pool_runTask() can hand them to the Future */
+  JS_SetOptions(cx, JS_GetOptions(cx) | JSOPTION_DONT_REPORT_UNCAUGHT);
+
+  if ((e = thread_applyPlacement(&worker->placement)))
+    gpsee_log(cx, GLOG_WARNING, CLASS_ID ".worker.placement: %s (%s)", e, strerror(errno));
+  thread_startCpuClock(&worker->cpuClock);
+
+  for (;;)
+  {
+    depth = JS_SuspendRequest(cx);
+
+    PR_Lock(pool->lock);
+    while (!pool->head && !pool->shuttingDown)
+      PR_WaitCondVar(pool->workReady, PR_INTERVAL_NO_TIMEOUT);
+
+    task = pool->head;
+    if (task)
+    {
+      pool->head = task->next;
+      if (!pool->head)
+	pool->tail = NULL;
+      pool->nQueued--;
+      task->state = task_running;
+    }
+    PR_Unlock(pool->lock);
+
+    JS_ResumeRequest(cx, depth);
+
+    if (!task)
+      break;
+
+    state = pool_runTask(cx, task->future);
+
+    PR_Lock(pool->lock);
+    task->state = state;
+    PR_NotifyAllCondVar(pool->taskDone);
+    PR_Unlock(pool->lock);
+
+    /* Last touch: once unrooted, the Future and its task may be finalized */
+    JS_RemoveObjectRoot(cx, &task->future);
+  }
+
+  thread_stopCpuClock(&worker->cpuClock);
+  gpsee_destroyContext(cx);
+}
+
+/** Find the task behind a Future, or throw */
+static pool_task_t *future_getTask(JSContext *cx, JSObject *obj, const char *methodName)
+{
+  pool_task_t *task = obj ? JS_GetInstancePrivate(cx, obj, future_clasp, NULL) : NULL;
+
+  if (!task)
+    gpsee_throw(cx, MODULE_ID ".Future.%s.invalidObject: Invalid Future object!", methodName);
+
+  return task;
+}
+
+/** Find the pool behind a Pool, or throw */
+static thread_pool_t *pool_getPool(JSContext *cx, JSObject *obj, const char *methodName)
+{
+  thread_pool_t *pool = obj ? JS_GetInstancePrivate(cx, obj, pool_clasp, NULL) : NULL;
+
+  if (!pool)
+    gpsee_throw(cx, CLASS_ID ".%s.invalidObject: Invalid Pool object!", methodName);
+
+  return pool;
+}
+
+/** True when obj is Pool.prototype, or an instance whose constructor did not finish. Getters
+ *  report undefined for these rather than throwing, so that the prototype can be enumerated.
+ */
+static JSBool pool_isPrototype(JSContext *cx, JSObject *obj)
+{
+  return (obj && JS_GET_CLASS(cx, obj) == pool_clasp && !JS_GetPrivate(cx, obj)) ? JS_TRUE : JS_FALSE;
+}
+
+/** True when the calling thread is one of the pool's workers. Workers record themselves
+ *  in thread-private storage before they run anything, so this needs no lock, and does 
+ *  not race the constructor or shutdown() writing pool->workers[].thread.
+ */
+static JSBool pool_isWorker(thread_pool_t *pool)
+{
+  pool_worker_t	*self = PR_GetThreadPrivate(workerIndex);
+
+  return (self && self->pool == pool) ? JS_TRUE : JS_FALSE;
+}
+
+/** 
+ *  Implements Pool.prototype.submit(fn, [args]). Queues fn for a worker
+ *  and returns a Future.
+ */
+static JSBool Pool_submit(JSContext *cx, uintN argc, jsval *vp)
+{
+  jsval			*argv = JS_ARGV(cx, vp);
+  thread_pool_t		*pool = pool_getPool(cx, JS_THIS_OBJECT(cx, vp), "submit");
+  pool_task_t		*task;
+  JSObject		*future;
+
+  if (!pool)
+    return JS_FALSE;
+
+  if (argc < 1 || argc > 2)
+    return gpsee_throw(cx, CLASS_ID ".submit.arguments.count");
+
+  if (!JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) || !JS_ObjectIsFunction(cx, JSVAL_TO_OBJECT(argv[0])))
+    return gpsee_throw(cx, CLASS_ID ".submit.arguments.0.typeof: must be a function");
+
+  if (argc == 2 && !JSVAL_IS_VOID(argv[1]) && !JSVAL_IS_NULL(argv[1]) && 
+      (!JSVAL_IS_OBJECT(argv[1]) || !JS_IsArrayObject(cx, JSVAL_TO_OBJECT(argv[1]))))
+    return gpsee_throw(cx, CLASS_ID ".submit.arguments.1.typeof: must be an array");
+
+  if (pool->shuttingDown)
+    return gpsee_throw(cx, CLASS_ID ".submit.shutdown: Pool has been shut down");
+
+  future = JS_NewObject(cx, future_clasp, pool->futureProto, NULL);
+  if (!future)
+    return JS_FALSE;
+  JS_SET_RVAL(cx, vp, OBJECT_TO_JSVAL(future));
+
+  if (!JS_SetReservedSlot(cx, future, future_slot_fn, argv[0]))
+    return JS_FALSE;
+  if (argc == 2 && !JS_SetReservedSlot(cx, future, future_slot_args, argv[1]))
+    return JS_FALSE;
+
+  task = JS_malloc(cx, sizeof(*task));
+  if (!task)
+    return JS_FALSE;
+
+  task->next	= NULL;
+  task->pool	= pool;
+  task->future	= future;
+  task->state	= task_queued;
+
+  PR_AtomicIncrement(&pool->refCount);
+  JS_SetPrivate(cx, future, task);
+
+  if (!JS_AddNamedObjectRoot(cx, &task->future, "thread.Pool.task"))
+    return JS_FALSE;
+
+  PR_Lock(pool->lock);
+  if (pool->shuttingDown)
+  {
+    task->state = task_failed;
+    PR_Unlock(pool->lock);
+    JS_RemoveObjectRoot(cx, &task->future);
+    return gpsee_throw(cx, CLASS_ID ".submit.shutdown: Pool has been shut down");
+  }
+
+  if (pool->tail)
+    pool->tail->next = task;
+  else
+    pool->head = task;
+  pool->tail = task;
+  pool->nQueued++;
+
+  PR_NotifyCondVar(pool->workReady);
+  PR_Unlock(pool->lock);
+
+  return JS_TRUE;
+}
+
+/** 
+ *  Implements Pool.prototype.shutdown(). Stops accepting work, waits for queued work
+ *  to finish and the workers to exit. Calling it again does nothing.
+ */
+static JSBool Pool_shutdown(JSContext *cx, uintN argc, jsval *vp)
+{
+  thread_pool_t		*pool = pool_getPool(cx, JS_THIS_OBJECT(cx, vp), "shutdown");
+
+  if (!pool)
+    return JS_FALSE;
+
+  if (pool_isWorker(pool))
+    return gpsee_throw(cx, CLASS_ID ".shutdown.worker: Cannot shut down a pool from one of its own workers!");
+
+  if (pool_shutdown(cx, pool))
+  {
+    pool_unlink(pool);
+    JS_RemoveObjectRoot(cx, &pool->obj);
+  }
+
+  JS_SET_RVAL(cx, vp, JSVAL_VOID);
+  return JS_TRUE;
+}
+
+/** Implements Pool.prototype.size getter: the number of worker threads */
+static JSBool pool_size_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  thread_pool_t		*pool;
+
+  if (pool_isPrototype(cx, obj))
+  {
+    *vp = JSVAL_VOID;
+    return JS_TRUE;
+  }
+
+  pool = pool_getPool(cx, obj, "size");
+  if (!pool)
+    return JS_FALSE;
+
+  return JS_NewNumberValue(cx, pool->nThreads, vp);
+}
+
+/** Implements Pool.prototype.pending getter: the number of tasks waiting for a worker */
+static JSBool pool_pending_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  thread_pool_t		*pool;
+  size_t		nQueued;
+
+  if (pool_isPrototype(cx, obj))
+  {
+    *vp = JSVAL_VOID;
+    return JS_TRUE;
+  }
+
+  pool = pool_getPool(cx, obj, "pending");
+  if (!pool)
+    return JS_FALSE;
+
+  PR_Lock(pool->lock);
+  nQueued = pool->nQueued;
+  PR_Unlock(pool->lock);
+
+  return JS_NewNumberValue(cx, nQueued, vp);
+}
+
+/** Implements Pool.prototype.onWorker getter: true when read from one of the pool's own workers */
+static JSBool pool_onWorker_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  thread_pool_t		*pool;
+
+  if (pool_isPrototype(cx, obj))
+  {
+    *vp = JSVAL_VOID;
+    return JS_TRUE;
+  }
+
+  pool = pool_getPool(cx, obj, "onWorker");
+  if (!pool)
+    return JS_FALSE;
+
+  *vp = pool_isWorker(pool) ? JSVAL_TRUE : JSVAL_FALSE;
+  return JS_TRUE;
+}
+
+/** Implements Pool.prototype.cpuTime getter: CPU seconds used by all workers, or undefined
+ *  when the platform cannot tell us.
+ */
+static JSBool pool_cpuTime_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  thread_pool_t		*pool;
+  jsdouble		total = 0, seconds;
+  size_t		i;
+
+  if (pool_isPrototype(cx, obj))
+  {
+    *vp = JSVAL_VOID;
+    return JS_TRUE;
+  }
+
+  pool = pool_getPool(cx, obj, "cpuTime");
+  if (!pool)
+    return JS_FALSE;
+
+  for (i = 0; i < pool->nThreads; i++)
+  {
+    if (!thread_readCpuClock(&pool->workers[i].cpuClock, &seconds))
+    {
+      *vp = JSVAL_VOID;
+      return JS_TRUE;
+    }
+    total += seconds;
+  }
+
+  return JS_NewNumberValue(cx, total, vp);
+}
+
+/** 
+ *  Implements the Pool constructor: new Pool([nThreads], [options]). Starts nThreads workers,
+ *  one per processor by default.
+ *
+ *  options.cpus and options.numaNode place the workers as for Thread.prototype.start().
+ *  When options.spread is true, each worker is bound to a single CPU from options.cpus,
+ *  taken in turn, instead of every worker sharing the whole list.
+ */
+static JSBool Pool(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  thread_pool_t		*pool;
+  gpsee_realm_t		*realm;
+  int32			n;
+  jsval			v;
+  size_t		i;
+  thread_placement_t	placement;
+  JSBool		spread = JS_FALSE;
+
+  if (JS_IsConstructing(cx) != JS_TRUE)
+    return gpsee_throw(cx, CLASS_ID ".constructor.notFunction: Cannot call constructor as a function!");
+
+  if (argc > 2)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.count");
+
+  if (!thread_getPlacement(cx, argc > 1 ? argv[1] : JSVAL_VOID, &placement, CLASS_ID ".constructor"))
+    return JS_FALSE;
+
+  if (argc > 1 && JSVAL_IS_OBJECT(argv[1]) && !JSVAL_IS_NULL(argv[1]))
+  {
+    if (!JS_GetProperty(cx, JSVAL_TO_OBJECT(argv[1]), "spread", &v) || !JS_ValueToBoolean(cx, v, &spread))
+      return JS_FALSE;
+  }
+
+  if (argc == 0 || JSVAL_IS_VOID(argv[0]))
+    n = PR_GetNumberOfProcessors();
+  else if (JS_ValueToECMAInt32(cx, argv[0], &n) != JS_TRUE)
+    return JS_FALSE;
+
+  if (n < 1 || n > POOL_MAX_THREADS)
+    return gpsee_throw(cx, CLASS_ID ".constructor.arguments.0.range: Pool size must be between 1 and %i", POOL_MAX_THREADS);
+
+  realm = gpsee_getRealm(cx);
+  if (!realm)
+    return JS_FALSE;
+
+  if (!JS_GetReservedSlot(cx, JS_GetPrototype(cx, obj), 0, &v) || !JSVAL_IS_OBJECT(v) || JSVAL_IS_NULL(v))
+    return gpsee_throw(cx, CLASS_ID ".constructor.prototype: Cannot find Future.prototype");
+
+  pool = JS_malloc(cx, sizeof(*pool));
+  if (!pool)
+    return JS_FALSE;
+
+  memset(pool, 0, sizeof(*pool));
+  pool->refCount	= 1;
+  pool->realm		= realm;
+  pool->obj		= obj;
+  pool->futureProto	= JSVAL_TO_OBJECT(v);
+  JS_SetPrivate(cx, obj, pool);		/* Finalizer cleans up if we fail below */
+
+  pool->workers = JS_malloc(cx, sizeof(pool->workers[0]) * n);
+  if (!pool->workers)
+    return JS_FALSE;
+  memset(pool->workers, 0, sizeof(pool->workers[0]) * n);
+
+  if (!(pool->lock = PR_NewLock()) || !(pool->workReady = PR_NewCondVar(pool->lock)) || !(pool->taskDone = PR_NewCondVar(pool->lock)))
+  {
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+  }
+
+  for (i = 0; i < (size_t)n; i++)
+  {
+    pool_worker_t	*worker = pool->workers + i;
+
+    worker->pool = pool;
+    if (spread)
+      thread_nthPlacement(&placement, i, &worker->placement);
+    else
+      worker->placement = placement;
+
+    worker->cx = gpsee_createContext(realm);
+    if (!worker->cx)
+      break;
+
+    /* Context was created in a request on our thread; hand it to the worker */
+    JS_EndRequest(worker->cx);
+    JS_ClearContextThread(worker->cx);
+
+    worker->thread = PR_CreateThread(PR_SYSTEM_THREAD, pool_worker, worker, PR_PRIORITY_NORMAL, 
+				     PR_GLOBAL_THREAD, PR_JOINABLE_THREAD, 0);
+    if (!worker->thread)
+    {
+      JS_SetContextThread(worker->cx);
+      JS_BeginRequest(worker->cx);
+      gpsee_destroyContext(worker->cx);
+      break;
+    }
+
+    pool->nThreads++;
+  }
+
+  if (pool->nThreads != (size_t)n)
+  {
+    pool_shutdown(cx, pool);
+    if (JS_IsExceptionPending(cx))
+      return JS_FALSE;
+    return gpsee_throw(cx, CLASS_ID ".constructor.thread: Could not start worker %i of %i", (int)i + 1, (int)n);
+  }
+
+  if (!JS_AddNamedObjectRoot(cx, &pool->obj, "thread.Pool"))
+  {
+    pool_shutdown(cx, pool);
+    return JS_FALSE;
+  }
+
+  PR_Lock(livePools_lock);
+  pool->next = livePools;
+  livePools = pool;
+  PR_Unlock(livePools_lock);
+
+  return JS_TRUE;
+}
+
+/** Pool Finalizer. Pools are rooted until shut down, so there are no workers left by now. */
+static void Pool_Finalize(JSContext *cx, JSObject *obj)
+{
+  thread_pool_t		*pool = JS_GetPrivate(cx, obj);
+
+  if (pool)
+    pool_release(cx, pool);
+}
+
+/** 
+ *  Implements Future.prototype.wait(). Blocks until the task has run, then returns its
+ *  value or rethrows its exception.
+ */
+static JSBool Future_wait(JSContext *cx, uintN argc, jsval *vp)
+{
+  JSObject		*obj = JS_THIS_OBJECT(cx, vp);
+  pool_task_t		*task = future_getTask(cx, obj, "wait");
+  thread_pool_t		*pool;
+  pool_taskState_t	state;
+  jsrefcount		depth;
+  jsval			v;
+
+  if (!task)
+    return JS_FALSE;
+
+  pool = task->pool;
+
+  PR_Lock(pool->lock);
+  state = task->state;
+  if (state == task_queued || state == task_running)
+  {
+    PR_Unlock(pool->lock);
+    depth = JS_SuspendRequest(cx);
+    PR_Lock(pool->lock);
+    while ((state = task->state) == task_queued || state == task_running)
+      PR_WaitCondVar(pool->taskDone, PR_INTERVAL_NO_TIMEOUT);
+    PR_Unlock(pool->lock);
+    JS_ResumeRequest(cx, depth);
+  }
+  else
+    PR_Unlock(pool->lock);
+
+  if (!JS_GetReservedSlot(cx, obj, future_slot_result, &v))
+    return JS_FALSE;
+
+  if (state == task_failed)
+  {
+    if (JSVAL_IS_VOID(v))
+      return gpsee_throw(cx, MODULE_ID ".Future.wait.failed: Task did not complete");
+
+    JS_SetPendingException(cx, v);
+    return JS_FALSE;
+  }
+
+  JS_SET_RVAL(cx, vp, v);
+  return JS_TRUE;
+}
+
+/** Implements Future.prototype.done getter: true once the task has run */
+static JSBool future_done_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  pool_task_t		*task = future_getTask(cx, obj, "done");
+  pool_taskState_t	state;
+
+  if (!task)
+    return JS_FALSE;
+
+  PR_Lock(task->pool->lock);
+  state = task->state;
+  PR_Unlock(task->pool->lock);
+
+  *vp = (state == task_done || state == task_failed) ? JSVAL_TRUE : JSVAL_FALSE;
+  return JS_TRUE;
+}
+
+/** Futures are only made by Pool.prototype.submit() */
+static JSBool Future(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  return gpsee_throw(cx, MODULE_ID ".Future.constructor: Futures are created by Pool.prototype.submit()");
+}
+
+/** Future Finalizer. Futures are rooted while their task is queued or running. */
+static void Future_Finalize(JSContext *cx, JSObject *obj)
+{
+  pool_task_t		*task = JS_GetPrivate(cx, obj);
+
+  if (!task)
+    return;
+
+  pool_release(cx, task->pool);
+  JS_free(cx, task);
+}
+
+/** Shut down every pool in the realm which is still running. Called from thread_FiniModule(). */
+void Pool_FiniClass(JSContext *cx, gpsee_realm_t *realm)
+{
+  thread_pool_t		*pool;
+  thread_pool_t		**pp;
+
+  if (!livePools_lock)
+    return;
+
+  do
+  {
+    PR_Lock(livePools_lock);
+    for (pp = &livePools; *pp && (*pp)->realm != realm; pp = &(*pp)->next)
+      ;
+    if ((pool = *pp))
+      *pp = pool->next;
+    PR_Unlock(livePools_lock);
+
+    if (pool && pool_shutdown(cx, pool))
+      JS_RemoveObjectRoot(cx, &pool->obj);
+  } while (pool);
+}
+
+/** Initializes thread.Pool and thread.Future */
+JSObject *Pool_InitClass(JSContext *cx, JSObject *obj)
+{
+  /** Description of the Pool class: */
+  static JSClass pool_class =
+  {
+    GPSEE_CLASS_NAME(Pool),		/**< its name is Pool */
+    JSCLASS_HAS_PRIVATE |		/**< private slot in use */
+    JSCLASS_HAS_RESERVED_SLOTS(1),	/**< slot 0 of Pool.prototype holds Future.prototype */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Pool_Finalize,			/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  /** Description of the Future class: */
+  static JSClass future_class =
+  {
+    GPSEE_CLASS_NAME(Future),		/**< its name is Future */
+    JSCLASS_HAS_PRIVATE |		/**< private slot in use */
+    JSCLASS_HAS_RESERVED_SLOTS(future_slots),	/**< function, arguments and result */
+    JS_PropertyStub,  			/**< addProperty stub */
+    JS_PropertyStub,  			/**< deleteProperty stub */
+    JS_PropertyStub,			/**< getProperty stub */
+    JS_PropertyStub, 			/**< setProperty stub */
+    JS_EnumerateStub, 			/**< enumerateProperty stub */
+    JS_ResolveStub,   			/**< resolveProperty stub */
+    JS_ConvertStub,   			/**< convertProperty stub */
+    Future_Finalize,			/**< it has a custom finalizer */
+
+    JSCLASS_NO_OPTIONAL_MEMBERS
+  };
+
+  static JSPropertySpec pool_props[] =
+  {
+    { "size",	 0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, pool_size_getter, NULL },
+    { "pending", 0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, pool_pending_getter, NULL },
+    { "cpuTime", 0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, pool_cpuTime_getter, NULL },
+    { "onWorker", 0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, pool_onWorker_getter, NULL },
+    { NULL, 0, 0, NULL, NULL }
+  };
+
+  static JSFunctionSpec pool_methods[] =
+  {
+    JS_FN("submit",		Pool_submit,			2, 0),
+    JS_FN("shutdown",		Pool_shutdown,			0, 0),
+    JS_FS_END
+  };
+
+  static JSPropertySpec future_props[] =
+  {
+    { "done",	0, JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_SHARED | JSPROP_READONLY, future_done_getter, NULL },
+    { NULL, 0, 0, NULL, NULL }
+  };
+
+  static JSFunctionSpec future_methods[] =
+  {
+    JS_FN("wait",		Future_wait,			0, 0),
+    JS_FS_END
+  };
+
+  JSObject	*proto;
+  JSObject	*futureProto;
+
+  if (PR_CallOnce(&workerIndexOnce, pool_newWorkerIndex) != PR_SUCCESS)
+  {
+    gpsee_throw(cx, CLASS_ID ".init.threadPrivate: Could not allocate a thread-private index");
+    return NULL;
+  }
+
+  if (!livePools_lock)
+  {
+    PRLock *lock = PR_NewLock();
+
+    if (!lock)
+    {
+      JS_ReportOutOfMemory(cx);
+      return NULL;
+    }
+
+    if (jsval_CompareAndSwap((jsval *)&livePools_lock, (jsval)NULL, (jsval)lock) != JS_TRUE)
+      PR_DestroyLock(lock);	/* Lost the race with another realm */
+  }
+
+  futureProto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &future_class,	/* clasp - Class struct to init. Defs class for use by other API funs */
+		   Future,		/* constructor function - Scope matches obj */
+		   0,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   future_props,	/* ps - props struct for parent_proto */
+		   future_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+  if (!futureProto)
+    return NULL;
+
+  proto =
+      JS_InitClass(cx, 			/* JS context from which to derive runtime information */
+		   obj, 		/* Object to use for initializing class (constructor arg?) */
+		   NULL, 		/* parent_proto - Prototype object for the class */
+ 		   &pool_class,		/* clasp - Class struct to init. Defs class for use by other API funs */
+		   Pool,		/* constructor function - Scope matches obj */
+		   1,			/* nargs - Number of arguments for constructor (can be MAXARGS) */
+		   pool_props,		/* ps - props struct for parent_proto */
+		   pool_methods, 	/* fs - functions struct for parent_proto (normal "this" methods) */
+		   NULL,		/* static_ps - props struct for constructor */
+		   NULL); 		/* static_fs - funcs struct for constructor (methods like Math.Abs()) */
+  if (!proto)
+    return NULL;
+
+  if (!JS_SetReservedSlot(cx, proto, 0, OBJECT_TO_JSVAL(futureProto)))
+    return NULL;
+
+  pool_clasp = &pool_class;
+  future_clasp = &future_class;
+
+  return proto;
+}
@@ -0,0 +1,382 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	placement.c	CPU affinity, NUMA node preference and per-thread CPU time
+ *				for Thread and Pool threads.
+ *
+ *  A placement is parsed from a JS options object on the thread which starts the new
+ *  thread, so that bad CPU or node numbers are thrown where they were written. It is
+ *  applied by the new thread to itself before it runs any JavaScript, because NSPR
+ *  does not give us the pthread_t of a thread we created.
+ *
+ *  Affinity and NUMA preference need HAVE_SCHED_SETAFFINITY (Linux). CPU time for the
+ *  calling thread needs CLOCK_THREAD_CPUTIME_ID; CPU time for other threads also needs
+ *  HAVE_PTHREAD_GETCPUCLOCKID. Where they are missing, asking for a placement throws and
+ *  CPU times read as undefined.
+ */
+
+#include "thread.h"
+#include <errno.h>
+#include <unistd.h>
+#if defined(HAVE_SCHED_SETAFFINITY)
+# include <sched.h>
+# include <sys/syscall.h>
+#endif
+
+#define NODE_SYSFS_PATH		"/sys/devices/system/node/node%i"
+#define MPOL_PREFERRED_MODE	1	/**< MPOL_PREFERRED from <linux/mempolicy.h>, which is not always installed */
+
+/** Convert a timespec to seconds */
+#define TIMESPEC_SECONDS(ts)	((jsdouble)(ts).tv_sec + (jsdouble)(ts).tv_nsec / 1e9)
+
+/** Add one CPU number to a placement. 
+ *  @returns	NULL on success, or a message to throw
+ */
+static const char *placement_addCpu(thread_placement_t *placement, int cpu, long nConfigured)
+{
+  if (cpu < 0 || cpu >= THREAD_MAX_CPUS || (nConfigured > 0 && cpu >= nConfigured))
+    return ".cpus.range: No such CPU";
+
+  if (!THREAD_CPU_ISSET(placement, cpu))
+  {
+    THREAD_CPU_SET(placement, cpu);
+    placement->nCpus++;
+  }
+
+  return NULL;
+}
+
+/**
+ *  Fill in a placement from the cpus and numaNode properties of a JS options object.
+ *
+ *  cpus is a CPU number or an array of them; numaNode is a node number. Either may be
+ *  left out, as may options itself (undefined or null), which leaves the placement empty.
+ *
+ *  @param	cx		JavaScript context
+ *  @param	options		Options object passed to the JS method
+ *  @param	placement	[out] Where the thread should run
+ *  @param	throwLabel	Prefix for exceptions, e.g. MODULE_ID ".Thread.start"
+ *
+ *  @returns	JS_TRUE on success, or JS_FALSE with an exception pending
+ */
+JSBool thread_getPlacement(JSContext *cx, jsval options, thread_placement_t *placement, const char *throwLabel)
+{
+  JSObject	*obj;
+  jsval		v;
+  int32		n;
+  long		nConfigured = sysconf(_SC_NPROCESSORS_CONF);
+  const char	*e = NULL;
+
+  memset(placement, 0, sizeof(*placement));
+  placement->numaNode = -1;
+
+  if (JSVAL_IS_VOID(options) || JSVAL_IS_NULL(options))
+    return JS_TRUE;
+
+  if (!JSVAL_IS_OBJECT(options))
+    return gpsee_throw(cx, "%s.options.typeof: options must be an object", throwLabel);
+  obj = JSVAL_TO_OBJECT(options);
+
+  if (!JS_GetProperty(cx, obj, "cpus", &v))
+    return JS_FALSE;
+
+  if (JSVAL_IS_OBJECT(v) && !JSVAL_IS_NULL(v) && JS_IsArrayObject(cx, JSVAL_TO_OBJECT(v)))
+  {
+    JSObject	*cpus = JSVAL_TO_OBJECT(v);
+    jsuint	length, i;
+
+    if (!JS_GetArrayLength(cx, cpus, &length))
+      return JS_FALSE;
+
+    for (i = 0; i < length && !e; i++)
+    {
+      if (!JS_GetElement(cx, cpus, i, &v) || !JS_ValueToECMAInt32(cx, v, &n))
+	return JS_FALSE;
+      e = placement_addCpu(placement, n, nConfigured);
+    }
+
+    if (!e && !placement->nCpus)
+      e = ".cpus.empty: No CPUs listed";
+  }
+  else if (!JSVAL_IS_VOID(v))
+  {
+    if (!JS_ValueToECMAInt32(cx, v, &n))
+      return JS_FALSE;
+    e = placement_addCpu(placement, n, nConfigured);
+  }
+
+  if (e)
+    return gpsee_throw(cx, "%s%s", throwLabel, e);
+
+  if (!JS_GetProperty(cx, obj, "numaNode", &v))
+    return JS_FALSE;
+
+  if (!JSVAL_IS_VOID(v))
+  {
+    char	path[sizeof(NODE_SYSFS_PATH) + 16];
+
+    if (!JS_ValueToECMAInt32(cx, v, &n))
+      return JS_FALSE;
+
+    snprintf(path, sizeof(path), NODE_SYSFS_PATH, (int)n);
+    if (n < 0 || n >= THREAD_MAX_NUMA_NODES || access(path, F_OK) != 0)
+      return gpsee_throw(cx, "%s.numaNode.range: No such NUMA node (%i)", throwLabel, (int)n);
+
+    placement->numaNode = n;
+  }
+
+#if !defined(HAVE_SCHED_SETAFFINITY)
+  if (placement->nCpus || placement->numaNode >= 0)
+    return gpsee_throw(cx, "%s.placement.unsupported: CPU affinity is not supported on this platform", throwLabel);
+#endif
+
+  return JS_TRUE;
+}
+
+/**
+ *  Narrow a placement to the n'th of its CPUs, wrapping around, so that a pool can give
+ *  each worker its own CPU from a shared list. An empty placement is copied as-is.
+ */
+void thread_nthPlacement(const thread_placement_t *all, size_t n, thread_placement_t *one)
+{
+  int	cpu;
+
+  *one = *all;
+  if (!all->nCpus)
+    return;
+
+  n %= all->nCpus;
+  for (cpu = 0; cpu < THREAD_MAX_CPUS; cpu++)
+  {
+    if (THREAD_CPU_ISSET(all, cpu) && n-- == 0)
+      break;
+  }
+
+  memset(one->cpuMask, 0, sizeof(one->cpuMask));
+  one->nCpus = 0;
+  (void)placement_addCpu(one, cpu, 0);
+}
+
+#if defined(HAVE_SCHED_SETAFFINITY)
+/** Add the CPUs of a NUMA node, read from sysfs in the kernel's "0-3,8-11" list format, to set.
+ *  @returns	Number of CPUs added, or -1 when the list cannot be read
+ */
+static int placement_addNodeCpus(int node, cpu_set_t *set)
+{
+  char	path[sizeof(NODE_SYSFS_PATH "/cpulist") + 16];
+  FILE	*file;
+  int	first, last, count = 0;
+  int	c;
+
+  snprintf(path, sizeof(path), NODE_SYSFS_PATH "/cpulist", node);
+  file = fopen(path, "r");
+  if (!file)
+    return -1;
+
+  while (fscanf(file, "%i", &first) == 1)
+  {
+    last = first;
+    if ((c = fgetc(file)) == '-')
+    {
+      if (fscanf(file, "%i", &last) != 1)
+	break;
+      c = fgetc(file);
+    }
+
+    for (; first <= last && first < CPU_SETSIZE; first++, count++)
+      CPU_SET(first, set);
+
+    if (c != ',')
+      break;
+  }
+
+  fclose(file);
+  return count;
+}
+#endif
+
+/**
+ *  Apply a placement to the calling thread. CPUs listed explicitly take precedence over
+ *  the CPUs of the NUMA node; either way, memory is preferentially allocated from the node.
+ *
+ *  @returns	NULL on success, or a message describing what could not be done; errno
+ *		holds the reason. Failure is not fatal: the thread simply runs unplaced.
+ */
+const char *thread_applyPlacement(const thread_placement_t *placement)
+{
+#if defined(HAVE_SCHED_SETAFFINITY)
+  cpu_set_t	set;
+  int		cpu;
+
+  if (placement->numaNode >= 0)
+  {
+# if defined(SYS_set_mempolicy)
+    unsigned long	nodeMask[THREAD_MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+
+    memset(nodeMask, 0, sizeof(nodeMask));
+    nodeMask[placement->numaNode / (8 * sizeof(unsigned long))] |= 1UL << (placement->numaNode % (8 * sizeof(unsigned long)));
+
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, nodeMask, (unsigned long)THREAD_MAX_NUMA_NODES) != 0)
+      return "could not set preferred NUMA node";
+# endif
+  }
+
+  CPU_ZERO(&set);
+  if (placement->nCpus)
+  {
+    for (cpu = 0; cpu < THREAD_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+    {
+      if (THREAD_CPU_ISSET(placement, cpu))
+	CPU_SET(cpu, &set);
+    }
+  }
+  else if (placement->numaNode >= 0)
+  {
+    if (placement_addNodeCpus(placement->numaNode, &set) <= 0)
+      return "could not read NUMA node CPU list";
+  }
+  else
+    return NULL;
+
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)	/* pid 0 is the calling thread */
+    return "could not set CPU affinity";
+#endif
+
+  return NULL;
+}
+
+static PRCallOnceType	cpuClockOnce;
+static PRLock		*cpuClockLock;	/**< Held while reading another thread's clock, and while a thread stops its own */
+
+static PRStatus cpuClock_init(void)
+{
+  cpuClockLock = PR_NewLock();
+  return PR_SUCCESS;
+}
+
+/** Start accounting CPU time for the calling thread; must be called on that thread. */
+void thread_startCpuClock(thread_cpuClock_t *clock)
+{
+  clock->seconds = 0;
+  clock->state = cpuClock_none;
+
+  if (PR_CallOnce(&cpuClockOnce, cpuClock_init) != PR_SUCCESS || !cpuClockLock)
+    return;
+
+#if defined(HAVE_PTHREAD_GETCPUCLOCKID) && defined(CLOCK_THREAD_CPUTIME_ID)
+  PR_Lock(cpuClockLock);
+  if (pthread_getcpuclockid(pthread_self(), &clock->clockID) == 0)
+    clock->state = cpuClock_running;
+  PR_Unlock(cpuClockLock);
+#endif
+}
+
+/** Record the final CPU time of the calling thread, which is about to exit. Once this
+ *  returns, no other thread will read the clock ID, which dies with the thread.
+ */
+void thread_stopCpuClock(thread_cpuClock_t *clock)
+{
+  jsdouble	seconds;
+
+  if (clock->state != cpuClock_running)
+    return;
+
+  PR_Lock(cpuClockLock);
+  if (thread_currentCpuTime(&seconds))
+    clock->seconds = seconds;
+  clock->state = cpuClock_stopped;
+  PR_Unlock(cpuClockLock);
+}
+
+/**
+ *  Read the CPU time consumed by the thread behind clock.
+ *
+ *  The thread cannot get past thread_stopCpuClock() while we hold cpuClockLock, so a
+ *  clock which is running under the lock belongs to a live thread. Once stopped, we
+ *  use the time the thread recorded on its way out.
+ *
+ *  @returns	JS_TRUE when *seconds was set, JS_FALSE when CPU time is not available
+ */
+JSBool thread_readCpuClock(thread_cpuClock_t *clock, jsdouble *seconds)
+{
+  JSBool		ok = JS_FALSE;
+#if defined(HAVE_PTHREAD_GETCPUCLOCKID) && defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec	ts;
+#endif
+
+  if (!cpuClockLock)
+    return JS_FALSE;	/* No clock has ever been started */
+
+  PR_Lock(cpuClockLock);
+  switch(clock->state)
+  {
+#if defined(HAVE_PTHREAD_GETCPUCLOCKID) && defined(CLOCK_THREAD_CPUTIME_ID)
+    case cpuClock_running:
+      if (clock_gettime(clock->clockID, &ts) == 0)
+      {
+	*seconds = TIMESPEC_SECONDS(ts);
+	ok = JS_TRUE;
+      }
+      break;
+#endif
+    case cpuClock_stopped:
+      *seconds = clock->seconds;
+      ok = JS_TRUE;
+      break;
+    default:
+      break;
+  }
+  PR_Unlock(cpuClockLock);
+
+  return ok;
+}
+
+/** Read the CPU time consumed so far by the calling thread.
+ *  @returns	JS_TRUE when *seconds was set, JS_FALSE when CPU time is not available
+ */
+JSBool thread_currentCpuTime(jsdouble *seconds)
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec	ts;
+
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+  {
+    *seconds = TIMESPEC_SECONDS(ts);
+    return JS_TRUE;
+  }
+#endif
+
+  return JS_FALSE;
+}
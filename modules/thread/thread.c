@@ -48,6 +48,9 @@
  *  Trickiness:     Cannot free resources until the thread has joined AND the 
  *                  JS Thread object is out of scope.
  *
+ *  Short-lived work is better served by the Pool class (Pool.c), whose workers
+ *  keep their threads and contexts between tasks.
+ *
  *  Naming Convention: 	thread_ prefix:	mechanics of performing an operation, does not 
  *					throw exceptions, but may return exception text 
  *					for caller to throw.
@@ -65,14 +68,14 @@ static const char __attribute__((unused)) rcsid[]="$Id: thread.c,v 1.7 2011/12/0
 #define DEBUG 1	/* moz */
 #include <nspr.h>
 #include "gpsee.h"
+#include "thread.h"
+#include <errno.h>
 #if defined(SOLARIS)
 # include <sys/processor.h>
 #endif
 
-#define MODULE_ID GPSEE_GLOBAL_NAMESPACE_NAME	".module.ca.page.thread"
-
 #define THREAD_THREADID_MAX_SIZE	(sizeof(void *) * 2) + 1	/* ThreadID is a hex string of ptr addr */
-#define THREAD_JOINALL_MAX_SLEEP_TICKS 	PR_TicksPerSecond() * 5
+#define THREAD_JOINALL_MAX_WAIT_TICKS 	PR_TicksPerSecond() * 5
 #define THREAD_INTERLEAVE_SWEEPERS	0
 
 /* Immutable values, used to cheaply compare thread states. Assigned during thread_InitModule() */
@@ -112,6 +115,8 @@ typedef struct
   thread_protected_t		*protected;		/**< Protected data (private data in prototype) */
   PRThread			*thread;		/**< NSPR thread handle */
   const char			*threadID;		/**< Our threadID, used as a prop of Thread.threadList */
+  thread_placement_t		placement;		/**< CPUs / NUMA node the thread binds itself to */
+  thread_cpuClock_t		cpuClock;		/**< CPU time used by the thread */
 } thread_private_t;
 
 /** Reasonable Defaults for initalizing a thread handle */
@@ -132,6 +137,10 @@ struct thread_protected
 #if !defined(THREAD_INTERLEAVE_SWEEPERS) || (THREAD_INTERLEAVE_SWEEPERS == 0)
   jsval				sweepLock;		/**< Set to JS_TRUE when we're sweeping the thread list for dead threads */
 #endif
+  PRLock			*exitLock;		/**< Guards exitCV, exitGeneration and sweptGeneration */
+  PRCondVar			*exitCV;		/**< Broadcast when a thread finishes running or is joined */
+  PRUint32			exitGeneration;		/**< Incremented with each broadcast of exitCV */
+  PRUint32			sweptGeneration;	/**< exitGeneration when Thread_Sweep() last started walking the list */
 };
 
 /** @warning	Union relies on two structs and enum all having the same address
@@ -207,6 +216,52 @@ static const char *thread_removeFromList(JSContext *cx, thread_private_t *hnd)
   return NULL;
 }
 
+/** Tell joiners and sweepers that a thread has finished running, or has been joined.
+ *  Everything the thread wrote before this call is visible to whoever wakes up.
+ */
+static void thread_postExit(thread_protected_t *protected)
+{
+  PR_Lock(protected->exitLock);
+  protected->exitGeneration++;
+  PR_NotifyAllCondVar(protected->exitCV);
+  PR_Unlock(protected->exitLock);
+}
+
+/** Read the exit generation; a change means some thread has finished or been joined since. */
+static PRUint32 thread_exitGeneration(thread_protected_t *protected)
+{
+  PRUint32	generation;
+
+  PR_Lock(protected->exitLock);
+  generation = protected->exitGeneration;
+  PR_Unlock(protected->exitLock);
+
+  return generation;
+}
+
+/** True when some thread has finished or been joined since the last sweep began */
+static JSBool thread_sweepDue(thread_protected_t *protected)
+{
+  JSBool	due;
+
+  PR_Lock(protected->exitLock);
+  due = (protected->exitGeneration != protected->sweptGeneration) ? JS_TRUE : JS_FALSE;
+  PR_Unlock(protected->exitLock);
+
+  return due;
+}
+
+/** Note that a sweep is starting. Threads which finish after this call bump exitGeneration 
+ *  past what we record, so the next sweep will look for them; those which finished before 
+ *  it are visible to the sweep which is starting.
+ */
+static void thread_claimSweep(thread_protected_t *protected)
+{
+  PR_Lock(protected->exitLock);
+  protected->sweptGeneration = protected->exitGeneration;
+  PR_Unlock(protected->exitLock);
+}
+
 /** Actual mechanics for joining a thread.
  *  This routine blocks until the thread is joined or cannot be joined.
  *
@@ -267,6 +322,8 @@ static const char *thread_join(JSContext *cx, thread_private_t *hnd, jsval *rval
   else
     GPSEE_NOT_REACHED("impossible");
 
+  thread_postExit(hnd->protected);
+
   return NULL;
 }
 
@@ -280,12 +337,22 @@ static void thread_run(void *vthread_argv)
   thread_private_t	*hnd = thread_argv[0];
   JSContext		*cx  = thread_argv[1];
   JSObject		*obj = thread_argv[2];
+  const char		*e;
+  JSBool		ok;
 
   JS_SetContextThread(cx);
   JS_BeginRequest(cx);		/* Context for thread, not calling context which is already in a request */
 
   JS_free(cx, thread_argv);
-  if (JS_CallFunctionName(cx, obj, "run", 0, NULL, &hnd->rval) == JS_TRUE)
+
+  if ((e = thread_applyPlacement(&hnd->placement)))
+    gpsee_log(cx, GLOG_WARNING, MODULE_ID ".run.placement: %s (%s)", e, strerror(errno));
+  thread_startCpuClock(&hnd->cpuClock);
+
+  ok = JS_CallFunctionName(cx, obj, "run", 0, NULL, &hnd->rval);
+  thread_stopCpuClock(&hnd->cpuClock);	/* Before termination, so joiners see the final time */
+
+  if (ok == JS_TRUE)
     hnd->termination = th_term_normal;
   else
   {
@@ -300,8 +367,9 @@ static void thread_run(void *vthread_argv)
     }
   }
 
-/* xxx JS_EndRequest(cx); cx cb needs */
-  JS_DestroyContext(cx);
+  gpsee_destroyContext(cx);	/* Usually parks cx on the realm's free list for the next thread */
+
+  thread_postExit(hnd->protected);
 
   return; /* The NSPR (OS) thread is now dead */
 }
@@ -332,9 +400,9 @@ static JSBool thread_yield(JSContext *cx)
  *  stalling the GC. This is very bad.
  *
  *  This routine will not attempt to join threads which are in "joining" state.
- *  These are considered to be unjoinable. But if we find some, we'll yield
- *  and try again, until they eventually go away. We use an exponential
- *  back off algorithm to determine yield time.
+ *  These are considered to be unjoinable. But if we find some, we wait on
+ *  protected->exitCV, which is broadcast as soon as any thread finishes or
+ *  is joined, and try again until they eventually go away.
  * 
  *  @note This routine is called automatically (from thread_FiniModule()) when
  * 	  used with the  gpsee.c startup/shutdown sequence.
@@ -348,7 +416,8 @@ static const char *thread_joinAll(JSContext *cx, JSObject *proto)
 {
   JSIdArray		*ida;
   thread_private_t	*hnd;
-  PRIntervalTime	ticks = 1;
+  PRUint32		generation;
+  jsrefcount		depth;
   const char		*e;
   int			foundJoiningState;
   int			i;
@@ -362,6 +431,7 @@ static const char *thread_joinAll(JSContext *cx, JSObject *proto)
   {
     JS_ResumeRequest(cx, JS_SuspendRequest(cx)); /* encourage the GC to interrupt us */
 
+    generation = thread_exitGeneration(protected);
     ida = JS_Enumerate(cx, protected->threadList);
 
     foundJoiningState = 0;
@@ -381,29 +451,24 @@ static const char *thread_joinAll(JSContext *cx, JSObject *proto)
       if (!(hnd = JS_GetInstancePrivate(cx, threadObj, clasp, NULL)))
 	continue;
 
-      if ((e = thread_join(cx, hnd, NULL)))
-      {
-	jsrefcount depth;
-
-	if (hnd->state == thState_joining)
-	  foundJoiningState = 1;
-
-	depth = JS_SuspendRequest(cx);
-
-	/* XXX Not really happy with this. Maybe some kind of
-	 * conditional would be a little kinder. -wg
-	 */
-
-	PR_Sleep(ticks);
-	ticks *= 2;
-	if (ticks > THREAD_JOINALL_MAX_SLEEP_TICKS)
-	  ticks = THREAD_JOINALL_MAX_SLEEP_TICKS;
-
-	JS_ResumeRequest(cx, ticks);
-      }
+      if ((e = thread_join(cx, hnd, NULL)) && (hnd->state == thState_joining))
+	foundJoiningState = 1;
     }
 
     JS_DestroyIdArray(cx, ida);
+
+    if (foundJoiningState)
+    {
+      /* Someone else is joining; wait for them (or any other thread) to finish. The
+       * timeout only guards against a lost wakeup - the list is rescanned either way.
+       */
+      depth = JS_SuspendRequest(cx);
+      PR_Lock(protected->exitLock);
+      if (protected->exitGeneration == generation)
+	PR_WaitCondVar(protected->exitCV, THREAD_JOINALL_MAX_WAIT_TICKS);
+      PR_Unlock(protected->exitLock);
+      JS_ResumeRequest(cx, depth);
+    }
   } while(foundJoiningState);
   
   return NULL;
@@ -413,6 +478,14 @@ static const char *thread_joinAll(JSContext *cx, JSObject *proto)
  *  Sweep through the thread list, looking for threads which 
  *  have terminated but not joined.
  *
+ *  Threads bump protected->exitGeneration as they finish, so when it 
+ *  has not changed since the last sweep there is nothing to do and we
+ *  return without walking the list. The sweep is only claimed, by 
+ *  recording the generation, once we are sure to walk the list: a sweeper
+ *  which loses the race for sweepLock leaves the generation for the next 
+ *  one, rather than marking threads swept which the winner may have 
+ *  already passed.
+ *
  *  @note This routine is safe to interleave and must be tested
  *        in interleaved mode to help find races. However, 
  *	  running it in interleaved mode has an adverse affect
@@ -432,11 +505,16 @@ JSBool Thread_Sweep(JSContext *cx, JSObject *proto)
   JSObject		*threadObj;
   JSObject		*owner;
 
+  if (!thread_sweepDue(protected))
+    return JS_TRUE; /* No thread has finished since the last sweep */
+
 #if !defined(THREAD_INTERLEAVE_SWEEPERS) || (THREAD_INTERLEAVE_SWEEPERS == 0)
   if (jsval_CompareAndSwap(&protected->sweepLock, JSVAL_FALSE, JSVAL_TRUE) != JS_TRUE)
     return JS_TRUE; /* Another lwp doing this already */
 #endif
 
+  thread_claimSweep(protected);
+
   threadObj = NULL;
 
   JS_AddNamedObjectRoot(cx, &threadObj, "ThreadSweep_threadObj");
@@ -511,7 +589,10 @@ JSBool thread_FiniModule(JSContext *cx, gpsee_realm_t *realm, JSObject *moduleOb
 
   if (force)
   {
+    Pool_FiniClass(cx, realm);
     (void)thread_joinAll(cx, proto);
+    PR_DestroyCondVar(protected->exitCV);
+    PR_DestroyLock(protected->exitLock);
     JS_free(cx, protected);
     JS_SetPrivate(cx, proto, NULL);
     return JS_TRUE;
@@ -623,15 +704,19 @@ static JSBool Thread(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsva
 }  
 
 /** 
- *  Implements Thread.prototype.start(). 
+ *  Implements Thread.prototype.start([options]). 
  *  Launches an NSPR thread for which a Thread object has been constructed,
  *  and then calls thread_run() to execute JS code in this thread. 
+ *
+ *  options.cpus (a CPU number or array of them) and options.numaNode (a node number)
+ *  bind the new thread before it runs any JavaScript; see placement.c.
  */
 static JSBool th_start(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
 {
   jsrefcount		depth;
   thread_private_t	*hnd = JS_GetPrivate(cx, obj);
   extern cfgHnd         cfg;
+  gpsee_realm_t		*realm;
   JSContext		*new_cx;
   void			**thread_argv;
   const char		*e;
@@ -643,19 +728,28 @@ static JSBool th_start(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, js
   
   CHECK_OBJECT_PRIVATE(start);
 
-  if (argc)
+  if (argc > 1)
     return gpsee_throw(cx, MODULE_ID ".start.arguments.count: Too many arguments (%i) specified", argc);
 
+  if (hnd->state == thState_new && !thread_getPlacement(cx, argc ? argv[0] : JSVAL_VOID, &hnd->placement, MODULE_ID ".start"))
+    return JS_FALSE;
+
   if (jsval_CompareAndSwap(&hnd->state, thState_new, thState_runnable) != JS_TRUE)
     return gpsee_throw(cx, MODULE_ID ".start.state: Cannot start thread - invalid state!");
 
   if ((e = thread_addToList(cx, obj, hnd)))
     return gpsee_throw(cx, "%s", e);
 
-  /* Create a new context for the new thread to use. Context will never 
-   * be used by any other thread, and thread itself will clean it up.
+  /* Get a context for the new thread to use, reusing one from the realm when we can. 
+   * Context will never be used by any other thread while this one runs, and the 
+   * thread itself will give it back. Only contexts of the usual stack chunk size
+   * are reused; gpsee_thread_stack_chunk_size may ask for another.
    */
-  new_cx = JS_NewContext(JS_GetRuntime(cx),atoi(
+  realm = gpsee_getRealm(cx);
+  if (!realm)
+    return JS_FALSE;
+
+  new_cx = gpsee_createContextWithStackChunkSize(realm, atoi(
       cfg_default_value(cfg, "gpsee_thread_stack_chunk_size", 
 		       cfg_default_value(cfg, "gpsee_stack_chunk_size", "8192"))));
   if (!new_cx)
@@ -663,10 +757,12 @@ static JSBool th_start(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, js
 
   JS_SetOptions(new_cx, JS_GetOptions(cx));
 
-  depth = JS_SuspendRequest(cx);
-
+  /* Context was created in a request on our thread; hand it to the new thread */
+  JS_EndRequest(new_cx);
   JS_ClearContextThread(new_cx);
 
+  depth = JS_SuspendRequest(cx);
+
   thread_argv = JS_malloc(cx, sizeof(*thread_argv) * 3);
   thread_argv[0] = (void *)hnd;
   thread_argv[1] = (void *)new_cx;
@@ -684,8 +780,10 @@ static JSBool th_start(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, js
     {
       hnd->termination = th_term_abnormal;
       JS_free(cx, thread_argv);
-      JS_DestroyContext(new_cx);
       JS_ResumeRequest(cx, depth);
+      JS_SetContextThread(new_cx);
+      JS_BeginRequest(new_cx);
+      gpsee_destroyContext(new_cx);
 
       if ((e = thread_removeFromList(cx, hnd)))
 	return gpsee_throw(cx, "%s", e);
@@ -745,6 +843,23 @@ static JSBool th_getcpuid(JSContext *cx, JSObject *obj, uintN argc, jsval *argv,
 }
 #endif
 
+/** 
+ *  Implements Thread.currentCpuTime(). Returns the CPU seconds used so far by the 
+ *  calling thread, or undefined when the platform cannot tell us.
+ */
+static JSBool th_currentCpuTime(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  jsdouble	seconds;
+
+  if (!thread_currentCpuTime(&seconds))
+  {
+    *rval = JSVAL_VOID;
+    return JS_TRUE;
+  }
+
+  return JS_NewNumberValue(cx, seconds, rval);
+}
+
 /** 
  *  Implements Thread.sleep().
  *  Blocks until argv[0] seconds have passed. argv[0] is parsed like a float.
@@ -858,6 +973,26 @@ static JSBool th_state_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
   return JS_TRUE;
 }
 
+/**
+ *  Implements Thread.prototype.cpuTime getter. Returns the CPU seconds used by the thread
+ *  so far, or undefined before it starts or when the platform cannot tell us.
+ */
+static JSBool th_cpuTime_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
+{
+  thread_private_t	*hnd = JS_GetPrivate(cx, obj);
+  jsdouble		seconds;
+
+  CHECK_OBJECT_PRIVATE(cpuTime_getter);
+
+  if (!thread_readCpuClock(&hnd->cpuClock, &seconds))
+  {
+    *vp = JSVAL_VOID;
+    return JS_TRUE;
+  }
+
+  return JS_NewNumberValue(cx, seconds, vp);
+}
+
 /** 
  * Get a JS Thread ID. Resprentation subject to change over time.
  * @note ThreadIDs may be reused from time to time!
@@ -962,6 +1097,7 @@ const char *thread_InitModule(JSContext *cx, JSObject *moduleObject)
 #endif
     { "yield",			th_yield,			0, 0, 0 },
     { "exit",			th_exit,			0, 0, 0 },
+    { "currentCpuTime",		th_currentCpuTime,		0, 0, 0 },
     { NULL,			NULL,				0, 0, 0 }
   };
 
@@ -970,6 +1106,7 @@ const char *thread_InitModule(JSContext *cx, JSObject *moduleObject)
   {
     { "state", 0,    	JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_READONLY,	th_state_getter,  	JS_PropertyStub },
     { "threadID", 0, 	JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_READONLY,	th_threadID_getter,	JS_PropertyStub },
+    { "cpuTime", 0, 	JSPROP_ENUMERATE | JSPROP_PERMANENT | JSPROP_READONLY,	th_cpuTime_getter,	JS_PropertyStub },
     { NULL, 0, 0, NULL, NULL }
   };
 
@@ -1014,6 +1151,10 @@ const char *thread_InitModule(JSContext *cx, JSObject *moduleObject)
 #if !defined(THREAD_INTERLEAVE_SWEEPERS) || (THREAD_INTERLEAVE_SWEEPERS == 0)
   protected->sweepLock	= JSVAL_FALSE;
 #endif
+  protected->exitLock	= PR_NewLock();
+  protected->exitCV	= protected->exitLock ? PR_NewCondVar(protected->exitLock) : NULL;
+  if (!protected->exitCV)
+    goto errout;
 
   /* Defining threadList on ctor serves two purposes:
    *  - provide a GC root for protected->threadList
@@ -1046,6 +1187,12 @@ const char *thread_InitModule(JSContext *cx, JSObject *moduleObject)
     thState_dead	= STRING_TO_JSVAL(JS_InternString(cx, "dead"));
   }
 
+  if (Pool_InitClass(cx, moduleObject) == NULL)
+    goto errout;
+
+  if (Channel_InitClass(cx, moduleObject) == NULL)
+    goto errout;
+
   /* These should be tunables */
   gpsee_addAsyncCallback(cx, Thread_SweepBCB, proto);
   gpsee_addAsyncCallback(cx, Thread_YieldBCB, NULL);
@@ -1057,7 +1204,13 @@ const char *thread_InitModule(JSContext *cx, JSObject *moduleObject)
 
   errout: 
   if (protected)
-    free(protected);
+  {
+    if (protected->exitCV)
+      PR_DestroyCondVar(protected->exitCV);
+    if (protected->exitLock)
+      PR_DestroyLock(protected->exitLock);
+    JS_free(cx, protected);
+  }
 
   return NULL;
 }
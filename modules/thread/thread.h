@@ -0,0 +1,93 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are 
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s): 
+ * 
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+/**
+ *  @file	thread.h	Symbols shared between classes in the thread module.
+ */
+
+#ifndef GPSEE_THREAD_MODULE_H
+#define GPSEE_THREAD_MODULE_H
+#include <nspr.h>
+#include "gpsee.h"
+#include <time.h>
+#if defined(HAVE_PTHREAD_GETCPUCLOCKID)
+# include <pthread.h>
+#endif
+
+#define MODULE_ID GPSEE_GLOBAL_NAMESPACE_NAME	".module.ca.page.thread"
+
+#define THREAD_MAX_CPUS			1024
+#define THREAD_MAX_NUMA_NODES		256
+#define THREAD_CPU_WORD_BITS		(8 * sizeof(unsigned long))
+#define THREAD_CPU_SET(p, cpu)		((p)->cpuMask[(cpu) / THREAD_CPU_WORD_BITS] |= 1UL << ((cpu) % THREAD_CPU_WORD_BITS))
+#define THREAD_CPU_ISSET(p, cpu)	(((p)->cpuMask[(cpu) / THREAD_CPU_WORD_BITS] >> ((cpu) % THREAD_CPU_WORD_BITS)) & 1)
+
+/** Where a thread should run; see placement.c */
+typedef struct
+{
+  unsigned long			cpuMask[THREAD_MAX_CPUS / THREAD_CPU_WORD_BITS];	/**< CPUs the thread may run on */
+  int				nCpus;			/**< Number of bits set in cpuMask; 0 for no CPU affinity */
+  int				numaNode;		/**< Preferred NUMA node, or -1 */
+} thread_placement_t;
+
+enum
+{
+  cpuClock_none = 0,					/**< Thread has not started, or CPU time is unsupported */
+  cpuClock_running,					/**< clockID is live */
+  cpuClock_stopped					/**< Thread has exited; seconds is final */
+};
+
+/** CPU time accounting for a thread other than the caller; see placement.c */
+typedef struct
+{
+  PRInt32			state;			/**< cpuClock_none | running | stopped; guarded by placement.c's cpuClockLock */
+  jsdouble			seconds;		/**< CPU time when the clock was stopped */
+#if defined(HAVE_PTHREAD_GETCPUCLOCKID)
+  clockid_t			clockID;		/**< Thread CPU clock, while running */
+#endif
+} thread_cpuClock_t;
+
+JSBool thread_getPlacement(JSContext *cx, jsval options, thread_placement_t *placement, const char *throwLabel);
+void thread_nthPlacement(const thread_placement_t *all, size_t n, thread_placement_t *one);
+const char *thread_applyPlacement(const thread_placement_t *placement);
+void thread_startCpuClock(thread_cpuClock_t *clock);
+void thread_stopCpuClock(thread_cpuClock_t *clock);
+JSBool thread_readCpuClock(thread_cpuClock_t *clock, jsdouble *seconds);
+JSBool thread_currentCpuTime(jsdouble *seconds);
+
+JSObject *Pool_InitClass(JSContext *cx, JSObject *obj);
+void Pool_FiniClass(JSContext *cx, gpsee_realm_t *realm);
+JSObject *Channel_InitClass(JSContext *cx, JSObject *obj);
+
+#endif/*GPSEE_THREAD_MODULE_H*/
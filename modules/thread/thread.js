@@ -0,0 +1,268 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Initial Developer of the Original Code is PageMail, Inc.
+ *
+ * Portions created by the Initial Developer are 
+ * Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+ *
+ * Contributor(s):
+ * 
+ * Alternatively, the contents of this file may be used under the terms of
+ * either of the GNU General Public License Version 2 or later (the "GPL"),
+ * or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** 
+ */
+
+/**
+ *  @file	thread.js	JavaScript portions of the GPSEE thread module: parallelMap()
+ *				and parallelReduce(), built on thread.Pool and thread.Channel.
+ */
+
+var defaultPool;	/* Pool shared by every call which does not pass options.pool */
+
+/** Pick the pool for a call; the default pool is started on first use, with one worker per CPU */
+function getPool(options)
+{
+  if (options && options.pool)
+    return options.pool;
+
+  if (!defaultPool)
+    defaultPool = new exports.Pool();
+
+  return defaultPool;
+}
+
+/** Read element i of a chunk, which is either an array or a ByteString */
+function element(data, i)
+{
+  return (data instanceof Array) ? data[i] : data.get(i);
+}
+
+/** 
+ *  Cut input into chunks of about options.chunk elements. Arrays are sliced, so each chunk
+ *  is copied when it is sent to a worker. ByteArrays are copied once into a ByteString, whose
+ *  slices share its bytes and are sent to workers without further copying.
+ */
+function split(input, nThreads, options)
+{
+  var chunks = [];
+  var length = input.length;
+  var size = (options && options.chunk) ? Math.floor(options.chunk) : Math.ceil(length / (nThreads * 4));
+  var start;
+
+  if (!(size >= 1))
+    size = 1;
+
+  if (!(input instanceof Array))
+  {
+    if (typeof input.toByteString !== "function")
+      throw new TypeError("thread: input must be an Array, ByteArray or ByteString");
+    input = input.toByteString();
+  }
+
+  for (start = 0; start < length; start += size)
+    chunks.push([chunks.length, start, input.slice(start, start + size)]);
+
+  return chunks;
+}
+
+/** Map fn over one chunk; runs on whichever thread drained the chunk */
+function mapChunk(fn, start, data)
+{
+  var out = new Array(data.length);
+  var i;
+
+  for (i = 0; i < data.length; i++)
+    out[i] = fn(element(data, i), start + i);
+
+  return out;
+}
+
+/** Reduce one chunk with fn, starting from its first element */
+function reduceChunk(fn, start, data)
+{
+  var acc = element(data, 0);
+  var i;
+
+  for (i = 1; i < data.length; i++)
+    acc = fn(acc, element(data, i), start + i);
+
+  return acc;
+}
+
+/** 
+ *  Pull chunks off input until it is empty, sending [index, work(fn, start, data)] to output
+ *  for each. Runs on the pool workers and on the calling thread. When work throws, the 
+ *  chunks left in input are discarded so that the other drainers stop early.
+ *
+ *  work is one of the module-level functions above, rather than a closure, so that the
+ *  only objects the workers share with the caller are fn and the two Channels, whose
+ *  state lives behind their own locks.
+ */
+function drain(work, fn, input, output)
+{
+  var msg;
+
+  try
+  {
+    while ((msg = input.tryReceive(null)) !== null)
+      output.send([msg[0], work(fn, msg[1], msg[2])]);
+  }
+  catch(e)
+  {
+    while (input.tryReceive(null) !== null);
+    throw e;
+  }
+}
+
+/** 
+ *  Run work over each chunk of input on the pool, plus the calling thread, and return the 
+ *  per-chunk results in input order. Every drainer has finished before this returns or throws.
+ *
+ *  When the calling thread is itself one of the pool's workers -- parallelMap() called from
+ *  inside parallelMap() -- every chunk runs on the calling thread. Queueing drainers there
+ *  could deadlock the pool, with every worker waiting on tasks which no worker is free to run.
+ */
+function runChunks(input, work, fn, options)
+{
+  var pool = getPool(options);
+  var nested = pool.onWorker;
+  var chunks = split(input, nested ? 1 : pool.size + 1, options);
+  var nWorkers = nested ? 0 : Math.min(pool.size, chunks.length - 1);
+  var queue = new exports.Channel();
+  var output = new exports.Channel();
+  var results = new Array(chunks.length);
+  var futures = [];
+  var failed = false;
+  var error, msg, i;
+
+  for (i = 0; i < chunks.length; i++)
+    queue.send(chunks[i]);
+  queue.close();
+
+  for (i = 0; i < nWorkers; i++)
+    futures.push(pool.submit(drain, [work, fn, queue, output]));
+
+  try
+  {
+    drain(work, fn, queue, output);
+  }
+  catch(e)
+  {
+    failed = true;
+    error = e;
+  }
+
+  for (i = 0; i < futures.length; i++)
+  {
+    try
+    {
+      futures[i].wait();
+    }
+    catch(e)
+    {
+      if (!failed)
+      {
+	failed = true;
+	error = e;
+      }
+    }
+  }
+
+  if (failed)
+    throw error;
+
+  for (i = 0; i < chunks.length; i++)
+  {
+    msg = output.receive();
+    results[msg[0]] = msg[1];
+  }
+
+  return results;
+}
+
+/** thread.parallelMap(input, fn, [options])
+ *  @name	thread.parallelMap
+ *  @function
+ *  @public
+ *
+ *  Returns a new array holding fn(input[n], n) for every element of input, which may be an
+ *  Array, ByteArray or ByteString. The work is split into chunks which run on a thread.Pool
+ *  and on the calling thread; results come back in input order. Elements and results travel
+ *  through thread.Channel, so they must be values a Channel can send. When called from one
+ *  of the pool's own workers, every chunk runs on the calling thread.
+ *
+ *  options.chunk	Elements per chunk; defaults to a quarter of an even share per thread
+ *  options.pool	thread.Pool to use; defaults to a shared pool with one worker per CPU
+ */
+exports.parallelMap = function parallelMap(input, fn, options)
+{
+  var chunks, result, i, j;
+
+  if (typeof fn !== "function")
+    throw new TypeError("thread.parallelMap: fn is not a function");
+
+  chunks = runChunks(input, mapChunk, fn, options);
+
+  result = [];
+  for (i = 0; i < chunks.length; i++)
+    for (j = 0; j < chunks[i].length; j++)
+      result.push(chunks[i][j]);
+
+  return result;
+}
+
+/** thread.parallelReduce(input, fn, [initial], [options])
+ *  @name	thread.parallelReduce
+ *  @function
+ *  @public
+ *
+ *  Reduces input, which may be an Array, ByteArray or ByteString, with fn(accumulator, value, n).
+ *  Each chunk is reduced on its own thread and the partial results are then reduced in input
+ *  order on the calling thread, starting from initial unless it is undefined; n is not passed
+ *  when combining partial results. fn must therefore be associative, and the partial results
+ *  must be values a Channel can send. Options are as for thread.parallelMap().
+ */
+exports.parallelReduce = function parallelReduce(input, fn, initial, options)
+{
+  var haveInitial = (initial !== undefined);
+  var partials, acc, i;
+
+  if (typeof fn !== "function")
+    throw new TypeError("thread.parallelReduce: fn is not a function");
+
+  partials = runChunks(input, reduceChunk, fn, options);
+
+  if (!partials.length)
+  {
+    if (!haveInitial)
+      throw new TypeError("thread.parallelReduce: empty input with no initial value");
+    return initial;
+  }
+
+  acc = haveInitial ? fn(initial, partials[0]) : partials[0];
+  for (i = 1; i < partials.length; i++)
+    acc = fn(acc, partials[i]);
+
+  return acc;
+}
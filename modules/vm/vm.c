@@ -419,6 +419,92 @@ static JSBool vm_isCompilableUnit(JSContext *cx, JSObject *obj, uintN argc, jsva
   return JS_TRUE;
 }
 
+/** Define a numeric, enumerable property on obj */
+static JSBool vm_defineNumber(JSContext *cx, JSObject *obj, const char *name, jsdouble d)
+{
+  jsval v;
+
+  if (JS_NewNumberValue(cx, d, &v) == JS_FALSE)
+    return JS_FALSE;
+
+  return JS_DefineProperty(cx, obj, name, v, NULL, NULL, JSPROP_ENUMERATE);
+}
+
+/** Snapshot of GPSEE monitor contention statistics: an array with one object per monitor,
+ *  or null when the runtime was not started with gpsee_monitor_stats.
+ */
+static JSBool vm_monitorStats(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  gpsee_runtime_t       *grt = JS_GetRuntimePrivate(JS_GetRuntime(cx));
+  gpsee_monitorStats_t  *stats;
+  size_t                count, i, j, n = 0;
+  JSObject              *array, *monitor, *histogram;
+  JSString              *name;
+  jsval                 v;
+  JSBool                b = JS_FALSE;
+
+  if (!grt->monitorStats)
+  {
+    *rval = JSVAL_NULL;
+    return JS_TRUE;
+  }
+
+  if (gpsee_getMonitorStats(grt, &stats, &count) == JS_FALSE)
+  {
+    JS_ReportOutOfMemory(cx);
+    return JS_FALSE;
+  }
+
+  array = JS_NewArrayObject(cx, 0, NULL);
+  if (!array)
+    goto out;
+  *rval = OBJECT_TO_JSVAL(array);
+
+  for (i = 0; i < count; i++)
+  {
+    if (!stats[i].entries)
+      continue;
+
+    if (!(monitor = JS_NewObject(cx, NULL, NULL, NULL)))
+      goto out;
+    v = OBJECT_TO_JSVAL(monitor);
+    if (JS_SetElement(cx, array, n++, &v) == JS_FALSE)
+      goto out;
+
+    if (!(name = JS_NewStringCopyZ(cx, stats[i].name)))
+      goto out;
+    if (JS_DefineProperty(cx, monitor, "name", STRING_TO_JSVAL(name), NULL, NULL, JSPROP_ENUMERATE) == JS_FALSE)
+      goto out;
+
+    if (vm_defineNumber(cx, monitor, "entries", stats[i].entries) == JS_FALSE ||
+        vm_defineNumber(cx, monitor, "contended", stats[i].contended) == JS_FALSE ||
+        vm_defineNumber(cx, monitor, "slept", stats[i].slept) == JS_FALSE ||
+        vm_defineNumber(cx, monitor, "waitTime", (jsdouble)stats[i].waitTime) == JS_FALSE ||
+        vm_defineNumber(cx, monitor, "maxWait", stats[i].maxWait) == JS_FALSE ||
+        vm_defineNumber(cx, monitor, "maxHold", stats[i].maxHold) == JS_FALSE)
+      goto out;
+
+    if (!(histogram = JS_NewArrayObject(cx, 0, NULL)))
+      goto out;
+    v = OBJECT_TO_JSVAL(histogram);
+    if (JS_DefineProperty(cx, monitor, "waitHistogram", v, NULL, NULL, JSPROP_ENUMERATE) == JS_FALSE)
+      goto out;
+
+    for (j = 0; j < GPSEE_MONITOR_HISTOGRAM_BUCKETS; j++)
+    {
+      if (JS_NewNumberValue(cx, stats[i].waitHistogram[j], &v) == JS_FALSE || JS_SetElement(cx, histogram, j, &v) == JS_FALSE)
+        goto out;
+    }
+  }
+
+  b = JS_TRUE;
+
+  out:
+  if (stats)
+    free(stats);
+  return b;
+}
+
 static JSBool vm_jit_getter(JSContext *cx, JSObject *obj, jsval id, jsval *vp)
 {
   *vp = (JS_GetOptions(cx) & JSOPTION_JIT) ? JSVAL_TRUE : JSVAL_FALSE;
@@ -453,6 +539,7 @@ const char *vm_InitModule(JSContext *cx, JSObject *moduleObject)
     { "dumpValue",		vm_dumpValue,			0, 0, 0 },
     { "dumpObject",		vm_dumpObject,			0, 0, 0 },
     { "halt",			vm_halt,			0, 0, 0 },
+    { "monitorStats",		vm_monitorStats,		0, 0, 0 },
     { NULL,			NULL,				0, 0, 0 },
   };
 
@@ -9,7 +9,9 @@ for each(var arg in arguments) switch (arg) {
 }
 
 const ByteArray  = require("binary").ByteArray;
+const ByteString = require("binary").ByteString;
 const Binary     = require("binary").Binary;
+const vm         = require("vm");
 
 function values(ob) {
     var values = [];
@@ -122,6 +124,12 @@ const EX_SETTER_INDEX_RANGE = BYTEARRAY + '.setter.index.range';
 const EX_SETTER_INDEX_INVALID = BYTEARRAY + '.setter.index.invalid';
 
 
+/* ByteArrays of at least 1KB, whose slices covering half or more share memory copy-on-write */
+function pattern(length) { var b = new ByteArray(length); for (var i = 0; i < length; i++) b[i] = i & 255; return b }
+function isPattern(b, offset) { for (var i = 0; i < b.length; i++) if (b[i] !== ((i + offset) & 255)) return false; return true }
+/* A copy-on-write slice whose parent is unreachable by the time the caller sees it */
+function orphanSlice(start, end) { return pattern(4096).slice(start, end) }
+
 var tests = [
 /* Various decode/extract tests (preserved from old test code. can't have too many tests!) */
 function(){return new ByteArray("hello world").decodeToString("utf-8") === 'hello world'},
@@ -142,12 +150,35 @@ function(t){return t.eq(new ByteArray("Where's Waldo?!").indexOf('W'.charCodeAt(
 function(t){return t.eq(new ByteArray("Where's Waldo?!").indexOf('W'.charCodeAt(0),1,7), -1)},
 function(t){return t.eq(new ByteArray("Where's Waldo?!").indexOf('!'.charCodeAt(0)), 14)},
 function(t){t.ex=t.sw(EX_INDEXOF_INVALID_BYTE); new ByteArray(":)").indexOf(256)},
+/* multi-byte needles are searched for as sequences; empty needles are not bytes */
+function(t){return t.eq(new ByteArray("Where's Waldo?!").indexOf(new ByteArray("Wa")), 8)},
+function(t){return t.eq(new ByteArray("Where's Waldo?!").indexOf(new ByteString("ldo?!")), 10)},
+function(t){t.ex=t.sw(EX_INDEXOF_INVALID_BYTE); new ByteArray(":)").indexOf(new ByteArray())},
 /* lastIndexOf tests */
 function(t){return t.eq(new ByteArray("Where's Waldo?!").lastIndexOf('W'.charCodeAt(0)), 8)},
 function(t){return t.eq(new ByteArray("Where's Waldo?!").lastIndexOf('W'.charCodeAt(0), 0, 7), 0)},
 function(t){t.ex=t.sw(EX_LASTINDEXOF_INVALID_BYTE); new ByteArray(":)").lastIndexOf(256)},
+function(t){return t.eq(new ByteArray("abcabcab").lastIndexOf(new ByteArray("abc")), 3)},
+function(t){t.ex=t.sw(EX_LASTINDEXOF_INVALID_BYTE); new ByteArray(":)").lastIndexOf(new ByteString())},
 /* slice tests */
 function(t){return t.eq(new ByteArray("Hey! Pizza Land, huh? That's lot's of fun!").slice(5,10).decodeToString('ascii'), 'Pizza')},
+/* copy-on-write slices: writes to either side are not seen by the other */
+function(t){var p=pattern(4096), c=p.slice(100,4000); p[100]=255; return t.eq(c[0], 100) && t.eq(p[100], 255) && t.eq(isPattern(c, 100), true)},
+function(t){var p=pattern(4096), c=p.slice(100,4000); c[0]=255; return t.eq(p[100], 100) && t.eq(c[0], 255) && t.eq(isPattern(p, 0), true)},
+function(t){var p=pattern(4096), c=p.slice(0,3000); p[1]=201; c[1]=202; c[2]=203; p[2]=204; 
+            return t.eq(p[1], 201) && t.eq(c[1], 202) && t.eq(c[2], 203) && t.eq(p[2], 204)},
+function(t){var p=pattern(4096), c=p.slice(0,3000); p.length=10; p.push(7); return t.eq(c.length, 3000) && t.eq(isPattern(c, 0), true)},
+function(t){var p=pattern(4096), c=p.slice(0,3000); c.unshift(1); c.length=5000; return t.eq(p.length, 4096) && t.eq(isPattern(p, 0), true)},
+/* slices of slices */
+function(t){var p=pattern(4096), c=p.slice(0,4000), d=c.slice(16,3000); c[16]=1; return t.eq(d[0], 16) && t.eq(p[16], 16)},
+function(t){var p=pattern(4096), c=p.slice(0,4000), d=c.slice(16,3000); d[0]=1; return t.eq(c[16], 16) && t.eq(p[16], 16) && t.eq(isPattern(c, 0), true)},
+function(t){var p=pattern(4096), c=p.slice(0,4000), d=c.slice(16,3000); p[16]=1; return t.eq(c[16], 16) && t.eq(d[0], 16) && t.eq(isPattern(d, 16), true)},
+function(t){var p=pattern(4096), c=p.slice(0,4000), d=c.slice(16,3000); c[0]=1; p[0]=1; vm.GC(); [pattern(4096) for each (x in [1,2,3,4])]; 
+            return t.eq(isPattern(d, 16), true)},
+/* slices outlive their parents, and can still be written afterwards */
+function(t){var c=orphanSlice(1,4000); vm.GC(); [pattern(4096) for each (x in [1,2,3,4])]; vm.GC(); return t.eq(c.length, 3999) && t.eq(isPattern(c, 1), true)},
+function(t){var c=orphanSlice(1,4000); vm.GC(); c[0]=0; c.push(9); return t.eq(c[0], 0) && t.eq(c[1], 2) && t.eq(c[3999], 9)},
+function(t){var d=orphanSlice(0,4096).slice(0,3000); vm.GC(); d[5]=0; return t.eq(d[5], 0) && t.eq(d[6], 6) && t.eq(d.length, 3000)},
 /* splice tests */
 function(t){var b=new ByteArray("PizzaLand"); return t.eq(b.splice(5).decodeToString('ascii'),'Land') && t.eq(b.decodeToString('ascii'),'Pizza') },
 function(t){var b=new ByteArray("PizzaLand"); return t.eq(b.splice(5,9).decodeToString('ascii'),'Land') && t.eq(b.decodeToString('ascii'),'Pizza') },
@@ -9,7 +9,9 @@ for each(var arg in arguments) switch (arg) {
 }
 
 const ByteString = require("binary").ByteString;
+const ByteArray  = require("binary").ByteArray;
 const Binary     = require("binary").Binary;
+const vm         = require("vm");
 
 function values(ob) {
     var values = [];
@@ -123,6 +125,10 @@ function runtest(test)
 
 /* Test material */
 const gobbledygook = '2~`E 6_BV JGrK 4*I<f 0^B,g Ctks ;~Sn dA:Z )#h/qp4 I3p^C';
+/* Long enough that slices of it share its backing store instead of copying */
+const alphabets = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789'.replace(/.*/, '$&$&$&');
+/* A shared slice whose parent is unreachable by the time the caller sees it */
+function orphanSlice(start, length) { return new ByteString(alphabets).substr(start, length) }
 /* Exceptions */
 //function mkexs(){return arguments.reduce(function(a,b)a+'.'+b)}
 const BASE = 'gpsee.module.ca.page';
@@ -131,6 +137,7 @@ const SUBSTR = BYTESTRING + '.substr';
 const SUBSTRING = BYTESTRING + '.substring';
 const EX_INDEXOF_INVALID_BYTE = BYTESTRING + '.indexOf.arguments.0.byte.invalid';
 const EX_LASTINDEXOF_INVALID_BYTE = BYTESTRING + '.lastIndexOf.arguments.0.byte.invalid';
+const EX_SPLIT_EMPTY = BYTESTRING + '.split.arguments.0.empty';
 
 var tests = [
 /* Various decode/extract tests (preserved from old test code. can't have too many tests!) */
@@ -156,10 +163,22 @@ function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf('W'.charCodeAt
 function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf('W'.charCodeAt(0),1,7), -1)},
 function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf('!'.charCodeAt(0)), 14)},
 function(t){t.ex=t.sw(EX_INDEXOF_INVALID_BYTE); new ByteString(":)").indexOf(256)},
+/* multi-byte needles are searched for as sequences; empty needles are not bytes */
+function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf(new ByteString("Wa")), 8)},
+function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf(new ByteArray("ldo?!")), 10)},
+function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf(new ByteString("Wa"), 0, 9), -1)},
+function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf(new ByteString("Waldo?!?")), -1)},
+function(t){return t.eq(new ByteString("Where's Waldo?!").indexOf(new ByteString("W")), 0)},
+function(t){t.ex=t.sw(EX_INDEXOF_INVALID_BYTE); new ByteString(":)").indexOf(new ByteString())},
+function(t){t.ex=t.sw(EX_INDEXOF_INVALID_BYTE); new ByteString(":)").indexOf(new ByteArray())},
 /* lastIndexOf tests */
 function(t){return t.eq(new ByteString("Where's Waldo?!").lastIndexOf('W'.charCodeAt(0)), 8)},
 function(t){return t.eq(new ByteString("Where's Waldo?!").lastIndexOf('W'.charCodeAt(0), 0, 7), 0)},
 function(t){t.ex=t.sw(EX_LASTINDEXOF_INVALID_BYTE); new ByteString(":)").lastIndexOf(256)},
+function(t){return t.eq(new ByteString("abcabcab").lastIndexOf(new ByteString("abc")), 3)},
+function(t){return t.eq(new ByteString("abcabcab").lastIndexOf(new ByteString("abc"), 0, 5), 0)},
+function(t){return t.eq(new ByteString("abcabcab").lastIndexOf(new ByteString("cba")), -1)},
+function(t){t.ex=t.sw(EX_LASTINDEXOF_INVALID_BYTE); new ByteString(":)").lastIndexOf(new ByteString())},
 /* charAt tests */
 function(t){return t.eq(new ByteString("Where's Waldo?!").charAt(0).decodeToString('US-ASCII'), 'W') },
 function(t){return t.eq(new ByteString("Where's Waldo?!").charAt(8).decodeToString('US-ASCII'), 'W') },
@@ -173,8 +192,24 @@ function(t){return t.eq(new ByteString("Where's Waldo?!").charCodeAt(8), 87) },
 function(t) { return t.eq([s.decodeToString('US-ASCII') for each (s in (new ByteString(gobbledygook).split(32)))], gobbledygook.split(' ')) },
 function(t) { return t.eq([s.decodeToString('US-ASCII') for each (s in (new ByteString(gobbledygook).split(66)))], gobbledygook.split('B')) },
 function(t) { return t.eq([s.decodeToString('US-ASCII') for each (s in (new ByteString('Hello World!').split(0)))], ['Hello World!']) },
+function(t) { return t.eq([s.decodeToString('US-ASCII') for each (s in (new ByteString('one, two, three').split(new ByteString(', '))))], ['one', 'two', 'three']) },
+function(t) { return t.eq([s.decodeToString('US-ASCII') for each (s in (new ByteString('one\r\ntwo\r\n').split(new ByteArray('\r\n'))))], ['one', 'two']) },
+function(t) { t.ex=t.sw(EX_SPLIT_EMPTY); new ByteString('Hello').split(new ByteString()) },
 /* slice tests */
 //function(t) { return t.eq(new ByteString
+function(t) { return t.eq(new ByteString(alphabets).slice(10, 90).decodeToString('ascii'), alphabets.slice(10, 90)) },
+/* slices of shared slices */
+function(t) { return t.eq(new ByteString(alphabets).slice(10, 150).slice(20, 100).decodeToString('ascii'), alphabets.slice(30, 110)) },
+function(t) { return t.eq(new ByteString(alphabets).substr(5, 150).substring(40, 100).substr(3, 40).decodeToString('ascii'), alphabets.substr(48, 40)) },
+function(t) { return t.eq([s.decodeToString('ascii') for each (s in new ByteString(alphabets).slice(1).split(48))], alphabets.slice(1).split('0')) },
+/* slices outlive their parents */
+function(t) { var s = orphanSlice(7, 100); vm.GC(); [new ByteString(alphabets) for each (x in alphabets)]; vm.GC();
+              return t.eq(s.decodeToString('ascii'), alphabets.substr(7, 100)) },
+function(t) { var s = orphanSlice(7, 100).slice(50); vm.GC(); [new ByteString(alphabets) for each (x in alphabets)]; vm.GC();
+              return t.eq(s.decodeToString('ascii'), alphabets.substr(57, 50)) },
+/* ByteArrays made from shared slices are private copies */
+function(t) { var s = new ByteString(alphabets).slice(0, 64), a = s.toByteArray(); a[0] = 33; 
+              return t.eq(s.decodeToString('ascii'), alphabets.slice(0, 64)) && t.eq(a.decodeToString('ascii'), '!' + alphabets.slice(1, 64)) },
 /* substr tests */
 function(t) { return t.eq(new ByteString('1234').substr(0,1).decodeToString('US-ASCII'), '1') },
 function(t) { return t.eq(new ByteString('1234').substr(1,1).decodeToString('US-ASCII'), '2') },
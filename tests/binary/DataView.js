@@ -0,0 +1,198 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+
+const binary     = require("binary");
+const ByteString = binary.ByteString;
+const ByteArray  = binary.ByteArray;
+const DataView   = binary.DataView;
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* Exceptions */
+const DATAVIEW = 'gpsee.module.ca.page.binary.DataView';
+
+/* A ByteArray big enough that its slices are copy-on-write */
+function pattern(length) { var b = new ByteArray(length); for (var i = 0; i < length; i++) b[i] = i & 255; return b }
+/* An object whose valueOf() runs fn before returning value */
+function sneaky(value, fn) { return { valueOf: function() { fn(); return value } } }
+
+var tests = [
+/* element types and byte order */
+function(t) { var b = new ByteArray(4); new DataView(b, 'uint16').set(0, 0x1234); return t.eq(b[0], 0x12) && t.eq(b[1], 0x34) },
+function(t) { var b = new ByteArray(4); new DataView(b, 'uint16', true).set(0, 0x1234); return t.eq(b[0], 0x34) && t.eq(b[1], 0x12) },
+function(t) { var b = new ByteArray([0xff, 0xfe]); return t.eq(new DataView(b, 'int8').get(0), -1) && t.eq(new DataView(b, 'int16').get(0), -2) },
+function(t) { var b = new ByteArray(4), v = new DataView(b, 'uint32'); v.set(0, 0xfffffffe); return t.eq(v.get(0), 0xfffffffe) && t.eq(b[3], 0xfe) },
+function(t) { var b = new ByteArray(4), v = new DataView(b, 'int32', true); v.set(0, -2); return t.eq(v.get(0), -2) && t.eq(b[0], 0xfe) },
+function(t) { var b = new ByteArray(12), v = new DataView(b, 'float64'); v.set(3, 1.5); return t.eq(v.get(3), 1.5) && t.eq(v.length, 1) },
+function(t) { var b = new ByteArray(4), v = new DataView(b, 'float32'); v.set(0, 0.25); return t.eq(v.get(0), 0.25) },
+function(t) { return t.eq(new DataView(new ByteString('abcd'), 'uint8').readArray(1, 3).join(), '98,99,100') },
+/* bulk access */
+function(t) { var b = new ByteArray(8), v = new DataView(b, 'uint16'); 
+              return t.eq(v.writeArray(2, [1, 2, 3]), 3) && t.eq(v.readArray(0, 4).join(), '0,1,2,3') },
+function(t) { var v = new DataView(new ByteArray(8), 'uint16'); return t.eq(v.writeArray(8, []), 0) },
+/* errors */
+function(t) { t.ex = t.sw(DATAVIEW + '.set.readOnly'); new DataView(new ByteString('abcd'), 'uint8').set(0, 1) },
+function(t) { t.ex = t.sw(DATAVIEW + '.writeArray.readOnly'); new DataView(new ByteString('abcd'), 'uint8').writeArray(0, [1]) },
+function(t) { t.ex = t.sw(DATAVIEW + '.get.range'); new DataView(new ByteArray(4), 'uint32').get(1) },
+function(t) { t.ex = t.sw(DATAVIEW + '.writeArray.range'); new DataView(new ByteArray(4), 'uint16').writeArray(2, [1, 2]) },
+function(t) { t.ex = t.sw(DATAVIEW + '.constructor.arguments.1.invalid'); new DataView(new ByteArray(4), 'int64') },
+/* valueOf() runs after the range check; the ByteThing is checked again before storing */
+function(t) { t.ex = t.sw(DATAVIEW + '.set.range'); var b = new ByteArray(8); new DataView(b, 'uint32').set(4, sneaky(1, function() { b.length = 2 })) },
+function(t) { var b = new ByteArray(8), v = new DataView(b, 'uint32'); v.set(4, sneaky(7, function() { b.length = 100000 }));
+              return t.eq(b.length, 100000) && t.eq(v.get(4), 7) },
+function(t) { var b = new ByteArray(8), v = new DataView(b, 'uint8'); 
+              try { v.writeArray(0, [1, 2, sneaky(3, function() { b.length = 2 }), 4]) } catch(e) { if (!t.sw(DATAVIEW + '.writeArray.range')(e)) return false }
+              return t.eq(b.length, 2) && t.eq(b[0], 1) && t.eq(b[1], 2) },
+function(t) { var b = new ByteArray(4), v = new DataView(b, 'uint8'); 
+              v.writeArray(0, [1, sneaky(2, function() { b.length = 8192 }), 3]); return t.eq(b[0], 1) && t.eq(b[1], 2) && t.eq(b[2], 3) },
+/* ...and a copy-on-write slice taken by valueOf() does not see the store */
+function(t) { var b = pattern(4096), v = new DataView(b, 'uint8'), s;
+              v.set(0, sneaky(99, function() { s = b.slice(0, 4000) }));
+              return t.eq(b[0], 99) && t.eq(s[0], 0) },
+function(t) { var b = pattern(4096), v = new DataView(b, 'uint8'), s;
+              v.writeArray(0, [10, sneaky(11, function() { s = b.slice(0, 4000) }), 12]);
+              return t.eq(b.slice(0, 3).toArray().join(), '10,11,12') && t.eq(s[0], 10) && t.eq(s[1], 1) && t.eq(s[2], 2) },
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
@@ -0,0 +1,180 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+
+const binary     = require("binary");
+const ByteString = binary.ByteString;
+const ByteArray  = binary.ByteArray;
+const Struct     = binary.Struct;
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* Exceptions */
+const STRUCT = 'gpsee.module.ca.page.binary.Struct';
+
+var tests = [
+/* pack and unpack */
+function(t) { return t.eq(new Struct('>HB').pack(0x1234, 0x56).toArray().join(), [0x12, 0x34, 0x56].join()) },
+function(t) { return t.eq(new Struct('<HB').pack(0x1234, 0x56).toArray().join(), [0x34, 0x12, 0x56].join()) },
+function(t) { return t.eq(new Struct('>bhiq').unpack(new Struct('>bhiq').pack(-1, -2, -3, -4)).join(), '-1,-2,-3,-4') },
+function(t) { return t.eq(new Struct('>3Bx2s').unpack(new ByteString([1, 2, 3, 0, 65, 66]))[3].decodeToString('ascii'), 'AB') },
+function(t) { return t.eq(new Struct('>Q').pack(0).length, 8) && t.eq(new Struct('>Q').unpack(new Struct('>Q').pack(65536))[0], 65536) },
+function(t) { var b = new ByteArray(), s = new Struct('>H'); return t.eq(s.packInto(b, 2, 7), 4) && t.eq(b.toArray().join(), '0,0,0,7') },
+function(t) { return t.eq(new Struct('>H').unpackAll(new ByteString([0, 1, 0, 2, 0, 3])).join(), '1,2,3') },
+/* unsigned codes narrower than 64 bits wrap as typed arrays do; Q does not */
+function(t) { return t.eq(new Struct('>B').pack(-1).toArray().join(), '255') },
+function(t) { t.ex = t.sw(STRUCT + '.pack.arguments.0.range'); new Struct('>Q').pack(-1) },
+function(t) { t.ex = t.sw(STRUCT + '.pack.arguments.0.range'); new Struct('>q').pack(Math.pow(2, 63)) },
+function(t) { t.ex = t.sw(STRUCT + '.pack.arguments.0.range'); new Struct('>i').pack(Infinity) },
+/* formats whose record size cannot be represented (on 32-bit hosts, the large counts themselves are rejected) */
+function(t) { t.ex = t.sw(STRUCT + '.format.count.range'); new Struct('99999999999999999999999999B') },
+function(t) { t.ex = t.sw(STRUCT + '.format.'); new Struct('>' + Math.pow(2, 62) + 'q') },
+function(t) { t.ex = t.sw(STRUCT + '.format.'); new Struct('>' + (Math.pow(2, 63) + Math.pow(2, 62)) + 's' + Math.pow(2, 62) + 's') },
+function(t) { t.ex = t.sw(STRUCT + '.format.invalid'); new Struct('>Z') },
+/* other errors */
+function(t) { t.ex = t.sw(STRUCT + '.pack.arguments.count'); new Struct('>HH').pack(1) },
+function(t) { t.ex = t.sw(STRUCT + '.unpack.range'); new Struct('>I').unpack(new ByteString([1, 2, 3])) },
+function(t) { t.ex = t.sw(STRUCT + '.packInto.arguments.1'); new Struct('>I').packInto(new ByteArray(), Math.pow(2, 64) - 2, 1) },
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
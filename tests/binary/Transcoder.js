@@ -0,0 +1,225 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+
+const binary     = require("binary");
+const ByteString = binary.ByteString;
+const ByteArray  = binary.ByteArray;
+const Transcoder = binary.Transcoder;
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* Test material: one-, two-, three- and four-byte UTF-8 sequences */
+const text = 'A\u00e9\u20ac\ud834\udd1e and then some more \u00e9\u20ac';
+const utf8 = new ByteString(text, 'utf-8');
+const utf16 = new ByteString(text, 'utf-16le');
+const jisText = 'abc \u65e5\u672c\u8a9e\u306e\u6587\u7ae0 def \u30c6\u30b9\u30c8 x';
+const jis = new ByteString(jisText, 'iso-2022-jp');
+/* Exceptions */
+const TRANSCODER = 'gpsee.module.ca.page.binary.Transcoder';
+
+/* Push bytes through a Transcoder in chunks of the given sizes (the last size repeats), then flush */
+function pushChunks(tc, bytes, sizes, out)
+{
+    out = out || new ByteArray();
+    for (var i = 0, j = 0; i < bytes.length; i += sizes[j], j = Math.min(j + 1, sizes.length - 1))
+        tc.push(bytes.slice(i, i + sizes[j]), out);
+    return tc.flush(out);
+}
+
+var tests = [
+/* whole input, with and without an explicit target */
+function(t) { return t.eq(new Transcoder('utf-8').push(utf8).decodeToString(), text) },
+function(t) { return t.eq(new Transcoder('utf-8', null).push(utf8).decodeToString(), text) },
+function(t) { return t.eq(new Transcoder('utf-8', 'iso-8859-1').push(new ByteString('caf\u00e9', 'utf-8')).decodeToString('iso-8859-1'), 'caf\u00e9') },
+function(t) { return t.eq(new Transcoder('iso-8859-1', 'utf-8').push(new ByteArray([99, 97, 102, 233])).decodeToString('utf-8'), 'caf\u00e9') },
+/* one byte at a time, and in chunks which split sequences in different places */
+function(t) { return t.eq(pushChunks(new Transcoder('utf-8'), utf8, [1]).decodeToString(), text) },
+function(t) { return t.eq(pushChunks(new Transcoder('utf-8'), utf8, [2]).decodeToString(), text) },
+function(t) { return t.eq(pushChunks(new Transcoder('utf-8'), utf8, [3, 5, 7]).decodeToString(), text) },
+function(t) { for (var i = 1; i < utf8.length; i++) 
+                  if (!t.eq(pushChunks(new Transcoder('utf-8'), utf8, [i, utf8.length]).decodeToString(), text)) 
+                      return false;
+              return true },
+/* a split sequence is held back until it is complete */
+function(t) { var tc = new Transcoder('utf-8'), out = new ByteArray(); 
+              tc.push(new ByteArray([0xe2]), out); tc.push(new ByteArray([0x82]), out);
+              if (!t.eq(out.length, 0)) return false;
+              tc.push(new ByteArray([0xac, 0x41]), out);
+              return t.eq(out.decodeToString(), '\u20acA') },
+/* output is appended to the caller's ByteArray */
+function(t) { var out = new ByteArray(), tc = new Transcoder('utf-8');
+              tc.push(new ByteString('ab', 'utf-8'), out); tc.push(new ByteString('cd', 'utf-8'), out);
+              return t.eq(out.decodeToString(), 'abcd') },
+function(t) { var out = new ByteArray([0x41]), tc = new Transcoder('utf-8', 'utf-8');
+              return t.eq(tc.push(new ByteString('bc', 'utf-8'), out), out) && t.eq(out.decodeToString('utf-8'), 'Abc') },
+/* flush ends the stream, and the Transcoder can then be re-used */
+function(t) { t.ex = t.sw(TRANSCODER + '.flush.incomplete'); var tc = new Transcoder('utf-8'); tc.push(new ByteArray([0x41, 0xe2, 0x82])); tc.flush() },
+function(t) { var tc = new Transcoder('utf-8'); tc.push(new ByteArray([0xe2])); 
+              try { tc.flush() } catch(e) {}
+              return t.eq(pushChunks(tc, utf8, [4]).decodeToString(), text) },
+/* bad input */
+function(t) { t.ex = t.sw(TRANSCODER + '.push.transcode'); new Transcoder('utf-8').push(new ByteArray([0x41, 0xff, 0x41])) },
+function(t) { t.ex = t.sw(TRANSCODER + '.push.arguments.0.type'); new Transcoder('utf-8').push('abc') },
+function(t) { t.ex = t.sw(TRANSCODER + '.constructor.charset'); new Transcoder('no-such-charset', 'utf-8') },
+function(t) { t.ex = t.sw(TRANSCODER + '.constructor.arguments.count'); new Transcoder() },
+/* multi-byte and stateful charsets, split at every offset */
+function(t) { for (var i = 1; i < utf16.length; i++) 
+                  if (!t.eq(pushChunks(new Transcoder('utf-16le'), utf16, [i]).decodeToString(), text)) 
+                      return false;
+              return true },
+function(t) { for (var i = 1; i < jis.length; i++) 
+                  if (!t.eq(pushChunks(new Transcoder('iso-2022-jp'), jis, [i]).decodeToString(), jisText)) 
+                      return false;
+              return true },
+function(t) { return t.eq(pushChunks(new Transcoder('iso-2022-jp'), jis, [1]).decodeToString(), jisText) },
+/* pending bytes survive empty pushes, and a sequence carried over several pushes */
+function(t) { var tc = new Transcoder('utf-8'), out = new ByteArray(); 
+              tc.push(new ByteArray([0xf0]), out); tc.push(new ByteArray(), out); tc.push(new ByteArray([0x9d]), out);
+              tc.push(new ByteArray(), out); tc.push(new ByteArray([0x84]), out);
+              if (!t.eq(out.length, 0)) return false;
+              tc.push(new ByteArray([0x9e, 0x42, 0xc3]), out); tc.push(new ByteArray([0xa9]), out);
+              return t.eq(tc.flush(out).decodeToString(), '\ud834\udd1eB\u00e9') },
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
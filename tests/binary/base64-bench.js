@@ -0,0 +1,121 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+
+/* 
+ * @file	base64-bench.js		Benchmark for binary.toBase64(), binary.fromBase64(), and
+ *					the streaming Base64Encoder / Base64Decoder at 1KB, 1MB 
+ *					and 100MB. Results are checked against each other.
+ *
+ * Usage: gsr -f base64-bench.js [maxBytes]
+ */
+
+const binary = require("binary");
+const maxBytes = +(require("system").args[1] || 100 * 1024 * 1024);
+const sizes = [ 1024, 1024 * 1024, 100 * 1024 * 1024 ].filter(function(n) n <= maxBytes);
+const chunkSize = 57 * 1024;	/* multiple of 57 bytes => whole 76-character MIME lines */
+
+function makeBytes(n)
+{
+  var ba = new binary.ByteArray(n);
+  var i;
+
+  for (i = 0; i < n; i++)
+    ba[i] = (i * 7 + (i >> 8)) & 0xff;
+
+  return ba.toByteString();
+}
+
+function timeIt(label, bytes, fn)
+{
+  var start = Date.now();
+  var result = fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + bytes + " bytes in " + elapsed + "ms (" + Math.round(bytes / 1024 / 1024 * 1000 / elapsed) + " MB/s)");
+  return result;
+}
+
+sizes.forEach(function(n)
+{
+  var bytes = makeBytes(n);
+  var iterations = Math.max(1, Math.floor(16 * 1024 * 1024 / n));
+  var encoded, decoded, mime, i;
+
+  encoded = timeIt("toBase64      x" + iterations, n * iterations, function() {
+    var s;
+    for (i = 0; i < iterations; i++)
+      s = binary.toBase64(bytes);
+    return s;
+  });
+
+  decoded = timeIt("fromBase64    x" + iterations, n * iterations, function() {
+    var b;
+    for (i = 0; i < iterations; i++)
+      b = binary.fromBase64(encoded);
+    return b;
+  });
+
+  if (binary.toBase64(decoded) != encoded)
+    throw new Error("fromBase64 did not round-trip " + n + " bytes");
+
+  mime = timeIt("Base64Encoder (MIME)", n, function() {
+    var enc = new binary.Base64Encoder({ lineLength: 76 });
+    var parts = [];
+    var pos;
+
+    for (pos = 0; pos < n; pos += chunkSize)
+      parts.push(enc.push(bytes.slice(pos, Math.min(pos + chunkSize, n))));
+    parts.push(enc.flush());
+
+    return parts.join("");
+  });
+
+  if (mime != binary.toBase64(bytes, 76))
+    throw new Error("Base64Encoder disagrees with toBase64 for " + n + " bytes");
+
+  timeIt("Base64Decoder (MIME)", n, function() {
+    var dec = new binary.Base64Decoder();
+    var total = 0;
+    var pos;
+
+    for (pos = 0; pos < mime.length; pos += 65536)
+      total += dec.push(mime.substr(pos, 65536)).length;
+    total += dec.flush().length;
+
+    if (total != n)
+      throw new Error("Base64Decoder produced " + total + " of " + n + " bytes");
+  });
+});
@@ -0,0 +1,302 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const binary     = require("binary");
+const ByteString = binary.ByteString;
+const ByteArray  = binary.ByteArray;
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* The base 64 codec works a group (or, with SSSE3, four groups) at a time and can stream. The
+ * tests below check it against JavaScript ports of the byte-at-a-time encoder and decoder it
+ * replaced, on lengths around the vector and chunk sizes, on truncated and damaged input, and
+ * through the streaming classes. Whitespace is the one deliberate difference: the old decoder
+ * stopped at it, and the new one skips it, so that MIME bodies decode.
+ */
+const ALPHABET = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=';
+const lengths  = range(71).concat([255, 256, 257, 1000, 3071, 3072, 3073, 3074, 4095, 4096, 4097, 6144, 10000]);
+
+/** The integers from 0 to n - 1 */
+function range(n) { var a = []; for (var i = 0; i < n; i++) a.push(i); return a }
+
+/** Pseudo-random numbers in [0, n), repeatable from a seed so that failures can be reproduced */
+var seed = 7;
+function random(n) { seed = (seed * 69069 + 1) % 4294967296; return Math.floor(seed / 65536) % n }
+function bytes(n) { var a = []; while (n--) a.push(random(256)); return a }
+
+/** The old binary_to_b64(): padded base 64 of an Array of bytes */
+function originalEncode(a)
+{
+  var s = '', i, c0, c1, c2;
+
+  for (i = 0; i < a.length; i += 3)
+  {
+    c0 = a[i]; c1 = a[i + 1]; c2 = a[i + 2];
+    s += ALPHABET[c0 >> 2];
+    s += ALPHABET[((c0 & 3) << 4) | (c1 === undefined ? 0 : c1 >> 4)];
+    s += c1 === undefined ? '=' : ALPHABET[((c1 & 15) << 2) | (c2 === undefined ? 0 : c2 >> 6)];
+    s += c2 === undefined ? '=' : ALPHABET[c2 & 63];
+  }
+  return s;
+}
+
+/** The old b64_to_binary(): stops at the first character outside ALPHABET, or at padding */
+function originalDecode(s)
+{
+  var out = [], leftover = 0, value, i;
+
+  for (i = 0; i < s.length && (value = ALPHABET.indexOf(s[i])) != -1; i++)
+  {
+    if (s[i] == '=')
+    {
+      if (i % 4 == 1)	/* A=== case */
+        out.push(leftover);
+      break;
+    }
+    switch (i % 4)
+    {
+      case 0: leftover = (value << 2) & 255; break;
+      case 1: out.push((value >> 4) | leftover); leftover = (value << 4) & 255; break;
+      case 2: out.push((value >> 2) | leftover); leftover = (value << 6) & 255; break;
+      case 3: out.push(value | leftover); leftover = 0; break;
+    }
+  }
+  return out;
+}
+
+/** Bytes of any ByteThing, as a comma-separated list */
+function listOf(thing) { var b = new ByteArray(); b.extendRight(thing); return b.toArray().join() }
+
+/** MIME-style lines of at most n characters, CRLF-separated with none at the end */
+function lines(s, n) { var parts = []; for (var i = 0; i < s.length; i += n) parts.push(s.substr(i, n)); return n ? parts.join('\r\n') : s }
+
+/** Decode s with fromBase64() and with the old decoder; true when they agree */
+function decodesAsBefore(s, expect)
+{
+  if (listOf(binary.fromBase64(s)) === originalDecode(expect === undefined ? s : expect).join())
+    return true;
+  print('fromBase64 differs from the old decoder on ' + uneval(s));
+  return false;
+}
+
+/** Run fn(a) on random Arrays of bytes of each length in lengths; true if fn always is */
+function eachLength(fn) { for each (let n in lengths) if (!fn(bytes(n))) { print('failed for ' + n + ' bytes'); return false } return true }
+
+/** Damage the encoding of 30 bytes at every position with each of a list of insertions */
+function damaged(insertions, fn)
+{
+  var enc = originalEncode(bytes(30));
+  for (var p = 0; p <= enc.length; p++)
+    for each (let bad in insertions)
+      if (!fn(enc.slice(0, p) + bad + enc.slice(p)))
+        return false;
+  return true;
+}
+
+var tests = [
+/* RFC 4648 test vectors */
+function(t){return t.eq(binary.toBase64(new ByteString()), '')},
+function(t){return t.eq(binary.toBase64(new ByteString('f', 'ascii')), 'Zg==')},
+function(t){return t.eq(binary.toBase64(new ByteString('fo', 'ascii')), 'Zm8=')},
+function(t){return t.eq(binary.toBase64(new ByteString('foo', 'ascii')), 'Zm9v')},
+function(t){return t.eq(binary.toBase64(new ByteString('foob', 'ascii')), 'Zm9vYg==')},
+function(t){return t.eq(binary.toBase64(new ByteString('fooba', 'ascii')), 'Zm9vYmE=')},
+function(t){return t.eq(binary.toBase64(new ByteString('foobar', 'ascii')), 'Zm9vYmFy')},
+function(t){return t.eq(listOf(binary.fromBase64('Zm9vYmFy')), [102,111,111,98,97,114].join())},
+/* Encoding matches the old encoder, and decoding round-trips, at every length near the vector and chunk sizes */
+function() eachLength(function(a) binary.toBase64(new ByteString(a)) === originalEncode(a)),
+function() eachLength(function(a) binary.toBase64(new ByteArray(a)) === originalEncode(a)),
+function() eachLength(function(a) listOf(binary.fromBase64(originalEncode(a))) === a.join()),
+function() eachLength(function(a) decodesAsBefore(originalEncode(a))),
+/* Every byte value survives, in every position of a group */
+function(t){var a=range(256); return t.eq(binary.toBase64(new ByteString(a)), originalEncode(a)) && t.eq(listOf(binary.fromBase64(originalEncode(a))), a.join())},
+function(t){var a=range(257).map(function(i) 255 - (i & 255)); return t.eq(listOf(binary.fromBase64(originalEncode(a))), a.join())},
+/* Truncated input decodes as before: a lone final character is dropped, two or three make bytes */
+function(){var enc = originalEncode(bytes(40)); for (var p = 0; p <= enc.length; p++) if (!decodesAsBefore(enc.slice(0, p))) return false; return true},
+function() decodesAsBefore('Zm9vYg') && decodesAsBefore('Zm9vYmE') && decodesAsBefore('Zm9vY'),
+/* Padding and characters outside the alphabet end the data, wherever they are */
+function() damaged(['=', '==', '===', '====', '!', '-', '_', '.', '\0', '\u007f', '\u0080', '\u00e9', '\u0141', '\uffff'], decodesAsBefore),
+function() decodesAsBefore('Zg==Zm9v') && decodesAsBefore('Zm8=Zm9v') && decodesAsBefore('=Zm9v') && decodesAsBefore('Zm9v!!!!'),
+function() decodesAsBefore('A===') && decodesAsBefore('Zm9vZ===') && decodesAsBefore('Zm9vZ=') && decodesAsBefore('Z=') && decodesAsBefore('Zm9v='),
+/* Characters beyond Latin-1 are not taken for their low byte */
+function(t){return t.eq(listOf(binary.fromBase64('Zm9v\u015aYmFy')), '102,111,111')},
+/* Whitespace is skipped, where the old decoder stopped at it */
+function() damaged([' ', '\t', '\r\n', '\n \n'], function(s) decodesAsBefore(s, s.replace(/\s/g, ''))),
+function() eachLength(function(a) decodesAsBefore(lines(originalEncode(a), 76), originalEncode(a))),
+/* Line breaks when encoding */
+function() eachLength(function(a) binary.toBase64(new ByteString(a), 76) === lines(originalEncode(a), 76)),
+function() [1, 3, 4, 5, 64, 77].every(function(n) eachLength(function(a) binary.toBase64(new ByteString(a), n) === lines(originalEncode(a), n))),
+function(t){return t.eq(binary.toBase64(new ByteString(bytes(57)), 76).indexOf('\r\n'), -1) && t.eq(binary.toBase64(new ByteString(bytes(57)), 0).length, 76)},
+function(t){t.ex=t.sw('gpsee.module.ca.page.binary.toBase64.arguments.1.range'); binary.toBase64(new ByteString('foo', 'ascii'), -1)},
+/* Streams of any chunk sizes encode as the whole would */
+function() [0, 76, 64, 1].every(function(n) eachLength(function(a) {
+  var enc = new binary.Base64Encoder(n ? { lineLength: n } : undefined), b = new ByteString(a), out = '', pos = 0, step;
+  while (pos < a.length) { step = 1 + random(n == 1 ? 7 : 700); out += enc.push(b.slice(pos, Math.min(pos + step, a.length))); pos += step }
+  out += enc.flush();
+  return out === lines(originalEncode(a), n);
+})),
+/* ...and decode as the whole would */
+function() eachLength(function(a) {
+  var dec = new binary.Base64Decoder(), s = lines(originalEncode(a), 76), out = new ByteArray(), pos = 0, step;
+  while (pos < s.length) { step = 1 + random(s.length > 100 ? 500 : 5); out.extendRight(dec.push(s.substr(pos, step))); pos += step }
+  out.extendRight(dec.flush());
+  return out.toArray().join() === a.join();
+}),
+function() damaged(['=', '!', 'Z==', '\u00e9'], function(s) {
+  var dec = new binary.Base64Decoder(), out = new ByteArray();
+  for (var i = 0; i < s.length; i++) out.extendRight(dec.push(s[i]));
+  out.extendRight(dec.flush());
+  return out.toArray().join() === originalDecode(s).join();
+}),
+/* A decoder which has seen the end of the data ignores the rest, until flushed */
+function(t){var dec=new binary.Base64Decoder(); return t.eq(listOf(dec.push('Zm9v!Zm9v')), '102,111,111') && t.eq(dec.push('Zm9v').length, 0) && t.eq(dec.flush().length, 0) && t.eq(listOf(dec.push('Zm8=')), '102,111')},
+/* An encoder may be reused after flush() */
+function(t){var enc=new binary.Base64Encoder({ lineLength: 4 }); enc.push(new ByteString('fooba', 'ascii')); enc.flush(); return t.eq(enc.push(new ByteString('foob', 'ascii')) + enc.flush(), 'Zm9v\r\nYg==')},
+/* Quoted-printable */
+function(t){return t.eq(binary.toQuotedPrintable(new ByteString([99,97,102,233,32,61,32,49])), 'caf=E9 =3D 1')},
+function(t){return t.eq(listOf(binary.fromQuotedPrintable('caf=E9 =3D 1')), [99,97,102,233,32,61,32,49].join())},
+function(t){var a=[0,9,32,33,61,126,127,128,200,255]; return t.eq(binary.toQuotedPrintable(new ByteString(a)), '=00\t !=3D~=7F=80=C8=FF') && t.eq(listOf(binary.fromQuotedPrintable(binary.toQuotedPrintable(new ByteString(a)))), a.join())},
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
@@ -0,0 +1,87 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+
+/* 
+ * @file	dataview-bench.js	Benchmark for reading 32-bit integers out of a ByteString,
+ *					one xintAt() call per value versus DataView.readArray().
+ *
+ * Usage: gsr -f dataview-bench.js [count]
+ */
+
+const binary = require("binary");
+const count = +(require("system").args[1] || 1000000);
+
+function timeIt(label, fn)
+{
+  var start = Date.now();
+  var result = fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + count + " values in " + elapsed + "ms (" + Math.round(count * 1000 / elapsed) + "/s)");
+  return result;
+}
+
+var ba = new binary.ByteArray(count * 4);
+var writer = new binary.DataView(ba, "int32", true);
+var values = [];
+var i;
+
+for (i = 0; i < count; i++)
+  values.push((i * 2654435761) | 0);
+writer.writeArray(0, values);
+
+var bs = ba.toByteString();
+var reader = new binary.DataView(bs, "int32", true);
+
+var sum1 = timeIt("xintAt loop   ", function() {
+  var sum = 0;
+  for (var j = 0; j < count; j++)
+    sum = (sum + bs.xintAt(j * 4)) | 0;
+  return sum;
+});
+
+var sum2 = timeIt("readArray     ", function() {
+  var a = reader.readArray(0, count);
+  var sum = 0;
+  for (var j = 0; j < count; j++)
+    sum = (sum + a[j]) | 0;
+  return sum;
+});
+
+if (sum1 != sum2)
+  throw new Error("xintAt and readArray disagree");
+
+timeIt("writeArray    ", function() { return writer.writeArray(0, values); });
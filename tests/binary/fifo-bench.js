@@ -0,0 +1,98 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+
+/* 
+ * @file	fifo-bench.js	Benchmark for ByteArray used as a FIFO receive buffer:
+ *				a stream is appended in 64KB blocks and consumed from the
+ *				front in 1KB splices, single-byte shifts, and refilled from
+ *				the front with unshift().
+ *
+ * Usage: gsr -f fifo-bench.js [megabytes]
+ */
+
+const binary = require("binary");
+const megabytes = +(require("system").args[1] || 100);
+const total = megabytes * 1024 * 1024;
+
+function timeIt(label, mb, fn)
+{
+  var start = Date.now();
+  var result = fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + result + " bytes in " + elapsed + "ms (" + Math.round(mb * 1000 / elapsed) + " MB/s)");
+}
+
+var block = new binary.ByteArray(64 * 1024);
+for (let i = 0; i < block.length; i++)
+  block[i] = i & 0xff;
+
+timeIt("splice(0, 1024)  ", megabytes, function() {
+  var fifo = new binary.ByteArray();
+  var consumed = 0;
+
+  for (let received = 0; received < total; received += block.length)
+  {
+    fifo.extendRight(block);
+    while (fifo.length >= 1024)
+      consumed += fifo.splice(0, 1024).length;
+  }
+  return consumed;
+});
+
+timeIt("shift()          ", megabytes / 16, function() {
+  var fifo = new binary.ByteArray();
+  var consumed = 0;
+
+  for (let received = 0; received < total / 16; received += block.length)
+  {
+    fifo.extendRight(block);
+    while (fifo.length)
+    {
+      fifo.shift();
+      consumed++;
+    }
+  }
+  return consumed;
+});
+
+timeIt("unshift()        ", megabytes / 16, function() {
+  var fifo = new binary.ByteArray();
+
+  for (let i = 0; i < total / 16; i++)
+    fifo.unshift(i & 0xff);
+  return fifo.length;
+});
@@ -0,0 +1,272 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const ByteArray  = require("binary").ByteArray;
+const vm         = require("vm");
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* ByteArrays keep spare room in front of their contents, so that shift(), splice(0, n),
+ * unshift() and extendLeft() need not move the rest. The tests below run the same operations
+ * on a ByteArray and on an Array of numbers, which does everything the slow way, and expect
+ * the same results: runs of random operations, and the FIFO patterns the room is kept for.
+ */
+
+/** Pseudo-random numbers in [0, n), repeatable from a seed so that failures can be reproduced */
+var seed;
+function random(n) { seed = (seed * 69069 + 1) % 4294967296; return Math.floor(seed / 65536) % n }
+function bytes(n) { var a = []; while (n--) a.push(random(256)); return a }
+
+/** True when ByteArray b holds the same bytes as Array a */
+function same(b, a) { return b.length === a.length && b.toArray().join() === a.join() }
+
+/* Operations on a ByteArray b and its model a. Each returns false when the results differ;
+ * copy-on-write slices, and what they should hold, are kept in saved. */
+const ops = {
+  push:        function(b, a) { var x = bytes(random(64)); b.push.apply(b, x); a.push.apply(a, x); return true },
+  pop:         function(b, a) { return !a.length || b.pop() === a.pop() },
+  shift:       function(b, a) { return b.shift() === a.shift() },
+  unshift:     function(b, a) { var x = bytes(random(64)); b.unshift(x); a.unshift.apply(a, x); return true },
+  unshiftByte: function(b, a) { var x = random(256); b.unshift(x); a.unshift(x); return true },
+  extendLeft:  function(b, a) { var x = bytes(random(300)); b.extendLeft(new ByteArray(x)); a.unshift.apply(a, x); return true },
+  extendRight: function(b, a) { var x = bytes(random(300)); b.extendRight(x); a.push.apply(a, x); return true },
+  unshiftSelf: function(b, a) { if (a.length < 2048) { b.unshift(b); a.unshift.apply(a, a.slice()) } return true },
+  concatSelf:  function(b, a) { if (a.length < 2048) { b.concat(b); a.push.apply(a, a.slice()) } return true },
+  spliceFront: function(b, a) { if (!a.length) return true; var n = random(Math.min(a.length, 1100) + 1);
+                                return same(b.splice(0, n), a.splice(0, n)) },
+  spliceAny:   function(b, a) { if (!a.length) return true; var s = random(a.length), e = s + random(a.length - s + 1);
+                                return same(b.splice(s, e), a.splice(s, e - s)) },
+  truncate:    function(b, a) { var n = random(a.length + 1); b.length = n; a.length = n; return true },
+  lengthen:    function(b, a) { var n = a.length + random(64); b.length = n; while (a.length < n) a.push(0); return true },
+  reverse:     function(b, a) { b.reverse(); a.reverse(); return true },
+  store:       function(b, a) { if (a.length) { var i = random(a.length); b[i] = a[i] = random(256) } return true },
+  slice:       function(b, a, saved) { if (a.length < 2048) return true;
+                                       var s = random(a.length >> 2), e = a.length - random(a.length >> 2);
+                                       var c = b.slice(s, e);
+                                       saved.push({ slice: c, model: a.slice(s, e) });
+                                       return same(c, a.slice(s, e)) },
+  storeSlice:  function(b, a, saved) { if (saved.length) { var o = saved[random(saved.length)];
+                                       if (o.model.length) { var i = random(o.model.length); o.slice[i] = o.model[i] = random(256) } }
+                                       return true },
+  shiftSlice:  function(b, a, saved) { if (!saved.length) return true; var o = saved[random(saved.length)];
+                                       return o.slice.shift() === o.model.shift() },
+};
+const opNames = [name for (name in ops)];
+
+/** Run count random operations from seed s, checking the ByteArray against its model after each */
+function randomRun(s, count)
+{
+  var b = new ByteArray(), a = [], saved = [], name, i, j;
+
+  seed = s;
+  for (i = 0; i < count; i++)
+  {
+    name = a.length > 8192 ? 'spliceFront' : opNames[random(opNames.length)];
+    if (!ops[name](b, a, saved) || !same(b, a))
+    {
+      print('seed ' + s + ', operation ' + i + ' (' + name + '): ByteArray differs from Array');
+      return false;
+    }
+
+    if (i % 250 == 0)
+    {
+      for (j = 0; j < saved.length; j++)
+        if (!same(saved[j].slice, saved[j].model))
+        {
+          print('seed ' + s + ', operation ' + i + ' (' + name + '): slice ' + j + ' differs from Array');
+          return false;
+        }
+      if (saved.length > 6)
+        saved.splice(0, 3);
+      vm.GC();
+    }
+  }
+  return true;
+}
+
+/** A ByteArray of length bytes counting up from first, modulo 256 */
+function pattern(length, first) { var b = new ByteArray(length); for (var i = 0; i < length; i++) b[i] = (i + first) & 255; return b }
+function isPattern(b, first) { for (var i = 0; i < b.length; i++) if (b[i] !== ((i + first) & 255)) return false; return true }
+
+var tests = [
+/* Random operations, compared with Array */
+function() randomRun(1, 3000),
+function() randomRun(2, 3000),
+function() randomRun(3, 3000),
+function() randomRun(42, 3000),
+function() randomRun(0xdead, 3000),
+/* A stream written in 768-byte blocks and read in 1KB splices arrives in order */
+function(t){var fifo=new ByteArray(), block=pattern(768,0), read=0, ok=true;
+            for (var sent=0; sent<768*333; sent+=768) {
+              fifo.extendRight(block);
+              while (fifo.length >= 1024) { ok = ok && isPattern(fifo.splice(0,1024), read & 255); read+=1024 }
+            }
+            return t.eq(ok, true) && t.eq(read + fifo.length, 768*333)},
+/* ...and read a byte at a time */
+function(t){var fifo=new ByteArray(), n=0, ok=true;
+            for (var i=0; i<200; i++) { fifo.extendRight(pattern(97, n + fifo.length)); while (fifo.length > 50) ok = ok && fifo.shift() === (n++ & 255) }
+            while (fifo.length) ok = ok && fifo.shift() === (n++ & 255);
+            return t.eq(ok, true) && t.eq(n, 200*97) && t.eq(fifo.shift(), undefined)},
+/* unshift() one byte at a time, then shift() them all back out */
+function(t){var b=new ByteArray(), i; for (i=0; i<10000; i++) b.unshift(i & 255);
+            for (i=0; i<10000; i++) if (b[i] !== ((9999-i) & 255)) return false;
+            for (i=9999; i>=0; i--) if (b.shift() !== (i & 255)) return false;
+            return t.eq(b.length, 0)},
+/* Space made by shift() is reused by unshift(), and by push() */
+function(t){var b=pattern(4096,0); for (var i=0; i<100; i++) b.shift(); for (i=99; i>=0; i--) b.unshift(i); return t.eq(isPattern(b,0), true) && t.eq(b.length, 4096)},
+function(t){var b=pattern(4096,0); b.splice(0,4000); b.length=5000; return t.eq(isPattern(b.slice(0,96),4000), true) && t.eq(b[96], 0) && t.eq(b[4999], 0)},
+function(t){var b=pattern(4096,0); b.splice(0,2000); for (var i=0; i<3000; i++) b.push((4096+i) & 255); return t.eq(isPattern(b,2000), true)},
+/* Emptied by shift(), a ByteArray starts again from the front of its memory */
+function(t){var b=pattern(100,0); while (b.length) b.shift(); b.push(1,2,3); b.unshift(0); return t.eq(b.toArray().join(), '0,1,2,3')},
+function(t){var b=pattern(100,0); b.splice(0,100); b.extendLeft([5,6]); b.extendRight([7]); return t.eq(b.toArray().join(), '5,6,7')},
+/* Copy-on-write slices of a ByteArray with room in front, written by either side */
+function(t){var b=pattern(4096,0); b.splice(0,500); var c=b.slice(0,b.length); b.unshift(1); return t.eq(isPattern(c,500), true) && t.eq(b[0], 1) && t.eq(isPattern(b.slice(1),500), true)},
+function(t){var b=pattern(4096,0); b.splice(0,500); var c=b.slice(0,b.length); c.shift(); c.unshift(9); b.shift(); return t.eq(c[0], 9) && t.eq(isPattern(c.slice(1),501), true) && t.eq(isPattern(b,501), true)},
+function(t){var b=pattern(4096,0); b.splice(0,500); var c=b.slice(100,b.length); b=null; vm.GC(); c.extendLeft([1,2]); return t.eq(isPattern(c.slice(2),600), true) && t.eq(c.length, 3498)},
+/* A ByteArray added to itself sees its contents as they were before the call */
+function(t){var b=pattern(300,0); b.splice(0,200); b.unshift(b); return t.eq(b.length, 200) && t.eq(isPattern(b.slice(0,100),200), true) && t.eq(isPattern(b.slice(100),200), true)},
+function(t){var b=pattern(300,0); b.splice(0,200); b.concat(b); return t.eq(b.length, 200) && t.eq(isPattern(b.slice(0,100),200), true) && t.eq(isPattern(b.slice(100),200), true)},
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
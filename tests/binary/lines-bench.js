@@ -0,0 +1,88 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+/* 
+ * @file	lines-bench.js	Throughput benchmark: fs-base Stream.readlines() (fgets)
+ *				versus Stream.lines() (binary.LineReader).
+ *
+ * Usage: gsr -f lines-bench.js [megabytes]
+ */
+
+const fs = require("fs-base");
+const binary = require("binary");
+const megabytes = +(require("system").args[1] || 64);
+const filename = "/tmp/lines-bench." + require("gpsee").pid;
+
+function timeIt(label, fn)
+{
+  var start = Date.now();
+  var count = fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + count + " lines in " + elapsed + "ms (" + Math.round(megabytes * 1000 / elapsed) + " MB/s)");
+}
+
+/* Build a file of log-like lines of varying length */
+var out = fs.openRaw(filename, { write: true, create: true, truncate: true });
+var block = [];
+for (let i = 0; i < 1024; i++)
+  block.push("2012-01-16 15:02:11 host" + (i % 17) + " daemon[" + i + "]: " + Array(i % 120).join("x"));
+block = new binary.ByteString(block.join("\n") + "\n", "ascii");
+for (let written = 0; written < megabytes * 1024 * 1024; written += block.length)
+  out.write(block);
+out.close();
+
+timeIt("readlines     ", function() {
+  var n = 0;
+  for (let line in fs.openRaw(filename, { read: true }).readlines())
+    n++;
+  return n;
+});
+
+timeIt("lines         ", function() {
+  var n = 0;
+  for (let line in fs.openRaw(filename, { read: true }).lines())
+    n++;
+  return n;
+});
+
+timeIt("mmap+LineReader", function() {
+  var n = 0;
+  for (let line in new binary.LineReader(fs.mmap(filename, "r")))
+    n++;
+  return n;
+});
+
+fs.remove(filename);
@@ -0,0 +1,221 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const binary     = require("binary");
+const ByteString = binary.ByteString;
+const ByteArray  = binary.ByteArray;
+const DataView   = binary.DataView;
+const fs         = require("fs-base");
+const gpsee      = require("gpsee");
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* Test material: a file a little over three pages long, holding byte i % 251 at offset i */
+const filename = "/tmp/mmap-test." + gpsee.pid;
+const size     = 3 * 4096 + 100;
+const contents = (function() { var a = []; for (var i = 0; i < size; i++) a.push(i % 251); return new ByteString(a) })();
+const MAP      = 'gpsee.byteThing.map';
+const READONLY = 'gpsee.byteThing.readOnly';
+
+function writeFile(bytes)
+{
+  var out = fs.openRaw(filename, { write: true, create: true, truncate: true });
+  out.write(bytes);
+  out.close();
+}
+
+/** Read the whole file back, without mmap */
+function readFile()
+{
+  var stream = fs.openRaw(filename, { read: true });
+  var bytes = new ByteString(stream.read());
+  stream.close();
+  return bytes;
+}
+
+/** Check that a mapping holds the bytes of the file from offset on */
+function holds(t, map, offset, length)
+{
+  return t.eq(gpsee.sizeofByteThing(map), length) &&
+         t.eq(new ByteString(map).toSource(), contents.slice(offset, offset + length).toSource());
+}
+
+writeFile(contents);
+
+var tests = [
+/* whole file, and unaligned regions */
+function(t) { return holds(t, fs.mmap(filename, 'r'), 0, size) },
+function(t) { return holds(t, fs.mmap(filename, 'r', 0, 10), 0, 10) },
+function(t) { return holds(t, fs.mmap(filename, 'r', 1, 10), 1, 10) },
+function(t) { return holds(t, fs.mmap(filename, 'r', 4095, 2), 4095, 2) },
+function(t) { return holds(t, fs.mmap(filename, 'r', 5000, 4000), 5000, 4000) },
+function(t) { return holds(t, fs.mmap(filename, 'r', size - 1, 1), size - 1, 1) },
+/* zero length maps to the end of the file; at the end of the file, that is nothing */
+function(t) { return holds(t, fs.mmap(filename, 'r', 4096, 0), 4096, size - 4096) },
+function(t) { return holds(t, fs.mmap(filename, 'r', 4097), 4097, size - 4097) },
+function(t) { return t.eq(gpsee.sizeofByteThing(fs.mmap(filename, 'r', size)), 0) },
+/* regions past the end of the file are refused rather than left to raise SIGBUS */
+function(t) { t.ex = t.sw(MAP + '.offset'); fs.mmap(filename, 'r', size + 1) },
+function(t) { t.ex = t.sw(MAP + '.offset'); fs.mmap(filename, 'r', size + 8192, 1) },
+function(t) { t.ex = t.sw(MAP + '.length'); fs.mmap(filename, 'r', 0, size + 1) },
+function(t) { t.ex = t.sw(MAP + '.length'); fs.mmap(filename, 'r', size - 10, 11) },
+function(t) { t.ex = t.sw(MAP + '.length'); fs.mmap(filename, 'r', 4096 * 3, 4096) },
+/* read-only mappings refuse writes instead of faulting */
+function(t) { t.ex = t.sw(READONLY); new DataView(fs.mmap(filename, 'r'), 'uint8').set(0, 1) },
+function(t) { t.ex = t.sw(READONLY); new DataView(fs.mmap(filename, 'r', 4097, 10), 'uint16').writeArray(0, [1, 2]) },
+function(t) { return t.eq(new DataView(fs.mmap(filename, 'r', 4097, 10), 'uint8').get(0), 4097 % 251) },
+/* writable mappings: private ones leave the file alone, shared ones write through */
+function(t) { var map = fs.mmap(filename, { read: true, write: true, private: true }, 4097, 10); 
+              new DataView(map, 'uint8').set(0, 7); 
+              return t.eq(new ByteString(map).get(0), 7) && t.eq(readFile().toSource(), contents.toSource()) },
+function(t) { var map = fs.mmap(filename, 'rw', 4097, 10);
+              new DataView(map, 'uint8').set(1, 9); map.sync();
+              var after = readFile();
+              writeFile(contents);
+              return t.eq(after.get(4098), 9) && t.eq(after.get(4097), 4097 % 251) && t.eq(after.length, size) },
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
+
+fs.remove(filename);
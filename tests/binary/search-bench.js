@@ -0,0 +1,79 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+/* 
+ * @file	search-bench.js	Throughput benchmark for multi-byte ByteString.indexOf(),
+ *				lastIndexOf() and split() on MB-scale inputs. The naive
+ *				figures search by calling single-byte indexOf() and comparing
+ *				the remaining bytes in script, as was necessary before these
+ *				methods accepted multi-byte needles.
+ *
+ * Usage: gsr -f search-bench.js [megabytes]
+ */
+
+const binary = require("binary");
+const megabytes = +(require("system").args[1] || 16);
+
+function timeIt(label, fn)
+{
+  var start = Date.now();
+  var result = fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + result + " in " + elapsed + "ms (" + Math.round(megabytes * 1000 / elapsed) + " MB/s)");
+}
+
+/* Build a haystack full of near-misses for the needle */
+var chunk = [];
+for (let i = 0; i < 4096; i++)
+  chunk.push("Content-Length: " + i + "\r\nContent-Type: text/plain\r\n");
+chunk = chunk.join("");
+var haystack = new binary.ByteString(Array(Math.ceil(megabytes * 1024 * 1024 / chunk.length) + 1).join(chunk) + "\r\n\r\nbody", "ascii");
+var needle = new binary.ByteString("\r\n\r\n", "ascii");
+
+timeIt("naive indexOf  ", function() {
+  var i = -1;
+  while ((i = haystack.indexOf(13, i + 1)) != -1)
+  {
+    if (haystack.get(i + 1) == 10 && haystack.get(i + 2) == 13 && haystack.get(i + 3) == 10)
+      break;
+  }
+  return i;
+});
+
+timeIt("indexOf        ", function() haystack.indexOf(needle));
+timeIt("lastIndexOf    ", function() haystack.lastIndexOf(needle));
+timeIt("split (1 byte) ", function() haystack.split(10).length + " chunks");
+timeIt("split (2 bytes)", function() haystack.split(new binary.ByteString("\r\n", "ascii")).length + " chunks");
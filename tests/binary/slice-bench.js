@@ -0,0 +1,117 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+
+/* 
+ * @file	slice-bench.js	Speed and memory benchmark for ByteString and ByteArray
+ *				slicing. Carves many large slices out of a big payload, the
+ *				way protocol parsers do, and reports the elapsed time and the
+ *				growth in resident set size. Slices of ByteStrings share the
+ *				parent's memory; large ByteArray slices are copy-on-write, so
+ *				the final run, which writes to every slice, pays for the copies.
+ *
+ * Usage: gsr -f slice-bench.js [megabytes] [slices]
+ */
+
+const binary = require("binary");
+const fs = require("fs-base");
+const megabytes = +(require("system").args[1] || 16);
+const nSlices = +(require("system").args[2] || 256);
+
+/** Resident set size in KB, from /proc/self/statm; 0 where that is unavailable */
+function rss()
+{
+  try
+  {
+    var statm = fs.openRaw("/proc/self/statm", { read: true });
+    var pages = statm.read().decodeToString("ascii").split(" ")[1];
+    statm.close();
+    return pages * 4;
+  }
+  catch(e)
+  {
+    return 0;
+  }
+}
+
+function timeIt(label, fn)
+{
+  var before, start, elapsed, slices;
+
+  before = rss();
+  start = Date.now();
+  slices = fn();
+  elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + slices.length + " slices in " + elapsed + "ms, RSS +" + (rss() - before) + "KB");
+}
+
+var bytes = megabytes * 1024 * 1024;
+var payload = new binary.ByteArray(bytes);
+for (let i = 0; i < bytes; i += 4096)
+  payload[i] = i & 0xff;
+var payloadString = payload.toByteString();
+
+timeIt("ByteString.slice    ", function() {
+  var a = [];
+  for (let i = 0; i < nSlices; i++)
+    a.push(payloadString.slice(i, bytes - i));
+  return a;
+});
+
+timeIt("ByteString.substr   ", function() {
+  var a = [];
+  for (let i = 0; i < nSlices; i++)
+    a.push(payloadString.substr(i, bytes / 2));
+  return a;
+});
+
+timeIt("ByteArray.slice     ", function() {
+  var a = [];
+  for (let i = 0; i < nSlices; i++)
+    a.push(payload.slice(i, bytes - i));
+  return a;
+});
+
+timeIt("ByteArray.slice+set ", function() {
+  var a = [];
+  for (let i = 0; i < nSlices; i++)
+  {
+    let s = payload.slice(i, bytes - i);
+    s[0] = 1;
+    a.push(s);
+  }
+  return a;
+});
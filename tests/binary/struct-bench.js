@@ -0,0 +1,123 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+
+/* 
+ * @file	struct-bench.js		Benchmark for building and parsing records of nine C ints
+ *					(a struct tm) with gffi.MutableStruct versus binary.Struct.
+ *
+ * Usage: gsr -f struct-bench.js [iterations]
+ */
+
+const binary = require("binary");
+const ffi = require("gffi");
+const iterations = +(require("system").args[1] || 100000);
+const fields = [ "tm_sec", "tm_min", "tm_hour", "tm_mday", "tm_mon", "tm_year", "tm_wday", "tm_yday", "tm_isdst" ];
+const tmStruct = new binary.Struct("@9i");
+
+function timeIt(label, fn)
+{
+  var start = Date.now();
+  var result = fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + iterations + " records in " + elapsed + "ms (" + Math.round(iterations * 1000 / elapsed) + "/s)");
+  return result;
+}
+
+var mutableBytes = timeIt("MutableStruct pack  ", function() {
+  var bs;
+  for (var i = 0; i < iterations; i++)
+  {
+    var tm = new ffi.MutableStruct("struct tm");
+    for (var f = 0; f < fields.length; f++)
+      tm[fields[f]] = i + f;
+    bs = binary.ByteString(tm, tmStruct.size);
+  }
+  return bs;
+});
+
+var structBytes = timeIt("Struct.pack          ", function() {
+  var bs;
+  for (var i = 0; i < iterations; i++)
+    bs = tmStruct.pack(i, i + 1, i + 2, i + 3, i + 4, i + 5, i + 6, i + 7, i + 8);
+  return bs;
+});
+
+if (mutableBytes.decodeToString("iso-8859-1") != structBytes.slice(0, mutableBytes.length).decodeToString("iso-8859-1"))
+  print("note: struct tm has members beyond the nine standard ints on this platform");
+
+var ba = new binary.ByteArray();
+timeIt("Struct.packInto      ", function() {
+  var offset = 0;
+  for (var i = 0; i < iterations; i++)
+    offset = tmStruct.packInto(ba, offset, i, i + 1, i + 2, i + 3, i + 4, i + 5, i + 6, i + 7, i + 8);
+});
+
+var records = ba.toByteString();
+
+timeIt("MutableStruct unpack ", function() {
+  var sum = 0;
+  for (var i = 0; i < iterations; i++)
+  {
+    var tm = ffi.MutableStruct(records.slice(i * tmStruct.size, (i + 1) * tmStruct.size));
+    sum += tm.tm_sec + tm.tm_isdst;
+  }
+  return sum;
+});
+
+timeIt("Struct.unpack        ", function() {
+  var sum = 0;
+  for (var i = 0; i < iterations; i++)
+  {
+    var r = tmStruct.unpack(records, i * tmStruct.size);
+    sum += r[0] + r[8];
+  }
+  return sum;
+});
+
+timeIt("Struct.unpackAll     ", function() {
+  var all = tmStruct.unpackAll(records);
+  var sum = 0;
+  for (var i = 0; i < all.length; i++)
+    sum += all[i][0] + all[i][8];
+  return sum;
+});
+
+var hdr = new binary.Struct(">IHHq");
+var packed = hdr.pack(0xdeadbeef, 1, 65535, -2);
+var back = hdr.unpack(packed);
+if (packed.length != 16 || back[0] != 0xdeadbeef || back[1] != 1 || back[2] != 65535 || back[3] != -2)
+  throw new Error("Struct round trip failed: " + back);
@@ -0,0 +1,72 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+
+/* 
+ * @file	transcode-bench.js	Benchmark for transcoding many short strings, where the
+ *				cost of iconv_open() used to dominate. UTF-8 and ISO-8859-1
+ *				to and from String use the hand-written transcoders; the
+ *				other charsets go through iconv with cached descriptors.
+ *
+ * Usage: gsr -f transcode-bench.js [iterations]
+ */
+
+const binary = require("binary");
+const iterations = +(require("system").args[1] || 100000);
+const strings = [ "GET", "/index.html", "Content-Type", "text/html; charset=utf-8", "café", "€ 42" ];
+
+function timeIt(label, fn)
+{
+  var start = Date.now();
+  fn();
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + iterations + " strings in " + elapsed + "ms (" + Math.round(iterations * 1000 / elapsed) + "/s)");
+}
+
+for each (let charset in [ "utf-8", "iso-8859-1", "utf-16BE", "windows-1252" ])
+{
+  let encoded = strings.map(function(s) new binary.ByteString(s.replace("€", "E"), charset));
+
+  timeIt("encode " + charset + "\t", function() {
+    for (let i = 0; i < iterations; i++)
+      new binary.ByteString(strings[i % strings.length].replace("€", "E"), charset);
+  });
+
+  timeIt("decode " + charset + "\t", function() {
+    for (let i = 0; i < iterations; i++)
+      encoded[i % encoded.length].decodeToString(charset);
+  });
+}
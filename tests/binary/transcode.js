@@ -0,0 +1,248 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const binary     = require("binary");
+const ByteString = binary.ByteString;
+const ByteArray  = binary.ByteArray;
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+/* The hand-written transcoders handle String characters (whichever of utf-16LE and utf-16BE
+ * is native) to and from UTF-8 and ISO-8859-1; everything else goes through iconv. Each test
+ * below compares one of those conversions with the same conversion made by iconv, going 
+ * through UTF-32, which only iconv knows.
+ */
+const flavours = [ 'utf-16LE', 'utf-16BE' ];
+const samples  = [ '', 'A', 'plain ASCII, long enough for the word-at-a-time loops to run several times',
+                   'caf\u00e9', '\u00ff\u00e9 mixed \u00e8 Latin-1 \u0080\u00a0', '\u20ac 42', '\u07ff\u0800\uffff',
+                   '\ud834\udd1e', 'A\u00e9\u20ac\ud834\udd1e and then some more \u00e9\u20ac\udbff\udfff' ];
+const latin1   = samples.filter(function(s) !/[^\u0000-\u00ff]/.test(s));
+const TRANSCODE = 'gpsee.module.ca.page.binary.ByteString.toByteString.transcode';
+const DECODE    = 'ByteString.decodeToString.transcode';
+
+/** Transcode with iconv alone */
+function viaIconv(bytes, from, to)
+{
+  return bytes.toByteString(from, 'utf-32LE').toByteString('utf-32LE', to);
+}
+
+/** Compare the default transcoding of bytes from one charset to another with iconv's */
+function sameAsIconv(t, bytes, from, to)
+{
+  return t.eq(bytes.toByteString(from, to).toSource(), viaIconv(bytes, from, to).toSource());
+}
+
+/** Run fn(s, flavour) for each string and UTF-16 flavour; true if fn always is */
+function eachFlavour(strings, fn)
+{
+  for each (let flavour in flavours)
+    for each (let s in strings)
+      if (!fn(s, flavour))
+        return false;
+  return true;
+}
+
+/** Make a function for each element of list which calls fn with that element */
+function forEach(list, fn)
+{
+  return list.map(function(x) function() fn(x));
+}
+
+/** Expect every call of fn to throw an exception starting with prefix */
+function allThrow(t, prefix, fns)
+{
+  for each (let fn in fns)
+  {
+    try
+    {
+      fn();
+    }
+    catch(e)
+    {
+      if (t.sw(prefix)(e))
+        continue;
+      return false;
+    }
+    print('NO EXCEPTION FROM', fn);
+    return false;
+  }
+  return true;
+}
+
+var tests = [
+/* UTF-16 <-> UTF-8 */
+function(t) { return eachFlavour(samples, function(s, f) sameAsIconv(t, new ByteString(s, f), f, 'utf-8')) },
+function(t) { return eachFlavour(samples, function(s, f) sameAsIconv(t, new ByteString(s, 'utf-8'), 'utf-8', f)) },
+function(t) { return eachFlavour(samples, function(s, f) t.eq(new ByteString(s, f).toByteString(f, 'utf-8').decodeToString('utf-8'), s)) },
+/* UTF-16 <-> ISO-8859-1 */
+function(t) { return eachFlavour(latin1, function(s, f) sameAsIconv(t, new ByteString(s, f), f, 'iso-8859-1')) },
+function(t) { return eachFlavour(latin1, function(s, f) sameAsIconv(t, new ByteString(s, 'iso-8859-1'), 'iso-8859-1', f)) },
+function(t) { return t.eq(new ByteArray([99, 97, 102, 233]).decodeToString('latin1'), 'caf\u00e9') },
+/* decodeToString() through the hand-written transcoders and through iconv */
+function(t) { return samples.every(function(s) t.eq(new ByteString(s, 'utf-8').decodeToString('utf-8'), new ByteString(s, 'utf-32LE').decodeToString('utf-32LE'), s)) },
+/* same charset, different spelling: String characters named as a flavour are copied */
+function(t) { return eachFlavour(samples, function(s, f) t.eq(new ByteString(s, f).decodeToString(f), s)) },
+function(t) { return samples.every(function(s) t.eq(new ByteString(s, 'utf-8').toByteString('UTF8', 'utf-8').toSource(), new ByteString(s, 'utf-8').toSource())) },
+function(t) { return latin1.every(function(s) t.eq(new ByteString(s, 'latin1').toByteString('ISO-8859-1', 'l1').toSource(), new ByteString(s, 'latin1').toSource())) },
+/* odd-length UTF-16 is left to iconv, which rejects it */
+function(t) { return allThrow(t, TRANSCODE, forEach(flavours, function(f) new ByteString([0x41, 0x00, 0x42]).toByteString(f, 'utf-8'))) },
+function(t) { return allThrow(t, TRANSCODE, forEach(flavours, function(f) new ByteString([0x41]).toByteString(f, 'iso-8859-1'))) },
+function(t) { return allThrow(t, DECODE,    forEach(flavours, function(f) new ByteString([0x41, 0x00, 0x42]).decodeToString(f))) },
+/* unpaired surrogates: a high surrogate before a non-surrogate, at the end, and a lone low surrogate */
+function(t) { return allThrow(t, TRANSCODE, [ function() new ByteString([0x00, 0xd8, 0x41, 0x00]).toByteString('utf-16LE', 'utf-8'),
+                                              function() new ByteString([0xd8, 0x00, 0x00, 0x41]).toByteString('utf-16BE', 'utf-8'),
+                                              function() new ByteString([0x41, 0x00, 0x00, 0xd8]).toByteString('utf-16LE', 'utf-8'),
+                                              function() new ByteString([0x00, 0x41, 0xd8, 0x00]).toByteString('utf-16BE', 'utf-8'),
+                                              function() new ByteString([0x00, 0xdc, 0x41, 0x00]).toByteString('utf-16LE', 'utf-8'),
+                                              function() new ByteString([0xdc, 0x00, 0x00, 0x41]).toByteString('utf-16BE', 'utf-8') ]) },
+/* invalid UTF-8: stray continuation, overlong, encoded surrogate, truncated sequence, out of range */
+function(t) { return allThrow(t, TRANSCODE, forEach([ [0x41, 0x80], [0xc0, 0x80], [0xe0, 0x80, 0x80], [0xed, 0xa0, 0x80], [0xe2, 0x82], [0xf4, 0x90, 0x80, 0x80], [0xff] ],
+                                                      function(b) new ByteString(b).toByteString('utf-8', 'utf-16LE'))
+                                              .concat(forEach([ [0xc0, 0x80], [0xed, 0xa0, 0x80], [0xe2, 0x82] ],
+                                                              function(b) new ByteString(b).toByteString('utf-8', 'utf-16BE'))) ) },
+/* characters which do not fit in ISO-8859-1 */
+function(t) { return allThrow(t, TRANSCODE, forEach(flavours, function(f) new ByteString('\u20ac', f).toByteString(f, 'iso-8859-1'))) },
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include "gpsee.h"
+
+/* Exercise the asynchronous syslog sink. syslog is opened with LOG_PERROR, so that each
+ * message which reaches syslog is also copied to stderr; stderr is redirected to a file
+ * which we read back.
+ */
+
+static char captured[GPSEE_MAX_LOG_MESSAGE_SIZE * 8];
+
+/** Point stderr at a fresh temporary file; returns its descriptor for captureRead() */
+static int captureStart(void)
+{
+  FILE *tmp = tmpfile();
+
+  if (!tmp)
+    panic("UNEXPECTED: could not create temporary file\n");
+
+  fflush(stderr);
+  dup2(fileno(tmp), STDERR_FILENO);
+  return dup(fileno(tmp));
+}
+
+/** Read back everything written to the capture file */
+static const char *captureRead(int fd)
+{
+  ssize_t n;
+
+  lseek(fd, 0, SEEK_SET);
+  n = read(fd, captured, sizeof(captured) - 1);
+  captured[n > 0 ? n : 0] = '\0';
+  return captured;
+}
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "SUCCESS" : "FAILURE", what);
+}
+
+int main(int argc, char **argv)
+{
+  int           savedStderr = dup(STDERR_FILENO);
+  int           fd;
+  int           status;
+  pid_t         pid;
+  char          *big;
+  const char    *s, *e;
+
+  /* Messages still in the ring at exit() are written by the atexit() drain */
+  fd = captureStart();
+  fflush(stdout);
+  pid = fork();
+  if (pid == 0)
+  {
+    openlog("async-log-test", LOG_PERROR, LOG_USER);
+    if (gpsee_startAsyncLog(16, 0) != 0)
+      _exit(2);
+    gpsee_log(NULL, GLOG_NOTICE, "queued before exit");
+    exit(1);
+  }
+  waitpid(pid, &status, 0);
+  check(WIFEXITED(status) && WEXITSTATUS(status) == 1, "child exited through exit()");
+  check(strstr(captureRead(fd), "queued before exit") != NULL, "atexit() drains the ring");
+  close(fd);
+
+  /* Queued messages reach syslog, in order, once the sink stops */
+  fd = captureStart();
+  openlog("async-log-test", LOG_PERROR, LOG_USER);
+  if (gpsee_startAsyncLog(16, 0) != 0)
+    panic("UNEXPECTED: could not start async log\n");
+
+  gpsee_log(NULL, GLOG_NOTICE, "first %d", 1);
+  gpsee_log(NULL, GLOG_ERR, "urgent %d", 2);
+  check(strstr(captureRead(fd), "urgent 2") != NULL, "errors are written synchronously");
+  gpsee_log(NULL, GLOG_NOTICE, "second %d", 3);
+
+  big = malloc(GPSEE_MAX_LOG_MESSAGE_SIZE * 2);
+  memset(big, 'x', GPSEE_MAX_LOG_MESSAGE_SIZE * 2 - 1);
+  big[GPSEE_MAX_LOG_MESSAGE_SIZE * 2 - 1] = '\0';
+  gpsee_log(NULL, GLOG_NOTICE, "long:%s", big);
+  free(big);
+
+  gpsee_stopAsyncLog();
+  captureRead(fd);
+  dup2(savedStderr, STDERR_FILENO);
+
+  s = strstr(captured, "first 1");
+  e = strstr(captured, "second 3");
+  check(s && e && s < e, "queued messages reach syslog in order");
+
+  s = strstr(captured, "long:");
+  e = s ? strchr(s, '\n') : NULL;
+  check(s && e && (e - s) == GPSEE_MAX_LOG_MESSAGE_SIZE - 1, "long messages are truncated to fit");
+  check(s && e && strncmp(e - 3, "...", 3) == 0, "truncated messages end with an ellipsis");
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include "gpsee.h"
+
+/* Exercise the realm's context free list: a context given back by gpsee_destroyContext()
+ * and handed out again by gpsee_createContext() must look like a new one.
+ */
+
+static int	privateDestroyed;
+
+/** GPSEE uses panic() to panic, expects embedder to provide */
+JS_FRIEND_API(void) __attribute__((noreturn)) panic(const char *message)
+{
+  printf("fatal error: %s\n", message);
+  abort();
+}
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "SUCCESS" : "FAILURE", what);
+}
+
+static void quietReporter(JSContext *cx, const char *message, JSErrorReport *report)
+{
+}
+
+static JSBool privateCallback(JSContext *cx, uintN contextOp)
+{
+  if (contextOp == JSCONTEXT_DESTROY)
+    privateDestroyed++;
+  return JS_TRUE;
+}
+
+/** Evaluate a script on cx's global, returning its result as a C string (or "" on error) */
+static const char *eval(JSContext *cx, const char *script)
+{
+  jsval		v;
+  JSString	*str;
+
+  if (!JS_EvaluateScript(cx, JS_GetGlobalObject(cx), script, strlen(script), __FILE__, 1, &v))
+    return "";
+  if (!(str = JS_ValueToString(cx, v)))
+    return "";
+  return JS_GetStringBytes(str);
+}
+
+int main(int argc, char **argv)
+{
+  gpsee_interpreter_t	*jsi;
+  gpsee_realm_t		*realm;
+  JSContext		*cx, *first;
+  uint32		options;
+  size_t		parked;
+
+  jsi = gpsee_createInterpreter();
+  if (!jsi)
+    panic("UNEXPECTED: could not create interpreter");
+  realm = jsi->realm;
+  options = JS_GetOptions(jsi->grt->coreCx);
+
+  /* Leave a mess behind in a context, then give it back */
+  first = gpsee_createContext(realm);
+  if (!first)
+    panic("UNEXPECTED: could not create context");
+  check(strcmp(eval(first, "/(q+)/.exec('xqqx'); RegExp.$1"), "qq") == 0, "RegExp statics are set by exec()");
+  JS_SetOptions(first, options ^ JSOPTION_STRICT);
+  JS_SetErrorReporter(first, quietReporter);
+  JS_SetVersion(first, JSVERSION_1_5);
+  JS_SetPendingException(first, INT_TO_JSVAL(42));
+
+  parked = realm->freeContexts.count;
+  gpsee_destroyContext(first);
+  check(realm->freeContexts.count == parked + 1, "a context without private storage is parked");
+
+  /* ...and take it again */
+  cx = gpsee_createContext(realm);
+  check(cx == first, "the parked context is reused");
+  check(realm->freeContexts.count == parked, "reusing a context takes it off the free list");
+  check(JS_IsExceptionPending(cx) == JS_FALSE, "a reused context has no pending exception");
+  check(JS_GetGlobalObject(cx) == realm->globalObject, "a reused context has the realm's global");
+  check(JS_GetOptions(cx) == options, "a reused context has the runtime's options");
+  check(JS_GetVersion(cx) == JS_GetVersion(jsi->grt->coreCx), "a reused context has the runtime's version");
+  check(JS_SetErrorReporter(cx, gpsee_errorReporter) == gpsee_errorReporter, "a reused context has GPSEE's error reporter");
+  check(strcmp(eval(cx, "RegExp.$1 + RegExp.lastMatch"), "") == 0, "a reused context has no RegExp statics");
+  check(strcmp(eval(cx, "1 + 1"), "2") == 0, "a reused context runs scripts");
+  gpsee_destroyContext(cx);
+
+  /* Contexts with private storage are destroyed, so that its owner hears about it */
+  cx = gpsee_createContext(realm);
+  parked = realm->freeContexts.count;
+  if (!gpsee_getContextPrivate(cx, &privateDestroyed, sizeof(int), privateCallback))
+    panic("UNEXPECTED: could not allocate context-private storage");
+  gpsee_destroyContext(cx);
+  check(privateDestroyed == 1, "context-private storage sees JSCONTEXT_DESTROY");
+  check(realm->freeContexts.count == parked, "a context with private storage is not parked");
+
+  /* Contexts of another stack chunk size are never reused */
+  cx = gpsee_createContextWithStackChunkSize(realm, jsi->grt->stackChunkSize * 2);
+  check(cx && cx != first, "an odd-sized context is new");
+  check(strcmp(eval(cx, "'odd'"), "odd") == 0, "an odd-sized context runs scripts");
+  parked = realm->freeContexts.count;
+  gpsee_destroyContext(cx);
+  check(realm->freeContexts.count == parked, "an odd-sized context is not parked");
+
+  /* The free list holds at most contextCacheSize contexts */
+  {
+    JSContext	*many[64];
+    size_t	i, n = jsi->grt->contextCacheSize + 2;
+
+    if (n > sizeof(many) / sizeof(many[0]))
+      n = sizeof(many) / sizeof(many[0]);
+    for (i = 0; i < n; i++)
+      many[i] = gpsee_createContext(realm);
+    for (i = 0; i < n; i++)
+      gpsee_destroyContext(many[i]);
+    check(realm->freeContexts.count == jsi->grt->contextCacheSize, "the free list stops at gpsee_context_cache_size");
+  }
+
+  gpsee_destroyInterpreter(jsi);
+
+  return 0;
+}
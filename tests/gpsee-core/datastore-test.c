@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include "gpsee.h"
+
+/* Exercise GPSEE data stores from one thread. Every routine must leave the store's monitor
+ * before it returns; one which does not makes the next write on the same store wait
+ * forever, so an alarm turns a hang into a failure.
+ */
+
+#define WATCHDOG_SECONDS	30
+
+static int keys[4];
+
+/** GPSEE uses panic() to panic, expects embedder to provide */
+JS_FRIEND_API(void) __attribute__((noreturn)) panic(const char *message)
+{
+  printf("fatal error: %s\n", message);
+  abort();
+}
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "SUCCESS" : "FAILURE", what);
+}
+
+static JSBool countEntry(JSContext *cx, const void *key, void *value, void *private)
+{
+  (*(int *)private)++;
+  return JS_TRUE;
+}
+
+/** Remove every entry from inside forEach, as WillFinalize's finalizer sweep does */
+static JSBool removeEntry(JSContext *cx, const void *key, void *value, void *private)
+{
+  return gpsee_ds_remove((gpsee_dataStore_t)private, key) == value ? JS_TRUE : JS_FALSE;
+}
+
+int main(int argc, char **argv)
+{
+  gpsee_runtime_t	*grt;
+  gpsee_dataStore_t	store;
+  int			count;
+
+  alarm(WATCHDOG_SECONDS);
+
+  grt = gpsee_createRuntime();
+  if (!grt)
+    panic("UNEXPECTED: could not instantiate gpsee_runtime_t\n");
+
+  store = gpsee_ds_create(grt, 0, 0);
+  if (!store)
+    panic("UNEXPECTED: could not create data store\n");
+
+  check(gpsee_ds_hasData(NULL, store) == JS_FALSE, "a new store has no data");
+  check(gpsee_ds_put(store, &keys[0], &keys[1]) == JS_TRUE, "put after hasData on an empty store");
+  check(gpsee_ds_hasData(NULL, store) == JS_TRUE, "a store with an entry has data");
+  check(gpsee_ds_put(store, &keys[1], &keys[2]) == JS_TRUE, "put after hasData on a store with data");
+  check(gpsee_ds_get(store, &keys[0]) == &keys[1], "get after put");
+  check(gpsee_ds_put(store, &keys[2], &keys[3]) == JS_TRUE, "put after get");
+
+  count = 0;
+  check(gpsee_ds_forEach(NULL, store, countEntry, &count) == JS_TRUE && count == 3, "forEach sees every entry");
+  check(gpsee_ds_match_remove(store, &keys[2], &keys[0]) == JS_FALSE, "match_remove leaves a mismatched value");
+  check(gpsee_ds_match_remove(store, &keys[2], &keys[3]) == JS_TRUE, "match_remove after forEach");
+
+  if (gpsee_ds_hasData(NULL, store))
+    check(gpsee_ds_forEach(NULL, store, removeEntry, store) == JS_TRUE, "forEach can remove entries after hasData");
+  check(gpsee_ds_hasData(NULL, store) == JS_FALSE, "removing every entry leaves no data");
+
+  check(gpsee_ds_put(store, &keys[3], &keys[0]) == JS_TRUE, "put after emptying");
+  gpsee_ds_empty(store);
+  check(gpsee_ds_remove(store, &keys[3]) == NULL, "remove after empty");
+
+  gpsee_ds_destroy(store);
+  gpsee_destroyRuntime(grt);
+
+  return 0;
+}
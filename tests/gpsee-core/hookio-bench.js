@@ -0,0 +1,78 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+/* 
+ * @file	hookio-bench.js		Benchmark for print() through a hooked stdout, comparing
+ *					the unbuffered, line-buffered and fully-buffered policies.
+ *
+ * Usage: gsr -f hookio-bench.js [lines]
+ */
+
+const gpsee = require("gpsee");
+const lines = +(require("system").args[1] || 1000000);
+const STDOUT_FILENO = 1;
+
+var calls, bytes;
+
+function collect(s)
+{
+  calls++;
+  bytes += s.length;
+  return s.length;
+}
+
+function timeIt(mode, size)
+{
+  var start, elapsed;
+
+  calls = bytes = 0;
+  gpsee.hookFileDescriptor(STDOUT_FILENO, null, collect);
+  gpsee.setHookBuffering(STDOUT_FILENO, mode, size);
+
+  start = Date.now();
+  for (var i = 0; i < lines; i++)
+    print("line " + i);
+  gpsee.flushHook(STDOUT_FILENO);
+  elapsed = (Date.now() - start) || 1;
+
+  gpsee.hookFileDescriptor(STDOUT_FILENO, null, null);
+  print(mode + (size ? "/" + size : "") + ": " + lines + " lines, " + bytes + " bytes in " + calls + " hook calls, " 
+	+ elapsed + "ms (" + Math.round(lines * 1000 / elapsed) + " lines/s)");
+}
+
+timeIt("none");
+timeIt("line");
+timeIt("full");
+timeIt("full", 65536);
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include "gpsee.h"
+
+/* Exercise the output buffering policies of hooked file descriptors: when output reaches the
+ * hook, in what pieces, and that pending output is delivered before we read from a hooked
+ * descriptor or a terminal. The hooks record each delivery as [chunk], and each read as <read>.
+ */
+
+static char	delivered[1024];
+
+/** GPSEE uses panic() to panic, expects embedder to provide */
+JS_FRIEND_API(void) __attribute__((noreturn)) panic(const char *message)
+{
+  printf("fatal error: %s\n", message);
+  abort();
+}
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "SUCCESS" : "FAILURE", what);
+}
+
+/** Check what the hooks have seen since the last call, and forget it */
+static void expect(const char *want, const char *what)
+{
+  if (strcmp(delivered, want) != 0)
+    printf("  delivered '%s', expected '%s'\n", delivered, want);
+  check(strcmp(delivered, want) == 0, what);
+  delivered[0] = '\0';
+}
+
+/** Output hook: record one delivery */
+static JSBool output(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  JSString	*str = JS_ValueToString(cx, argv[0]);
+
+  if (!str)
+    return JS_FALSE;
+
+  snprintf(delivered + strlen(delivered), sizeof(delivered) - strlen(delivered), "[%s]", JS_GetStringBytes(str));
+  return JS_TRUE;
+}
+
+/** Input hook: record the read, and return a line */
+static JSBool input(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  JSString	*str = JS_NewStringCopyZ(cx, "typed\n");
+
+  if (!str)
+    return JS_FALSE;
+
+  strncat(delivered, "<read>", sizeof(delivered) - strlen(delivered) - 1);
+  *rval = STRING_TO_JSVAL(str);
+  return JS_TRUE;
+}
+
+/** Make a native function into a rooted jsval */
+static jsval hookFunction(JSContext *cx, JSNative native, const char *name, jsval *root)
+{
+  JSFunction	*fn = JS_NewFunction(cx, native, 2, 0, NULL, name);
+
+  if (!fn)
+    panic("UNEXPECTED: could not create hook function");
+
+  *root = OBJECT_TO_JSVAL(JS_GetFunctionObject(fn));
+  if (!JS_AddNamedRoot(cx, root, name))
+    panic("UNEXPECTED: could not root hook function");
+
+  return *root;
+}
+
+int main(int argc, char **argv)
+{
+  gpsee_interpreter_t	*jsi;
+  JSContext		*cx;
+  jsval			outputFn, inputFn;
+  char			buf[64];
+  int			pipeFds[2];
+
+  jsi = gpsee_createInterpreter();
+  if (!jsi)
+    panic("UNEXPECTED: could not create interpreter");
+  cx = jsi->cx;
+
+  hookFunction(cx, output, "output", &outputFn);
+  hookFunction(cx, input, "input", &inputFn);
+  if (!gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, outputFn) ||
+      !gpsee_hookFileDescriptor(cx, STDERR_FILENO, JSVAL_VOID, outputFn))
+    panic("UNEXPECTED: could not hook stdout and stderr");
+  delivered[0] = '\0';
+
+  /* Line buffered, the default for stdout: delivered a line at a time */
+  gpsee_fputs(cx, "one ", stdout);
+  gpsee_fputs(cx, "two", stdout);
+  expect("", "line buffering holds output without a newline");
+  gpsee_fputs(cx, " three\n", stdout);
+  expect("[one two three\n]", "line buffering delivers on a newline, in one piece");
+  gpsee_printf(cx, "%s\n%s\n", "four", "five");
+  expect("[four\nfive\n]", "line buffering delivers several lines written at once together");
+  gpsee_fputc(cx, 'x', stdout);
+  gpsee_flushIOHook(cx, STDOUT_FILENO);
+  expect("[x]", "flushIOHook delivers a partial line");
+
+  /* Unbuffered, the default for stderr: delivered a write at a time */
+  gpsee_fputs(cx, "e1", stderr);
+  gpsee_fputc(cx, '2', stderr);
+  expect("[e1][2]", "stderr is unbuffered by default");
+
+  /* Fully buffered: delivered when the buffer would overflow */
+  if (!gpsee_setIOHookBuffering(cx, STDOUT_FILENO, _IOFBF, 16))
+    panic("UNEXPECTED: could not select full buffering");
+  gpsee_fputs(cx, "12345678\n", stdout);
+  gpsee_fputs(cx, "abcdef", stdout);
+  expect("", "full buffering ignores newlines");
+  gpsee_fputs(cx, "XY", stdout);
+  expect("[12345678\nabcdef]", "full buffering delivers what fits before overflowing");
+  gpsee_fputs(cx, "0123456789ABCDEF", stdout);
+  expect("[XY][0123456789ABCDEF]", "full buffering delivers once the buffer is full");
+
+  /* Changing the policy delivers what the old one held */
+  gpsee_fputs(cx, "held", stdout);
+  if (!gpsee_setIOHookBuffering(cx, STDOUT_FILENO, _IONBF, 0))
+    panic("UNEXPECTED: could not select no buffering");
+  expect("[held]", "changing the buffering policy delivers pending output");
+  gpsee_fputs(cx, "a", stdout);
+  gpsee_fputs(cx, "b\n", stdout);
+  expect("[a][b\n]", "unbuffered output is delivered a write at a time");
+
+  /* Output on any descriptor and the order of stdout and stderr are kept across policies */
+  if (!gpsee_setIOHookBuffering(cx, STDOUT_FILENO, _IOLBF, 0))
+    panic("UNEXPECTED: could not select line buffering");
+  gpsee_fputs(cx, "out\n", stdout);
+  gpsee_fputs(cx, "err", stderr);
+  gpsee_fputs(cx, "out2\n", stdout);
+  expect("[out\n][err][out2\n]", "stdout and stderr reach their hooks in the order written");
+
+  /* Reading from a hooked descriptor delivers pending output first */
+  if (!gpsee_hookFileDescriptor(cx, STDIN_FILENO, inputFn, JSVAL_VOID))
+    panic("UNEXPECTED: could not hook stdin");
+  gpsee_fputs(cx, "prompt> ", stdout);
+  check(gpsee_fgets(cx, buf, sizeof(buf), stdin) && strcmp(buf, "typed\n") == 0, "fgets returns what the input hook returned");
+  expect("[prompt> ]<read>", "a hooked read delivers the pending prompt first");
+  gpsee_fputs(cx, "more> ", stdout);
+  check(gpsee_fgetc(cx, stdin) == 't', "fgetc returns the first character from the input hook");
+  expect("[more> ]<read>", "a hooked fgetc delivers the pending prompt first");
+  if (!gpsee_hookFileDescriptor(cx, STDIN_FILENO, JSVAL_VOID, JSVAL_VOID))
+    panic("UNEXPECTED: could not unhook stdin");
+
+  /* Reading unhooked stdin delivers pending output first when it is a terminal, as stdio does */
+  if (pipe(pipeFds) != 0 || write(pipeFds[1], "piped\nagain\n", 12) != 12)
+    panic("UNEXPECTED: could not make pipe");
+  close(pipeFds[1]);
+  dup2(pipeFds[0], STDIN_FILENO);
+  clearerr(stdin);
+
+  setenv("GPSEE_STDIN_ISATTY", "1", 1);
+  gpsee_fputs(cx, "tty> ", stdout);
+  check(gpsee_fgets(cx, buf, sizeof(buf), stdin) && strcmp(buf, "piped\n") == 0, "unhooked fgets reads stdin");
+  expect("[tty> ]", "reading a terminal delivers the pending prompt first");
+
+  setenv("GPSEE_STDIN_ISATTY", "0", 1);
+  gpsee_fputs(cx, "pipe> ", stdout);
+  check(gpsee_fgets(cx, buf, sizeof(buf), stdin) && strcmp(buf, "again\n") == 0, "unhooked fgets reads stdin again");
+  expect("", "reading a pipe leaves a line-buffered prompt pending");
+  gpsee_flushIOHook(cx, -1);
+  expect("[pipe> ]", "the prompt is still delivered on flush");
+
+  gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, JSVAL_VOID);
+  gpsee_hookFileDescriptor(cx, STDERR_FILENO, JSVAL_VOID, JSVAL_VOID);
+  JS_RemoveRoot(cx, &outputFn);
+  JS_RemoveRoot(cx, &inputFn);
+  gpsee_destroyInterpreter(jsi);
+
+  return 0;
+}
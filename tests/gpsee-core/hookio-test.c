@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include "gpsee.h"
+
+/* Exercise hookable I/O from several threads: output hooks which write to each other's
+ * descriptors, and hooks which change while other threads write. A thread calling a hook
+ * while holding a descriptor's monitor deadlocks here, so an alarm turns a hang into a failure.
+ */
+
+#define WATCHDOG_SECONDS	60
+#define LINES			2000
+#define HOOK_CHANGES		500
+
+static gpsee_realm_t	*realm;
+static jsval		outHookFn, errHookFn, countHookFn;
+static PRInt32		seen[STDERR_FILENO + 1][128];	/* Characters given to each descriptor's output hooks */
+static char		captured[LINES * 4 + 1];
+
+static const char	*script =
+  "function outHook(s) { record(1, s); if (/a/.test(s)) writeFd(2, s.replace(/a/g, 'A')); }\n"
+  "function errHook(s) { record(2, s); if (/b/.test(s)) writeFd(1, s.replace(/b/g, 'B')); }\n"
+  "function countHook(s) { record(1, s); }\n";
+
+typedef struct
+{
+  FILE		*file;
+  const char	*line;
+} writer_t;
+
+/** GPSEE uses panic() to panic, expects embedder to provide */
+JS_FRIEND_API(void) __attribute__((noreturn)) panic(const char *message)
+{
+  printf("fatal error: %s\n", message);
+  abort();
+}
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "SUCCESS" : "FAILURE", what);
+}
+
+static PRThread *start(void (*fn)(void *), void *arg)
+{
+  PRThread *thread = PR_CreateThread(PR_USER_THREAD, fn, arg, PR_PRIORITY_NORMAL, PR_GLOBAL_THREAD, PR_JOINABLE_THREAD, 0);
+
+  if (!thread)
+    panic("UNEXPECTED: could not create thread");
+
+  return thread;
+}
+
+/** record(fd, string): count the characters an output hook was given */
+static JSBool record(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  int32		fd;
+  JSString	*str;
+  const char	*s;
+
+  if (!JS_ValueToInt32(cx, argv[0], &fd) || !(str = JS_ValueToString(cx, argv[1])))
+    return JS_FALSE;
+
+  for (s = JS_GetStringBytes(str); *s; s++)
+    PR_AtomicIncrement(&seen[fd][*s & 0x7f]);
+
+  return JS_TRUE;
+}
+
+/** writeFd(fd, string): write through the hookable I/O layer, as C code called by a hook might */
+static JSBool writeFd(JSContext *cx, JSObject *obj, uintN argc, jsval *argv, jsval *rval)
+{
+  int32		fd;
+  JSString	*str;
+
+  if (!JS_ValueToInt32(cx, argv[0], &fd) || !(str = JS_ValueToString(cx, argv[1])))
+    return JS_FALSE;
+
+  gpsee_fputs(cx, JS_GetStringBytes(str), fd == STDERR_FILENO ? stderr : stdout);
+  return JS_TRUE;
+}
+
+/** Write LINES lines outside of a request, as print() does */
+static void writer(void *arg)
+{
+  writer_t	*w = arg;
+  JSContext	*cx = gpsee_createContext(realm);
+  jsrefcount	depth;
+  int		i;
+
+  if (!cx)
+    panic("UNEXPECTED: could not create context");
+
+  depth = JS_SuspendRequest(cx);
+  for (i = 0; i < LINES; i++)
+    gpsee_fputs(cx, w->line, w->file);
+  JS_ResumeRequest(cx, depth);
+
+  gpsee_destroyContext(cx);
+}
+
+/** Switch stdout between two hooks while the writers run */
+static void rehooker(void *unused)
+{
+  JSContext	*cx = gpsee_createContext(realm);
+  int		i;
+
+  if (!cx)
+    panic("UNEXPECTED: could not create context");
+
+  for (i = 0; i < HOOK_CHANGES; i++)
+  {
+    gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, (i & 1) ? countHookFn : outHookFn);
+    JS_YieldRequest(cx);
+  }
+
+  gpsee_destroyContext(cx);
+}
+
+/** Hook and unhook stdout while the writers run, finishing hooked */
+static void unhooker(void *unused)
+{
+  JSContext	*cx = gpsee_createContext(realm);
+  int		i;
+
+  if (!cx)
+    panic("UNEXPECTED: could not create context");
+
+  for (i = 0; i < HOOK_CHANGES; i++)
+  {
+    gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, (i & 1) ? JSVAL_VOID : countHookFn);
+    JS_YieldRequest(cx);
+  }
+  gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, countHookFn);
+
+  gpsee_destroyContext(cx);
+}
+
+/** Run fn alongside two threads writing line to file, with cx's request suspended */
+static void race(JSContext *cx, void (*fn)(void *), writer_t *w1, writer_t *w2)
+{
+  PRThread	*threads[3];
+  jsrefcount	depth;
+  int		i;
+
+  memset(seen, 0, sizeof(seen));
+
+  depth = JS_SuspendRequest(cx);
+  threads[0] = start(writer, w1);
+  threads[1] = start(writer, w2);
+  threads[2] = fn ? start(fn, NULL) : NULL;
+  for (i = 0; i < 3; i++)
+    if (threads[i])
+      PR_JoinThread(threads[i]);
+  JS_ResumeRequest(cx, depth);
+
+  gpsee_flushIOHook(cx, -1);
+}
+
+int main(int argc, char **argv)
+{
+  gpsee_interpreter_t	*jsi;
+  JSContext		*cx;
+  jsval			v;
+  writer_t		aOut = { stdout, "a\n" }, bErr = { stderr, "b\n" }, cOut = { stdout, "c\n" };
+  int			savedStdout, fd, nCaptured, i;
+  ssize_t		n;
+  FILE			*tmp;
+
+  alarm(WATCHDOG_SECONDS);
+
+  jsi = gpsee_createInterpreter();
+  if (!jsi)
+    panic("UNEXPECTED: could not create interpreter");
+  cx = jsi->cx;
+  realm = jsi->realm;
+
+  if (!JS_DefineFunction(cx, jsi->globalObject, "record", record, 2, 0) ||
+      !JS_DefineFunction(cx, jsi->globalObject, "writeFd", writeFd, 2, 0) ||
+      !JS_EvaluateScript(cx, jsi->globalObject, script, strlen(script), __FILE__, 1, &v) ||
+      !JS_GetProperty(cx, jsi->globalObject, "outHook", &outHookFn) ||
+      !JS_GetProperty(cx, jsi->globalObject, "errHook", &errHookFn) ||
+      !JS_GetProperty(cx, jsi->globalObject, "countHook", &countHookFn))
+    panic("UNEXPECTED: could not define hooks");
+
+  /* Each hook writes to the other's descriptor, while threads write to both */
+  gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, outHookFn);
+  gpsee_hookFileDescriptor(cx, STDERR_FILENO, JSVAL_VOID, errHookFn);
+  race(cx, NULL, &aOut, &bErr);
+  check(seen[STDOUT_FILENO]['a'] == LINES, "stdout hook saw every line written to stdout");
+  check(seen[STDERR_FILENO]['b'] == LINES, "stderr hook saw every line written to stderr");
+  check(seen[STDERR_FILENO]['A'] == LINES, "stdout hook wrote every line to stderr");
+  check(seen[STDOUT_FILENO]['B'] == LINES, "stderr hook wrote every line to stdout");
+
+  /* Changing hooks while other threads write loses nothing */
+  race(cx, rehooker, &cOut, &cOut);
+  check(seen[STDOUT_FILENO]['c'] == LINES * 2, "every line reached one of the changing hooks");
+
+  /* Unhooked, output goes to the descriptor itself */
+  tmp = tmpfile();
+  if (!tmp)
+    panic("UNEXPECTED: could not create temporary file");
+  fflush(stdout);
+  savedStdout = dup(STDOUT_FILENO);
+  dup2(fileno(tmp), STDOUT_FILENO);
+  fd = dup(fileno(tmp));
+
+  race(cx, unhooker, &cOut, &cOut);
+  fflush(stdout);
+  dup2(savedStdout, STDOUT_FILENO);
+
+  lseek(fd, 0, SEEK_SET);
+  n = read(fd, captured, sizeof(captured) - 1);
+  for (i = 0, nCaptured = 0; i < n; i++)
+    if (captured[i] == 'c')
+      nCaptured++;
+  close(fd);
+  fclose(tmp);
+  check(seen[STDOUT_FILENO]['c'] + nCaptured == LINES * 2, "every line reached the hook or stdout while hooking and unhooking");
+
+  gpsee_hookFileDescriptor(cx, STDOUT_FILENO, JSVAL_VOID, JSVAL_VOID);
+  gpsee_hookFileDescriptor(cx, STDERR_FILENO, JSVAL_VOID, JSVAL_VOID);
+  gpsee_destroyInterpreter(jsi);
+
+  return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <signal.h>
+#include "gpsee.h"
+
+/* Exercise GPSEE's reader/writer monitors from several NSPR threads. */
+
+#define CONTENDERS	8
+#define ITERATIONS	20000
+
+static gpsee_monitor_t	monitor;
+static char		order[8];		/* Who got in, in order; guarded by monitor */
+static PRInt32		nOrder;
+static volatile int	counter;		/* Bumped twice per exclusive entry; guarded by monitor */
+static PRInt32		torn;			/* Readers which saw counter mid-update */
+static PRInt32		readersInside;
+
+/** GPSEE uses panic() to panic, expects embedder to provide */
+JS_FRIEND_API(void) __attribute__((noreturn)) panic(const char *message)
+{
+  printf("fatal error: %s\n", message);
+  abort();
+}
+
+static void check(int ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "SUCCESS" : "FAILURE", what);
+}
+
+static PRThread *start(void (*fn)(void *), void *arg)
+{
+  PRThread *thread = PR_CreateThread(PR_USER_THREAD, fn, arg, PR_PRIORITY_NORMAL, PR_GLOBAL_THREAD, PR_JOINABLE_THREAD, 0);
+
+  if (!thread)
+    panic("UNEXPECTED: could not create thread");
+
+  return thread;
+}
+
+static void writer(void *label)
+{
+  gpsee_enterMonitor(monitor);
+  order[nOrder++] = *(char *)label;
+  PR_Sleep(PR_MillisecondsToInterval(50));
+  gpsee_leaveMonitor(monitor);
+}
+
+static void reader(void *label)
+{
+  gpsee_enterMonitorShared(monitor);
+  order[PR_AtomicIncrement(&nOrder) - 1] = *(char *)label;
+  gpsee_leaveMonitor(monitor);
+}
+
+/** Wait inside the monitor, shared, until another reader is inside too */
+static void pairedReader(void *unused)
+{
+  int i;
+
+  gpsee_enterMonitorShared(monitor);
+  PR_AtomicIncrement(&readersInside);
+  for (i = 0; i < 200 && PR_AtomicAdd(&readersInside, 0) < 2; i++)
+    PR_Sleep(PR_MillisecondsToInterval(5));
+  gpsee_leaveMonitor(monitor);
+}
+
+/** Alternate exclusive updates and shared reads, hard enough to sleep on the monitor */
+static void contender(void *unused)
+{
+  int i, seen;
+
+  for (i = 0; i < ITERATIONS; i++)
+  {
+    gpsee_enterMonitor(monitor);
+    counter++;
+    counter++;
+    gpsee_leaveMonitor(monitor);
+
+    gpsee_enterMonitorShared(monitor);
+    seen = counter;
+    if (seen & 1)
+      PR_AtomicIncrement(&torn);
+    gpsee_leaveMonitor(monitor);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  gpsee_runtime_t	*grt;
+  PRThread		*threads[CONTENDERS];
+  int			i;
+
+  grt = gpsee_createRuntime();
+  if (!grt)
+    panic("UNEXPECTED: could not instantiate gpsee_runtime_t\n");
+  monitor = gpsee_createMonitor(grt, "monitor-test");
+
+  /* An exclusive holder may enter shared; that nests, and other writers wait for both leaves */
+  gpsee_enterMonitor(monitor);
+  gpsee_enterMonitorShared(monitor);
+  nOrder = 0;
+  threads[0] = start(writer, "W");
+  PR_Sleep(PR_MillisecondsToInterval(50));
+  gpsee_leaveMonitor(monitor);
+  PR_Sleep(PR_MillisecondsToInterval(50));
+  check(nOrder == 0, "leaving the nested shared entry does not release the monitor");
+  gpsee_leaveMonitor(monitor);
+  PR_JoinThread(threads[0]);
+  check(nOrder == 1 && order[0] == 'W', "writer gets in once the exclusive entry is left");
+
+  /* Readers share */
+  readersInside = 0;
+  threads[0] = start(pairedReader, NULL);
+  threads[1] = start(pairedReader, NULL);
+  PR_JoinThread(threads[0]);
+  PR_JoinThread(threads[1]);
+  check(readersInside == 2, "two readers are inside at once");
+
+  /* A waiting writer holds back new readers */
+  nOrder = 0;
+  gpsee_enterMonitorShared(monitor);
+  threads[0] = start(writer, "W");
+  PR_Sleep(PR_MillisecondsToInterval(100));	/* Let the writer start waiting */
+  threads[1] = start(reader, "R");
+  PR_Sleep(PR_MillisecondsToInterval(100));
+  check(nOrder == 0, "new reader waits behind a waiting writer");
+  gpsee_leaveMonitor(monitor);
+  PR_JoinThread(threads[0]);
+  PR_JoinThread(threads[1]);
+  check(nOrder == 2 && order[0] == 'W' && order[1] == 'R', "writer goes before the reader which arrived after it");
+
+  /* Every sleeper is woken; a lost wakeup hangs here */
+  counter = 0;
+  torn = 0;
+  for (i = 0; i < CONTENDERS; i++)
+    threads[i] = start(contender, NULL);
+  for (i = 0; i < CONTENDERS; i++)
+    PR_JoinThread(threads[i]);
+  check(counter == CONTENDERS * ITERATIONS * 2, "no exclusive updates were lost under contention");
+  check(torn == 0, "no reader saw an exclusive update in progress");
+
+#if defined(GPSEE_DEBUG_BUILD)
+  /* Entering shared twice would deadlock behind a waiting writer; debug builds assert */
+  {
+    pid_t	pid;
+    int		status;
+
+    fflush(stdout);
+    if ((pid = fork()) == 0)
+    {
+      gpsee_enterMonitorShared(monitor);
+      gpsee_enterMonitorShared(monitor);
+      _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    check(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "nested shared entry asserts");
+  }
+#endif
+
+  gpsee_destroyMonitor(grt, monitor);
+  gpsee_destroyRuntime(grt);
+
+  return 0;
+}
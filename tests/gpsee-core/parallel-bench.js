@@ -0,0 +1,106 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+/* 
+ * @file	parallel-bench.js	Scaling benchmark for thread.parallelMap() and 
+ *					thread.parallelReduce(), over an Array and a ByteString,
+ *					from 1 to N threads.
+ *
+ * Usage: gsr -f parallel-bench.js [elements] [maxThreads]
+ */
+
+const thread = require("thread");
+const binary = require("binary");
+const elements = +(require("system").args[1] || 1000000);
+const maxThreads = +(require("system").args[2] || 4);
+
+function work(x)
+{
+  var i, y = x;
+
+  for (i = 0; i < 50; i++)
+    y = (y * 31 + i) % 65521;
+
+  return y;
+}
+
+function add(a, b)
+{
+  return a + b;
+}
+
+function report(label, threads, start, baseline)
+{
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + elements + " elements on " + threads + " thread(s), " + elapsed + "ms"
+	+ (baseline ? ", speedup " + (baseline / elapsed).toFixed(2) : ""));
+  return elapsed;
+}
+
+function run(label, input)
+{
+  var start, baseline, sum, pool, threads, check;
+
+  start = Date.now();
+  check = 0;
+  for (var i = 0; i < input.length; i++)
+    check += work(input instanceof Array ? input[i] : input.get(i));
+  baseline = report(label + " sequential", 1, start);
+
+  /* The calling thread takes chunks too, so a pool of n-1 workers runs on n threads */
+  for (threads = 2; threads <= maxThreads; threads++)
+  {
+    pool = new thread.Pool(threads - 1);
+
+    start = Date.now();
+    sum = thread.parallelReduce(thread.parallelMap(input, work, { pool: pool }), add, 0, { pool: pool });
+    report(label + " parallel", threads, start, baseline);
+
+    if (sum !== check)
+      throw new Error(label + ": parallel sum " + sum + " != sequential sum " + check);
+
+    pool.shutdown();
+  }
+}
+
+var array = new Array(elements);
+var bytes = new binary.ByteArray(elements);
+
+for (var i = 0; i < elements; i++)
+  array[i] = bytes[i] = i & 0xff;
+
+run("Array", array);
+run("ByteString", bytes.toByteString());
@@ -0,0 +1,109 @@
+// ***** BEGIN LICENSE BLOCK *****
+// Version: MPL 1.1/GPL 2.0/LGPL 2.1
+//
+// The contents of this file are subject to the Mozilla Public License Version
+// 1.1 (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+// http://www.mozilla.org/MPL/
+//
+// Software distributed under the License is distributed on an "AS IS" basis,
+// WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+// for the specific language governing rights and limitations under the
+// License.
+//
+// The Initial Developer of the Original Code is PageMail, Inc.
+//
+// Portions created by the Initial Developer are 
+// Copyright (c) 2012, PageMail, Inc. All Rights Reserved.
+//
+// Contributor(s):
+// 
+// Alternatively, the contents of this file may be used under the terms of
+// either of the GNU General Public License Version 2 or later (the "GPL"),
+// or the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+// in which case the provisions of the GPL or the LGPL are applicable instead
+// of those above. If you wish to allow use of your version of this file only
+// under the terms of either the GPL or the LGPL, and not to allow others to
+// use your version of this file under the terms of the MPL, indicate your
+// decision by deleting the provisions above and replace them with the notice
+// and other provisions required by the GPL or the LGPL. If you do not delete
+// the provisions above, a recipient may use your version of this file under
+// the terms of any one of the MPL, the GPL or the LGPL.
+//
+// ***** END LICENSE BLOCK ***** 
+//
+
+/* 
+ * @file	thread-pool-bench.js	Benchmark for many small tasks, run on a thread.Pool
+ *					versus one thread.Thread per task.
+ *
+ * Usage: gsr -f thread-pool-bench.js [tasks] [threads]
+ */
+
+const thread = require("thread");
+const tasks = +(require("system").args[1] || 100000);
+const threads = +(require("system").args[2] || 4);
+
+function work(a, b)
+{
+  return a * b + 1;
+}
+
+function report(label, start, sum)
+{
+  var elapsed = (Date.now() - start) || 1;
+
+  print(label + ": " + tasks + " tasks on " + threads + " threads, sum " + sum + ", " 
+	+ elapsed + "ms (" + Math.round(tasks * 1000 / elapsed) + " tasks/s)");
+}
+
+function viaPool()
+{
+  var pool = new thread.Pool(threads);
+  var futures = new Array(tasks);
+  var start = Date.now();
+  var sum = 0;
+  var i;
+
+  for (i = 0; i < tasks; i++)
+    futures[i] = pool.submit(work, [i, 3]);
+  for (i = 0; i < tasks; i++)
+    sum += futures[i].wait();
+
+  report("Pool", start, sum);
+  pool.shutdown();
+}
+
+/* Threads are started and joined in batches of 'threads', so both runs have the same concurrency */
+function viaThread()
+{
+  var batch = new Array(threads);
+  var start = Date.now();
+  var sum = 0;
+  var i, j, n;
+
+  function task(a)
+  {
+    return function() { this.result = work(a, 3); };
+  }
+
+  for (i = 0; i < tasks; i += n)
+  {
+    n = Math.min(threads, tasks - i);
+    for (j = 0; j < n; j++)
+    {
+      batch[j] = new thread.Thread(task(i + j));
+      batch[j].start();
+    }
+    for (j = 0; j < n; j++)
+    {
+      batch[j].join();
+      sum += batch[j].result;
+    }
+  }
+
+  report("Thread", start, sum);
+}
+
+viaPool();
+viaThread();
@@ -0,0 +1,4 @@
+/* Count our initializations, then linger so that other threads arrive while we load */
+require("./counter").loads++;
+require("thread").Thread.sleep(0.2);
+exports.token = Math.random();
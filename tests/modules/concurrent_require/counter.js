@@ -0,0 +1 @@
+exports.loads = 0;
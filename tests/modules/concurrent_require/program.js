@@ -0,0 +1,18 @@
+/* Several threads require the same module at once: it is initialized once, every
+ * thread waits for it to finish, and all of them get the same exports.
+ */
+const thread = require("thread");
+const pool = new thread.Pool(4);
+var futures = [], tokens = [], i;
+
+for (i = 0; i < 8; i++)
+  futures.push(pool.submit(function() { return require("./counted").token }));
+for (i = 0; i < futures.length; i++)
+  tokens.push(futures[i].wait());
+pool.shutdown();
+
+var ok = require("./counter").loads === 1 && typeof tokens[0] === "number";
+for (i = 1; i < tokens.length; i++)
+  ok = ok && tokens[i] === tokens[0];
+
+print(ok ? 'PASS' : 'FAIL');
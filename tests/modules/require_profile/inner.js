@@ -0,0 +1,5 @@
+/* Spend a measurable time in the module body, so that the profile has a time to check */
+var start = Date.now();
+while (Date.now() - start < 50);
+
+exports.loaded = true;
@@ -0,0 +1 @@
+exports.inner = require("./inner");
@@ -0,0 +1,6 @@
+/* Loads a module which loads another, then asks for both again. Run by require_profile.sh
+ * with the require() profiler on, which checks what the profiler reported.
+ */
+require("./outer");
+require("./outer");
+print(require("./inner").loaded ? 'PASS' : 'FAIL');
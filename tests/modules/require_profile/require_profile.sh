@@ -0,0 +1,44 @@
+#! /bin/sh
+#
+# Run program.js with the require() profiler on (gsr -P), and check the text report on
+# stderr and the Chrome trace written to $GPSEE_REQUIRE_TRACE.
+
+[ "$GSR" ] || GSR=/usr/bin/gsr
+path="`dirname $0`"
+report=/tmp/require_profile.$$.txt
+trace=/tmp/require_profile.$$.json
+
+check()
+{
+  if [ "$1" = "$2" ]; then
+    echo "OKAY: $3"
+  else
+    echo "FAIL: $3 (got '$1', expected '$2')"
+  fi
+}
+
+output="`GPSEE_REQUIRE_TRACE=$trace $GSR -CPF $path/program.js 2>$report`"
+check "$?" 0 "program exits normally with the profiler on"
+check "$output" PASS "program runs normally with the profiler on"
+
+# Report rows are: total, resolve, compile, exec, xdr bytes, then the module name indented by depth
+check "`grep -c '[^ ]  \./outer$' $report`"                  1 "outer is reported once, required by the program"
+check "`grep -c '[^ ]    \./inner$' $report`"                1 "inner is reported once, nested under outer"
+check "`grep -c '[^ ]  \./outer (already loaded)$' $report`" 1 "the second require of outer is reported as already loaded"
+check "`grep -c '[^ ]  \./inner (already loaded)$' $report`" 1 "the program's require of inner is reported as already loaded"
+
+calls="`sed -n 's/^require() profile: \([0-9]*\) calls.*/\1/p' $report`"
+rows="`sed -n '/total ms/,$p' $report | sed 1d | wc -l | tr -d ' '`"
+check "$calls" "$rows" "the call count matches the rows reported"
+
+check "`awk '/[^ ]    \.\/inner$/ { print ($4 >= 50) }' $report`" 1 "inner's body is timed at 50ms or more"
+check "`awk '/[^ ]  \.\/outer$/ { o = $1 } /[^ ]    \.\/inner$/ { i = $1 } END { print (o >= i) }' $report`" 1 \
+      "outer's time includes inner's"
+
+check "`head -c 15 $trace 2>/dev/null`"           '{"traceEvents":' "the trace is written to GPSEE_REQUIRE_TRACE"
+check "`grep -c '^{"name":"\./inner"' $trace`"    2 "the trace has an event for each require of inner"
+check "`grep -c '^{"name":"\./outer"' $trace`"    2 "the trace has an event for each require of outer"
+dur="`grep '^{"name":"execute".*inner' $trace | sed 's/.*"dur":\([0-9]*\).*/\1/'`"
+check "`[ "$dur" ] && [ "$dur" -ge 50000 ] && echo 1`" 1 "the trace times inner's body at 50ms or more"
+
+rm -f $report $trace
@@ -0,0 +1,3 @@
+exports.name = "a";
+require("thread").Thread.sleep(0.2);	/* Let b start loading on the other thread */
+exports.peer = require("./b").name;
@@ -0,0 +1,3 @@
+exports.name = "b";
+require("thread").Thread.sleep(0.2);	/* Let a start loading on the other thread */
+exports.peer = require("./a").name;
@@ -0,0 +1,14 @@
+/* a requires b and b requires a, loaded from two threads at once. Each thread ends up
+ * waiting on a module the other is loading; the second to notice is given the partly
+ * initialized exports, as a single-threaded cycle would be, instead of deadlocking.
+ */
+const thread = require("thread");
+const pool = new thread.Pool(2);
+var fa = pool.submit(function() { return require("./a").peer });
+var fb = pool.submit(function() { return require("./b").peer });
+
+var ok = fa.wait() === "b" && fb.wait() === "a";
+pool.shutdown();
+
+ok = ok && require("./a").peer === "b" && require("./b").peer === "a";
+print(ok ? 'PASS' : 'FAIL');
@@ -0,0 +1,224 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const thread = require("thread");
+const binary = require("binary");
+const vm = require("vm");
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+const PFX = "gpsee.module.ca.page.thread.Channel.";
+
+var pool = new thread.Pool(2);
+
+/* Send a value and return the copy which comes out the other end */
+function roundTrip(v) { var ch = new thread.Channel(); ch.send(v); return ch.receive(); }
+
+/* A ByteString of length bytes, where byte n is n % 251 */
+function bytes(length) { var a = new binary.ByteArray(length); for (var n = 0; n < length; n++) a[n] = n % 251; return a.toByteString(); }
+
+/* Returns b.length if byte n of b is (offset + n) % 251 throughout, otherwise -1 */
+function checkBytes(b, offset) { for (var n = 0; n < b.length; n++) if (b.get(n) !== (offset + n) % 251) return -1; return b.length; }
+
+/* Run on a worker: send [id, n] for n = 0..count-1 */
+function sendSequence(ch, id, count) { for (var n = 0; n < count; n++) ch.send([id, n]); return count; }
+
+/* Run on a worker: send until the channel is closed, and report how many sends succeeded */
+function sendUntilClosed(ch) { var n = 0; try { for (;;) { ch.send(n); n++; } } catch(e) { if (!/\.send\.closed/.test(e.message)) throw e; } return n; }
+
+var tests = [
+/* Values survive the trip, as copies */
+function(t) { return t.eq(roundTrip(42), 42) && t.eq(roundTrip("str"), "str") && t.eq(roundTrip(null), null) && t.eq(roundTrip(undefined), undefined) && t.eq(roundTrip(true), true) },
+function(t) { var v = { a: [1, "two", { three: 3 }], b: null }; return t.eq(uneval(roundTrip(v)), uneval(v)) },
+function(t) { var v = [1, 2]; var c = roundTrip(v); c.push(3); return t.eq(v.length, 2) },
+function(t) { var b = roundTrip(new binary.ByteString("hello", "ascii")); return t.eq(b instanceof binary.ByteString, true) && t.eq(b.decodeToString("ascii"), "hello") },
+/* Values come out in the order they were sent */
+function(t) { var ch = new thread.Channel(), i; for (i = 0; i < 1000; i++) ch.send(i); 
+              for (i = 0; i < 1000; i++) if (ch.receive() !== i) return false; return t.eq(ch.length, 0) },
+function(t) { var ch = new thread.Channel(), next = [0, 0], msg, i;
+              var f = [pool.submit(sendSequence, [ch, 0, 500]), pool.submit(sendSequence, [ch, 1, 500])];
+              for (i = 0; i < 1000; i++) { msg = ch.receive(); if (msg[1] !== next[msg[0]]++) return false; }
+              return t.eq(f[0].wait() + f[1].wait(), 1000) && t.eq(next[0], 500) && t.eq(next[1], 500) },
+/* length and tryReceive */
+function(t) { var ch = new thread.Channel(); ch.send(1); ch.send(2); return t.eq(ch.length, 2) && t.eq(ch.tryReceive(), 1) && t.eq(ch.length, 1) },
+function(t) { var ch = new thread.Channel(); return t.eq(ch.tryReceive(), undefined) && t.eq(ch.tryReceive("none"), "none") },
+/* close(): what was sent can still be received, then receive() throws and send() throws */
+function(t) { var ch = new thread.Channel(); ch.send(1); ch.close(); ch.close(); return t.eq(ch.closed, true) && t.eq(ch.receive(), 1) && t.eq(ch.tryReceive("empty"), "empty") },
+function(t) { var ch = new thread.Channel(); ch.close(); t.ex = t.sw(PFX + "receive.closed"); ch.receive() },
+function(t) { var ch = new thread.Channel(); ch.close(); t.ex = t.sw(PFX + "send.closed"); ch.send(1) },
+function(t) { var ch = new thread.Channel(); var f = pool.submit(function(ch) { return ch.receive() }, [ch]);
+              thread.Thread.sleep(0.05); ch.close(); 
+              t.ex = t.sw(PFX + "receive.closed"); f.wait() },
+/* Every send that did not throw is received, even when close() races the senders */
+function(t) { var ch = new thread.Channel(), received = 0, sent, f;
+              f = [pool.submit(sendUntilClosed, [ch]), pool.submit(sendUntilClosed, [ch])];
+              while (ch.length < 1000);
+              ch.close();
+              sent = f[0].wait() + f[1].wait();
+              while (ch.tryReceive(null) !== null) received++;
+              return t.eq(received, sent) },
+/* The received ByteString holds the byte store; the sender's object may be collected first */
+function(t) { var ch = new thread.Channel();
+              (function() { ch.send(bytes(65536)); })();
+              vm.GC(); vm.GC();
+              return t.eq(pool.submit(function(ch) { return checkBytes(ch.receive(), 0) }, [ch]).wait(), 65536) },
+function(t) { var ch = new thread.Channel();
+              (function() { ch.send(bytes(65536).slice(1000, 5000)); })();
+              vm.GC(); vm.GC();
+              return t.eq(pool.submit(function(ch) { return checkBytes(ch.receive(), 1000) }, [ch]).wait(), 4000) },
+function(t) { var ch = new thread.Channel(), b;
+              pool.submit(function(ch) { ch.send(bytes(4096)) }, [ch]).wait();
+              vm.GC(); vm.GC();
+              b = ch.receive(); vm.GC();
+              return t.eq(checkBytes(b, 0), 4096) },
+/* Only values which cannot change under the receiver are sent */
+function(t) { t.ex = t.sw(PFX + "send.byteThing.mutable"); new thread.Channel().send(new binary.ByteArray(4)) },
+function(t) { t.ex = t.sw(PFX + "send.byteThing.mutable"); new thread.Channel().send({ data: [new binary.ByteArray(4)] }) },
+function(t) { var ch = new thread.Channel(); try { ch.send([1, new binary.ByteArray(4)]) } catch(e) {} return t.eq(ch.length, 0) },
+function(t) { t.ex = t.sw(PFX + "send.type"); new thread.Channel().send(new Date()) },
+function(t) { var a = []; a.push(a); t.ex = t.sw(PFX + "send.depth"); new thread.Channel().send(a) },
+function(t) { pool.shutdown(); return true },
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
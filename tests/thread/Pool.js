@@ -0,0 +1,197 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const thread = require("thread");
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+const PFX = "gpsee.module.ca.page.thread.Pool.";
+
+/* Shared by the tests below; shut down by the last one */
+var pool = new thread.Pool(2);
+
+function add(a, b) { return a + b; }
+
+var tests = [
+/* Futures return the function's value, or rethrow its exception */
+function(t) { return t.eq(pool.submit(add, [2, 3]).wait(), 5) },
+function(t) { return t.eq(pool.submit(function() { return "no args" }).wait(), "no args") },
+function(t) { var f = pool.submit(add, [1, 1]); f.wait(); return t.eq(f.done, true) && t.eq(f.wait(), 2) },
+function(t) { t.ex = function(e) { return t.eq(e, "boom") }; pool.submit(function() { throw "boom" }).wait() },
+function(t) { var f = pool.submit(function() { throw new Error("again") }); 
+              try { f.wait() } catch(e) { return t.eq(f.done, true) && t.eq(e instanceof Error, true) && t.eq(e.message, "again") } return false },
+/* The Future rejects with the very object thrown, not a report of it */
+function(t) { var err = new TypeError("original"), f = pool.submit(function(e) { throw e }, [err]);
+              try { f.wait() } catch(e) { return t.eq(e === err, true) && t.eq(e.message, "original") && t.eq(e.name, "TypeError") } return false },
+function(t) { var f = pool.submit(function() { null.property });
+              try { f.wait() } catch(e) { return t.eq(e instanceof TypeError, true) && t.eq(typeof e.message, "string") } return false },
+/* onWorker tells the pool's workers from everybody else */
+function(t) { return t.eq(pool.onWorker, false) && t.eq(pool.submit(function() { return pool.onWorker }).wait(), true) },
+function(t) { var other = new thread.Pool(1), onOther = other.submit(function() { return pool.onWorker }).wait();
+              other.shutdown(); return t.eq(onOther, false) },
+/* Every task runs exactly once, whichever worker picks it up */
+function(t) { var futures = [], sum = 0, i;
+              for (i = 0; i < 500; i++) futures.push(pool.submit(add, [i, 1]));
+              for (i = 0; i < futures.length; i++) sum += futures[i].wait();
+              return t.eq(sum, 500 * 499 / 2 + 500) },
+/* Properties */
+function(t) { return t.eq(pool.size, 2) && t.eq(typeof pool.pending, "number") },
+function(t) { return t.eq(thread.Pool.prototype.size, undefined) && t.eq(thread.Pool.prototype.pending, undefined) },
+function(t) { var names = []; for (var name in thread.Pool.prototype) names.push(name); return t.eq(names.indexOf("size") != -1, true) },
+/* Argument checking */
+function(t) { t.ex = t.sw(PFX + "constructor.arguments.0.range"); new thread.Pool(0) },
+function(t) { t.ex = t.sw(PFX + "submit.arguments.0.typeof"); pool.submit(42) },
+function(t) { t.ex = t.sw(PFX + "submit.arguments.1.typeof"); pool.submit(add, 3) },
+function(t) { t.ex = t.sw("gpsee.module.ca.page.thread.Future.constructor"); new thread.Future() },
+/* shutdown() runs work already queued, then refuses more */
+function(t) { var p = new thread.Pool(1), futures = [], i;
+              for (i = 0; i < 50; i++) futures.push(p.submit(add, [i, 0]));
+              p.shutdown();
+              for (i = 0; i < futures.length; i++) if (!futures[i].done || futures[i].wait() !== i) return false;
+              return true },
+function(t) { var p = new thread.Pool(1); p.shutdown(); p.shutdown(); t.ex = t.sw(PFX + "submit.shutdown"); p.submit(add, [1, 2]) },
+function(t) { pool.shutdown(); return t.eq(pool.size, 2) },
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+
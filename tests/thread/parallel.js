@@ -0,0 +1,197 @@
+#!/usr/bin/gsr -zzdd
+
+var verbose = 0, quiet = false;
+for each(var arg in arguments) switch (arg) {
+    case '-v':
+        verbose++;
+    case '-q':
+        quiet = true;
+}
+
+const thread = require("thread");
+const binary = require("binary");
+
+function values(ob) {
+    var values = [];
+    for(var key in ob)
+        if (ob.hasOwnProperty(key))
+            values.push(ob[key]);
+    return values;
+}
+
+/* Provide some scaffolding for individual tests */
+var testUtils = {
+    /* eq compares two or more values and expects that they will pass an equality test without type coercion (===) */
+    'eq': function()
+    {
+        if (arguments.length < 2) throw 'too few arguments to testUtils.eq()';
+        for(var i=1, l=arguments.length; i<l; i++)
+        {
+            if (('object' == typeof arguments[0]) && ('object' == typeof arguments[i]))
+            {
+                var vals0 = values(arguments[0]);
+                var valsi = values(arguments[i]);
+                if (vals0.length != valsi.length)
+                {
+                    print('OBJECT SIZE MISMATCH');
+                    print('V1', vals0);
+                    print('V2', valsi);
+                    return false;
+                }
+                for (var j=0, jl=vals0.length; j<jl; j++)
+                {
+                    /* TODO recursion instead of one level-deep bs */
+                    if (vals0[j] !== valsi[j])
+                    {
+                        print('OBJECT VALUE MISMATCH');
+                        print('V1', arguments[0]);
+                        print('V2', arguments[i]);
+                        return false;
+                    }
+                }
+            } else {
+                if (arguments[0] !== arguments[i])
+                {
+                    print('VALUE MISMATCH');
+                    print('V1', arguments[0]);
+                    print('V2', arguments[i]);
+                    return false;
+                }
+            }
+        }
+        return true;
+    },
+    'dbg': function(level, msg)
+    {
+        if (level <= verbose)
+            print(msg);
+    },
+    /* 'startswith' string function for gpsee exception handling */
+    'sw': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: '+ex.message);
+            if (ex.message.substr(0, criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+    /* 'endswith' string function for gpsee exception handling */
+    'ew': function(criteria) {
+        return function(ex) {
+            testUtils.dbg(1, 'testing exception: "'+ex.message+'"');
+            if (ex.message.substr(ex.message.length-criteria.length) == criteria) return true;
+            print('EXCEPTION MISMATCH');
+            print('V1', ex.message);
+            print('V2', criteria);
+            return false;
+        }
+    },
+};
+
+/* A little scaffolding for dispatching individual tests */
+function runtest(test)
+{
+    /* The test can set testUtils.ex to an expected exception, if you're into that sort of thing */
+    delete testUtils.ex;
+    testUtils.dbg(2, 'Running following test:');
+    testUtils.dbg(2, test);
+    var rval;
+    try {
+        rval = test(testUtils);
+        if ('undefined' == typeof testUtils.ex)
+            return rval;
+        throw 'no exception thrown!'
+    }
+    catch (ex)
+    {
+        /* Is an exception expected? */
+        if (testUtils.ex)
+        {
+            /* Is it to be tested against a function? */
+            if ('function' == typeof testUtils.ex)
+                return testUtils.ex(ex);
+            /* Otherwise just compare */
+            return testUtils.ex == ex;
+        }
+        /* This will all end in tears */
+        print('Exception thrown:', ex);
+        return false;
+    }
+}
+
+function range(n) { var a = []; for (var i = 0; i < n; i++) a.push(i); return a; }
+function seqSum(n) { return n * (n - 1) / 2; }
+function add(a, b) { return a + b; }
+
+var small = new thread.Pool(2);
+
+var tests = [
+/* parallelMap: results in input order, with the element index */
+function(t) { return t.eq(thread.parallelMap(range(1000), function(v) { return v * 2 }).join(), range(1000).map(function(v) { return v * 2 }).join()) },
+function(t) { return t.eq(thread.parallelMap(["a", "b", "c"], function(v, n) { return v + n }).join(), "a0,b1,c2") },
+function(t) { return t.eq(thread.parallelMap(range(10), function(v, n) { return n }, { chunk: 3, pool: small }).join(), range(10).join()) },
+function(t) { return t.eq(thread.parallelMap([], function(v) { return v }).length, 0) },
+function(t) { var b = new binary.ByteArray([1, 2, 3, 4, 5]); return t.eq(thread.parallelMap(b, function(v) { return v + 1 }, { chunk: 2 }).join(), "2,3,4,5,6") },
+function(t) { var b = new binary.ByteString([250, 251]); return t.eq(thread.parallelMap(b, function(v) { return v }).join(), "250,251") },
+function(t) { t.ex = function(e) { return t.eq(e instanceof TypeError, true) }; thread.parallelMap(range(3), "nope") },
+function(t) { t.ex = function(e) { return t.eq(e instanceof TypeError, true) }; thread.parallelMap({ length: 3 }, function(v) { return v }) },
+/* The first exception thrown by fn is rethrown once every chunk has stopped */
+function(t) { t.ex = function(e) { return t.eq(e, "bad 7") }; 
+              thread.parallelMap(range(100), function(v) { if (v == 7) throw "bad " + v; return v }, { chunk: 1, pool: small }) },
+function(t) { try { thread.parallelMap(range(100), function(v) { throw "bad" }, { pool: small }) } catch(e) {}
+              return t.eq(small.pending, 0) && t.eq(thread.parallelMap([1], function(v) { return v }, { pool: small })[0], 1) },
+/* Nested calls on the same pool run inline on the worker, rather than deadlocking it */
+function(t) { var r = thread.parallelMap(range(8), function(v) { return thread.parallelMap(range(v), function(w) { return w }, { pool: small }).length }, { chunk: 1, pool: small });
+              return t.eq(r.join(), range(8).join()) },
+function(t) { var r = thread.parallelMap(range(16), function(v) { return thread.parallelReduce(range(v + 1), add) }, { chunk: 1 });
+              return t.eq(r.join(), range(16).map(function(v) { return seqSum(v + 1) }).join()) },
+function(t) { var outer = new thread.Pool(1); 
+              var r = thread.parallelMap(range(4), function(v) { return small.onWorker }, { pool: outer });
+              outer.shutdown(); return t.eq(r.join(), "false,false,false,false") },
+/* parallelReduce */
+function(t) { return t.eq(thread.parallelReduce(range(10000), add), seqSum(10000)) },
+function(t) { return t.eq(thread.parallelReduce(range(10000), add, 5), seqSum(10000) + 5) },
+function(t) { return t.eq(thread.parallelReduce([7], add), 7) },
+function(t) { return t.eq(thread.parallelReduce([], add, "init"), "init") },
+function(t) { t.ex = function(e) { return t.eq(e instanceof TypeError, true) }; thread.parallelReduce([], add) },
+function(t) { return t.eq(thread.parallelReduce(new binary.ByteArray([1, 2, 3, 4]), add, 0, { chunk: 3 }), 10) },
+/* Partial results: each chunk is reduced with an index; partials are then combined in input
+ * order without one, starting from initial when given. Show where each join happened.
+ */
+function(t) { var join = function(a, b, n) { return a + (n === undefined ? "|" : "") + b };
+              return t.eq(thread.parallelReduce(["a", "b", "c", "d", "e", "f"], join, undefined, { chunk: 2, pool: small }), "ab|cd|ef") },
+function(t) { var join = function(a, b, n) { return a + (n === undefined ? "|" : "") + b };
+              return t.eq(thread.parallelReduce(["a", "b", "c", "d", "e"], join, "x", { chunk: 2, pool: small }), "x|ab|cd|e") },
+function(t) { return t.eq(thread.parallelReduce(["a", "b", "c", "d", "e", "f", "g"], add, "", { chunk: 1, pool: small }), "abcdefg") },
+function(t) { small.shutdown(); return true },
+
+];
+
+/* Run all the tests! */
+var passed = 0;
+var failed = 0;
+for each(var test in tests)
+{
+    if (runtest(test))
+    {
+        passed++;
+    } else {
+        failed++;
+        print("the test that failed this way:");
+        print(test);
+    }
+}
+
+/* Report test results */
+if (!quiet) {
+  print('passed '+passed+' tests');
+  print('failed '+failed+' tests');
+
+  if (!failed)
+      print('ALL TESTS PASSED');
+  else
+      print('FAIL');
+}
+